@@ -0,0 +1,178 @@
+/**
+ * @file block_cache.hpp
+ * @brief Shared cache of decoded RED blocks
+ *
+ * Readers attached to the same BlockCache decode each block once; later
+ * reads of the block skip both the data file and the RED decoder.
+ * DiskBlockCache is a second, persistent tier on local storage for
+ * sessions on slow (e.g. network) filesystems.
+ */
+
+#ifndef BRAINMAZE_MEFD_BLOCK_CACHE_HPP
+#define BRAINMAZE_MEFD_BLOCK_CACHE_HPP
+
+#include "types.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace brainmaze_mefd {
+
+/**
+ * @brief Identity of a stored block
+ *
+ * The fields come from the block's index entry, so a block rewritten in
+ * place (e.g. by compaction) does not match a stale entry.
+ */
+struct BlockKey {
+    std::string segment;   // Segment identity chosen by the reader (UUID, channel and number)
+    si8 file_offset = 0;   // Offset of the block in the data file
+    si8 start_time = 0;    // Block start time (uUTC)
+    ui4 block_bytes = 0;   // Stored block size
+};
+
+/**
+ * @brief Samples of one decoded block
+ */
+struct DecodedBlock {
+    std::vector<si4> samples;
+    ui1 flags = 0;         // RED block flags (discontinuity, level 1/2 encryption)
+};
+
+/**
+ * @brief Counters reported by BlockCache::get_statistics()
+ */
+struct BlockCacheStatistics {
+    si8 hits = 0;
+    si8 misses = 0;
+    si8 insertions = 0;
+    si8 evictions = 0;
+    si8 blocks = 0;          // Blocks held
+    si8 bytes = 0;           // Sample bytes held
+    si8 capacity_bytes = 0;
+};
+
+/**
+ * @brief Thread-safe LRU cache of decoded blocks with a byte limit
+ *
+ * Blocks are handed out as shared pointers, so an evicted block stays
+ * valid for readers still using it.
+ */
+class BlockCache {
+public:
+    /**
+     * @brief Create a cache holding up to capacity_bytes of samples
+     */
+    explicit BlockCache(si8 capacity_bytes);
+    ~BlockCache();
+
+    BlockCache(const BlockCache&) = delete;
+    BlockCache& operator=(const BlockCache&) = delete;
+
+    /**
+     * @brief Look up a block and mark it as recently used
+     * @return The block, or nullptr on a miss
+     */
+    std::shared_ptr<const DecodedBlock> find(const BlockKey& key);
+
+    /**
+     * @brief Add a block, evicting the least recently used blocks over the limit
+     *
+     * Blocks larger than the whole capacity are not cached.
+     */
+    void insert(const BlockKey& key, std::shared_ptr<const DecodedBlock> block);
+
+    /**
+     * @brief Change the byte limit, evicting blocks if it shrinks
+     */
+    void set_capacity(si8 capacity_bytes);
+
+    /**
+     * @brief Drop all blocks
+     */
+    void clear();
+
+    /**
+     * @brief Get hit, miss and eviction counters and the current size
+     */
+    BlockCacheStatistics get_statistics() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+/**
+ * @brief Persistent LRU cache of decoded blocks in a local directory
+ *
+ * Each block is one file in a subdirectory named after its key hash. The
+ * file holds a 64-byte header (key, sample count, flags, CRC of the
+ * samples), the segment identity, and the samples as native si4 starting
+ * at a 64-byte aligned offset, so the file can be mapped and used in
+ * place. Files are written to a temporary name and renamed; a file whose
+ * key or CRC does not match is treated as a miss and removed.
+ *
+ * Recency is tracked in memory and seeded from file modification times
+ * when the cache is opened, so eviction order survives restarts. Size
+ * accounting is per process: processes sharing a directory each enforce
+ * the limit on the blocks they know of. All methods are thread-safe.
+ */
+class DiskBlockCache {
+public:
+    /**
+     * @brief Open or create a cache directory holding up to capacity_bytes
+     *
+     * Existing block files are indexed and evicted down to the limit;
+     * leftover temporary files are removed.
+     *
+     * @throws std::runtime_error if the directory cannot be created
+     */
+    DiskBlockCache(const std::string& directory, si8 capacity_bytes);
+    ~DiskBlockCache();
+
+    DiskBlockCache(const DiskBlockCache&) = delete;
+    DiskBlockCache& operator=(const DiskBlockCache&) = delete;
+
+    /**
+     * @brief Read a block and mark it as recently used
+     * @return The block, or nullptr on a miss
+     */
+    std::shared_ptr<const DecodedBlock> find(const BlockKey& key);
+
+    /**
+     * @brief Store a block, evicting the least recently used files over the limit
+     *
+     * Write errors (e.g. a full disk) are ignored; the block is simply not cached.
+     */
+    void insert(const BlockKey& key, const DecodedBlock& block);
+
+    /**
+     * @brief Change the byte limit, evicting files if it shrinks
+     */
+    void set_capacity(si8 capacity_bytes);
+
+    /**
+     * @brief Remove all block files
+     */
+    void clear();
+
+    /**
+     * @brief Get hit, miss and eviction counters and the current size in file bytes
+     */
+    BlockCacheStatistics get_statistics() const;
+
+    /**
+     * @brief Get the cache directory
+     */
+    const std::string& get_directory() const { return m_directory; }
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+
+    std::string m_directory;
+};
+
+} // namespace brainmaze_mefd
+
+#endif // BRAINMAZE_MEFD_BLOCK_CACHE_HPP
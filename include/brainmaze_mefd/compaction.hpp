@@ -0,0 +1,71 @@
+/**
+ * @file compaction.hpp
+ * @brief Merging of small RED blocks in closed segments
+ *
+ * Low-latency streaming writes short blocks; once a segment is closed its
+ * runs of small blocks can be merged into larger ones, which compress
+ * better and shrink the index.
+ */
+
+#ifndef BRAINMAZE_MEFD_COMPACTION_HPP
+#define BRAINMAZE_MEFD_COMPACTION_HPP
+
+#include "types.hpp"
+#include <string>
+
+namespace brainmaze_mefd {
+
+/**
+ * @brief Counters reported by segment compaction
+ */
+struct CompactionStatistics {
+    si8 segments = 0;         // Segments rewritten
+    si8 segments_failed = 0;  // Segments left unchanged after an error (background only)
+    si8 segments_skipped = 0; // Segments left unchanged without an atomic directory exchange
+    si8 blocks_before = 0;    // Blocks in the rewritten segments before compaction
+    si8 blocks_after = 0;     // Blocks in the rewritten segments after compaction
+    si8 bytes_before = 0;     // .tdat bytes before compaction
+    si8 bytes_after = 0;      // .tdat bytes after compaction
+    sf8 seconds = 0.0;        // Time spent compacting
+};
+
+/**
+ * @brief Merge runs of small blocks of a closed segment into larger blocks
+ *
+ * Consecutive blocks are merged until target_block_len samples would be
+ * exceeded. A block flagged as a discontinuity always starts a new block,
+ * blocks of target_block_len samples or more are kept, and encrypted
+ * blocks are copied unchanged. Merged blocks are re-encoded losslessly
+ * from the decoded samples.
+ *
+ * Blocks are read from the data file one at a time. The new .tdat, .tidx
+ * and .tmet are written and synced in a staging directory next to the
+ * segment, which is then exchanged with the segment directory in one
+ * atomic rename (renameat2 with RENAME_EXCHANGE). Where the platform or
+ * filesystem has no such exchange the segment is left unchanged and
+ * counted in segments_skipped, since replacing its files one by one would
+ * expose a new data file with an old index to readers. MefReader
+ * instances opened earlier detect that a data file no longer matches
+ * their index and reload the segment's index.
+ *
+ * The segment must not be open in a MefWriter.
+ *
+ * @param segment_path Path of the .segd directory
+ * @param target_block_len Maximum number of samples in a merged block
+ * @return Compaction statistics (segments == 0 if nothing was merged)
+ * @throws std::runtime_error if the segment cannot be read, decoded or
+ *         replaced
+ */
+CompactionStatistics compact_segment(const std::string& segment_path, si4 target_block_len);
+
+/**
+ * @brief Compact every segment of every time series channel of a session
+ * @param session_path Path of the .mefd directory
+ * @param target_block_len Maximum number of samples in a merged block
+ * @return Accumulated compaction statistics
+ */
+CompactionStatistics compact_session(const std::string& session_path, si4 target_block_len);
+
+} // namespace brainmaze_mefd
+
+#endif // BRAINMAZE_MEFD_COMPACTION_HPP
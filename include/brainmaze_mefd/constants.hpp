@@ -356,6 +356,7 @@ constexpr si4 RED_BLOCK_STATISTICS_BYTES = 256;
 constexpr ui1 RED_DISCONTINUITY_MASK = 0x01;
 constexpr ui1 RED_LEVEL_1_ENCRYPTION_MASK = 0x02;
 constexpr ui1 RED_LEVEL_2_ENCRYPTION_MASK = 0x04;
+constexpr ui1 RED_NAN_GAP_MASK = 0x08;  // NaN run dropped before the block (count in discretionary region)
 
 // RED Reserved Values
 constexpr si4 RED_NAN = static_cast<si4>(0x80000000);
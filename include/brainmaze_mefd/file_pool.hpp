@@ -0,0 +1,186 @@
+/**
+ * @file file_pool.hpp
+ * @brief Bounded pool of append-only output files
+ *
+ * Lets a writer keep thousands of files logically open while holding only a
+ * bounded number of operating system file descriptors.
+ */
+
+#ifndef BRAINMAZE_MEFD_FILE_POOL_HPP
+#define BRAINMAZE_MEFD_FILE_POOL_HPP
+
+#include "types.hpp"
+#include "storage.hpp"
+#include "io_engine.hpp"
+#include <memory>
+#include <string>
+
+namespace brainmaze_mefd {
+
+/**
+ * @brief Pool of append-only files with LRU descriptor reuse
+ *
+ * Each file tracks its own logical end offset. Appended bytes are collected
+ * in fixed-size write-combining buffers drawn from a shared budget and are
+ * written with positional writes (pwrite) in large sequential chunks. When
+ * more files are registered than descriptors are allowed, the least recently
+ * used descriptor is closed and the file is reopened for writing at its
+ * tracked offset the next time a buffer has to be written out.
+ *
+ * Buffers are aligned so files can optionally be written with O_DIRECT,
+ * bypassing the page cache; with O_DIRECT only whole alignment units are
+ * written until the file is flushed or closed, when the tail is written
+ * zero-padded and the padding is truncated away on close. Files can also be
+ * preallocated (fallocate) at creation to avoid fragmentation; they are
+ * truncated to their logical size on close.
+ *
+ * Files are opened through a Storage, the local file system by default;
+ * O_DIRECT and preallocation apply where the storage supports them.
+ *
+ * With an IoEngine set, full buffers are queued rather than written one at
+ * a time, and the queue is written as one batch when it reaches the
+ * engine's queue depth, when the buffer budget runs out, or when a file is
+ * flushed, synced or closed; flush_all() writes all files' buffers as one
+ * batch. Queued buffers keep their descriptors open, so up to a queue
+ * depth more descriptors than max_open_files may be open at once.
+ *
+ * All methods are thread-safe. Each file has its own lock, so appends,
+ * flushes and syncs of different files copy and write concurrently; only
+ * descriptor and buffer bookkeeping is shared. When every buffer of the
+ * budget is held by a file another thread is writing, a buffer is
+ * allocated past the budget rather than waiting, and freed when returned.
+ */
+class FilePool {
+public:
+    using FileId = si4;
+    static constexpr FileId INVALID_FILE_ID = -1;
+
+    static constexpr size_t DEFAULT_MAX_OPEN_FILES = 256;
+    static constexpr size_t DEFAULT_BUFFER_BYTES = 256 * 1024;
+    static constexpr size_t DEFAULT_BUFFER_BUDGET_BYTES = 64 * 1024 * 1024;
+    static constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+
+    /**
+     * @brief Pool limits
+     */
+    struct Options {
+        size_t max_open_files = DEFAULT_MAX_OPEN_FILES;     // Descriptor limit
+        size_t buffer_bytes = DEFAULT_BUFFER_BYTES;         // Size of one write-combining buffer
+        size_t buffer_budget_bytes = DEFAULT_BUFFER_BUDGET_BYTES;  // Total buffer memory
+        bool direct_io = false;  // Open files created from now on with O_DIRECT where supported
+    };
+
+    /**
+     * @brief I/O counters
+     */
+    struct Statistics {
+        size_t open_files = 0;      // Descriptors currently open
+        size_t files = 0;           // Files currently registered
+        si8 reopens = 0;            // Descriptors reopened after LRU eviction
+        si8 write_calls = 0;        // Positional writes issued
+        si8 bytes_written = 0;      // Bytes handed to the operating system
+        si8 preallocated_bytes = 0; // Bytes reserved with fallocate
+        size_t direct_io_files = 0; // Open files using O_DIRECT
+        si8 write_batches = 0;      // Batches of writes submitted through an IoEngine
+    };
+
+    FilePool();
+    explicit FilePool(const Options& options);
+    FilePool(const Options& options, std::shared_ptr<Storage> storage);
+    ~FilePool();
+
+    FilePool(const FilePool&) = delete;
+    FilePool& operator=(const FilePool&) = delete;
+
+    /**
+     * @brief Create (or truncate) a file and register it in the pool
+     * @param path File path
+     * @param expected_bytes Expected final size to preallocate (0 = none)
+     * @return Identifier used for subsequent calls
+     * @throws std::runtime_error if the file cannot be created
+     */
+    FileId create(const std::string& path, si8 expected_bytes = 0);
+
+    /**
+     * @brief Append bytes at the file's tracked end offset
+     * @param file File identifier
+     * @param data Bytes to append
+     * @param length Number of bytes
+     */
+    void append(FileId file, const void* data, size_t length);
+
+    /**
+     * @brief Logical file size, including bytes still buffered
+     */
+    si8 size(FileId file) const;
+
+    /**
+     * @brief Write out any buffered bytes of a file
+     */
+    void flush(FileId file);
+
+    /**
+     * @brief Write out buffered bytes of all files
+     */
+    void flush_all();
+
+    /**
+     * @brief Queue full buffers and write them in batches through an engine
+     *
+     * Pass nullptr to write buffers one at a time again; queued buffers
+     * are written first.
+     */
+    void set_io_engine(std::shared_ptr<IoEngine> engine);
+
+    /**
+     * @brief Get the engine set with set_io_engine(), if any
+     */
+    std::shared_ptr<IoEngine> get_io_engine() const;
+
+    /**
+     * @brief Write out buffered bytes and flush the file to stable storage
+     *        (fdatasync where available)
+     */
+    void sync(FileId file);
+
+    /**
+     * @brief Flush a file that is not part of the pool to stable storage
+     * @throws std::runtime_error if the file cannot be opened or synced
+     */
+    static void sync_path(const std::string& path);
+
+    /**
+     * @brief Flush a directory's entries so newly created files survive a
+     *        crash (no-op on Windows)
+     */
+    static void sync_directory(const std::string& path);
+
+    /**
+     * @brief Flush a file, truncate it to its logical size if it was
+     *        preallocated or padded, close its descriptor and unregister it
+     */
+    void close(FileId file);
+
+    /**
+     * @brief Change the descriptor limit; excess descriptors are closed
+     */
+    void set_max_open_files(size_t max_open_files);
+    size_t get_max_open_files() const;
+
+    /**
+     * @brief Replace all pool options; buffered data is written out first.
+     *        The buffer size is rounded up to whole alignment units.
+     */
+    void set_options(const Options& options);
+    Options get_options() const;
+
+    Statistics get_statistics() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+} // namespace brainmaze_mefd
+
+#endif // BRAINMAZE_MEFD_FILE_POOL_HPP
@@ -0,0 +1,149 @@
+/**
+ * @file io_engine.hpp
+ * @brief Asynchronous batched file I/O
+ *
+ * Issues many positional reads or writes at once so that fast storage sees
+ * a deep queue instead of one request at a time.
+ */
+
+#ifndef BRAINMAZE_MEFD_IO_ENGINE_HPP
+#define BRAINMAZE_MEFD_IO_ENGINE_HPP
+
+#include "types.hpp"
+#include "storage.hpp"
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace brainmaze_mefd {
+
+/**
+ * @brief Engine submitting batches of positional reads and writes
+ *
+ * On Linux, batches go through io_uring: requests are queued in a
+ * submission ring and their completions reaped while further requests are
+ * still in flight. Where io_uring is unavailable (older kernels, seccomp
+ * filters, other platforms) or a file has no operating system descriptor,
+ * a pool of threads issues the requests with pread/pwrite instead.
+ *
+ * read() hands each completed request to a callback on the calling thread
+ * while the rest of the batch is outstanding, so the caller can decode one
+ * block while the next ones are being read.
+ *
+ * An engine can be shared by any number of readers and writers; all
+ * methods are thread-safe.
+ */
+class IoEngine {
+public:
+    static constexpr size_t DEFAULT_QUEUE_DEPTH = 64;
+    static constexpr size_t DEFAULT_THREADS = 8;
+
+    /**
+     * @brief How requests are issued
+     */
+    enum class Backend {
+        AUTO,          // io_uring if available, otherwise THREAD_POOL; batches
+                       // whose ring cannot be set up also use THREAD_POOL
+        IO_URING,      // io_uring; throws at construction if unavailable
+        THREAD_POOL    // pread/pwrite from worker threads
+    };
+
+    /**
+     * @brief Engine settings
+     */
+    struct Options {
+        Backend backend = Backend::AUTO;
+        size_t queue_depth = DEFAULT_QUEUE_DEPTH;  // Requests in flight per batch
+        size_t threads = DEFAULT_THREADS;          // Workers of the thread pool
+    };
+
+    /**
+     * @brief One positional read or write
+     */
+    struct Request {
+        StorageFile* file = nullptr;
+        void* data = nullptr;   // Destination of a read, source of a write
+        size_t length = 0;
+        si8 offset = 0;
+        size_t result = 0;      // Bytes read; fewer than length only at the end of the file
+    };
+
+    /**
+     * @brief I/O counters
+     */
+    struct Statistics {
+        si8 batches = 0;            // Calls to read() and write()
+        si8 reads = 0;              // Read requests completed
+        si8 writes = 0;             // Write requests completed
+        si8 bytes_read = 0;
+        si8 bytes_written = 0;
+        si8 submissions = 0;        // io_uring_enter calls or thread pool hand-offs
+        sf8 mean_queue_depth = 0.0; // Requests in flight, averaged over submitted requests
+        si8 max_queue_depth = 0;
+        sf8 seconds = 0.0;          // Time spent in batches
+
+        /**
+         * @brief Bytes transferred per second spent in batches, in GB/s
+         */
+        sf8 gigabytes_per_second() const {
+            return seconds > 0.0 ? static_cast<sf8>(bytes_read + bytes_written) / seconds / 1e9 : 0.0;
+        }
+    };
+
+    IoEngine();
+    explicit IoEngine(const Options& options);
+    ~IoEngine();
+
+    IoEngine(const IoEngine&) = delete;
+    IoEngine& operator=(const IoEngine&) = delete;
+
+    /**
+     * @brief Backend in use, never AUTO
+     */
+    Backend get_backend() const;
+
+    /**
+     * @brief Whether io_uring can be used on this system
+     */
+    static bool io_uring_available();
+
+    const Options& get_options() const { return m_options; }
+
+    /**
+     * @brief Read a batch, calling on_complete(i) as each request i finishes
+     *
+     * on_complete runs on the calling thread. If it throws, no further
+     * callbacks run; outstanding requests are waited for and the exception
+     * is rethrown.
+     *
+     * @throws std::runtime_error if a read fails
+     */
+    void read(std::vector<Request>& requests,
+              const std::function<void(size_t)>& on_complete = nullptr);
+
+    /**
+     * @brief Write a batch and wait until every request has completed
+     * @throws std::runtime_error if a write fails or is short
+     */
+    void write(std::vector<Request>& requests);
+
+    /**
+     * @brief Get I/O counters
+     */
+    Statistics get_statistics() const;
+
+    /**
+     * @brief Reset I/O counters
+     */
+    void reset_statistics();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+
+    Options m_options;
+};
+
+} // namespace brainmaze_mefd
+
+#endif // BRAINMAZE_MEFD_IO_ENGINE_HPP
@@ -26,10 +26,19 @@
 #include "aes.hpp"
 #include "sha256.hpp"
 #include "red.hpp"
+#include "records.hpp"
+#include "storage.hpp"
+#include "io_engine.hpp"
+#include "file_pool.hpp"
+#include "block_cache.hpp"
 
 // High-level API
 #include "mef_reader.hpp"
 #include "mef_writer.hpp"
+#include "mef_dataset.hpp"
+#include "mef_server.hpp"
+#include "session_tools.hpp"
+#include "compaction.hpp"
 
 /**
  * @namespace brainmaze_mefd
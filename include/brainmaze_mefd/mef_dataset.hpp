@@ -0,0 +1,188 @@
+/**
+ * @file mef_dataset.hpp
+ * @brief Catalog of the MEF 3.0 sessions under a directory tree
+ *
+ * Long recordings are usually split into many .mefd sessions (one per day
+ * or per acquisition restart). MefDataset indexes every session below a
+ * root directory by channel and time range, persists that index so it can
+ * be reopened without opening the sessions again, and reads time ranges
+ * that cross session boundaries.
+ */
+
+#ifndef BRAINMAZE_MEFD_MEF_DATASET_HPP
+#define BRAINMAZE_MEFD_MEF_DATASET_HPP
+
+#include "types.hpp"
+#include "constants.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace brainmaze_mefd {
+
+/**
+ * @brief Options for MefDataset
+ */
+struct DatasetOptions {
+    std::string password;              // Password of the sessions
+    std::string catalog_path;          // Catalog file ("" = mefd_dataset.catalog in the root)
+    bool save_catalog = true;          // Rewrite the catalog when sessions were (re)indexed
+    size_t max_open_sessions = 16;     // Session readers kept open between queries
+    size_t threads = 0;                // Sessions read in parallel (0 = hardware threads)
+};
+
+/**
+ * @brief Counters reported by MefDataset::get_statistics()
+ */
+struct DatasetStatistics {
+    size_t sessions = 0;               // Sessions in the catalog
+    size_t sessions_indexed = 0;       // Sessions opened to (re)build their catalog entry
+    size_t sessions_from_catalog = 0;  // Sessions whose entry was reused from the catalog file
+    size_t readers_opened = 0;         // Session readers opened by queries
+    size_t reader_cache_hits = 0;      // Queries served by an already open reader
+};
+
+/**
+ * @brief Time-indexed catalog of all sessions under a directory
+ *
+ * Every .mefd directory below the root is a session. For each session the
+ * catalog stores the time range and sample count of each channel, keyed by
+ * a fingerprint of the modification times of the session, channel and
+ * segment directories and of the last segment index of each channel, so a
+ * reopen only opens sessions that were added or changed since the catalog
+ * was written.
+ *
+ * Queries open only the sessions overlapping the requested range. Open
+ * session readers are shared between queries in a bounded LRU cache, and
+ * the sessions of one query are read in parallel. All methods may be
+ * called concurrently except rescan().
+ */
+class MefDataset {
+public:
+    /**
+     * @brief Catalog entry of one session
+     */
+    struct SessionInfo {
+        std::string path;                      // Session directory
+        si8 start_time = UUTC_NO_ENTRY;        // Earliest channel start (uUTC)
+        si8 end_time = UUTC_NO_ENTRY;          // Latest channel end (uUTC)
+        std::vector<std::string> channels;     // Time series channels
+    };
+
+    /**
+     * @brief Time range of one channel within one session
+     */
+    struct ChannelSpan {
+        std::string session;                   // Session directory
+        sf8 sampling_frequency = 0.0;
+        si8 start_time = UUTC_NO_ENTRY;        // First sample (uUTC)
+        si8 end_time = UUTC_NO_ENTRY;          // Last sample (uUTC)
+        si8 number_of_samples = 0;
+    };
+
+    /**
+     * @brief Index the sessions under a directory
+     *
+     * Reads the catalog file if present, then calls rescan().
+     *
+     * @param root Directory searched recursively for .mefd sessions
+     * @param options Password, catalog and cache options
+     * @throws std::runtime_error if root is not a directory or the catalog
+     *         cannot be written
+     */
+    explicit MefDataset(const std::string& root, const DatasetOptions& options = DatasetOptions{});
+    ~MefDataset();
+
+    MefDataset(const MefDataset&) = delete;
+    MefDataset& operator=(const MefDataset&) = delete;
+    MefDataset(MefDataset&& other) noexcept;
+    MefDataset& operator=(MefDataset&& other) noexcept;
+
+    /**
+     * @brief Pick up sessions added, changed or removed since the last scan
+     *
+     * Only sessions whose fingerprint changed are opened. Open readers of
+     * changed sessions are dropped from the cache. The catalog file is
+     * rewritten if anything changed and DatasetOptions::save_catalog is set.
+     *
+     * @return Number of sessions (re)indexed
+     */
+    size_t rescan();
+
+    /**
+     * @brief Write the catalog file
+     * @throws std::runtime_error if the file cannot be written
+     */
+    void save_catalog() const;
+
+    /**
+     * @brief Get the root directory
+     */
+    const std::string& get_root() const { return m_root; }
+
+    /**
+     * @brief Get the catalog entries of all sessions, ordered by start time
+     */
+    std::vector<SessionInfo> get_sessions() const;
+
+    /**
+     * @brief Get the names of all channels in any session
+     */
+    std::vector<std::string> get_channels() const;
+
+    /**
+     * @brief Get the sessions holding a channel, ordered by start time
+     * @param channel_name Name of the channel
+     * @param start_time Only spans ending at or after this time (optional)
+     * @param end_time Only spans starting before this time (optional)
+     */
+    std::vector<ChannelSpan> get_channel_spans(const std::string& channel_name,
+                                               const si8* start_time = nullptr,
+                                               const si8* end_time = nullptr) const;
+
+    /**
+     * @brief Get the earliest start time over all sessions
+     */
+    si8 get_start_time() const;
+
+    /**
+     * @brief Get the latest end time over all sessions
+     */
+    si8 get_end_time() const;
+
+    /**
+     * @brief Read a channel over a time range spanning any number of sessions
+     *
+     * Samples follow the same conventions as MefReader::get_data(), with
+     * the time between sessions returned as NaN like any other recording
+     * gap. Where sessions overlap in time, the earlier session wins.
+     *
+     * @param channel_name Name of the channel
+     * @param start_time Start time in uUTC (optional, nullptr = beginning)
+     * @param end_time End time in uUTC (optional, nullptr = end)
+     * @return Vector of samples (float64)
+     * @throws std::runtime_error if the channel is unknown, a session cannot
+     *         be opened, or the sampling frequency differs between the
+     *         sessions in the range
+     */
+    std::vector<sf8> get_data(const std::string& channel_name,
+                              const si8* start_time = nullptr,
+                              const si8* end_time = nullptr) const;
+
+    /**
+     * @brief Get catalog and reader cache counters
+     */
+    DatasetStatistics get_statistics() const;
+
+private:
+    // Internal implementation
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+
+    std::string m_root;
+    DatasetOptions m_options;
+};
+
+} // namespace brainmaze_mefd
+
+#endif // BRAINMAZE_MEFD_MEF_DATASET_HPP
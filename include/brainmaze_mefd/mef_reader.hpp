@@ -11,10 +11,16 @@
 #include "types.hpp"
 #include "constants.hpp"
 #include "structures.hpp"
+#include "red.hpp"
+#include "records.hpp"
+#include "block_cache.hpp"
+#include "storage.hpp"
+#include "io_engine.hpp"
 #include <string>
 #include <vector>
 #include <map>
 #include <memory>
+#include <functional>
 #include <filesystem>
 
 namespace brainmaze_mefd {
@@ -27,6 +33,12 @@ namespace brainmaze_mefd {
  */
 class MefReader {
 public:
+    /**
+     * @brief Dense integer handle to a channel, see get_channel_handle()
+     */
+    using ChannelHandle = si4;
+    static constexpr ChannelHandle INVALID_CHANNEL_HANDLE = -1;
+
     /**
      * @brief Channel information structure
      */
@@ -55,12 +67,43 @@ public:
         si8 number_of_blocks = 0;
     };
 
+    /**
+     * @brief What a refresh() picked up
+     */
+    struct RefreshResult {
+        si4 new_channels = 0;
+        si4 new_segments = 0;
+        si4 rewritten_segments = 0;   // Segments whose index was replaced, e.g. by compaction
+        si8 new_blocks = 0;
+        si8 new_samples = 0;
+        si8 bytes_read = 0;           // Index bytes read for segments already loaded
+        sf8 latency_seconds = 0.0;    // From the newest index write seen until it was readable
+        sf8 seconds = 0.0;            // Time spent in refresh()
+
+        bool changed() const {
+            return new_channels > 0 || new_segments > 0 || rewritten_segments > 0 || new_blocks > 0;
+        }
+    };
+
+    /**
+     * @brief Accumulated refresh counters and write-to-read latency
+     */
+    struct RefreshStatistics {
+        si8 refreshes = 0;
+        si8 updates = 0;                   // Refreshes that found new data
+        si8 new_blocks = 0;
+        sf8 mean_latency_seconds = 0.0;    // Over updates
+        sf8 max_latency_seconds = 0.0;
+    };
+
     /**
      * @brief Constructor - open a MEF session
      * @param path Path to .mefd session directory
      * @param password Optional password for encrypted files
+     * @param storage Storage holding the session (nullptr = local file system)
      */
-    explicit MefReader(const std::string& path, const std::string& password = "");
+    explicit MefReader(const std::string& path, const std::string& password = "",
+                       std::shared_ptr<Storage> storage = nullptr);
     
     /**
      * @brief Destructor
@@ -87,6 +130,11 @@ public:
      */
     const std::string& get_path() const { return m_path; }
 
+    /**
+     * @brief Get the storage holding the session
+     */
+    std::shared_ptr<Storage> get_storage() const;
+
     /**
      * @brief Get session name
      * @return Session name
@@ -105,6 +153,18 @@ public:
      */
     std::vector<std::string> get_time_series_channels() const;
 
+    /**
+     * @brief Look up a channel handle by name
+     * 
+     * Handle-based methods index channel records directly, with segment
+     * paths and block tables precomputed, so repeated reads avoid string work.
+     * 
+     * @param channel_name Name of the channel
+     * @return Channel handle
+     * @throws std::runtime_error if channel not found
+     */
+    ChannelHandle get_channel_handle(const std::string& channel_name) const;
+
     /**
      * @brief Get channel information
      * @param channel_name Name of the channel
@@ -113,6 +173,15 @@ public:
      */
     ChannelInfo get_channel_info(const std::string& channel_name) const;
 
+    /**
+     * @brief Get channel information by handle
+     * 
+     * @param channel Channel handle
+     * @return Copy of the ChannelInfo, consistent with concurrent refresh()
+     * @throws std::runtime_error if the handle is invalid
+     */
+    ChannelInfo get_channel_info(ChannelHandle channel) const;
+
     /**
      * @brief Get segment information for a channel
      * @param channel_name Name of the channel
@@ -134,6 +203,15 @@ public:
 
     /**
      * @brief Read data from a channel
+     *
+     * Returns the samples whose time is in [start_time, end_time). NaN runs
+     * the writer dropped (see MefWriter::set_max_nans_written()) are
+     * returned as NaN where they fall within the window; other gaps in the
+     * recording are not filled. Times
+     * are located with a binary search over block start times, so gaps
+     * between blocks are respected and, for sessions written with aligned
+     * blocks, a window on block boundaries decodes exactly its own blocks.
+     * 
      * @param channel_name Name of the channel
      * @param start_time Start time in uUTC (optional, nullptr = beginning)
      * @param end_time End time in uUTC (optional, nullptr = end)
@@ -154,23 +232,229 @@ public:
                                   si8 start_sample,
                                   si8 end_sample) const;
 
+    /**
+     * @brief Read data from a channel by handle
+     * @param channel Channel handle
+     * @param start_time Start time in uUTC (optional, nullptr = beginning)
+     * @param end_time End time in uUTC (optional, nullptr = end)
+     * @return Vector of samples (float64)
+     */
+    std::vector<sf8> get_data(ChannelHandle channel,
+                              const si8* start_time = nullptr,
+                              const si8* end_time = nullptr) const;
+
+    /**
+     * @brief Read raw samples from a channel by handle
+     * @param channel Channel handle
+     * @param start_sample Start sample index
+     * @param end_sample End sample index (exclusive)
+     * @return Vector of raw samples (si4)
+     */
+    std::vector<si4> get_raw_data(ChannelHandle channel,
+                                  si8 start_sample,
+                                  si8 end_sample) const;
+
+    /**
+     * @brief Read data from several channels over the same time range
+     *
+     * Equivalent to get_data() per channel, but the blocks of all channels
+     * missing from the caches are read as one batch, so an I/O engine (see
+     * set_io_engine()) keeps them all in flight at once.
+     *
+     * @param channel_names Names of the channels
+     * @param start_time Start time in uUTC (optional, nullptr = beginning)
+     * @param end_time End time in uUTC (optional, nullptr = end)
+     * @return Samples of each channel, in the order of channel_names
+     */
+    std::vector<std::vector<sf8>> get_data(const std::vector<std::string>& channel_names,
+                                           const si8* start_time = nullptr,
+                                           const si8* end_time = nullptr) const;
+
+    /**
+     * @brief Read the stored RED blocks covering a time range
+     *
+     * Returns every block that holds a sample in [start_time, end_time),
+     * undecoded, with its index entry as stored in the segment's .tidx
+     * (file offset and start sample are relative to the source segment).
+     * Blocks can be appended to another session with
+     * MefWriter::write_compressed_blocks() without recompression.
+     *
+     * @param channel Channel handle
+     * @param start_time Start time in uUTC (optional, nullptr = beginning)
+     * @param end_time End time in uUTC (optional, nullptr = end)
+     * @return Blocks in time order
+     * @throws std::runtime_error if a data file cannot be read
+     */
+    std::vector<CompressedBlock> read_compressed_blocks(ChannelHandle channel,
+                                                        const si8* start_time = nullptr,
+                                                        const si8* end_time = nullptr) const;
+
+    /**
+     * @brief Read the stored RED blocks covering a time range
+     * @see read_compressed_blocks(ChannelHandle, const si8*, const si8*)
+     */
+    std::vector<CompressedBlock> read_compressed_blocks(const std::string& channel_name,
+                                                        const si8* start_time = nullptr,
+                                                        const si8* end_time = nullptr) const;
+
+    /**
+     * @brief Decode a block returned by read_compressed_blocks()
+     * @param block Block to decode (decrypted with the session password)
+     * @return Raw samples of the block
+     * @throws std::runtime_error if the block cannot be decoded
+     */
+    std::vector<si4> decode_block(const CompressedBlock& block) const;
+
+    /**
+     * @brief Get session records overlapping a time range
+     *
+     * Record indices are read from the session's .ridx on first use and
+     * again whenever a writer has grown the file; record bodies are not
+     * decoded (see read_record()). A record overlaps
+     * [start_time, end_time) if it starts before end_time and its end time
+     * is at or after start_time; queries take O(log n + k) time for n
+     * records of which k overlap.
+     *
+     * @param start_time Start time in uUTC (optional, nullptr = beginning)
+     * @param end_time End time in uUTC (optional, nullptr = end)
+     * @return Records sorted by time
+     * @throws std::runtime_error if a record file cannot be read
+     */
+    std::vector<RecordInfo> get_records(const si8* start_time = nullptr,
+                                        const si8* end_time = nullptr) const;
+
+    /**
+     * @brief Get the records of a channel and its segments overlapping a
+     *        time range
+     * @see get_records(const si8*, const si8*)
+     */
+    std::vector<RecordInfo> get_records(const std::string& channel_name,
+                                        const si8* start_time = nullptr,
+                                        const si8* end_time = nullptr) const;
+
+    /**
+     * @brief Read and decrypt the body of a record returned by get_records()
+     *
+     * Encrypted bodies are decrypted with keys derived from the session
+     * password; without sufficient access the record is returned with
+     * accessible == false and an empty body.
+     *
+     * @param info Record to read
+     * @return Record with its body
+     * @throws std::runtime_error if the record cannot be read or its CRC
+     *         does not match
+     */
+    Record read_record(const RecordInfo& info) const;
+
+    /**
+     * @brief Pick up data a writer appended since the session was loaded
+     *
+     * Loads new channels and segments and, for the last segment of each
+     * channel, reads only the index entries appended to its .tidx since
+     * the previous refresh. Disk reads happen without blocking readers;
+     * the new entries are then installed under the reader's exclusive lock,
+     * so every read sees either the old or the new view of a channel. Only
+     * blocks whose index entry the writer has published are visible (see
+     * MefWriter::flush()); records are picked up by get_records() itself.
+     *
+     * @return What changed, with the write-to-read latency of new entries
+     */
+    RefreshResult refresh();
+
+    /**
+     * @brief Refresh in a background thread whenever the session changes
+     *
+     * Uses inotify on the session, channel and segment directories where
+     * available (local storage on Linux) and calls refresh() after each burst of changes, or every
+     * poll_seconds if no change notification arrives. The callback runs on
+     * the watch thread after refreshes that changed something. The reader
+     * must not be moved while watching.
+     *
+     * @param callback Called with the result of each refresh that changed something
+     * @param poll_seconds Fallback refresh interval
+     * @throws std::runtime_error if a watch is already running
+     */
+    void watch(std::function<void(const RefreshResult&)> callback = nullptr,
+               sf8 poll_seconds = 1.0);
+
+    /**
+     * @brief Stop the watch thread started by watch(), if any
+     */
+    void stop_watch();
+
+    /**
+     * @brief Check whether a watch thread is running
+     */
+    bool is_watching() const;
+
+    /**
+     * @brief Get accumulated refresh counters
+     */
+    RefreshStatistics get_refresh_statistics() const;
+
+    /**
+     * @brief Cache decoded blocks in a cache that may be shared with other readers
+     *
+     * Blocks found in the cache are neither read nor decoded again. Pass
+     * nullptr to stop caching.
+     */
+    void set_block_cache(std::shared_ptr<BlockCache> cache);
+
+    /**
+     * @brief Get the block cache set with set_block_cache(), if any
+     */
+    std::shared_ptr<BlockCache> get_block_cache() const;
+
+    /**
+     * @brief Keep decoded blocks in a persistent cache on local storage
+     *
+     * Meant for sessions on slow or network filesystems. Blocks missing
+     * from the block cache are looked up on disk before the data file is
+     * read; hits are promoted to the block cache. Blocks are keyed by
+     * segment UUID, channel and segment number, so copies of a session
+     * share entries. Samples of encrypted sessions are stored decrypted.
+     * Pass nullptr to stop using the disk cache.
+     */
+    void set_disk_block_cache(std::shared_ptr<DiskBlockCache> cache);
+
+    /**
+     * @brief Get the disk cache set with set_disk_block_cache(), if any
+     */
+    std::shared_ptr<DiskBlockCache> get_disk_block_cache() const;
+
+    /**
+     * @brief Read blocks through an asynchronous I/O engine
+     *
+     * All blocks of a read that miss the caches are submitted at once and
+     * each is decoded as soon as its bytes arrive, while the others are
+     * still in flight. Without an engine, blocks are decoded from a
+     * read-only mapping of the data file. Pass nullptr to stop using the
+     * engine.
+     */
+    void set_io_engine(std::shared_ptr<IoEngine> engine);
+
+    /**
+     * @brief Get the engine set with set_io_engine(), if any
+     */
+    std::shared_ptr<IoEngine> get_io_engine() const;
+
     /**
      * @brief Get session start time
      * @return Start time in uUTC
      */
-    si8 get_start_time() const { return m_start_time; }
+    si8 get_start_time() const;
 
     /**
      * @brief Get session end time
      * @return End time in uUTC
      */
-    si8 get_end_time() const { return m_end_time; }
+    si8 get_end_time() const;
 
     /**
      * @brief Get recording duration in microseconds
      * @return Duration in microseconds
      */
-    si8 get_duration() const { return m_end_time - m_start_time; }
+    si8 get_duration() const;
 
 private:
     // Internal implementation
@@ -185,18 +469,45 @@ private:
     si8 m_start_time = UUTC_NO_ENTRY;
     si8 m_end_time = UUTC_NO_ENTRY;
 
-    // Channel data
-    std::map<std::string, ChannelInfo> m_channels;
+    // Channel and segment records (defined in mef_reader.cpp)
+    struct SegmentRecord;
+    struct ChannelRecord;
+    struct SampleSpan;
+    struct StaleSegment;
+    struct RecordFile;
+    struct BlockFetch;
 
     // Internal methods
     bool load_session();
     bool load_channel(const std::filesystem::path& channel_path);
-    bool load_segment(const std::filesystem::path& segment_path, 
-                      const std::string& channel_name);
+    ChannelRecord read_channel(const std::filesystem::path& channel_path) const;
+    bool load_segment(const std::filesystem::path& segment_path, ChannelRecord& channel) const;
+    static void summarize_channel(ChannelRecord& channel);
+    void update_session_times();
+    void watch_loop(std::function<void(const RefreshResult&)> callback, sf8 poll_seconds);
+    const ChannelRecord& channel_record(ChannelHandle channel) const;
+    si8 sample_at_time(const ChannelRecord& record, si8 time) const;
+    void add_trailing_nan_gap(const ChannelRecord& record, si8 end_sample,
+                              std::vector<SampleSpan>& spans) const;
     std::vector<TimeSeriesIndex> read_indices(const std::filesystem::path& indices_path) const;
-    std::vector<si4> decompress_blocks(const std::filesystem::path& data_path,
-                                       const std::vector<TimeSeriesIndex>& indices,
-                                       si8 start_idx, si8 end_idx) const;
+    template <typename Read>
+    auto read_consistent(Read read) const -> decltype(read());
+    void reload_segment(SegmentRecord& segment) const;
+    const RecordFile& loaded_records(RecordFile& file) const;
+    RecordFile& record_file(const std::string& channel_name, si4 segment) const;
+    std::vector<si4> read_samples(const ChannelRecord& record, si8 start_sample, si8 end_sample,
+                                  std::vector<SampleSpan>* spans) const;
+    std::vector<sf8> physical_samples(const ChannelInfo& info, const std::vector<si4>& raw,
+                                      const std::vector<SampleSpan>& spans,
+                                      const si8* start_time, const si8* end_time) const;
+    std::vector<CompressedBlock> read_blocks(const ChannelRecord& record, const si8* start_time,
+                                             const si8* end_time) const;
+    void plan_blocks(const ChannelRecord& record, si8 start_sample, si8 end_sample,
+                     std::vector<BlockFetch>& blocks) const;
+    void fetch_blocks(std::vector<BlockFetch>& blocks) const;
+    void assemble_samples(const std::vector<BlockFetch>& blocks, size_t begin, size_t end,
+                          std::vector<si4>& output, std::vector<SampleSpan>* spans,
+                          sf8 sampling_frequency) const;
 };
 
 } // namespace brainmaze_mefd
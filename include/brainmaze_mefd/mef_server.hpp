@@ -0,0 +1,281 @@
+/**
+ * @file mef_server.hpp
+ * @brief Local read server sharing decoded blocks between processes
+ *
+ * MefServer owns session readers and one BlockCache and answers read
+ * requests over a Unix domain socket; mefd_serve runs it as a daemon.
+ * MefClient mirrors the MefReader read API in the client process. Samples
+ * are returned in a shared memory file passed with the response, so they
+ * never travel through the socket and can be used in place through
+ * SharedSamples.
+ *
+ * The transfer is zero-copy on the client side only. The server decodes
+ * the requested samples (from its block cache) into memory of its own and
+ * copies them into a new shared memory file for every request, so each
+ * request still costs one copy of its samples plus the creation and
+ * mapping of that file.
+ *
+ * Available on POSIX systems; elsewhere the constructors throw.
+ */
+
+#ifndef BRAINMAZE_MEFD_MEF_SERVER_HPP
+#define BRAINMAZE_MEFD_MEF_SERVER_HPP
+
+#include "types.hpp"
+#include "constants.hpp"
+#include "block_cache.hpp"
+#include "mef_reader.hpp"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace brainmaze_mefd {
+
+/**
+ * @brief Options for MefServer
+ */
+struct ServerOptions {
+    si8 cache_bytes = 1LL << 30;   // Decoded block cache shared by all sessions
+    size_t max_sessions = 64;      // Session readers kept open
+};
+
+/**
+ * @brief Counters reported by MefServer::get_statistics()
+ */
+struct ServerStatistics {
+    si8 connections = 0;           // Clients accepted
+    si8 requests = 0;              // Requests answered, including errors
+    si8 errors = 0;                // Requests answered with an error
+    si8 sessions_opened = 0;       // Session readers opened
+    si8 samples_served = 0;
+    si8 bytes_served = 0;          // Bytes passed in shared memory
+    BlockCacheStatistics cache;
+};
+
+/**
+ * @brief Read server for the sessions of one machine
+ *
+ * Each client connection is bound to one session. Readers are shared by
+ * all clients of the same session and password, and all readers share the
+ * decoded block cache; reopening an already open session refreshes it, so
+ * clients of a session that is still being written see its new blocks.
+ */
+class MefServer {
+public:
+    /**
+     * @brief Create a server listening on socket_path once started
+     * @throws std::runtime_error on platforms without Unix domain sockets
+     */
+    explicit MefServer(const std::string& socket_path, const ServerOptions& options = ServerOptions{});
+
+    /**
+     * @brief Stops the server
+     */
+    ~MefServer();
+
+    MefServer(const MefServer&) = delete;
+    MefServer& operator=(const MefServer&) = delete;
+
+    /**
+     * @brief Bind the socket and serve clients from background threads
+     *
+     * An existing socket file at the path is replaced.
+     *
+     * @throws std::runtime_error if the socket cannot be bound or the
+     *         server is already running
+     */
+    void start();
+
+    /**
+     * @brief Close the socket, disconnect clients and join their threads
+     */
+    void stop();
+
+    /**
+     * @brief Check whether the server is accepting clients
+     */
+    bool is_running() const;
+
+    /**
+     * @brief Get the socket path
+     */
+    const std::string& get_socket_path() const { return m_socket_path; }
+
+    /**
+     * @brief Get request counters and block cache statistics
+     */
+    ServerStatistics get_statistics() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+
+    std::string m_socket_path;
+    ServerOptions m_options;
+
+    void accept_loop();
+    void serve_client(int fd);
+};
+
+/**
+ * @brief Samples in a shared memory mapping received from MefServer
+ *
+ * Read-only and valid for the lifetime of the object.
+ */
+template <typename T>
+class SharedSamples {
+public:
+    SharedSamples() = default;
+    SharedSamples(const T* data, size_t size, size_t mapped_bytes)
+        : m_data(data), m_size(size), m_mapped_bytes(mapped_bytes) {}
+    ~SharedSamples() { release(); }
+
+    SharedSamples(const SharedSamples&) = delete;
+    SharedSamples& operator=(const SharedSamples&) = delete;
+    SharedSamples(SharedSamples&& other) noexcept { *this = std::move(other); }
+    SharedSamples& operator=(SharedSamples&& other) noexcept {
+        if (this != &other) {
+            release();
+            m_data = other.m_data;
+            m_size = other.m_size;
+            m_mapped_bytes = other.m_mapped_bytes;
+            other.m_data = nullptr;
+            other.m_size = 0;
+            other.m_mapped_bytes = 0;
+        }
+        return *this;
+    }
+
+    const T* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    const T* begin() const { return m_data; }
+    const T* end() const { return m_data + m_size; }
+    const T& operator[](size_t i) const { return m_data[i]; }
+
+private:
+    const T* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_mapped_bytes = 0;
+
+    void release();
+};
+
+/**
+ * @brief Client of a MefServer, bound to one session
+ *
+ * Provides the read API of MefReader for a session opened by the server.
+ * Channel information is fetched when the client connects. Methods may be
+ * called from several threads; requests on one client are serialized.
+ */
+class MefClient {
+public:
+    /**
+     * @brief Connect to a server and open a session
+     * @param socket_path Socket of a running MefServer
+     * @param session_path Path of the .mefd session, as seen by the server
+     * @param password Password of the session
+     * @throws std::runtime_error if the server cannot be reached
+     */
+    MefClient(const std::string& socket_path, const std::string& session_path,
+              const std::string& password = "");
+    ~MefClient();
+
+    MefClient(const MefClient&) = delete;
+    MefClient& operator=(const MefClient&) = delete;
+
+    /**
+     * @brief Check whether the server could open the session
+     */
+    bool is_valid() const { return m_valid; }
+
+    /**
+     * @brief Get session path
+     */
+    const std::string& get_path() const { return m_path; }
+
+    /**
+     * @brief Get list of channel names
+     */
+    std::vector<std::string> get_channels() const;
+
+    /**
+     * @brief Get list of time series channel names
+     */
+    std::vector<std::string> get_time_series_channels() const;
+
+    /**
+     * @brief Get channel information
+     * @throws std::runtime_error if channel not found
+     */
+    MefReader::ChannelInfo get_channel_info(const std::string& channel_name) const;
+
+    /**
+     * @brief Get session start time
+     */
+    si8 get_start_time() const { return m_start_time; }
+
+    /**
+     * @brief Get session end time
+     */
+    si8 get_end_time() const { return m_end_time; }
+
+    /**
+     * @brief Get recording duration in microseconds
+     */
+    si8 get_duration() const { return m_end_time - m_start_time; }
+
+    /**
+     * @brief Read data from a channel
+     * @see MefReader::get_data()
+     */
+    std::vector<sf8> get_data(const std::string& channel_name,
+                              const si8* start_time = nullptr,
+                              const si8* end_time = nullptr) const;
+
+    /**
+     * @brief Read raw samples from a channel
+     * @see MefReader::get_raw_data()
+     */
+    std::vector<si4> get_raw_data(const std::string& channel_name,
+                                  si8 start_sample,
+                                  si8 end_sample) const;
+
+    /**
+     * @brief Read data from a channel without copying it out of shared memory
+     */
+    SharedSamples<sf8> get_data_view(const std::string& channel_name,
+                                     const si8* start_time = nullptr,
+                                     const si8* end_time = nullptr) const;
+
+    /**
+     * @brief Read raw samples without copying them out of shared memory
+     */
+    SharedSamples<si4> get_raw_data_view(const std::string& channel_name,
+                                         si8 start_sample,
+                                         si8 end_sample) const;
+
+    /**
+     * @brief Get the server's counters
+     */
+    ServerStatistics get_server_statistics() const;
+
+private:
+    int m_fd = -1;
+    mutable std::mutex m_mutex;
+
+    bool m_valid = false;
+    std::string m_path;
+    si8 m_start_time = UUTC_NO_ENTRY;
+    si8 m_end_time = UUTC_NO_ENTRY;
+    std::vector<MefReader::ChannelInfo> m_channels;
+
+    std::vector<ui1> request(ui4 opcode, const std::vector<ui1>& payload, int* shared_fd) const;
+    template <typename T>
+    SharedSamples<T> receive_samples(ui4 opcode, const std::vector<ui1>& payload) const;
+};
+
+} // namespace brainmaze_mefd
+
+#endif // BRAINMAZE_MEFD_MEF_SERVER_HPP
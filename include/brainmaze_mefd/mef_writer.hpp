@@ -11,6 +11,11 @@
 #include "types.hpp"
 #include "constants.hpp"
 #include "structures.hpp"
+#include "red.hpp"
+#include "compaction.hpp"
+#include "records.hpp"
+#include "storage.hpp"
+#include "io_engine.hpp"
 #include <string>
 #include <vector>
 #include <map>
@@ -27,17 +32,156 @@ namespace brainmaze_mefd {
  */
 class MefWriter {
 public:
+    /**
+     * @brief Dense integer handle to a channel opened with open_channel()
+     */
+    using ChannelHandle = si4;
+    static constexpr ChannelHandle INVALID_CHANNEL_HANDLE = -1;
+
+    struct ChannelState;
+
+    /**
+     * @brief Writer bound to a single channel
+     * 
+     * Obtained from MefWriter::channel_writer(). Each ChannelWriter only
+     * touches its own channel's state, guarded by a per-channel lock, so
+     * different channels can be written concurrently from different threads
+     * without a writer-wide lock. Must not outlive the MefWriter it came from;
+     * close() waits for in-flight writes and rejects later ones.
+     */
+    class ChannelWriter {
+    public:
+        /**
+         * @brief Write data (float64)
+         * @param data Pointer to sample data
+         * @param num_samples Number of samples
+         * @param start_uutc Start time in microseconds since epoch
+         * @param precision Optional decimal precision for conversion
+         * @param new_segment If true, create a new segment
+         */
+        void write_data(const sf8* data, size_t num_samples, si8 start_uutc,
+                        si4 precision = -1, bool new_segment = false);
+
+        /**
+         * @brief Write raw integer data
+         * @param data Pointer to sample data (si4)
+         * @param num_samples Number of samples
+         * @param start_uutc Start time in microseconds since epoch
+         * @param new_segment If true, create a new segment
+         */
+        void write_raw_data(const si4* data, size_t num_samples, si8 start_uutc,
+                            bool new_segment = false);
+
+        /**
+         * @brief Write data (float64) with one timestamp per sample
+         * @see MefWriter::write_data(ChannelHandle, const sf8*, const si8*, size_t, si4)
+         */
+        void write_data(const sf8* data, const si8* timestamps, size_t num_samples,
+                        si4 precision = -1);
+
+        /**
+         * @brief Write raw integer data with one timestamp per sample
+         * @see MefWriter::write_raw_data(ChannelHandle, const si4*, const si8*, size_t)
+         */
+        void write_raw_data(const si4* data, const si8* timestamps, size_t num_samples);
+
+        /**
+         * @brief Append already compressed RED blocks
+         * @see MefWriter::write_compressed_blocks(ChannelHandle, const std::vector<CompressedBlock>&)
+         */
+        void write_compressed_blocks(const std::vector<CompressedBlock>& blocks);
+
+        /**
+         * @brief Compress pending samples, flush this channel's data file and
+         *        publish its index to readers
+         */
+        void flush();
+
+        /**
+         * @brief Finalize this channel's current segment and reject later
+         *        writes; other channels stay open
+         */
+        void close();
+
+        const std::string& get_channel_name() const;
+        ChannelHandle get_handle() const { return m_handle; }
+
+    private:
+        friend class MefWriter;
+        ChannelWriter(MefWriter* writer, ChannelState* state, ChannelHandle handle);
+
+        MefWriter* m_writer;
+        ChannelState* m_state;
+        ChannelHandle m_handle;
+    };
+
+    /**
+     * @brief Result of sample resolution (ADC LSB) detection
+     *
+     * Describes the quantization step found in floating point input that is
+     * really integer ADC counts multiplied by a constant step.
+     */
+    struct ResolutionEstimate {
+        bool found = false;
+        sf8 resolution = 0.0;
+        si8 samples_used = 0;
+        sf8 expected_compression_gain = 1.0;
+    };
+
+    /**
+     * @brief One block length evaluated by estimate_block_len()
+     */
+    struct BlockLengthCandidate {
+        si4 block_len = 0;
+        si8 compressed_bytes = 0;      // RED blocks of the training window
+        si8 index_bytes = 0;           // .tidx entries of those blocks
+        sf8 bytes_per_sample = 0.0;    // (compressed + index bytes) per sample
+        sf8 query_seconds = 0.0;       // Expected decode time of one query window
+        sf8 cost = 0.0;                // Weighted size and latency, relative to the best
+    };
+
+    /**
+     * @brief Result of block length tuning
+     */
+    struct BlockLengthEstimate {
+        bool found = false;
+        si4 block_len = 0;
+        si8 samples_used = 0;
+        std::vector<BlockLengthCandidate> candidates;
+    };
+
+    /**
+     * @brief When written data is forced to stable storage
+     */
+    enum class DurabilityMode {
+        NONE,               // Never sync; fastest, for bulk conversion
+        PERIODIC,           // Checkpoint each channel every sync interval
+        ON_SEGMENT_CLOSE    // Sync when a segment is finalized
+    };
+
+    /**
+     * @brief Time spent forcing data to stable storage
+     */
+    struct SyncStatistics {
+        si8 sync_calls = 0;         // fdatasync/fsync calls on files and directories
+        si8 checkpoints = 0;        // Periodic checkpoints taken
+        sf8 sync_seconds = 0.0;     // Total time spent in sync calls
+        sf8 max_sync_seconds = 0.0; // Longest single sync call
+    };
+
     /**
      * @brief Constructor - create or open a MEF session
      * @param path Path to .mefd session directory
      * @param overwrite If true, overwrite existing session. If false, append.
      * @param password1 Optional level 1 (write) password
      * @param password2 Optional level 2 (read) password
+     * @param storage Storage holding the session (nullptr = local file system)
      */
     MefWriter(const std::string& path, 
               bool overwrite = true,
               const std::string& password1 = "",
-              const std::string& password2 = "");
+              const std::string& password2 = "",
+              std::shared_ptr<Storage> storage = nullptr);
     
     /**
      * @brief Destructor - ensures all data is flushed
@@ -58,6 +202,17 @@ public:
      */
     bool is_valid() const { return m_valid; }
 
+    /**
+     * @brief Get the session path
+     * @return Path to the .mefd directory
+     */
+    const std::string& get_path() const { return m_path; }
+
+    /**
+     * @brief Get the storage holding the session
+     */
+    std::shared_ptr<Storage> get_storage() const;
+
     // ========================================================================
     // Properties (Python-style interface)
     // ========================================================================
@@ -70,6 +225,14 @@ public:
 
     /**
      * @brief Get/set maximum NaN samples to write
+     *
+     * Runs of NaN (RED_NAN) samples longer than this are not stored: the
+     * data around them is split into separate blocks, the block after the
+     * run starts at its own time and is flagged as a discontinuity, and it
+     * records the length of the run (RED_NAN_GAP_MASK) so the reader
+     * returns the run as NaN. A run at the very end of the recording has no
+     * following block and is not returned. Shorter runs are stored sample
+     * by sample. Negative (the default) stores every NaN sample.
      */
     si4 get_max_nans_written() const { return m_max_nans; }
     void set_max_nans_written(si4 value) { m_max_nans = value; }
@@ -86,6 +249,202 @@ public:
     sf8 get_units_conversion_factor() const { return m_units_conversion_factor; }
     void set_units_conversion_factor(sf8 value) { m_units_conversion_factor = value; }
 
+    /**
+     * @brief Get/set automatic resolution detection
+     *
+     * When enabled and write_data() is called with precision < 0, the first
+     * write to a channel looks for the quantization step of the data and uses
+     * it as the units conversion factor, so stored integers are the original
+     * ADC counts. Falls back to full-range scaling when no step is found.
+     */
+    bool get_auto_resolution() const { return m_auto_resolution; }
+    void set_auto_resolution(bool value) { m_auto_resolution = value; }
+
+    /**
+     * @brief Get/set automatic block length selection
+     *
+     * When enabled, the first write to a channel evaluates candidate block
+     * lengths on its samples with estimate_block_len() and the channel
+     * uses the cheapest one instead of mef_block_len. The first write
+     * should carry a representative stretch of data (several query
+     * windows); with too few samples the channel keeps mef_block_len.
+     */
+    bool get_auto_block_len() const { return m_auto_block_len; }
+    void set_auto_block_len(bool value) { m_auto_block_len = value; }
+
+    /**
+     * @brief Get/set the typical query window in seconds used to weigh
+     *        decode latency in automatic block length selection
+     */
+    sf8 get_block_query_seconds() const { return m_block_query_seconds; }
+    void set_block_query_seconds(sf8 value) { m_block_query_seconds = value; }
+
+    /**
+     * @brief Get/set the weight of decode latency against stored size in
+     *        automatic block length selection (0 = size only)
+     */
+    sf8 get_block_latency_weight() const { return m_block_latency_weight; }
+    void set_block_latency_weight(sf8 value) { m_block_latency_weight = value; }
+
+    /**
+     * @brief Get/set per-block relative precision (0 = lossless)
+     *
+     * When > 0, each block gets its own RED scale factor chosen so that the
+     * quantization error stays below this fraction of the block's peak
+     * absolute value. Quiet stretches keep full resolution while large
+     * excursions are stored coarser. The scale factor is recorded in each
+     * block header and applied by the reader.
+     *
+     * Without a detected ADC resolution or explicit precision, the units
+     * conversion factor is then chosen so that the first write's peak uses
+     * only a small part of the integer range, leaving headroom for much
+     * louder later writes instead of clamping them.
+     */
+    sf8 get_block_relative_precision() const { return m_block_relative_precision; }
+    void set_block_relative_precision(sf8 value) { m_block_relative_precision = value; }
+
+    /**
+     * @brief Get/set the timestamp jitter tolerance in microseconds
+     *
+     * Used by the timestamped writes: a step between consecutive sample
+     * timestamps that differs from the sample period by more than this is a
+     * gap. 0 (default) means half a sample period.
+     */
+    si8 get_timestamp_tolerance() const { return m_timestamp_tolerance; }
+    void set_timestamp_tolerance(si8 value) { m_timestamp_tolerance = value; }
+
+    /**
+     * @brief Get/set block alignment in microseconds (0 = off)
+     *
+     * When set, blocks of every channel are cut at multiples of this
+     * interval since the epoch (e.g. 1000000 for every whole second), so
+     * block boundaries line up across channels and with common query
+     * windows. Blocks still never exceed mef_block_len samples.
+     */
+    si8 get_block_alignment() const { return m_block_alignment; }
+    void set_block_alignment(si8 value) { m_block_alignment = value; }
+
+    /**
+     * @brief Get/set time-based segment rollover in seconds (0 = off)
+     *
+     * Writes start a new segment once this much time has passed since the
+     * first sample of the current segment. The boundary is sample-accurate:
+     * the block in progress is cut there.
+     */
+    sf8 get_segment_rollover_seconds() const { return m_segment_rollover_seconds; }
+    void set_segment_rollover_seconds(sf8 value) { m_segment_rollover_seconds = value; }
+
+    /**
+     * @brief Get/set size-based segment rollover in bytes (0 = off)
+     *
+     * A new segment is started at the next block boundary once the current
+     * segment's data file has reached this size.
+     */
+    si8 get_segment_rollover_bytes() const { return m_segment_rollover_bytes; }
+    void set_segment_rollover_bytes(si8 value) { m_segment_rollover_bytes = value; }
+
+    /**
+     * @brief Get/set alignment of time-based rollover to wall-clock time
+     *
+     * When enabled, segments end at multiples of the rollover duration since
+     * the epoch (e.g. on the UTC hour for 3600 s) rather than relative to
+     * their first sample.
+     */
+    bool get_segment_rollover_aligned() const { return m_segment_rollover_aligned; }
+    void set_segment_rollover_aligned(bool value) { m_segment_rollover_aligned = value; }
+
+    /**
+     * @brief Get/set the maximum number of simultaneously open data files
+     *
+     * Segment data files are kept in a pool: when more channels are being
+     * written than descriptors are allowed, the least recently written file
+     * is closed and reopened at its tracked offset when next needed.
+     */
+    size_t get_max_open_files() const;
+    void set_max_open_files(size_t value);
+
+    /**
+     * @brief Get/set the size of each data-file write buffer in bytes
+     *
+     * Compressed blocks are gathered into buffers of this size (rounded up
+     * to whole 4 KiB units) and written in one call once full.
+     */
+    size_t get_write_buffer_bytes() const;
+    void set_write_buffer_bytes(size_t value);
+
+    /**
+     * @brief Get/set O_DIRECT writing of segment data files
+     *
+     * Bypasses the page cache where the file system supports it; silently
+     * falls back to buffered writes elsewhere.
+     */
+    bool get_direct_io() const;
+    void set_direct_io(bool value);
+
+    /**
+     * @brief Get/set the engine writing full data-file buffers
+     *
+     * With an engine, full buffers of all channels are queued and written
+     * as batches of asynchronous writes instead of one pwrite at a time
+     * (see FilePool::set_io_engine()). nullptr writes them directly.
+     */
+    std::shared_ptr<IoEngine> get_io_engine() const;
+    void set_io_engine(std::shared_ptr<IoEngine> engine);
+
+    /**
+     * @brief Get/set expected segment duration used for preallocation
+     *
+     * When > 0, each new .tdat file is preallocated (fallocate) for this
+     * many seconds at the channel's sampling rate and the compressed size
+     * per sample of its previous segment, and truncated to its final size
+     * when the segment is finalized. 0 disables preallocation.
+     */
+    sf8 get_preallocation_seconds() const { return m_preallocation_seconds; }
+    void set_preallocation_seconds(sf8 value) { m_preallocation_seconds = value; }
+
+    /**
+     * @brief Get/set the durability mode
+     *
+     * With any mode other than NONE, directories are synced after segment
+     * files are created and finalized segments are synced in the order data,
+     * index, metadata, so after a crash the index and metadata never describe
+     * blocks that are not on disk. PERIODIC additionally checkpoints each
+     * channel every sync interval: pending samples are cut into a block, the
+     * data file is synced, new index entries are appended and synced before
+     * the index header is updated, and the metadata is rewritten last.
+     */
+    DurabilityMode get_durability_mode() const { return m_durability_mode; }
+    void set_durability_mode(DurabilityMode value) { m_durability_mode = value; }
+
+    /**
+     * @brief Get/set the checkpoint interval in seconds for PERIODIC mode
+     */
+    sf8 get_sync_interval() const { return m_sync_interval; }
+    void set_sync_interval(sf8 value) { m_sync_interval = value; }
+
+    /**
+     * @brief Get accumulated sync counts and times
+     */
+    SyncStatistics get_sync_statistics() const;
+
+    /**
+     * @brief Get/set the block length of background compaction
+     *
+     * When > 0, every finalized segment is handed to a background thread
+     * that merges its runs of shorter blocks into blocks of up to this many
+     * samples (see compact_segment()), so short blocks can be written for
+     * low latency and stored densely once the segment is closed. close()
+     * waits for pending compactions. 0 disables compaction. Compaction
+     * works on the local file system only and is skipped for other storage.
+     */
+    si4 get_compaction_block_len() const { return m_compaction_block_len; }
+    void set_compaction_block_len(si4 value) { m_compaction_block_len = value; }
+
+    /**
+     * @brief Get accumulated background compaction counters
+     */
+    CompactionStatistics get_compaction_statistics() const;
+
     /**
      * @brief Get/set recording time offset
      */
@@ -132,6 +491,27 @@ public:
     // Writing Methods
     // ========================================================================
 
+    /**
+     * @brief Open (or look up) a channel and return its handle
+     * 
+     * Handles index per-channel state directly, so writes through a handle
+     * avoid name lookups. Opening an existing channel returns its handle.
+     * 
+     * @param channel_name Name of the channel
+     * @param sampling_freq Sampling frequency in Hz
+     * @return Channel handle
+     * @throws std::runtime_error if the sampling frequency does not match
+     */
+    ChannelHandle open_channel(const std::string& channel_name, sf8 sampling_freq);
+
+    /**
+     * @brief Get a writer bound to one channel, for use from its own thread
+     * @param channel_name Name of the channel
+     * @param sampling_freq Sampling frequency in Hz
+     * @return ChannelWriter for the channel
+     */
+    ChannelWriter channel_writer(const std::string& channel_name, sf8 sampling_freq);
+
     /**
      * @brief Write data to a channel
      * @param data Sample data (float64)
@@ -180,14 +560,239 @@ public:
                         sf8 sampling_freq,
                         bool new_segment = false);
 
+    /**
+     * @brief Write data to an open channel
+     * @param channel Channel handle from open_channel()
+     * @param data Pointer to sample data (float64)
+     * @param num_samples Number of samples
+     * @param start_uutc Start time in microseconds since epoch
+     * @param precision Optional decimal precision for conversion
+     * @param new_segment If true, create a new segment
+     */
+    void write_data(ChannelHandle channel,
+                    const sf8* data,
+                    size_t num_samples,
+                    si8 start_uutc,
+                    si4 precision = -1,
+                    bool new_segment = false);
+
+    /**
+     * @brief Write raw integer data to an open channel
+     * 
+     * Samples are buffered per channel and compressed in blocks of
+     * mef_block_len; a trailing partial block stays pending until more
+     * contiguous data arrives, a gap occurs, or flush()/close() is called.
+     * 
+     * @param channel Channel handle from open_channel()
+     * @param data Pointer to sample data (si4)
+     * @param num_samples Number of samples
+     * @param start_uutc Start time in microseconds since epoch
+     * @param new_segment If true, create a new segment
+     */
+    void write_raw_data(ChannelHandle channel,
+                        const si4* data,
+                        size_t num_samples,
+                        si8 start_uutc,
+                        bool new_segment = false);
+
+    /**
+     * @brief Write data (float64) with one timestamp per sample
+     *
+     * Converted like write_data() and then written as by the timestamped
+     * write_raw_data() overload.
+     *
+     * @param channel Channel handle from open_channel()
+     * @param data Pointer to sample data (float64)
+     * @param timestamps Pointer to sample times in microseconds since epoch
+     * @param num_samples Number of samples (and timestamps)
+     * @param precision Optional decimal precision for conversion
+     */
+    void write_data(ChannelHandle channel,
+                    const sf8* data,
+                    const si8* timestamps,
+                    size_t num_samples,
+                    si4 precision = -1);
+
+    /**
+     * @brief Write raw integer data with one timestamp per sample
+     *
+     * Consecutive timestamps are scanned for steps that differ from the
+     * sample period by more than the timestamp tolerance. Data is split only
+     * at such steps: each run is written as contiguous data starting at its
+     * own first timestamp, and the block after a gap is flagged with
+     * RED_DISCONTINUITY_MASK. Block start times are taken from the sample
+     * timestamps, so they stay exact under jitter.
+     *
+     * @param channel Channel handle from open_channel()
+     * @param data Pointer to sample data (si4)
+     * @param timestamps Pointer to sample times in microseconds since epoch
+     * @param num_samples Number of samples (and timestamps)
+     */
+    void write_raw_data(ChannelHandle channel,
+                        const si4* data,
+                        const si8* timestamps,
+                        size_t num_samples);
+
+    /**
+     * @brief Set the units conversion factor of one channel
+     *
+     * Overrides the writer-wide factor in the channel's metadata; float
+     * writes without an explicit precision scale by it. Needed when raw or
+     * compressed samples are copied from a channel with its own factor.
+     *
+     * @param channel Channel handle from open_channel()
+     * @param value Units per stored integer step
+     */
+    void set_units_conversion_factor(ChannelHandle channel, sf8 value);
+
+    /**
+     * @brief Set the block length of one channel
+     *
+     * Overrides mef_block_len and automatic selection for this channel,
+     * e.g. with a length chosen by the mefd_block_len tool.
+     *
+     * @param channel Channel handle from open_channel()
+     * @param value Samples per block
+     */
+    void set_channel_block_len(ChannelHandle channel, si4 value);
+
+    /**
+     * @brief Append already compressed RED blocks to an open channel
+     *
+     * Blocks (for example from MefReader::read_compressed_blocks()) are
+     * appended verbatim after pending samples are flushed; only the index
+     * entry's file offset and start sample are rewritten. Segment rollover
+     * and gaps are handled at block starts as for sample data; a block that
+     * must start a discontinuity but is not flagged gets the flag set and
+     * its CRC recomputed. The channel's sampling frequency and units
+     * conversion factor must match the source of the blocks.
+     *
+     * @param channel Channel handle from open_channel()
+     * @param blocks Blocks in time order
+     * @throws std::runtime_error if a block fails CRC or size validation;
+     *         blocks before it have been written
+     */
+    void write_compressed_blocks(ChannelHandle channel,
+                                 const std::vector<CompressedBlock>& blocks);
+
+    /**
+     * @brief Append records to the session or to a channel
+     *
+     * Records are written to the session's (or channel's) .rdat file in
+     * arrival order and their index entries are merged into the .ridx file
+     * by time, so the index stays sorted when detections arrive late. Each
+     * call persists the whole batch: record data first, then the index
+     * entries, then the headers that count them; a batch in time order is
+     * appended in place, an earlier one rewrites the index through a
+     * temporary file. Records are therefore visible to readers while the
+     * recording is still running. Bodies are padded to 16 bytes and
+     * encrypted at record.info.encryption; the time, type, version and
+     * encryption level are taken from record.info.
+     *
+     * @param records Records to append, e.g. from encode_note()
+     * @param channel_name Channel opened with open_channel(), or "" for
+     *        session records
+     * @throws std::runtime_error if the writer is closed, the channel is not
+     *         open, or a record's encryption level has no password
+     */
+    void write_records(const std::vector<Record>& records,
+                       const std::string& channel_name = "");
+
+    /**
+     * @brief Append one record to the session or to a channel
+     * @see write_records()
+     */
+    void write_record(const Record& record, const std::string& channel_name = "");
+
+    /**
+     * @brief Detect the quantization step of floating point samples
+     *
+     * Uses the smallest non-zero difference within a training window, refined
+     * by small integer divisors, and accepts a step only if every training
+     * sample and difference is an integer multiple of it. The expected gain
+     * compares RED-encoded sizes under full-range scaling and under the step.
+     *
+     * @param data Sample data (float64)
+     * @param num_samples Number of samples
+     * @param block_len Block length used for the compression estimate
+     * @return ResolutionEstimate describing the detected step
+     */
+    static ResolutionEstimate estimate_resolution(const sf8* data, size_t num_samples,
+                                                  si4 block_len = 1000);
+
+    /**
+     * @brief Get the resolution estimate made for a channel
+     * @param channel_name Name of the channel
+     * @return ResolutionEstimate (found == false if none was made)
+     */
+    ResolutionEstimate get_resolution_estimate(const std::string& channel_name) const;
+
+    /**
+     * @brief Get the number of samples of a channel that were clamped
+     *
+     * The first float64 write to a channel fixes its units conversion
+     * factor; later samples whose value exceeds the integer range under
+     * that factor are stored as the nearest representable value and
+     * counted here.
+     *
+     * @param channel_name Name of the channel
+     * @return Number of clamped samples (0 if none)
+     */
+    si8 get_clipped_samples(const std::string& channel_name) const;
+
+    /**
+     * @brief Choose a block length trading stored size against random-access
+     *        decode latency
+     *
+     * Encodes a training window with each candidate block length and
+     * measures the compressed size, the index overhead (one entry per block)
+     * and the decode time per block. A query window at a random offset
+     * touches query_samples / block_len + 1 blocks on average, so its
+     * expected decode time grows with short blocks (per-block overhead) and
+     * with long blocks (samples outside the window). Each candidate's cost
+     * is its size relative to the smallest plus latency_weight times its
+     * latency relative to the fastest; the cheapest candidate wins.
+     *
+     * @param samples Sample data (si4)
+     * @param num_samples Number of samples
+     * @param sampling_frequency Sampling frequency in Hz
+     * @param query_seconds Typical query window in seconds
+     * @param latency_weight Weight of decode latency against size
+     * @param candidates Block lengths to evaluate (empty = 1/8 s to 8 s in
+     *        powers of two at the sampling frequency)
+     * @return BlockLengthEstimate (found == false if no candidate fits
+     *         twice into the training window)
+     */
+    static BlockLengthEstimate estimate_block_len(const si4* samples, size_t num_samples,
+                                                  sf8 sampling_frequency, sf8 query_seconds = 1.0,
+                                                  sf8 latency_weight = 1.0,
+                                                  const std::vector<si4>& candidates = {});
+
+    /**
+     * @brief Get the block length estimate made for a channel
+     * @param channel_name Name of the channel
+     * @return BlockLengthEstimate (found == false if none was made)
+     */
+    BlockLengthEstimate get_block_len_estimate(const std::string& channel_name) const;
+
     /**
      * @brief Flush and finalize all data
      * 
      * This is called automatically by the destructor, but can be called
-     * explicitly to ensure data is written to disk.
+     * explicitly to ensure data is written to disk. Flushed blocks are
+     * added to the segment index, so MefReader::refresh() picks them up;
+     * unlike sync(), nothing is forced to stable storage.
      */
     void flush();
 
+    /**
+     * @brief Checkpoint all channels to stable storage now
+     *
+     * Compresses pending samples and syncs data, index and metadata files
+     * in crash-consistent order, regardless of the durability mode.
+     */
+    void sync();
+
     /**
      * @brief Close the session
      * 
@@ -202,7 +807,6 @@ private:
 
     // Session state
     bool m_valid = false;
-    bool m_closed = false;
     std::string m_path;
     std::string m_session_name;
     bool m_overwrite = true;
@@ -211,9 +815,23 @@ private:
 
     // Configuration
     si4 m_block_len = 1000;
-    si4 m_max_nans = 0;
+    si4 m_max_nans = -1;  // Negative = NaN runs are never dropped
     std::string m_data_units = "V";
     sf8 m_units_conversion_factor = 1.0;
+    bool m_auto_resolution = false;
+    bool m_auto_block_len = false;
+    sf8 m_block_query_seconds = 1.0;
+    sf8 m_block_latency_weight = 1.0;
+    sf8 m_block_relative_precision = 0.0;
+    sf8 m_preallocation_seconds = 0.0;
+    si8 m_block_alignment = 0;
+    si8 m_timestamp_tolerance = 0;
+    sf8 m_segment_rollover_seconds = 0.0;
+    si8 m_segment_rollover_bytes = 0;
+    bool m_segment_rollover_aligned = false;
+    DurabilityMode m_durability_mode = DurabilityMode::NONE;
+    sf8 m_sync_interval = 10.0;
+    si4 m_compaction_block_len = 0;
     si8 m_recording_time_offset = 0;
     si4 m_gmt_offset = GMT_OFFSET_NO_ENTRY;
     std::string m_subject_name;
@@ -222,30 +840,44 @@ private:
     std::string m_channel_description;
     std::string m_session_description;
 
-    // Channel tracking
-    struct ChannelState {
-        std::filesystem::path path;
-        si4 current_segment = -1;
-        si8 last_sample_index = 0;
-        si8 last_end_time = UUTC_NO_ENTRY;
-        sf8 sampling_frequency = 0.0;
-        std::vector<TimeSeriesIndex> indices;
-        si8 total_samples = 0;
-        si4 total_blocks = 0;
-    };
-    std::map<std::string, ChannelState> m_channel_states;
-
     // Internal methods
+    static sf8 full_range_scale(const sf8* data, size_t num_samples);
     bool create_session();
-    void ensure_channel(const std::string& channel_name, sf8 sampling_freq);
-    void create_segment(const std::string& channel_name);
-    void write_block(const std::string& channel_name, 
+    ChannelState& channel_state(ChannelHandle channel) const;
+    si4 channel_block_len(const ChannelState& state) const;
+    void append_data(ChannelState& state, const sf8* data, size_t num_samples,
+                     si8 start_uutc, si4 precision, bool new_segment,
+                     const si8* timestamps = nullptr);
+    void append_raw_data(ChannelState& state, const si4* data, size_t num_samples,
+                         si8 start_uutc, bool new_segment,
+                         const si8* timestamps = nullptr);
+    void append_run(ChannelState& state, const si4* data, size_t num_samples,
+                    si8 start_uutc, bool new_segment, const si8* timestamps);
+    void append_timestamped_data(ChannelState& state, const si4* data,
+                                 const si8* timestamps, size_t num_samples);
+    void append_compressed_blocks(ChannelState& state, const CompressedBlock* blocks,
+                                  size_t num_blocks);
+    void create_segment(ChannelState& state);
+    static size_t find_timestamp_break(const si8* timestamps, size_t num_samples,
+                                       si8 min_step, si8 max_step);
+    static size_t samples_before(si8 boundary, si8 start_uutc, size_t consumed,
+                                 sf8 sample_period);
+    void roll_over_if_due(ChannelState& state, si8 sample_time);
+    void flush_pending(ChannelState& state);
+    void write_block(ChannelState& state,
                      const si4* samples, ui4 num_samples, si8 start_time,
                      bool is_discontinuity);
-    void finalize_channel(const std::string& channel_name);
-    void finalize_segment(const std::string& channel_name, si4 segment_num);
-    void write_metadata(const std::string& channel_name, si4 segment_num);
-    void write_indices(const std::string& channel_name, si4 segment_num);
+    void append_block(ChannelState& state, const ui1* block_data, size_t block_bytes,
+                      TimeSeriesIndex index);
+    void finalize_segment(ChannelState& state);
+    void checkpoint(ChannelState& state);
+    void write_metadata(ChannelState& state, bool durable);
+    void write_indices(ChannelState& state, bool durable);
+    struct RecordFileState;
+    RecordFileState& record_file_state(const std::string& channel_name);
+    void write_record_index(RecordFileState& file, size_t first_changed, bool durable);
+    void sync_file(const std::string& path);
+    void sync_directory(const std::filesystem::path& path);
 };
 
 } // namespace brainmaze_mefd
@@ -0,0 +1,225 @@
+/**
+ * @file records.hpp
+ * @brief MEF 3.0 records (.rdat/.ridx annotations)
+ *
+ * Records hold annotations such as notes, seizure marks and stimulation
+ * events at the session, channel and segment levels. Each record is a
+ * RecordHeader followed by a type-specific body padded to 16 bytes; the
+ * body layouts follow the MEF 3 records specification (mefrec.h).
+ * The decode_* functions read record bodies and the encode_* functions
+ * build records for MefWriter::write_records().
+ */
+
+#ifndef BRAINMAZE_MEFD_RECORDS_HPP
+#define BRAINMAZE_MEFD_RECORDS_HPP
+
+#include "types.hpp"
+#include "constants.hpp"
+#include <string>
+#include <vector>
+
+namespace brainmaze_mefd {
+
+// Record type strings
+constexpr char RECORD_TYPE_NOTE[] = "Note";                  // Free text
+constexpr char RECORD_TYPE_SYSTEM_LOG[] = "SyLg";            // System log text
+constexpr char RECORD_TYPE_EDF_ANNOTATION[] = "EDFA";        // EDF+ annotation with duration
+constexpr char RECORD_TYPE_SEIZURE[] = "Seiz";               // Seizure with per-channel onsets
+constexpr char RECORD_TYPE_COGNITIVE_STIMULUS[] = "CSti";    // Cognitive stimulus and response
+constexpr char RECORD_TYPE_ELECTRICAL_STIMULUS[] = "ESti";   // Electrical stimulation parameters
+constexpr char RECORD_TYPE_EPOCH[] = "Epoc";                 // Epoch with end time
+
+// Body layouts (version 1.0)
+constexpr si4 RECORD_EDFA_BYTES = 8;
+constexpr si4 RECORD_SEIZ_BYTES = 1312;
+constexpr si4 RECORD_SEIZ_MARKER_NAME_BYTES = 128;
+constexpr si4 RECORD_SEIZ_ANNOTATION_BYTES = 1024;
+constexpr si4 RECORD_SEIZ_CHANNEL_BYTES = 272;
+constexpr si4 RECORD_CSTI_BYTES = 200;
+constexpr si4 RECORD_CSTI_STRING_BYTES = 64;
+constexpr si4 RECORD_ESTI_BYTES = 416;
+constexpr si4 RECORD_ESTI_STRING_BYTES = 128;
+
+constexpr si4 SEIZURE_ONSET_NO_ENTRY = -1;
+constexpr si4 SEIZURE_ONSET_UNKNOWN = 0;
+constexpr si4 SEIZURE_ONSET_FOCAL = 1;
+constexpr si4 SEIZURE_ONSET_GENERALIZED = 2;
+constexpr si4 SEIZURE_ONSET_PROPAGATED = 3;
+constexpr si4 SEIZURE_ONSET_MIXED = 4;
+
+constexpr si4 STIMULUS_AMPLITUDE_UNIT_UNKNOWN = 0;
+constexpr si4 STIMULUS_AMPLITUDE_UNIT_MA = 1;
+constexpr si4 STIMULUS_AMPLITUDE_UNIT_V = 2;
+constexpr si4 STIMULUS_MODE_UNKNOWN = 0;
+constexpr si4 STIMULUS_MODE_CURRENT = 1;
+constexpr si4 STIMULUS_MODE_VOLTAGE = 2;
+
+/**
+ * @brief One record as listed in a .ridx file, with its time extent
+ */
+struct RecordInfo {
+    std::string type;                 // Four-character record type, e.g. "Note"
+    ui1 version_major = 1;
+    ui1 version_minor = 0;
+    si1 encryption = NO_ENCRYPTION;   // Encryption level of the body
+    si8 time = UUTC_NO_ENTRY;         // Record time (uUTC)
+    si8 end_time = UUTC_NO_ENTRY;     // Last time covered; equals time for instantaneous records
+    std::string channel;              // Owning channel ("" for session records)
+    si4 segment = -1;                 // Owning segment number (-1 for session and channel records)
+    si8 file_offset = 0;              // Offset of the record header in the .rdat file
+};
+
+/**
+ * @brief A record with its decoded body
+ */
+struct Record {
+    RecordInfo info;
+    std::vector<ui1> body;    // Body bytes after the record header, decrypted
+    bool accessible = true;   // false if the body is encrypted above the access level
+};
+
+/**
+ * @brief Per-channel onset and offset of a seizure record
+ */
+struct SeizureChannel {
+    std::string name;
+    si8 onset = -1;    // uUTC (-1 = no entry)
+    si8 offset = -1;   // uUTC (-1 = no entry)
+};
+
+/**
+ * @brief Body of a "Seiz" record
+ */
+struct SeizureRecord {
+    si8 earliest_onset = UUTC_NO_ENTRY;
+    si8 latest_offset = UUTC_NO_ENTRY;
+    si8 duration = 0;                           // microseconds
+    si4 onset_code = SEIZURE_ONSET_NO_ENTRY;
+    std::string marker_name_1;
+    std::string marker_name_2;
+    std::string annotation;
+    std::vector<SeizureChannel> channels;
+};
+
+/**
+ * @brief Body of an "EDFA" record
+ */
+struct EdfAnnotationRecord {
+    si8 duration = 0;   // microseconds
+    std::string annotation;
+};
+
+/**
+ * @brief Body of a "CSti" record
+ */
+struct CognitiveStimulusRecord {
+    std::string task_type;
+    si8 stimulus_duration = 0;   // microseconds
+    std::string stimulus_type;
+    std::string patient_response;
+};
+
+/**
+ * @brief Body of an "ESti" record
+ */
+struct ElectricalStimulusRecord {
+    sf8 amplitude = 0.0;
+    sf8 frequency = 0.0;
+    si8 pulse_width = 0;                                     // microseconds
+    si4 amplitude_unit_code = STIMULUS_AMPLITUDE_UNIT_UNKNOWN;
+    si4 mode_code = STIMULUS_MODE_UNKNOWN;
+    std::string waveform;
+    std::string anode;
+    std::string cathode;
+};
+
+/**
+ * @brief Bytes at the start of a body that determine a record's end time
+ * @param type Record type string
+ * @return Number of body bytes needed by record_end_time() (0 for
+ *         instantaneous record types)
+ */
+size_t record_extent_bytes(const std::string& type);
+
+/**
+ * @brief Last time covered by a record
+ *
+ * EDFA, Seiz, CSti and Epoc records span an interval given by a duration
+ * or end time field; all other records are instantaneous.
+ *
+ * @param type Record type string
+ * @param time Record time (uUTC)
+ * @param body Start of the decrypted body
+ * @param size Bytes available at body (at least record_extent_bytes())
+ * @return End time (uUTC), or time if the record has no extent
+ */
+si8 record_end_time(const std::string& type, si8 time, const ui1* body, size_t size);
+
+/**
+ * @brief Decode the text of a "Note" or "SyLg" record
+ * @throws std::runtime_error if the record is of another type or not accessible
+ */
+std::string decode_note(const Record& record);
+
+/**
+ * @brief Decode an "EDFA" record
+ * @throws std::runtime_error if the record is of another type, too short
+ *         or not accessible
+ */
+EdfAnnotationRecord decode_edf_annotation(const Record& record);
+
+/**
+ * @brief Decode a "Seiz" record
+ * @throws std::runtime_error if the record is of another type, too short
+ *         or not accessible
+ */
+SeizureRecord decode_seizure(const Record& record);
+
+/**
+ * @brief Decode a "CSti" record
+ * @throws std::runtime_error if the record is of another type, too short
+ *         or not accessible
+ */
+CognitiveStimulusRecord decode_cognitive_stimulus(const Record& record);
+
+/**
+ * @brief Decode an "ESti" record
+ * @throws std::runtime_error if the record is of another type, too short
+ *         or not accessible
+ */
+ElectricalStimulusRecord decode_electrical_stimulus(const Record& record);
+
+/**
+ * @brief Build a "Note" or "SyLg" record
+ * @param time Record time (uUTC)
+ * @param text Note text
+ * @param type RECORD_TYPE_NOTE or RECORD_TYPE_SYSTEM_LOG
+ * @return Unencrypted record with a NUL-terminated, padded body
+ */
+Record encode_note(si8 time, const std::string& text, const char* type = RECORD_TYPE_NOTE);
+
+/**
+ * @brief Build an "EDFA" record
+ */
+Record encode_edf_annotation(si8 time, const EdfAnnotationRecord& annotation);
+
+/**
+ * @brief Build a "Seiz" record with one channel entry per seizure channel
+ *
+ * Strings longer than their fields are truncated.
+ */
+Record encode_seizure(si8 time, const SeizureRecord& seizure);
+
+/**
+ * @brief Build a "CSti" record
+ */
+Record encode_cognitive_stimulus(si8 time, const CognitiveStimulusRecord& stimulus);
+
+/**
+ * @brief Build an "ESti" record
+ */
+Record encode_electrical_stimulus(si8 time, const ElectricalStimulusRecord& stimulus);
+
+} // namespace brainmaze_mefd
+
+#endif // BRAINMAZE_MEFD_RECORDS_HPP
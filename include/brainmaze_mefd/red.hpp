@@ -18,6 +18,17 @@
 
 namespace brainmaze_mefd {
 
+/**
+ * @brief A RED block as stored in a .tdat file, with its index entry
+ *
+ * Used to move compressed data between sessions without decoding it.
+ * data holds the complete block (header and encoded differences).
+ */
+struct CompressedBlock {
+    TimeSeriesIndex index;
+    std::vector<ui1> data;
+};
+
 /**
  * @brief RED compression/decompression codec
  * 
@@ -31,8 +42,10 @@ public:
      */
     struct CompressionParams {
         ui1 mode = RED_LOSSLESS_COMPRESSION;
+        sf4 scale_factor = RED_SCALE_FACTOR_DEFAULT;  // used with RED_FIXED_SCALE_FACTOR
         si1 encryption_level = RED_ENCRYPTION_LEVEL_DEFAULT;
         bool discontinuity = true;
+        si8 nan_gap_samples = 0;  // NaN samples dropped before the block (RED_NAN_GAP_MASK)
         bool detrend_data = false;
         sf8 goal_compression_ratio = RED_GOAL_COMPRESSION_RATIO_DEFAULT;
         sf8 goal_mean_residual_ratio = RED_GOAL_MEAN_RESIDUAL_RATIO_DEFAULT;
@@ -105,6 +118,14 @@ public:
                                           const ui1* compressed_data,
                                           const PasswordData* password_data = nullptr);
 
+    /**
+     * @brief Check a stored block's header and CRC
+     * @param block_data Pointer to the block (header and encoded differences)
+     * @param block_size Size of the block in bytes
+     * @return true if block_bytes matches block_size and the CRC is correct
+     */
+    static bool validate_block(const ui1* block_data, size_t block_size);
+
     /**
      * @brief Calculate required buffer size for compression
      * @param num_samples Number of samples to compress
@@ -0,0 +1,121 @@
+/**
+ * @file session_tools.hpp
+ * @brief Whole-session operations built on MefReader and MefWriter
+ *
+ * Slicing, concatenation and channel subsetting that copy compressed RED
+ * blocks instead of decoding and recompressing them, and repacking that
+ * re-encodes a session with different writer settings.
+ */
+
+#ifndef BRAINMAZE_MEFD_SESSION_TOOLS_HPP
+#define BRAINMAZE_MEFD_SESSION_TOOLS_HPP
+
+#include "types.hpp"
+#include "constants.hpp"
+#include <string>
+#include <vector>
+
+namespace brainmaze_mefd {
+
+/**
+ * @brief Options for copy_sessions()
+ */
+struct SessionCopyOptions {
+    std::vector<std::string> channels;   // Channels to copy (empty = all time series channels)
+    si8 start_time = UUTC_NO_ENTRY;      // Keep samples at or after this time (uUTC)
+    si8 end_time = UUTC_NO_ENTRY;        // Keep samples before this time (uUTC)
+    std::string password;                // Password of the source sessions
+    size_t threads = 0;                  // Channels copied in parallel (0 = hardware threads)
+    si8 chunk_seconds = 600;             // Blocks held in memory per channel, in seconds of data
+    bool overwrite = true;               // Replace an existing destination session
+};
+
+/**
+ * @brief Counters reported by copy_sessions()
+ */
+struct SessionCopyStatistics {
+    size_t channels = 0;        // Channels written
+    si8 blocks_copied = 0;      // Blocks copied without decoding
+    si8 blocks_decoded = 0;     // Edge blocks decoded and re-encoded
+    si8 bytes_copied = 0;       // Compressed bytes copied verbatim
+    si8 samples = 0;            // Samples written
+    sf8 seconds = 0.0;          // Wall-clock time
+};
+
+/**
+ * @brief Slice, concatenate and subset sessions in the compressed domain
+ *
+ * Writes one session holding the selected channels of all sources, in
+ * order, restricted to [start_time, end_time). Blocks that lie entirely in
+ * the range are copied verbatim; only the blocks cut by the range edges
+ * are decoded and re-encoded. Gaps between sources are flagged as
+ * discontinuities or start new segments. The destination's .tidx and
+ * .tmet files are regenerated by MefWriter. Channels are processed in
+ * parallel, each reading its blocks in bounded time chunks.
+ *
+ * @param sources Paths of the source .mefd sessions, in time order
+ * @param destination Path of the .mefd session to write
+ * @param options Channel, time range and parallelism options
+ * @return Copy statistics
+ * @throws std::runtime_error if a source cannot be opened, a requested
+ *         channel is missing from every source, or a copy fails
+ */
+SessionCopyStatistics copy_sessions(const std::vector<std::string>& sources,
+                                    const std::string& destination,
+                                    const SessionCopyOptions& options = SessionCopyOptions{});
+
+/**
+ * @brief Options for repack_session()
+ */
+struct RepackOptions {
+    std::vector<std::string> channels;   // Channels to repack (empty = all time series channels)
+    std::string password;                // Password of the source session
+    std::string password1;               // Level 1 password of the destination
+    std::string password2;               // Level 2 password of the destination
+    si4 block_len = 0;                   // Destination block length (0 = writer default)
+    bool auto_block_len = false;         // Tune the block length per channel on its first chunk
+    sf8 block_relative_precision = 0.0;  // Lossy tier: relative error bound per block (0 = lossless)
+    size_t threads = 0;                  // Channels repacked in parallel (0 = hardware threads)
+    si8 chunk_seconds = 600;             // Samples held in memory per channel, in seconds of data
+    bool resume = false;                 // Continue an interrupted repack of the same destination
+};
+
+/**
+ * @brief Counters reported by repack_session()
+ */
+struct RepackStatistics {
+    size_t channels = 0;          // Channels repacked by this call
+    size_t channels_skipped = 0;  // Channels already complete when resuming
+    si8 samples = 0;              // Samples re-encoded
+    si8 source_bytes = 0;         // Compressed bytes read
+    si8 destination_bytes = 0;    // Bytes of the written .tdat files
+    sf8 seconds = 0.0;            // Wall-clock time
+};
+
+/**
+ * @brief Re-encode a session with different block length, compression or
+ *        passwords
+ *
+ * Reads every block with MefReader and writes the samples with MefWriter
+ * at their original times, so gaps are preserved. Channels are repacked
+ * in parallel; within a channel the next time chunk is read and decoded
+ * while the current one is encoded, so memory stays bounded by two chunks
+ * per worker. Segments are finalized durably and each completed channel is
+ * recorded in a journal inside the destination; with resume set, channels
+ * in the journal are kept and the others are rewritten from scratch. The
+ * journal is removed when the repack completes.
+ *
+ * @param source Path of the source .mefd session
+ * @param destination Path of the .mefd session to write
+ * @param options Writer settings, parallelism and resume options
+ * @return Repack statistics
+ * @throws std::runtime_error if the source cannot be opened, a requested
+ *         channel is missing, or a write fails
+ */
+RepackStatistics repack_session(const std::string& source,
+                                const std::string& destination,
+                                const RepackOptions& options = RepackOptions{});
+
+} // namespace brainmaze_mefd
+
+#endif // BRAINMAZE_MEFD_SESSION_TOOLS_HPP
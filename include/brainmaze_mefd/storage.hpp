@@ -0,0 +1,312 @@
+/**
+ * @file storage.hpp
+ * @brief Storage backends for MefReader and MefWriter
+ *
+ * All file access of the reader and the writer goes through a Storage:
+ * directory listing, positional reads and writes, and read-only mappings.
+ * PosixStorage uses the local file system, MemoryStorage keeps whole
+ * sessions in memory, and PackedStorage reads sessions packed into a
+ * single archive file.
+ */
+
+#ifndef BRAINMAZE_MEFD_STORAGE_HPP
+#define BRAINMAZE_MEFD_STORAGE_HPP
+
+#include "types.hpp"
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace brainmaze_mefd {
+
+/**
+ * @brief Entry of a directory listing
+ */
+struct StorageEntry {
+    std::string name;          // File name without the directory
+    bool is_directory = false;
+};
+
+/**
+ * @brief Read-only view of a range of a file
+ *
+ * Keeps the underlying mapping or buffer alive for the lifetime of the
+ * view. Bytes already written are stable; files are only appended to or
+ * replaced by renames while readers map them.
+ */
+class StorageMapping {
+public:
+    StorageMapping() = default;
+    StorageMapping(const ui1* data, size_t size, std::shared_ptr<const void> owner)
+        : m_data(data), m_size(size), m_owner(std::move(owner)) {}
+
+    const ui1* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+private:
+    const ui1* m_data = nullptr;
+    size_t m_size = 0;
+    std::shared_ptr<const void> m_owner;
+};
+
+/**
+ * @brief Open file of a Storage
+ *
+ * Positional reads and mappings may be used from several threads at once.
+ */
+class StorageFile {
+public:
+    virtual ~StorageFile() = default;
+
+    /**
+     * @brief Current file size in bytes
+     */
+    virtual si8 size() const = 0;
+
+    /**
+     * @brief Read up to length bytes at offset
+     * @return Bytes read; fewer than length only at the end of the file
+     */
+    virtual size_t pread(void* data, size_t length, si8 offset) const = 0;
+
+    /**
+     * @brief Write length bytes at offset, extending the file as needed
+     * @throws std::runtime_error if the write fails or the file is read-only
+     */
+    virtual void pwrite(const void* data, size_t length, si8 offset) = 0;
+
+    /**
+     * @brief Set the file size
+     * @throws std::runtime_error on failure
+     */
+    virtual void truncate(si8 length) = 0;
+
+    /**
+     * @brief Flush written data to stable storage
+     * @throws std::runtime_error on failure
+     */
+    virtual void sync() {}
+
+    /**
+     * @brief Reserve space for length bytes
+     * @return false if the backend cannot reserve space
+     */
+    virtual bool preallocate(si8 length) { (void)length; return false; }
+
+    /**
+     * @brief Whether the file was opened bypassing the page cache
+     */
+    virtual bool direct_io() const { return false; }
+
+    /**
+     * @brief Operating system descriptor for asynchronous I/O, or -1
+     *
+     * Byte 0 of the file is at native_offset() of the descriptor.
+     */
+    virtual int native_handle() const { return -1; }
+    virtual si8 native_offset() const { return 0; }
+
+    /**
+     * @brief Map a range of the file read-only
+     *
+     * The default implementation reads the range into memory.
+     *
+     * @throws std::runtime_error if the range extends past the end of the file
+     */
+    virtual StorageMapping map(si8 offset, size_t length) const;
+};
+
+/**
+ * @brief File system interface used by MefReader and MefWriter
+ *
+ * Paths use the same syntax as std::filesystem. Methods querying a path
+ * that does not exist return false, -1 or an empty list rather than throw.
+ * All methods are thread-safe.
+ */
+class Storage {
+public:
+    /**
+     * @brief How open() treats the file
+     */
+    enum class OpenMode {
+        READ,      // Existing file, read only
+        WRITE,     // Read and write, created if missing
+        TRUNCATE   // Read and write, created if missing and emptied
+    };
+
+    virtual ~Storage() = default;
+
+    /**
+     * @brief Open a file
+     * @param direct_io Bypass the page cache if the backend supports it
+     * @throws std::runtime_error if the file cannot be opened
+     */
+    virtual std::unique_ptr<StorageFile> open(const std::string& path, OpenMode mode,
+                                              bool direct_io = false) = 0;
+
+    virtual bool exists(const std::string& path) const = 0;
+    virtual bool is_directory(const std::string& path) const = 0;
+
+    /**
+     * @brief List a directory, in no particular order
+     */
+    virtual std::vector<StorageEntry> list(const std::string& path) const = 0;
+
+    /**
+     * @brief Size of a file, or -1 if it does not exist
+     */
+    virtual si8 file_size(const std::string& path) const = 0;
+
+    /**
+     * @brief Last modification time, or file_time_type::min() if unknown
+     */
+    virtual std::filesystem::file_time_type modification_time(const std::string& path) const = 0;
+
+    /**
+     * @brief Create a directory and its missing parents
+     * @throws std::runtime_error on failure
+     */
+    virtual void create_directories(const std::string& path) = 0;
+
+    /**
+     * @brief Remove a file or a directory tree, if it exists
+     * @throws std::runtime_error on failure
+     */
+    virtual void remove_all(const std::string& path) = 0;
+
+    /**
+     * @brief Rename a file, replacing an existing target
+     * @throws std::runtime_error on failure
+     */
+    virtual void rename(const std::string& from, const std::string& to) = 0;
+
+    /**
+     * @brief Flush a directory's entries to stable storage
+     */
+    virtual void sync_directory(const std::string& path) { (void)path; }
+
+    /**
+     * @brief Whether paths name files of the operating system
+     *
+     * Features working on paths directly (segment compaction, change
+     * notification while watching) need a local storage.
+     */
+    virtual bool is_local() const { return false; }
+};
+
+/**
+ * @brief Local file system, using positional I/O and mmap
+ */
+class PosixStorage : public Storage {
+public:
+    std::unique_ptr<StorageFile> open(const std::string& path, OpenMode mode,
+                                      bool direct_io = false) override;
+    bool exists(const std::string& path) const override;
+    bool is_directory(const std::string& path) const override;
+    std::vector<StorageEntry> list(const std::string& path) const override;
+    si8 file_size(const std::string& path) const override;
+    std::filesystem::file_time_type modification_time(const std::string& path) const override;
+    void create_directories(const std::string& path) override;
+    void remove_all(const std::string& path) override;
+    void rename(const std::string& from, const std::string& to) override;
+    void sync_directory(const std::string& path) override;
+    bool is_local() const override { return true; }
+};
+
+/**
+ * @brief Shared PosixStorage used when no storage is given
+ */
+std::shared_ptr<Storage> posix_storage();
+
+/**
+ * @brief Files and directories held in memory
+ *
+ * Sessions written to a MemoryStorage can be read back without touching
+ * the file system or the page cache. Paths are compared after lexical
+ * normalization. Open files keep their contents when removed or replaced,
+ * and mappings are snapshots: writing a mapped file copies it first.
+ */
+class MemoryStorage : public Storage {
+public:
+    MemoryStorage();
+    ~MemoryStorage() override;
+
+    std::unique_ptr<StorageFile> open(const std::string& path, OpenMode mode,
+                                      bool direct_io = false) override;
+    bool exists(const std::string& path) const override;
+    bool is_directory(const std::string& path) const override;
+    std::vector<StorageEntry> list(const std::string& path) const override;
+    si8 file_size(const std::string& path) const override;
+    std::filesystem::file_time_type modification_time(const std::string& path) const override;
+    void create_directories(const std::string& path) override;
+    void remove_all(const std::string& path) override;
+    void rename(const std::string& from, const std::string& to) override;
+
+    /**
+     * @brief Total size of all files in bytes
+     */
+    si8 get_bytes() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+/**
+ * @brief Read-only storage over a single archive file
+ *
+ * An archive holds a directory tree, e.g. a session with tens of thousands
+ * of segment files, as one file: a header, the file contents and a table
+ * of entries read when the archive is opened. Reads are positional reads
+ * and mappings of the archive, so no per-file open or lookup reaches the
+ * file system. Paths are relative to the archive root; the packed tree
+ * keeps the name of its top directory (e.g. "session.mefd").
+ */
+class PackedStorage : public Storage {
+public:
+    /**
+     * @brief Open an archive written by pack()
+     * @throws std::runtime_error if the archive is missing or damaged
+     */
+    explicit PackedStorage(const std::string& archive_path);
+    ~PackedStorage() override;
+
+    /**
+     * @brief Pack the tree at source_path of a storage into an archive
+     *
+     * The archive is written to a temporary file and renamed into place.
+     *
+     * @throws std::runtime_error if the source is not a directory or the
+     *         archive cannot be written
+     */
+    static void pack(Storage& source, const std::string& source_path,
+                     const std::string& archive_path);
+
+    std::unique_ptr<StorageFile> open(const std::string& path, OpenMode mode,
+                                      bool direct_io = false) override;
+    bool exists(const std::string& path) const override;
+    bool is_directory(const std::string& path) const override;
+    std::vector<StorageEntry> list(const std::string& path) const override;
+    si8 file_size(const std::string& path) const override;
+    std::filesystem::file_time_type modification_time(const std::string& path) const override;
+    void create_directories(const std::string& path) override;
+    void remove_all(const std::string& path) override;
+    void rename(const std::string& from, const std::string& to) override;
+
+    /**
+     * @brief Get the archive path
+     */
+    const std::string& get_archive_path() const { return m_archive_path; }
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+
+    std::string m_archive_path;
+};
+
+} // namespace brainmaze_mefd
+
+#endif // BRAINMAZE_MEFD_STORAGE_HPP
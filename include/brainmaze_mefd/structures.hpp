@@ -281,6 +281,15 @@ struct TimeSeriesIndex {
         RED_block_protected_region.fill(PAD_BYTE_VALUE);
         RED_block_discretionary_region.fill(PAD_BYTE_VALUE);
     }
+    
+    /** @brief NaN samples the writer dropped right before the block (0 = none) */
+    si8 nan_gap_samples() const {
+        si8 samples = 0;
+        if (RED_block_flags & RED_NAN_GAP_MASK) {
+            std::memcpy(&samples, RED_block_discretionary_region.data(), sizeof(samples));
+        }
+        return samples;
+    }
 };
 
 /**
@@ -392,6 +401,24 @@ struct REDBlockHeader {
         if (value) flags |= RED_LEVEL_2_ENCRYPTION_MASK;
         else flags &= ~RED_LEVEL_2_ENCRYPTION_MASK;
     }
+    
+    si8 nan_gap_samples() const {
+        si8 samples = 0;
+        if (flags & RED_NAN_GAP_MASK) {
+            std::memcpy(&samples, discretionary_region.data(), sizeof(samples));
+        }
+        return samples;
+    }
+    
+    void set_nan_gap_samples(si8 samples) {
+        if (samples > 0) {
+            flags |= RED_NAN_GAP_MASK;
+            std::memcpy(discretionary_region.data(), &samples, sizeof(samples));
+        } else {
+            flags &= ~RED_NAN_GAP_MASK;
+            discretionary_region.fill(PAD_BYTE_VALUE);
+        }
+    }
 };
 
 #pragma pack(pop)
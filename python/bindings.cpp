@@ -7,10 +7,81 @@
 #include <pybind11/stl.h>
 #include <pybind11/numpy.h>
 #include <brainmaze_mefd/mef.hpp>
+#include <algorithm>
 
 namespace py = pybind11;
 using namespace brainmaze_mefd;
 
+namespace {
+
+py::dict block_len_estimate_dict(const MefWriter::BlockLengthEstimate& estimate) {
+    py::list candidates;
+    for (const auto& candidate : estimate.candidates) {
+        py::dict entry;
+        entry["block_len"] = candidate.block_len;
+        entry["compressed_bytes"] = candidate.compressed_bytes;
+        entry["index_bytes"] = candidate.index_bytes;
+        entry["bytes_per_sample"] = candidate.bytes_per_sample;
+        entry["query_seconds"] = candidate.query_seconds;
+        entry["cost"] = candidate.cost;
+        candidates.append(entry);
+    }
+    py::dict result;
+    result["found"] = estimate.found;
+    result["block_len"] = estimate.block_len;
+    result["samples_used"] = estimate.samples_used;
+    result["candidates"] = candidates;
+    return result;
+}
+
+// Field of a record dict as returned by the decode_* functions
+template <typename T>
+T dict_value(const py::dict& fields, const char* key, T fallback) {
+    return fields.contains(key) ? fields[key].cast<T>() : fallback;
+}
+
+Record with_encryption(Record record, si1 encryption) {
+    record.info.encryption = encryption;
+    return record;
+}
+
+py::dict cache_statistics_dict(const BlockCacheStatistics& stats) {
+    py::dict result;
+    result["hits"] = stats.hits;
+    result["misses"] = stats.misses;
+    result["insertions"] = stats.insertions;
+    result["evictions"] = stats.evictions;
+    result["blocks"] = stats.blocks;
+    result["bytes"] = stats.bytes;
+    result["capacity_bytes"] = stats.capacity_bytes;
+    return result;
+}
+
+// Numpy array over a shared memory mapping, which it keeps alive
+template <typename T>
+py::array_t<T> shared_array(SharedSamples<T> samples) {
+    auto owner = new SharedSamples<T>(std::move(samples));
+    py::capsule release(owner, [](void* p) { delete static_cast<SharedSamples<T>*>(p); });
+    py::array_t<T> result(static_cast<py::ssize_t>(owner->size()), owner->data(), release);
+    py::detail::array_proxy(result.ptr())->flags &= ~py::detail::npy_api::NPY_ARRAY_WRITEABLE_;
+    return result;
+}
+
+py::dict refresh_dict(const MefReader::RefreshResult& refresh) {
+    py::dict result;
+    result["new_channels"] = refresh.new_channels;
+    result["new_segments"] = refresh.new_segments;
+    result["rewritten_segments"] = refresh.rewritten_segments;
+    result["new_blocks"] = refresh.new_blocks;
+    result["new_samples"] = refresh.new_samples;
+    result["bytes_read"] = refresh.bytes_read;
+    result["latency_seconds"] = refresh.latency_seconds;
+    result["seconds"] = refresh.seconds;
+    return result;
+}
+
+} // namespace
+
 PYBIND11_MODULE(_brainmaze_mefd, m) {
     m.doc() = "Modern C++ MEF 3.0 library - Python bindings";
     
@@ -18,19 +89,149 @@ PYBIND11_MODULE(_brainmaze_mefd, m) {
     m.def("get_version", &get_version, "Get library version");
     m.def("get_mef_version", &get_mef_version, "Get MEF format version");
     
+    // Stored RED block, copied between sessions without decoding
+    py::class_<CompressedBlock>(m, "CompressedBlock", "Undecoded RED block with its index entry")
+        .def_property_readonly("start_time", [](const CompressedBlock& b) { return b.index.start_time; })
+        .def_property_readonly("start_sample", [](const CompressedBlock& b) { return b.index.start_sample; })
+        .def_property_readonly("number_of_samples",
+                               [](const CompressedBlock& b) { return b.index.number_of_samples; })
+        .def_property_readonly("flags", [](const CompressedBlock& b) { return b.index.RED_block_flags; })
+        .def_property_readonly("data", [](const CompressedBlock& b) {
+            return py::bytes(reinterpret_cast<const char*>(b.data.data()), b.data.size());
+        });
+    
+    // Session, channel and segment records
+    py::class_<RecordInfo>(m, "RecordInfo", "Record listed in a .ridx file")
+        .def_readonly("type", &RecordInfo::type)
+        .def_readonly("version_major", &RecordInfo::version_major)
+        .def_readonly("version_minor", &RecordInfo::version_minor)
+        .def_readonly("encryption", &RecordInfo::encryption)
+        .def_readonly("time", &RecordInfo::time)
+        .def_readonly("end_time", &RecordInfo::end_time)
+        .def_readonly("channel", &RecordInfo::channel)
+        .def_readonly("segment", &RecordInfo::segment)
+        .def_readonly("file_offset", &RecordInfo::file_offset);
+    
+    py::class_<Record>(m, "Record", "Record with its decrypted body")
+        .def_readonly("info", &Record::info)
+        .def_readonly("accessible", &Record::accessible)
+        .def_property_readonly("body", [](const Record& r) {
+            return py::bytes(reinterpret_cast<const char*>(r.body.data()), r.body.size());
+        });
+    
+    // Decoded block cache, shareable between readers
+    py::class_<BlockCache, std::shared_ptr<BlockCache>>(m, "BlockCache", "Shared LRU cache of decoded blocks")
+        .def(py::init<si8>(), py::arg("capacity_bytes"), "Create a cache holding up to capacity_bytes of samples")
+        .def("set_capacity", &BlockCache::set_capacity, py::arg("capacity_bytes"), "Change the byte limit")
+        .def("clear", &BlockCache::clear, "Drop all blocks")
+        .def("get_statistics", [](const BlockCache& cache) {
+            return cache_statistics_dict(cache.get_statistics());
+        }, "Get hit, miss and eviction counters and the current size");
+    
+    // Persistent decoded block cache on local storage
+    py::class_<DiskBlockCache, std::shared_ptr<DiskBlockCache>>(m, "DiskBlockCache",
+                                                                "Persistent LRU cache of decoded blocks in a local directory")
+        .def(py::init<const std::string&, si8>(), py::arg("directory"), py::arg("capacity_bytes"),
+             "Open or create a cache directory holding up to capacity_bytes")
+        .def("set_capacity", &DiskBlockCache::set_capacity, py::arg("capacity_bytes"), "Change the byte limit")
+        .def("clear", &DiskBlockCache::clear, py::call_guard<py::gil_scoped_release>(), "Remove all block files")
+        .def("get_directory", &DiskBlockCache::get_directory, "Get the cache directory")
+        .def("get_statistics", [](const DiskBlockCache& cache) {
+            return cache_statistics_dict(cache.get_statistics());
+        }, "Get hit, miss and eviction counters and the current size in file bytes");
+    
+    // Storage backends for readers and writers
+    py::class_<Storage, std::shared_ptr<Storage>>(m, "Storage", "File system used by readers and writers")
+        .def("exists", &Storage::exists, py::arg("path"), "Check if a file or directory exists")
+        .def("is_directory", &Storage::is_directory, py::arg("path"), "Check if a path is a directory")
+        .def("list", [](const Storage& storage, const std::string& path) {
+            std::vector<std::string> names;
+            for (const auto& entry : storage.list(path)) {
+                names.push_back(entry.name);
+            }
+            std::sort(names.begin(), names.end());
+            return names;
+        }, py::arg("path"), "List the names in a directory")
+        .def("file_size", &Storage::file_size, py::arg("path"), "Size of a file, or -1 if it does not exist")
+        .def("is_local", &Storage::is_local, "Whether paths name files of the operating system");
+    
+    py::class_<PosixStorage, Storage, std::shared_ptr<PosixStorage>>(m, "PosixStorage", "Local file system")
+        .def(py::init<>());
+    
+    py::class_<MemoryStorage, Storage, std::shared_ptr<MemoryStorage>>(m, "MemoryStorage",
+                                                                       "Files and directories held in memory")
+        .def(py::init<>())
+        .def("get_bytes", &MemoryStorage::get_bytes, "Total size of all files in bytes");
+    
+    py::class_<PackedStorage, Storage, std::shared_ptr<PackedStorage>>(m, "PackedStorage",
+                                                                       "Read-only storage over a single archive file")
+        .def(py::init<const std::string&>(), py::arg("archive_path"), "Open an archive written by pack()")
+        .def_static("pack", [](const std::string& source_path, const std::string& archive_path,
+                               std::shared_ptr<Storage> source) {
+            Storage& storage = source ? *source : *posix_storage();
+            PackedStorage::pack(storage, source_path, archive_path);
+        }, py::arg("source_path"), py::arg("archive_path"), py::arg("source") = nullptr,
+           py::call_guard<py::gil_scoped_release>(),
+           "Pack a directory tree, e.g. a session, into an archive")
+        .def("get_archive_path", &PackedStorage::get_archive_path, "Get the archive path");
+    
+    // Batched asynchronous I/O, shareable between readers and writers
+    py::class_<IoEngine, std::shared_ptr<IoEngine>> engine_class(m, "IoEngine",
+                                                                 "Asynchronous batched file I/O (io_uring or thread pool)");
+    
+    py::enum_<IoEngine::Backend>(engine_class, "Backend")
+        .value("AUTO", IoEngine::Backend::AUTO)
+        .value("IO_URING", IoEngine::Backend::IO_URING)
+        .value("THREAD_POOL", IoEngine::Backend::THREAD_POOL);
+    
+    engine_class
+        .def(py::init([](IoEngine::Backend backend, size_t queue_depth, size_t threads) {
+            IoEngine::Options options;
+            options.backend = backend;
+            options.queue_depth = queue_depth;
+            options.threads = threads;
+            return std::make_shared<IoEngine>(options);
+        }), py::arg("backend") = IoEngine::Backend::AUTO,
+            py::arg("queue_depth") = IoEngine::DEFAULT_QUEUE_DEPTH,
+            py::arg("threads") = IoEngine::DEFAULT_THREADS,
+            "Create an engine; AUTO uses io_uring where available")
+        .def("get_backend", &IoEngine::get_backend, "Backend in use")
+        .def_static("io_uring_available", &IoEngine::io_uring_available,
+                    "Whether io_uring can be used on this system")
+        .def("get_statistics", [](const IoEngine& engine) {
+            auto stats = engine.get_statistics();
+            py::dict result;
+            result["batches"] = stats.batches;
+            result["reads"] = stats.reads;
+            result["writes"] = stats.writes;
+            result["bytes_read"] = stats.bytes_read;
+            result["bytes_written"] = stats.bytes_written;
+            result["submissions"] = stats.submissions;
+            result["mean_queue_depth"] = stats.mean_queue_depth;
+            result["max_queue_depth"] = stats.max_queue_depth;
+            result["seconds"] = stats.seconds;
+            result["gigabytes_per_second"] = stats.gigabytes_per_second();
+            return result;
+        }, "Get request counts, achieved queue depth and throughput")
+        .def("reset_statistics", &IoEngine::reset_statistics, "Reset the counters");
+    
     // MefReader class
     py::class_<MefReader>(m, "MefReader", "MEF 3.0 session reader")
-        .def(py::init<const std::string&, const std::string&>(),
+        .def(py::init<const std::string&, const std::string&, std::shared_ptr<Storage>>(),
              py::arg("path"),
              py::arg("password") = "",
+             py::arg("storage") = nullptr,
              "Open a MEF session for reading")
         .def("is_valid", &MefReader::is_valid, "Check if session is valid")
         .def("get_path", &MefReader::get_path, "Get session path")
+        .def("get_storage", &MefReader::get_storage, "Get the storage holding the session")
         .def("get_session_name", &MefReader::get_session_name, "Get session name")
         .def_property_readonly("channels", &MefReader::get_channels, "List of channel names")
         .def("get_channels", &MefReader::get_channels, "Get list of channel names")
         .def("get_time_series_channels", &MefReader::get_time_series_channels, 
              "Get list of time series channel names")
+        .def("get_channel_handle", &MefReader::get_channel_handle, py::arg("channel_name"),
+             "Look up the integer handle of a channel")
         .def("get_start_time", &MefReader::get_start_time, "Get session start time")
         .def("get_end_time", &MefReader::get_end_time, "Get session end time")
         .def("get_duration", &MefReader::get_duration, "Get recording duration in microseconds")
@@ -67,27 +268,495 @@ PYBIND11_MODULE(_brainmaze_mefd, m) {
             return result;
         }, py::arg("channel_name"), py::arg("start_time") = py::none(), 
            py::arg("end_time") = py::none(),
-           "Read data from a channel");
+           "Read data from a channel")
+        .def("get_data", [](const MefReader& reader, MefReader::ChannelHandle channel,
+                            py::object start, py::object end) {
+            si8 start_time = 0, end_time = 0;
+            si8* p_start = nullptr;
+            si8* p_end = nullptr;
+            
+            if (!start.is_none()) {
+                start_time = start.cast<si8>();
+                p_start = &start_time;
+            }
+            if (!end.is_none()) {
+                end_time = end.cast<si8>();
+                p_end = &end_time;
+            }
+            
+            auto data = reader.get_data(channel, p_start, p_end);
+            
+            py::array_t<sf8> result(static_cast<py::ssize_t>(data.size()));
+            auto buf = result.request();
+            std::copy(data.begin(), data.end(), static_cast<sf8*>(buf.ptr));
+            return result;
+        }, py::arg("channel"), py::arg("start_time") = py::none(),
+           py::arg("end_time") = py::none(),
+           "Read data from a channel by handle")
+        .def("get_data", [](const MefReader& reader, const std::vector<std::string>& channels,
+                            py::object start, py::object end) {
+            si8 start_time = 0, end_time = 0;
+            si8* p_start = nullptr;
+            si8* p_end = nullptr;
+            
+            if (!start.is_none()) {
+                start_time = start.cast<si8>();
+                p_start = &start_time;
+            }
+            if (!end.is_none()) {
+                end_time = end.cast<si8>();
+                p_end = &end_time;
+            }
+            
+            std::vector<std::vector<sf8>> data;
+            {
+                py::gil_scoped_release release;
+                data = reader.get_data(channels, p_start, p_end);
+            }
+            
+            py::list result;
+            for (const auto& samples : data) {
+                py::array_t<sf8> array(static_cast<py::ssize_t>(samples.size()));
+                auto buf = array.request();
+                std::copy(samples.begin(), samples.end(), static_cast<sf8*>(buf.ptr));
+                result.append(array);
+            }
+            return result;
+        }, py::arg("channel_names"), py::arg("start_time") = py::none(),
+           py::arg("end_time") = py::none(),
+           "Read data from several channels, fetching their blocks as one batch")
+        .def("read_compressed_blocks", [](const MefReader& reader, const std::string& channel,
+                                          py::object start, py::object end) {
+            si8 start_time = 0, end_time = 0;
+            si8* p_start = nullptr;
+            si8* p_end = nullptr;
+            
+            if (!start.is_none()) {
+                start_time = start.cast<si8>();
+                p_start = &start_time;
+            }
+            if (!end.is_none()) {
+                end_time = end.cast<si8>();
+                p_end = &end_time;
+            }
+            
+            py::gil_scoped_release release;
+            return reader.read_compressed_blocks(channel, p_start, p_end);
+        }, py::arg("channel_name"), py::arg("start_time") = py::none(),
+           py::arg("end_time") = py::none(),
+           "Read the undecoded RED blocks covering a time range")
+        .def("get_records", [](const MefReader& reader, py::object channel,
+                               py::object start, py::object end) {
+            si8 start_time = 0, end_time = 0;
+            si8* p_start = nullptr;
+            si8* p_end = nullptr;
+            
+            if (!start.is_none()) {
+                start_time = start.cast<si8>();
+                p_start = &start_time;
+            }
+            if (!end.is_none()) {
+                end_time = end.cast<si8>();
+                p_end = &end_time;
+            }
+            
+            if (channel.is_none()) {
+                return reader.get_records(p_start, p_end);
+            }
+            return reader.get_records(channel.cast<std::string>(), p_start, p_end);
+        }, py::arg("channel_name") = py::none(), py::arg("start_time") = py::none(),
+           py::arg("end_time") = py::none(),
+           "List the session records, or a channel's and its segments' records, "
+           "overlapping a time range")
+        .def("read_record", &MefReader::read_record, py::arg("info"),
+             "Read and decrypt the body of a record")
+        .def("refresh", [](MefReader& reader) {
+            MefReader::RefreshResult refresh;
+            {
+                py::gil_scoped_release release;
+                refresh = reader.refresh();
+            }
+            return refresh_dict(refresh);
+        }, "Load channels, segments and blocks appended since the last refresh")
+        .def("watch", [](MefReader& reader, py::object callback, sf8 poll_seconds) {
+            std::function<void(const MefReader::RefreshResult&)> notify;
+            if (!callback.is_none()) {
+                // The callback runs on the watch thread and must hold the GIL
+                auto shared = std::make_shared<py::object>(callback);
+                notify = [shared](const MefReader::RefreshResult& refresh) {
+                    py::gil_scoped_acquire acquire;
+                    try {
+                        (*shared)(refresh_dict(refresh));
+                    } catch (py::error_already_set& error) {
+                        error.discard_as_unraisable("MefReader.watch callback");
+                    }
+                };
+            }
+            reader.watch(std::move(notify), poll_seconds);
+        }, py::arg("callback") = py::none(), py::arg("poll_seconds") = 1.0,
+           "Refresh in a background thread whenever the session changes; call "
+           "stop_watch() before releasing the reader")
+        .def("stop_watch", &MefReader::stop_watch, py::call_guard<py::gil_scoped_release>(),
+             "Stop the background watch")
+        .def("is_watching", &MefReader::is_watching, "Whether a background watch is running")
+        .def("set_block_cache", &MefReader::set_block_cache, py::arg("cache"),
+             "Cache decoded blocks in a cache that may be shared with other readers (None to stop)")
+        .def("get_block_cache", &MefReader::get_block_cache, "Get the block cache, if any")
+        .def("set_disk_block_cache", &MefReader::set_disk_block_cache, py::arg("cache"),
+             "Keep decoded blocks in a persistent cache on local storage (None to stop)")
+        .def("get_disk_block_cache", &MefReader::get_disk_block_cache, "Get the disk block cache, if any")
+        .def("set_io_engine", &MefReader::set_io_engine, py::arg("engine"),
+             "Read blocks in batches through an asynchronous I/O engine (None to stop)")
+        .def("get_io_engine", &MefReader::get_io_engine, "Get the I/O engine, if any")
+        .def("get_refresh_statistics", [](const MefReader& reader) {
+            auto stats = reader.get_refresh_statistics();
+            py::dict result;
+            result["refreshes"] = stats.refreshes;
+            result["updates"] = stats.updates;
+            result["new_blocks"] = stats.new_blocks;
+            result["mean_latency_seconds"] = stats.mean_latency_seconds;
+            result["max_latency_seconds"] = stats.max_latency_seconds;
+            return result;
+        }, "Get refresh counts and write-to-read latency");
+    
+    // Catalog of the sessions under a directory
+    py::class_<MefDataset>(m, "MefDataset", "Time-indexed catalog of the MEF sessions under a directory")
+        .def(py::init([](const std::string& root, const std::string& password,
+                         const std::string& catalog_path, bool save_catalog,
+                         size_t max_open_sessions, size_t threads) {
+                 DatasetOptions options;
+                 options.password = password;
+                 options.catalog_path = catalog_path;
+                 options.save_catalog = save_catalog;
+                 options.max_open_sessions = max_open_sessions;
+                 options.threads = threads;
+                 py::gil_scoped_release release;
+                 return std::make_unique<MefDataset>(root, options);
+             }),
+             py::arg("root"), py::arg("password") = "", py::arg("catalog_path") = "",
+             py::arg("save_catalog") = true, py::arg("max_open_sessions") = 16,
+             py::arg("threads") = 0,
+             "Index the sessions under a directory, reusing the catalog file when present")
+        .def("rescan", &MefDataset::rescan, py::call_guard<py::gil_scoped_release>(),
+             "Index sessions added or changed since the last scan")
+        .def("save_catalog", &MefDataset::save_catalog, "Write the catalog file")
+        .def("get_root", &MefDataset::get_root, "Get the root directory")
+        .def("get_channels", &MefDataset::get_channels, "Get the names of all channels")
+        .def("get_start_time", &MefDataset::get_start_time, "Get the earliest start time")
+        .def("get_end_time", &MefDataset::get_end_time, "Get the latest end time")
+        .def("get_sessions", [](const MefDataset& dataset) {
+            py::list result;
+            for (const auto& session : dataset.get_sessions()) {
+                py::dict entry;
+                entry["path"] = session.path;
+                entry["start_time"] = session.start_time;
+                entry["end_time"] = session.end_time;
+                entry["channels"] = session.channels;
+                result.append(entry);
+            }
+            return result;
+        }, "Get the catalog entries of all sessions, ordered by start time")
+        .def("get_channel_spans", [](const MefDataset& dataset, const std::string& channel,
+                                     py::object start, py::object end) {
+            si8 start_time = 0, end_time = 0;
+            si8* p_start = nullptr;
+            si8* p_end = nullptr;
+            
+            if (!start.is_none()) {
+                start_time = start.cast<si8>();
+                p_start = &start_time;
+            }
+            if (!end.is_none()) {
+                end_time = end.cast<si8>();
+                p_end = &end_time;
+            }
+            
+            py::list result;
+            for (const auto& span : dataset.get_channel_spans(channel, p_start, p_end)) {
+                py::dict entry;
+                entry["session"] = span.session;
+                entry["sampling_frequency"] = span.sampling_frequency;
+                entry["start_time"] = span.start_time;
+                entry["end_time"] = span.end_time;
+                entry["number_of_samples"] = span.number_of_samples;
+                result.append(entry);
+            }
+            return result;
+        }, py::arg("channel_name"), py::arg("start_time") = py::none(),
+           py::arg("end_time") = py::none(),
+           "List the sessions holding a channel within a time range")
+        .def("get_data", [](const MefDataset& dataset, const std::string& channel,
+                            py::object start, py::object end) {
+            si8 start_time = 0, end_time = 0;
+            si8* p_start = nullptr;
+            si8* p_end = nullptr;
+            
+            if (!start.is_none()) {
+                start_time = start.cast<si8>();
+                p_start = &start_time;
+            }
+            if (!end.is_none()) {
+                end_time = end.cast<si8>();
+                p_end = &end_time;
+            }
+            
+            std::vector<sf8> data;
+            {
+                py::gil_scoped_release release;
+                data = dataset.get_data(channel, p_start, p_end);
+            }
+            
+            py::array_t<sf8> result(static_cast<py::ssize_t>(data.size()));
+            auto buf = result.request();
+            std::copy(data.begin(), data.end(), static_cast<sf8*>(buf.ptr));
+            return result;
+        }, py::arg("channel_name"), py::arg("start_time") = py::none(),
+           py::arg("end_time") = py::none(),
+           "Read a channel over a time range spanning any number of sessions")
+        .def("get_statistics", [](const MefDataset& dataset) {
+            auto stats = dataset.get_statistics();
+            py::dict result;
+            result["sessions"] = stats.sessions;
+            result["sessions_indexed"] = stats.sessions_indexed;
+            result["sessions_from_catalog"] = stats.sessions_from_catalog;
+            result["readers_opened"] = stats.readers_opened;
+            result["reader_cache_hits"] = stats.reader_cache_hits;
+            return result;
+        }, "Get catalog and reader cache counters");
+    
+#ifndef _WIN32
+    // Local read server and its client
+    py::class_<MefServer>(m, "MefServer", "Read server sharing decoded blocks between local processes")
+        .def(py::init([](const std::string& socket_path, si8 cache_bytes, size_t max_sessions) {
+                 ServerOptions options;
+                 options.cache_bytes = cache_bytes;
+                 options.max_sessions = max_sessions;
+                 return std::make_unique<MefServer>(socket_path, options);
+             }),
+             py::arg("socket_path"), py::arg("cache_bytes") = 1LL << 30, py::arg("max_sessions") = 64,
+             "Create a server listening on a Unix domain socket once started")
+        .def("start", &MefServer::start, "Serve clients from background threads")
+        .def("stop", &MefServer::stop, py::call_guard<py::gil_scoped_release>(),
+             "Disconnect clients and close the socket")
+        .def("is_running", &MefServer::is_running, "Whether the server is accepting clients")
+        .def("get_socket_path", &MefServer::get_socket_path, "Get the socket path")
+        .def("get_statistics", [](const MefServer& server) {
+            auto stats = server.get_statistics();
+            py::dict result;
+            result["connections"] = stats.connections;
+            result["requests"] = stats.requests;
+            result["errors"] = stats.errors;
+            result["sessions_opened"] = stats.sessions_opened;
+            result["samples_served"] = stats.samples_served;
+            result["bytes_served"] = stats.bytes_served;
+            result["cache"] = cache_statistics_dict(stats.cache);
+            return result;
+        }, "Get request counters and block cache statistics");
+    
+    py::class_<MefClient>(m, "MefClient", "Session opened through a MefServer")
+        .def(py::init<const std::string&, const std::string&, const std::string&>(),
+             py::arg("socket_path"), py::arg("session_path"), py::arg("password") = "",
+             "Connect to a server and open a session")
+        .def("is_valid", &MefClient::is_valid, "Check if the server could open the session")
+        .def("get_path", &MefClient::get_path, "Get session path")
+        .def("get_channels", &MefClient::get_channels, "Get list of channel names")
+        .def("get_time_series_channels", &MefClient::get_time_series_channels,
+             "Get list of time series channel names")
+        .def("get_start_time", &MefClient::get_start_time, "Get session start time")
+        .def("get_end_time", &MefClient::get_end_time, "Get session end time")
+        .def("get_duration", &MefClient::get_duration, "Get recording duration in microseconds")
+        .def("get_channel_info", [](const MefClient& client, const std::string& channel) {
+            auto info = client.get_channel_info(channel);
+            py::dict result;
+            result["name"] = info.name;
+            result["sampling_frequency"] = info.sampling_frequency;
+            result["number_of_samples"] = info.number_of_samples;
+            result["start_time"] = info.start_time;
+            result["end_time"] = info.end_time;
+            result["units"] = info.units;
+            result["units_conversion_factor"] = info.units_conversion_factor;
+            result["number_of_segments"] = info.number_of_segments;
+            return result;
+        }, py::arg("channel_name"), "Get channel information")
+        .def("get_data", [](const MefClient& client, const std::string& channel,
+                            py::object start, py::object end) {
+            si8 start_time = 0, end_time = 0;
+            si8* p_start = nullptr;
+            si8* p_end = nullptr;
+            
+            if (!start.is_none()) {
+                start_time = start.cast<si8>();
+                p_start = &start_time;
+            }
+            if (!end.is_none()) {
+                end_time = end.cast<si8>();
+                p_end = &end_time;
+            }
+            
+            SharedSamples<sf8> samples;
+            {
+                py::gil_scoped_release release;
+                samples = client.get_data_view(channel, p_start, p_end);
+            }
+            return shared_array(std::move(samples));
+        }, py::arg("channel_name"), py::arg("start_time") = py::none(),
+           py::arg("end_time") = py::none(),
+           "Read data from a channel as a read-only array over shared memory")
+        .def("get_raw_data", [](const MefClient& client, const std::string& channel,
+                                si8 start_sample, si8 end_sample) {
+            SharedSamples<si4> samples;
+            {
+                py::gil_scoped_release release;
+                samples = client.get_raw_data_view(channel, start_sample, end_sample);
+            }
+            return shared_array(std::move(samples));
+        }, py::arg("channel_name"), py::arg("start_sample"), py::arg("end_sample"),
+           "Read raw samples as a read-only array over shared memory");
+#endif
     
     // MefWriter class
-    py::class_<MefWriter>(m, "MefWriter", "MEF 3.0 session writer")
-        .def(py::init<const std::string&, bool, const std::string&, const std::string&>(),
+    py::class_<MefWriter> writer_class(m, "MefWriter", "MEF 3.0 session writer");
+    
+    // Per-channel writer; releases the GIL so channels can be written from
+    // separate Python threads
+    py::class_<MefWriter::ChannelWriter>(writer_class, "ChannelWriter",
+                                         "Writer bound to a single channel")
+        .def_property_readonly("channel_name", &MefWriter::ChannelWriter::get_channel_name)
+        .def_property_readonly("handle", &MefWriter::ChannelWriter::get_handle)
+        .def("write_data", [](MefWriter::ChannelWriter& channel, py::array_t<sf8> data,
+                              si8 start_uutc, si4 precision, bool new_segment) {
+            auto buf = data.request();
+            if (buf.ndim != 1) {
+                throw std::runtime_error("Data must be 1-dimensional");
+            }
+            py::gil_scoped_release release;
+            channel.write_data(static_cast<const sf8*>(buf.ptr),
+                               static_cast<size_t>(buf.size),
+                               start_uutc, precision, new_segment);
+        }, py::arg("data"), py::arg("start_uutc"),
+           py::arg("precision") = -1, py::arg("new_segment") = false,
+           "Write data to this channel")
+        .def("write_raw_data", [](MefWriter::ChannelWriter& channel, py::array_t<si4> data,
+                                  si8 start_uutc, bool new_segment) {
+            auto buf = data.request();
+            if (buf.ndim != 1) {
+                throw std::runtime_error("Data must be 1-dimensional");
+            }
+            py::gil_scoped_release release;
+            channel.write_raw_data(static_cast<const si4*>(buf.ptr),
+                                   static_cast<size_t>(buf.size),
+                                   start_uutc, new_segment);
+        }, py::arg("data"), py::arg("start_uutc"), py::arg("new_segment") = false,
+           "Write raw integer samples to this channel")
+        .def("write_timestamped_data", [](MefWriter::ChannelWriter& channel, py::array_t<sf8> data,
+                                          py::array_t<si8> timestamps, si4 precision) {
+            auto buf = data.request();
+            auto ts = timestamps.request();
+            if (buf.ndim != 1 || ts.ndim != 1 || buf.size != ts.size) {
+                throw std::runtime_error("Data and timestamps must be 1-dimensional and of equal length");
+            }
+            py::gil_scoped_release release;
+            channel.write_data(static_cast<const sf8*>(buf.ptr), static_cast<const si8*>(ts.ptr),
+                               static_cast<size_t>(buf.size), precision);
+        }, py::arg("data"), py::arg("timestamps"), py::arg("precision") = -1,
+           "Write data with one timestamp per sample")
+        .def("write_timestamped_raw_data", [](MefWriter::ChannelWriter& channel, py::array_t<si4> data,
+                                              py::array_t<si8> timestamps) {
+            auto buf = data.request();
+            auto ts = timestamps.request();
+            if (buf.ndim != 1 || ts.ndim != 1 || buf.size != ts.size) {
+                throw std::runtime_error("Data and timestamps must be 1-dimensional and of equal length");
+            }
+            py::gil_scoped_release release;
+            channel.write_raw_data(static_cast<const si4*>(buf.ptr), static_cast<const si8*>(ts.ptr),
+                                   static_cast<size_t>(buf.size));
+        }, py::arg("data"), py::arg("timestamps"),
+           "Write raw integer samples with one timestamp per sample")
+        .def("write_compressed_blocks", &MefWriter::ChannelWriter::write_compressed_blocks,
+             py::arg("blocks"), py::call_guard<py::gil_scoped_release>(),
+             "Append undecoded RED blocks to this channel")
+        .def("flush", &MefWriter::ChannelWriter::flush,
+             py::call_guard<py::gil_scoped_release>(),
+             "Compress pending samples and flush this channel");
+    
+    py::enum_<MefWriter::DurabilityMode>(writer_class, "DurabilityMode")
+        .value("NONE", MefWriter::DurabilityMode::NONE)
+        .value("PERIODIC", MefWriter::DurabilityMode::PERIODIC)
+        .value("ON_SEGMENT_CLOSE", MefWriter::DurabilityMode::ON_SEGMENT_CLOSE);
+    
+    writer_class
+        .def(py::init<const std::string&, bool, const std::string&, const std::string&,
+                      std::shared_ptr<Storage>>(),
              py::arg("path"),
              py::arg("overwrite") = true,
              py::arg("password1") = "",
              py::arg("password2") = "",
+             py::arg("storage") = nullptr,
              "Create a MEF session for writing")
         .def("is_valid", &MefWriter::is_valid, "Check if writer is valid")
+        .def("get_storage", &MefWriter::get_storage, "Get the storage holding the session")
         .def_property("mef_block_len", &MefWriter::get_mef_block_len, &MefWriter::set_mef_block_len,
                       "MEF block length (samples per block)")
         .def_property("max_nans_written", &MefWriter::get_max_nans_written, 
                       &MefWriter::set_max_nans_written,
-                      "Maximum NaN samples to write")
+                      "Longest NaN run stored; longer runs are dropped as gaps (negative = store all)")
         .def_property("data_units", &MefWriter::get_data_units, &MefWriter::set_data_units,
                       "Data units description")
         .def_property("units_conversion_factor", &MefWriter::get_units_conversion_factor,
                       &MefWriter::set_units_conversion_factor,
                       "Units conversion factor")
+        .def_property("auto_resolution", &MefWriter::get_auto_resolution,
+                      &MefWriter::set_auto_resolution,
+                      "Detect the ADC quantization step when precision is not given")
+        .def_property("auto_block_len", &MefWriter::get_auto_block_len,
+                      &MefWriter::set_auto_block_len,
+                      "Choose each channel's block length on its first write")
+        .def_property("block_query_seconds", &MefWriter::get_block_query_seconds,
+                      &MefWriter::set_block_query_seconds,
+                      "Typical query window in seconds for block length selection")
+        .def_property("block_latency_weight", &MefWriter::get_block_latency_weight,
+                      &MefWriter::set_block_latency_weight,
+                      "Weight of decode latency against size for block length selection")
+        .def_property("block_relative_precision", &MefWriter::get_block_relative_precision,
+                      &MefWriter::set_block_relative_precision,
+                      "Per-block relative error bound for adaptive scale factors (0 = lossless)")
+        .def_property("timestamp_tolerance", &MefWriter::get_timestamp_tolerance,
+                      &MefWriter::set_timestamp_tolerance,
+                      "Timestamp jitter tolerance in microseconds (0 = half a sample period)")
+        .def_property("block_alignment", &MefWriter::get_block_alignment,
+                      &MefWriter::set_block_alignment,
+                      "Cut blocks at multiples of this many microseconds since the epoch (0 = off)")
+        .def_property("segment_rollover_seconds", &MefWriter::get_segment_rollover_seconds,
+                      &MefWriter::set_segment_rollover_seconds,
+                      "Start a new segment after this many seconds (0 = off)")
+        .def_property("segment_rollover_bytes", &MefWriter::get_segment_rollover_bytes,
+                      &MefWriter::set_segment_rollover_bytes,
+                      "Start a new segment once the data file reaches this size (0 = off)")
+        .def_property("segment_rollover_aligned", &MefWriter::get_segment_rollover_aligned,
+                      &MefWriter::set_segment_rollover_aligned,
+                      "Align time-based rollover to multiples of the duration since the epoch")
+        .def_property("max_open_files", &MefWriter::get_max_open_files,
+                      &MefWriter::set_max_open_files,
+                      "Maximum number of simultaneously open segment data files")
+        .def_property("write_buffer_bytes", &MefWriter::get_write_buffer_bytes,
+                      &MefWriter::set_write_buffer_bytes,
+                      "Size of each data-file write buffer in bytes")
+        .def_property("direct_io", &MefWriter::get_direct_io, &MefWriter::set_direct_io,
+                      "Write segment data files with O_DIRECT where supported")
+        .def_property("io_engine", &MefWriter::get_io_engine, &MefWriter::set_io_engine,
+                      "Engine writing full data-file buffers in batches (None = direct writes)")
+        .def_property("preallocation_seconds", &MefWriter::get_preallocation_seconds,
+                      &MefWriter::set_preallocation_seconds,
+                      "Expected segment duration used to preallocate data files (0 = off)")
+        .def_property("durability_mode", &MefWriter::get_durability_mode,
+                      &MefWriter::set_durability_mode,
+                      "When written data is forced to stable storage")
+        .def_property("sync_interval", &MefWriter::get_sync_interval,
+                      &MefWriter::set_sync_interval,
+                      "Checkpoint interval in seconds for PERIODIC durability")
+        .def_property("compaction_block_len", &MefWriter::get_compaction_block_len,
+                      &MefWriter::set_compaction_block_len,
+                      "Block length of background compaction of closed segments (0 = off)")
         .def_property("recording_time_offset", &MefWriter::get_recording_time_offset,
                       &MefWriter::set_recording_time_offset,
                       "Recording time offset")
@@ -113,6 +782,7 @@ PYBIND11_MODULE(_brainmaze_mefd, m) {
             if (buf.ndim != 1) {
                 throw std::runtime_error("Data must be 1-dimensional");
             }
+            py::gil_scoped_release release;
             writer.write_data(static_cast<const sf8*>(buf.ptr), 
                               static_cast<size_t>(buf.size),
                               channel, start_uutc, sampling_freq, precision, new_segment);
@@ -120,9 +790,314 @@ PYBIND11_MODULE(_brainmaze_mefd, m) {
            py::arg("sampling_freq"), py::arg("precision") = -1, 
            py::arg("new_segment") = false,
            "Write data to a channel")
+        .def("open_channel", &MefWriter::open_channel,
+             py::arg("channel_name"), py::arg("sampling_freq"),
+             "Open a channel and return its integer handle")
+        .def("write_data", [](MefWriter& writer, MefWriter::ChannelHandle channel,
+                              py::array_t<sf8> data, si8 start_uutc,
+                              si4 precision, bool new_segment) {
+            auto buf = data.request();
+            if (buf.ndim != 1) {
+                throw std::runtime_error("Data must be 1-dimensional");
+            }
+            py::gil_scoped_release release;
+            writer.write_data(channel, static_cast<const sf8*>(buf.ptr),
+                              static_cast<size_t>(buf.size),
+                              start_uutc, precision, new_segment);
+        }, py::arg("channel"), py::arg("data"), py::arg("start_uutc"),
+           py::arg("precision") = -1, py::arg("new_segment") = false,
+           "Write data to a channel opened with open_channel()")
+        .def("write_timestamped_data", [](MefWriter& writer, MefWriter::ChannelHandle channel,
+                                          py::array_t<sf8> data, py::array_t<si8> timestamps,
+                                          si4 precision) {
+            auto buf = data.request();
+            auto ts = timestamps.request();
+            if (buf.ndim != 1 || ts.ndim != 1 || buf.size != ts.size) {
+                throw std::runtime_error("Data and timestamps must be 1-dimensional and of equal length");
+            }
+            py::gil_scoped_release release;
+            writer.write_data(channel, static_cast<const sf8*>(buf.ptr),
+                              static_cast<const si8*>(ts.ptr),
+                              static_cast<size_t>(buf.size), precision);
+        }, py::arg("channel"), py::arg("data"), py::arg("timestamps"), py::arg("precision") = -1,
+           "Write data with one timestamp per sample; gaps are detected and flagged")
+        .def("channel_writer", &MefWriter::channel_writer,
+             py::arg("channel_name"), py::arg("sampling_freq"),
+             py::keep_alive<0, 1>(),
+             "Get a writer bound to one channel, usable from its own thread")
+        .def("get_clipped_samples", &MefWriter::get_clipped_samples, py::arg("channel_name"),
+             "Number of samples clamped to the range fixed by the channel's first write")
+        .def("get_resolution_estimate", [](const MefWriter& writer, const std::string& channel) {
+            auto estimate = writer.get_resolution_estimate(channel);
+            py::dict result;
+            result["found"] = estimate.found;
+            result["resolution"] = estimate.resolution;
+            result["samples_used"] = estimate.samples_used;
+            result["expected_compression_gain"] = estimate.expected_compression_gain;
+            return result;
+        }, py::arg("channel_name"),
+           "Get the detected quantization step and expected compression gain for a channel")
+        .def("get_block_len_estimate", [](const MefWriter& writer, const std::string& channel) {
+            return block_len_estimate_dict(writer.get_block_len_estimate(channel));
+        }, py::arg("channel_name"),
+           "Get the block length chosen for a channel and the candidates evaluated")
+        .def_static("estimate_block_len", [](py::array_t<si4> data, sf8 sampling_frequency,
+                                             sf8 query_seconds, sf8 latency_weight,
+                                             const std::vector<si4>& candidates) {
+            auto buf = data.request();
+            if (buf.ndim != 1) {
+                throw std::runtime_error("Data must be 1-dimensional");
+            }
+            MefWriter::BlockLengthEstimate estimate;
+            {
+                py::gil_scoped_release release;
+                estimate = MefWriter::estimate_block_len(static_cast<const si4*>(buf.ptr),
+                                                         static_cast<size_t>(buf.size),
+                                                         sampling_frequency, query_seconds,
+                                                         latency_weight, candidates);
+            }
+            return block_len_estimate_dict(estimate);
+        }, py::arg("data"), py::arg("sampling_frequency"), py::arg("query_seconds") = 1.0,
+           py::arg("latency_weight") = 1.0, py::arg("candidates") = std::vector<si4>{},
+           "Evaluate candidate block lengths on raw samples")
+        .def("set_channel_block_len", &MefWriter::set_channel_block_len,
+             py::arg("channel"), py::arg("block_len"),
+             "Set the block length of one channel")
+        .def("get_sync_statistics", [](const MefWriter& writer) {
+            auto stats = writer.get_sync_statistics();
+            py::dict result;
+            result["sync_calls"] = stats.sync_calls;
+            result["checkpoints"] = stats.checkpoints;
+            result["sync_seconds"] = stats.sync_seconds;
+            result["max_sync_seconds"] = stats.max_sync_seconds;
+            return result;
+        }, "Get sync call counts and time spent syncing")
+        .def("get_compaction_statistics", [](const MefWriter& writer) {
+            auto stats = writer.get_compaction_statistics();
+            py::dict result;
+            result["segments"] = stats.segments;
+            result["segments_failed"] = stats.segments_failed;
+            result["segments_skipped"] = stats.segments_skipped;
+            result["blocks_before"] = stats.blocks_before;
+            result["blocks_after"] = stats.blocks_after;
+            result["bytes_before"] = stats.bytes_before;
+            result["bytes_after"] = stats.bytes_after;
+            result["seconds"] = stats.seconds;
+            return result;
+        }, "Get background compaction counters")
+        .def("write_compressed_blocks", &MefWriter::write_compressed_blocks,
+             py::arg("channel"), py::arg("blocks"), py::call_guard<py::gil_scoped_release>(),
+             "Append undecoded RED blocks to an open channel")
+        .def("write_records", &MefWriter::write_records,
+             py::arg("records"), py::arg("channel_name") = "",
+             py::call_guard<py::gil_scoped_release>(),
+             "Append records to the session, or to a channel if channel_name is given")
+        .def("write_record", &MefWriter::write_record,
+             py::arg("record"), py::arg("channel_name") = "",
+             py::call_guard<py::gil_scoped_release>(),
+             "Append one record to the session or to a channel")
+        .def("sync", &MefWriter::sync, py::call_guard<py::gil_scoped_release>(),
+             "Checkpoint all channels to stable storage")
         .def("flush", &MefWriter::flush, "Flush data to disk")
         .def("close", &MefWriter::close, "Close the session");
     
+    // Session tools
+    m.def("copy_sessions", [](const std::vector<std::string>& sources, const std::string& destination,
+                              const std::vector<std::string>& channels, py::object start,
+                              py::object end, const std::string& password, size_t threads,
+                              bool overwrite) {
+        SessionCopyOptions options;
+        options.channels = channels;
+        if (!start.is_none()) {
+            options.start_time = start.cast<si8>();
+        }
+        if (!end.is_none()) {
+            options.end_time = end.cast<si8>();
+        }
+        options.password = password;
+        options.threads = threads;
+        options.overwrite = overwrite;
+        
+        SessionCopyStatistics stats;
+        {
+            py::gil_scoped_release release;
+            stats = copy_sessions(sources, destination, options);
+        }
+        py::dict result;
+        result["channels"] = stats.channels;
+        result["blocks_copied"] = stats.blocks_copied;
+        result["blocks_decoded"] = stats.blocks_decoded;
+        result["bytes_copied"] = stats.bytes_copied;
+        result["samples"] = stats.samples;
+        result["seconds"] = stats.seconds;
+        return result;
+    }, py::arg("sources"), py::arg("destination"), py::arg("channels") = std::vector<std::string>{},
+       py::arg("start_time") = py::none(), py::arg("end_time") = py::none(),
+       py::arg("password") = "", py::arg("threads") = 0, py::arg("overwrite") = true,
+       "Slice, concatenate and subset sessions by copying compressed blocks");
+    
+    m.def("repack_session", [](const std::string& source, const std::string& destination,
+                               const std::vector<std::string>& channels, si4 block_len,
+                               sf8 block_relative_precision, const std::string& password,
+                               const std::string& password1, const std::string& password2,
+                               size_t threads, bool resume, bool auto_block_len) {
+        RepackOptions options;
+        options.channels = channels;
+        options.block_len = block_len;
+        options.block_relative_precision = block_relative_precision;
+        options.password = password;
+        options.password1 = password1;
+        options.password2 = password2;
+        options.threads = threads;
+        options.resume = resume;
+        options.auto_block_len = auto_block_len;
+        
+        RepackStatistics stats;
+        {
+            py::gil_scoped_release release;
+            stats = repack_session(source, destination, options);
+        }
+        py::dict result;
+        result["channels"] = stats.channels;
+        result["channels_skipped"] = stats.channels_skipped;
+        result["samples"] = stats.samples;
+        result["source_bytes"] = stats.source_bytes;
+        result["destination_bytes"] = stats.destination_bytes;
+        result["seconds"] = stats.seconds;
+        return result;
+    }, py::arg("source"), py::arg("destination"), py::arg("channels") = std::vector<std::string>{},
+       py::arg("block_len") = 0, py::arg("block_relative_precision") = 0.0,
+       py::arg("password") = "", py::arg("password1") = "", py::arg("password2") = "",
+       py::arg("threads") = 0, py::arg("resume") = false, py::arg("auto_block_len") = false,
+       "Re-encode a session with different block length, compression or passwords");
+    
+    m.def("compact_session", [](const std::string& session, si4 block_len) {
+        CompactionStatistics stats;
+        {
+            py::gil_scoped_release release;
+            stats = compact_session(session, block_len);
+        }
+        py::dict result;
+        result["segments"] = stats.segments;
+        result["segments_failed"] = stats.segments_failed;
+        result["segments_skipped"] = stats.segments_skipped;
+        result["blocks_before"] = stats.blocks_before;
+        result["blocks_after"] = stats.blocks_after;
+        result["bytes_before"] = stats.bytes_before;
+        result["bytes_after"] = stats.bytes_after;
+        result["seconds"] = stats.seconds;
+        return result;
+    }, py::arg("session"), py::arg("block_len"),
+       "Merge runs of small blocks of every closed segment of a session");
+    
+    // Record body decoding
+    m.def("decode_note", &decode_note, py::arg("record"), "Text of a Note or SyLg record");
+    m.def("decode_edf_annotation", [](const Record& record) {
+        auto body = decode_edf_annotation(record);
+        py::dict result;
+        result["duration"] = body.duration;
+        result["annotation"] = body.annotation;
+        return result;
+    }, py::arg("record"), "Decode an EDFA record");
+    m.def("decode_seizure", [](const Record& record) {
+        auto body = decode_seizure(record);
+        py::list channels;
+        for (const auto& channel : body.channels) {
+            py::dict entry;
+            entry["name"] = channel.name;
+            entry["onset"] = channel.onset;
+            entry["offset"] = channel.offset;
+            channels.append(entry);
+        }
+        py::dict result;
+        result["earliest_onset"] = body.earliest_onset;
+        result["latest_offset"] = body.latest_offset;
+        result["duration"] = body.duration;
+        result["onset_code"] = body.onset_code;
+        result["marker_name_1"] = body.marker_name_1;
+        result["marker_name_2"] = body.marker_name_2;
+        result["annotation"] = body.annotation;
+        result["channels"] = channels;
+        return result;
+    }, py::arg("record"), "Decode a Seiz record");
+    m.def("decode_cognitive_stimulus", [](const Record& record) {
+        auto body = decode_cognitive_stimulus(record);
+        py::dict result;
+        result["task_type"] = body.task_type;
+        result["stimulus_duration"] = body.stimulus_duration;
+        result["stimulus_type"] = body.stimulus_type;
+        result["patient_response"] = body.patient_response;
+        return result;
+    }, py::arg("record"), "Decode a CSti record");
+    m.def("decode_electrical_stimulus", [](const Record& record) {
+        auto body = decode_electrical_stimulus(record);
+        py::dict result;
+        result["amplitude"] = body.amplitude;
+        result["frequency"] = body.frequency;
+        result["pulse_width"] = body.pulse_width;
+        result["amplitude_unit_code"] = body.amplitude_unit_code;
+        result["mode_code"] = body.mode_code;
+        result["waveform"] = body.waveform;
+        result["anode"] = body.anode;
+        result["cathode"] = body.cathode;
+        return result;
+    }, py::arg("record"), "Decode an ESti record");
+    
+    // Record construction; fields use the keys returned by the decode_* functions
+    m.def("encode_note", [](si8 time, const std::string& text, bool system_log, si1 encryption) {
+        return with_encryption(encode_note(time, text, system_log ? RECORD_TYPE_SYSTEM_LOG
+                                                                  : RECORD_TYPE_NOTE), encryption);
+    }, py::arg("time"), py::arg("text"), py::arg("system_log") = false, py::arg("encryption") = 0,
+       "Build a Note (or SyLg) record");
+    m.def("encode_edf_annotation", [](si8 time, const py::dict& fields, si1 encryption) {
+        EdfAnnotationRecord body;
+        body.duration = dict_value<si8>(fields, "duration", 0);
+        body.annotation = dict_value<std::string>(fields, "annotation", "");
+        return with_encryption(encode_edf_annotation(time, body), encryption);
+    }, py::arg("time"), py::arg("fields"), py::arg("encryption") = 0, "Build an EDFA record");
+    m.def("encode_seizure", [](si8 time, const py::dict& fields, si1 encryption) {
+        SeizureRecord body;
+        body.earliest_onset = dict_value<si8>(fields, "earliest_onset", UUTC_NO_ENTRY);
+        body.latest_offset = dict_value<si8>(fields, "latest_offset", UUTC_NO_ENTRY);
+        body.duration = dict_value<si8>(fields, "duration", 0);
+        body.onset_code = dict_value<si4>(fields, "onset_code", SEIZURE_ONSET_NO_ENTRY);
+        body.marker_name_1 = dict_value<std::string>(fields, "marker_name_1", "");
+        body.marker_name_2 = dict_value<std::string>(fields, "marker_name_2", "");
+        body.annotation = dict_value<std::string>(fields, "annotation", "");
+        if (fields.contains("channels")) {
+            for (const auto& item : fields["channels"]) {
+                py::dict channel = item.cast<py::dict>();
+                SeizureChannel entry;
+                entry.name = dict_value<std::string>(channel, "name", "");
+                entry.onset = dict_value<si8>(channel, "onset", -1);
+                entry.offset = dict_value<si8>(channel, "offset", -1);
+                body.channels.push_back(entry);
+            }
+        }
+        return with_encryption(encode_seizure(time, body), encryption);
+    }, py::arg("time"), py::arg("fields"), py::arg("encryption") = 0, "Build a Seiz record");
+    m.def("encode_cognitive_stimulus", [](si8 time, const py::dict& fields, si1 encryption) {
+        CognitiveStimulusRecord body;
+        body.task_type = dict_value<std::string>(fields, "task_type", "");
+        body.stimulus_duration = dict_value<si8>(fields, "stimulus_duration", 0);
+        body.stimulus_type = dict_value<std::string>(fields, "stimulus_type", "");
+        body.patient_response = dict_value<std::string>(fields, "patient_response", "");
+        return with_encryption(encode_cognitive_stimulus(time, body), encryption);
+    }, py::arg("time"), py::arg("fields"), py::arg("encryption") = 0, "Build a CSti record");
+    m.def("encode_electrical_stimulus", [](si8 time, const py::dict& fields, si1 encryption) {
+        ElectricalStimulusRecord body;
+        body.amplitude = dict_value<sf8>(fields, "amplitude", 0.0);
+        body.frequency = dict_value<sf8>(fields, "frequency", 0.0);
+        body.pulse_width = dict_value<si8>(fields, "pulse_width", 0);
+        body.amplitude_unit_code = dict_value<si4>(fields, "amplitude_unit_code",
+                                                   STIMULUS_AMPLITUDE_UNIT_UNKNOWN);
+        body.mode_code = dict_value<si4>(fields, "mode_code", STIMULUS_MODE_UNKNOWN);
+        body.waveform = dict_value<std::string>(fields, "waveform", "");
+        body.anode = dict_value<std::string>(fields, "anode", "");
+        body.cathode = dict_value<std::string>(fields, "cathode", "");
+        return with_encryption(encode_electrical_stimulus(time, body), encryption);
+    }, py::arg("time"), py::arg("fields"), py::arg("encryption") = 0, "Build an ESti record");
+    
     // Constants
     m.attr("MEF_VERSION_MAJOR") = MEF_VERSION_MAJOR;
     m.attr("MEF_VERSION_MINOR") = MEF_VERSION_MINOR;
@@ -0,0 +1,464 @@
+/**
+ * @file block_cache.cpp
+ * @brief Shared cache of decoded RED blocks
+ */
+
+#include "brainmaze_mefd/block_cache.hpp"
+#include "brainmaze_mefd/crc.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace brainmaze_mefd {
+
+namespace {
+
+struct BlockKeyHash {
+    size_t operator()(const BlockKey& key) const {
+        size_t hash = std::hash<std::string>()(key.segment);
+        hash ^= std::hash<si8>()(key.file_offset) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+        hash ^= std::hash<si8>()(key.start_time) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+        hash ^= std::hash<ui4>()(key.block_bytes) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+};
+
+struct BlockKeyEqual {
+    bool operator()(const BlockKey& a, const BlockKey& b) const {
+        return std::tie(a.file_offset, a.start_time, a.block_bytes, a.segment) ==
+               std::tie(b.file_offset, b.start_time, b.block_bytes, b.segment);
+    }
+};
+
+si8 block_bytes(const DecodedBlock& block) {
+    return static_cast<si8>(block.samples.size() * sizeof(si4));
+}
+
+// Layout of a DiskBlockCache file
+constexpr char DISK_BLOCK_MAGIC[8] = {'M', 'E', 'F', 'D', 'B', 'L', 'K', '1'};
+constexpr size_t DISK_BLOCK_ALIGNMENT = 64;
+constexpr const char* DISK_BLOCK_EXTENSION = ".blk";
+
+struct DiskBlockHeader {
+    char magic[8];
+    si8 file_offset;
+    si8 start_time;
+    ui4 block_bytes;
+    ui4 number_of_samples;
+    ui4 segment_bytes;
+    ui4 samples_crc;
+    ui1 flags;
+    ui1 reserved[23];
+};
+static_assert(sizeof(DiskBlockHeader) == DISK_BLOCK_ALIGNMENT, "DiskBlockHeader must be 64 bytes");
+
+size_t aligned(size_t bytes) {
+    return (bytes + DISK_BLOCK_ALIGNMENT - 1) / DISK_BLOCK_ALIGNMENT * DISK_BLOCK_ALIGNMENT;
+}
+
+size_t samples_offset(size_t segment_bytes) {
+    return sizeof(DiskBlockHeader) + aligned(segment_bytes);
+}
+
+// FNV-1a; stable across runs and platforms, unlike std::hash
+ui8 disk_key_hash(const BlockKey& key) {
+    ui8 hash = 0xcbf29ce484222325ULL;
+    auto mix = [&hash](const void* data, size_t length) {
+        const ui1* bytes = static_cast<const ui1*>(data);
+        for (size_t i = 0; i < length; ++i) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ULL;
+        }
+    };
+    mix(key.segment.data(), key.segment.size());
+    mix(&key.file_offset, sizeof(key.file_offset));
+    mix(&key.start_time, sizeof(key.start_time));
+    mix(&key.block_bytes, sizeof(key.block_bytes));
+    return hash;
+}
+
+std::string hash_name(ui8 hash) {
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return name;
+}
+
+} // namespace
+
+struct BlockCache::Impl {
+    using Entry = std::pair<BlockKey, std::shared_ptr<const DecodedBlock>>;
+
+    mutable std::mutex mutex;
+    std::list<Entry> lru;   // Most recently used first
+    std::unordered_map<BlockKey, std::list<Entry>::iterator, BlockKeyHash, BlockKeyEqual> entries;
+    BlockCacheStatistics statistics;
+
+    void evict_to(si8 capacity) {
+        while (statistics.bytes > capacity && !lru.empty()) {
+            statistics.bytes -= block_bytes(*lru.back().second);
+            statistics.evictions++;
+            entries.erase(lru.back().first);
+            lru.pop_back();
+        }
+        statistics.blocks = static_cast<si8>(entries.size());
+    }
+};
+
+BlockCache::BlockCache(si8 capacity_bytes)
+    : m_impl(std::make_unique<Impl>())
+{
+    m_impl->statistics.capacity_bytes = capacity_bytes;
+}
+
+BlockCache::~BlockCache() = default;
+
+std::shared_ptr<const DecodedBlock> BlockCache::find(const BlockKey& key) {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    auto it = m_impl->entries.find(key);
+    if (it == m_impl->entries.end()) {
+        m_impl->statistics.misses++;
+        return nullptr;
+    }
+    m_impl->statistics.hits++;
+    m_impl->lru.splice(m_impl->lru.begin(), m_impl->lru, it->second);
+    return it->second->second;
+}
+
+void BlockCache::insert(const BlockKey& key, std::shared_ptr<const DecodedBlock> block) {
+    if (!block) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    si8 bytes = block_bytes(*block);
+    if (bytes > m_impl->statistics.capacity_bytes) {
+        return;
+    }
+    auto it = m_impl->entries.find(key);
+    if (it != m_impl->entries.end()) {
+        // Another reader decoded the same block first
+        m_impl->lru.splice(m_impl->lru.begin(), m_impl->lru, it->second);
+        return;
+    }
+    m_impl->lru.emplace_front(key, std::move(block));
+    m_impl->entries.emplace(key, m_impl->lru.begin());
+    m_impl->statistics.bytes += bytes;
+    m_impl->statistics.insertions++;
+    m_impl->evict_to(m_impl->statistics.capacity_bytes);
+}
+
+void BlockCache::set_capacity(si8 capacity_bytes) {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    m_impl->statistics.capacity_bytes = capacity_bytes;
+    m_impl->evict_to(capacity_bytes);
+}
+
+void BlockCache::clear() {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    m_impl->lru.clear();
+    m_impl->entries.clear();
+    m_impl->statistics.bytes = 0;
+    m_impl->statistics.blocks = 0;
+}
+
+BlockCacheStatistics BlockCache::get_statistics() const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    return m_impl->statistics;
+}
+
+struct DiskBlockCache::Impl {
+    struct Entry {
+        ui8 hash;
+        si8 file_bytes;
+    };
+
+    fs::path directory;
+    std::atomic<ui8> next_tmp{0};
+
+    // The index only tracks recency and sizes; file I/O happens outside the lock
+    mutable std::mutex mutex;
+    std::list<Entry> lru;   // Most recently used first
+    std::unordered_map<ui8, std::list<Entry>::iterator> entries;
+    BlockCacheStatistics statistics;
+
+    fs::path block_path(ui8 hash) const {
+        std::string name = hash_name(hash);
+        return directory / name.substr(0, 2) / (name + DISK_BLOCK_EXTENSION);
+    }
+
+    void touch(ui8 hash, si8 file_bytes) {
+        auto it = entries.find(hash);
+        if (it != entries.end()) {
+            statistics.bytes += file_bytes - it->second->file_bytes;
+            it->second->file_bytes = file_bytes;
+            lru.splice(lru.begin(), lru, it->second);
+        } else {
+            lru.push_front(Entry{hash, file_bytes});
+            entries.emplace(hash, lru.begin());
+            statistics.bytes += file_bytes;
+        }
+        statistics.blocks = static_cast<si8>(entries.size());
+    }
+
+    void forget(ui8 hash) {
+        auto it = entries.find(hash);
+        if (it == entries.end()) {
+            return;
+        }
+        statistics.bytes -= it->second->file_bytes;
+        lru.erase(it->second);
+        entries.erase(it);
+        statistics.blocks = static_cast<si8>(entries.size());
+    }
+
+    // Drops entries over capacity from the index; the caller removes the files
+    std::vector<fs::path> evict_to(si8 capacity) {
+        std::vector<fs::path> victims;
+        while (statistics.bytes > capacity && !lru.empty()) {
+            statistics.bytes -= lru.back().file_bytes;
+            statistics.evictions++;
+            victims.push_back(block_path(lru.back().hash));
+            entries.erase(lru.back().hash);
+            lru.pop_back();
+        }
+        statistics.blocks = static_cast<si8>(entries.size());
+        return victims;
+    }
+
+    static void remove_files(const std::vector<fs::path>& paths) {
+        std::error_code ec;
+        for (const auto& path : paths) {
+            fs::remove(path, ec);
+        }
+    }
+
+    std::shared_ptr<DecodedBlock> read_block(const fs::path& path, const BlockKey& key) const {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return nullptr;
+        }
+        DiskBlockHeader header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, DISK_BLOCK_MAGIC, sizeof(DISK_BLOCK_MAGIC)) != 0 ||
+            header.file_offset != key.file_offset || header.start_time != key.start_time ||
+            header.block_bytes != key.block_bytes || header.segment_bytes != key.segment.size()) {
+            return nullptr;
+        }
+        std::string segment(header.segment_bytes, '\0');
+        if (!file.read(segment.data(), static_cast<std::streamsize>(segment.size())) || segment != key.segment) {
+            return nullptr;
+        }
+
+        auto block = std::make_shared<DecodedBlock>();
+        block->flags = header.flags;
+        block->samples.resize(header.number_of_samples);
+        size_t sample_bytes = block->samples.size() * sizeof(si4);
+        file.seekg(static_cast<std::streamoff>(samples_offset(header.segment_bytes)));
+        if (!file.read(reinterpret_cast<char*>(block->samples.data()), static_cast<std::streamsize>(sample_bytes)) ||
+            CRC32::calculate(reinterpret_cast<const ui1*>(block->samples.data()), sample_bytes) != header.samples_crc) {
+            return nullptr;
+        }
+        return block;
+    }
+
+    bool write_block(const fs::path& path, const BlockKey& key, const DecodedBlock& block) {
+        DiskBlockHeader header{};
+        std::memcpy(header.magic, DISK_BLOCK_MAGIC, sizeof(DISK_BLOCK_MAGIC));
+        header.file_offset = key.file_offset;
+        header.start_time = key.start_time;
+        header.block_bytes = key.block_bytes;
+        header.number_of_samples = static_cast<ui4>(block.samples.size());
+        header.segment_bytes = static_cast<ui4>(key.segment.size());
+        header.samples_crc = CRC32::calculate(reinterpret_cast<const ui1*>(block.samples.data()),
+                                              block.samples.size() * sizeof(si4));
+        header.flags = block.flags;
+
+        std::error_code ec;
+        fs::create_directories(path.parent_path(), ec);
+
+        // Unique per writer, so concurrent inserts of one block do not interleave
+        std::ostringstream tmp_name;
+        tmp_name << path.filename().string() << '.' << std::this_thread::get_id() << '.' << next_tmp++ << ".tmp";
+        fs::path tmp_path = path.parent_path() / tmp_name.str();
+        {
+            std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+            std::vector<char> padding(aligned(key.segment.size()) - key.segment.size(), 0);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(key.segment.data(), static_cast<std::streamsize>(key.segment.size()));
+            file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+            file.write(reinterpret_cast<const char*>(block.samples.data()),
+                       static_cast<std::streamsize>(block.samples.size() * sizeof(si4)));
+            if (!file) {
+                file.close();
+                fs::remove(tmp_path, ec);
+                return false;
+            }
+        }
+        fs::rename(tmp_path, path, ec);
+        if (ec) {
+            fs::remove(tmp_path, ec);
+            return false;
+        }
+        return true;
+    }
+};
+
+DiskBlockCache::DiskBlockCache(const std::string& directory, si8 capacity_bytes)
+    : m_impl(std::make_unique<Impl>())
+    , m_directory(directory)
+{
+    m_impl->directory = directory;
+    m_impl->statistics.capacity_bytes = capacity_bytes;
+
+    std::error_code ec;
+    fs::create_directories(m_impl->directory, ec);
+    if (!fs::is_directory(m_impl->directory)) {
+        throw std::runtime_error("Cannot create block cache directory: " + directory);
+    }
+
+    // Index the files left by earlier runs, most recently used first
+    struct Found {
+        ui8 hash;
+        si8 file_bytes;
+        fs::file_time_type mtime;
+    };
+    std::vector<Found> found;
+    std::vector<fs::path> stale;
+    for (auto it = fs::recursive_directory_iterator(m_impl->directory, ec);
+         !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (!it->is_regular_file(ec)) {
+            continue;
+        }
+        const fs::path& path = it->path();
+        if (path.extension() == ".tmp") {
+            stale.push_back(path);
+            continue;
+        }
+        std::string stem = path.stem().string();
+        if (path.extension() != DISK_BLOCK_EXTENSION || stem.size() != 16 ||
+            stem.find_first_not_of("0123456789abcdef") != std::string::npos) {
+            continue;
+        }
+        Found entry;
+        entry.hash = std::stoull(stem, nullptr, 16);
+        entry.file_bytes = static_cast<si8>(it->file_size(ec));
+        entry.mtime = it->last_write_time(ec);
+        found.push_back(entry);
+    }
+    Impl::remove_files(stale);
+
+    std::sort(found.begin(), found.end(),
+              [](const Found& a, const Found& b) { return a.mtime < b.mtime; });
+    for (const auto& entry : found) {
+        m_impl->touch(entry.hash, entry.file_bytes);
+    }
+    Impl::remove_files(m_impl->evict_to(capacity_bytes));
+}
+
+DiskBlockCache::~DiskBlockCache() = default;
+
+std::shared_ptr<const DecodedBlock> DiskBlockCache::find(const BlockKey& key) {
+    ui8 hash = disk_key_hash(key);
+    fs::path path = m_impl->block_path(hash);
+
+    // Files written by other processes sharing the directory are picked up
+    // here as well, so the index is not consulted before reading
+    std::shared_ptr<DecodedBlock> block = m_impl->read_block(path, key);
+
+    std::error_code ec;
+    if (!block) {
+        bool corrupt = fs::exists(path, ec);
+        {
+            std::lock_guard<std::mutex> lock(m_impl->mutex);
+            m_impl->statistics.misses++;
+            if (corrupt) {
+                m_impl->forget(hash);
+            }
+        }
+        if (corrupt) {
+            // Truncated or damaged file, or a hash collision with another block
+            fs::remove(path, ec);
+        }
+        return nullptr;
+    }
+
+    // Persist recency for the next run
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    m_impl->statistics.hits++;
+    m_impl->touch(hash, static_cast<si8>(samples_offset(key.segment.size()) + block_bytes(*block)));
+    return block;
+}
+
+void DiskBlockCache::insert(const BlockKey& key, const DecodedBlock& block) {
+    ui8 hash = disk_key_hash(key);
+    si8 file_bytes = static_cast<si8>(samples_offset(key.segment.size())) + block_bytes(block);
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        if (file_bytes > m_impl->statistics.capacity_bytes) {
+            return;
+        }
+        auto it = m_impl->entries.find(hash);
+        if (it != m_impl->entries.end()) {
+            m_impl->lru.splice(m_impl->lru.begin(), m_impl->lru, it->second);
+            return;
+        }
+    }
+
+    if (!m_impl->write_block(m_impl->block_path(hash), key, block)) {
+        return;
+    }
+
+    std::vector<fs::path> victims;
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        m_impl->touch(hash, file_bytes);
+        m_impl->statistics.insertions++;
+        victims = m_impl->evict_to(m_impl->statistics.capacity_bytes);
+    }
+    Impl::remove_files(victims);
+}
+
+void DiskBlockCache::set_capacity(si8 capacity_bytes) {
+    std::vector<fs::path> victims;
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        m_impl->statistics.capacity_bytes = capacity_bytes;
+        victims = m_impl->evict_to(capacity_bytes);
+    }
+    Impl::remove_files(victims);
+}
+
+void DiskBlockCache::clear() {
+    std::vector<fs::path> paths;
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        for (const auto& entry : m_impl->lru) {
+            paths.push_back(m_impl->block_path(entry.hash));
+        }
+        m_impl->lru.clear();
+        m_impl->entries.clear();
+        m_impl->statistics.bytes = 0;
+        m_impl->statistics.blocks = 0;
+    }
+    Impl::remove_files(paths);
+}
+
+BlockCacheStatistics DiskBlockCache::get_statistics() const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    return m_impl->statistics;
+}
+
+} // namespace brainmaze_mefd
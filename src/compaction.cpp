@@ -0,0 +1,336 @@
+/**
+ * @file compaction.cpp
+ * @brief Merging of small RED blocks in closed segments
+ */
+
+#include "brainmaze_mefd/compaction.hpp"
+#include "brainmaze_mefd/constants.hpp"
+#include "brainmaze_mefd/structures.hpp"
+#include "brainmaze_mefd/red.hpp"
+#include "brainmaze_mefd/crc.hpp"
+#include "brainmaze_mefd/file_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+#endif
+
+namespace brainmaze_mefd {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Staging directory for a segment being rewritten; not a .segd, so
+// readers ignore it
+fs::path staging_path(const fs::path& segment) {
+    return fs::path(segment.string() + ".compact");
+}
+
+std::vector<ui1> read_file(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        throw std::runtime_error("Cannot open file: " + path.string());
+    }
+    std::vector<ui1> bytes(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!file) {
+        throw std::runtime_error("Cannot read file: " + path.string());
+    }
+    return bytes;
+}
+
+void write_file(const fs::path& path, const std::vector<ui1>& bytes) {
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(bytes.data()),
+                   static_cast<std::streamsize>(bytes.size()));
+        if (!file) {
+            throw std::runtime_error("Cannot write file: " + path.string());
+        }
+    }
+    FilePool::sync_path(path.string());
+}
+
+// Exchange the staging directory with the segment in one atomic rename,
+// so readers see either the old or the new files and never a mix
+bool exchange_segment(const fs::path& segment, const fs::path& staging) {
+#if defined(__linux__) && defined(SYS_renameat2)
+    return syscall(SYS_renameat2, AT_FDCWD, staging.c_str(), AT_FDCWD, segment.c_str(),
+                   RENAME_EXCHANGE) == 0;
+#else
+    (void)segment;
+    (void)staging;
+    return false;
+#endif
+}
+
+bool exchange_supported() {
+#if defined(__linux__) && defined(SYS_renameat2)
+    return true;
+#else
+    return false;
+#endif
+}
+
+} // namespace
+
+CompactionStatistics compact_segment(const std::string& segment_path, si4 target_block_len) {
+    auto started = std::chrono::steady_clock::now();
+    CompactionStatistics stats;
+    if (!exchange_supported()) {
+        stats.segments_skipped = 1;
+        return stats;
+    }
+    fs::path segment(segment_path);
+    std::string name = segment.stem().string();
+    fs::path data_path = segment / (name + ".tdat");
+    fs::path idx_path = segment / (name + ".tidx");
+    fs::path meta_path = segment / (name + ".tmet");
+
+    // Leftover staging directory of an interrupted compaction
+    fs::remove_all(staging_path(segment));
+
+    auto idx_bytes = read_file(idx_path);
+    if (idx_bytes.size() < UNIVERSAL_HEADER_BYTES) {
+        throw std::runtime_error("Invalid index file: " + idx_path.string());
+    }
+    UniversalHeader idx_header;
+    std::memcpy(&idx_header, idx_bytes.data(), UNIVERSAL_HEADER_BYTES);
+    size_t count = std::min<size_t>(
+        static_cast<size_t>(std::max<si8>(idx_header.number_of_entries, 0)),
+        (idx_bytes.size() - UNIVERSAL_HEADER_BYTES) / TIME_SERIES_INDEX_BYTES);
+    std::vector<TimeSeriesIndex> entries(count);
+    std::memcpy(entries.data(), idx_bytes.data() + UNIVERSAL_HEADER_BYTES,
+                count * TIME_SERIES_INDEX_BYTES);
+
+    // Plan runs of blocks to merge. Only blocks with the same RED scale
+    // factor are merged, and the merged block keeps it: decoded samples of
+    // such blocks are exact multiples of the factor, so re-encoding with it
+    // is lossless and lossy blocks stay coarse
+    const ui1 encrypted = RED_LEVEL_1_ENCRYPTION_MASK | RED_LEVEL_2_ENCRYPTION_MASK;
+    auto mergeable = [&](const TimeSeriesIndex& idx) {
+        return !(idx.RED_block_flags & encrypted) &&
+               idx.number_of_samples < static_cast<ui4>(std::max(target_block_len, 1));
+    };
+    std::vector<sf4> scale_factors;  // Per entry, once the data file is read
+    std::vector<std::pair<size_t, size_t>> runs;  // [first, last) entries
+    auto plan = [&]() {
+        runs.clear();
+        si8 run_samples = 0;
+        bool merges = false;
+        for (size_t i = 0; i < count; ++i) {
+            const auto& idx = entries[i];
+            bool joins = !runs.empty() && mergeable(idx) && mergeable(entries[runs.back().second - 1]) &&
+                         !(idx.RED_block_flags & (RED_DISCONTINUITY_MASK | RED_NAN_GAP_MASK)) &&
+                         run_samples + idx.number_of_samples <= static_cast<si8>(target_block_len) &&
+                         (scale_factors.empty() || scale_factors[i] == scale_factors[runs.back().first]);
+            if (joins) {
+                runs.back().second = i + 1;
+                run_samples += idx.number_of_samples;
+                merges = true;
+            } else {
+                runs.emplace_back(i, i + 1);
+                run_samples = idx.number_of_samples;
+            }
+        }
+        return merges;
+    };
+    if (!plan()) {
+        return stats;
+    }
+
+    // Blocks are read one at a time, so memory use does not grow with
+    // the segment
+    std::ifstream data_file(data_path, std::ios::binary);
+    if (!data_file) {
+        throw std::runtime_error("Cannot open file: " + data_path.string());
+    }
+    const si8 data_size = static_cast<si8>(fs::file_size(data_path));
+    std::vector<ui1> block;
+    auto read_block = [&](const TimeSeriesIndex& idx, size_t bytes) {
+        if (idx.file_offset < UNIVERSAL_HEADER_BYTES || idx.file_offset + idx.block_bytes > data_size ||
+            idx.block_bytes < RED_BLOCK_HEADER_BYTES) {
+            throw std::runtime_error("Index entry outside data file: " + data_path.string());
+        }
+        block.resize(bytes);
+        data_file.seekg(idx.file_offset);
+        data_file.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(bytes));
+        if (!data_file) {
+            throw std::runtime_error("Cannot read file: " + data_path.string());
+        }
+        return block.data();
+    };
+    scale_factors.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        REDBlockHeader header;
+        std::memcpy(&header, read_block(entries[i], RED_BLOCK_HEADER_BYTES), sizeof(header));
+        scale_factors[i] = header.scale_factor;
+    }
+    if (!plan()) {
+        return stats;
+    }
+
+    // Write the new data file into the staging directory as the runs are
+    // merged, then the new index
+    fs::path staging = staging_path(segment);
+    fs::create_directories(staging);
+    std::ofstream new_data(staging / (name + ".tdat"), std::ios::binary | std::ios::trunc);
+    std::vector<ui1> universal_header(UNIVERSAL_HEADER_BYTES);
+    data_file.seekg(0);
+    data_file.read(reinterpret_cast<char*>(universal_header.data()), UNIVERSAL_HEADER_BYTES);
+    if (!data_file) {
+        throw std::runtime_error("Cannot read file: " + data_path.string());
+    }
+    si8 new_data_size = 0;
+    auto append_data = [&](const ui1* bytes, size_t size) {
+        new_data.write(reinterpret_cast<const char*>(bytes), static_cast<std::streamsize>(size));
+        new_data_size += static_cast<si8>(size);
+    };
+    append_data(universal_header.data(), universal_header.size());
+
+    std::vector<TimeSeriesIndex> new_entries;
+    std::vector<si4> samples;
+    for (const auto& [first, last] : runs) {
+        TimeSeriesIndex entry = entries[first];
+        if (last - first == 1) {
+            const ui1* bytes = read_block(entry, entry.block_bytes);
+            entry.file_offset = new_data_size;
+            append_data(bytes, entry.block_bytes);
+            new_entries.push_back(entry);
+            continue;
+        }
+
+        samples.clear();
+        for (size_t b = first; b < last; ++b) {
+            auto result = REDCodec::decompress(read_block(entries[b], entries[b].block_bytes),
+                                               entries[b].block_bytes);
+            if (!result.success || result.samples.size() != entries[b].number_of_samples) {
+                throw std::runtime_error("Cannot decode block in: " + data_path.string());
+            }
+            samples.insert(samples.end(), result.samples.begin(), result.samples.end());
+        }
+        REDCodec::CompressionParams params;
+        params.discontinuity = (entry.RED_block_flags & RED_DISCONTINUITY_MASK) != 0;
+        params.nan_gap_samples = entry.nan_gap_samples();
+        if (scale_factors[first] > 1.0f) {
+            params.mode = RED_FIXED_SCALE_FACTOR;
+            params.scale_factor = scale_factors[first];
+        }
+        auto result = REDCodec::compress(samples.data(), static_cast<ui4>(samples.size()),
+                                         entry.start_time, params);
+        if (!result.success) {
+            throw std::runtime_error("Compression failed");
+        }
+        result.index.file_offset = new_data_size;
+        result.index.start_sample = entry.start_sample;
+        append_data(result.compressed_data.data(), result.compressed_data.size());
+        new_entries.push_back(result.index);
+    }
+    new_data.close();
+    if (!new_data) {
+        throw std::runtime_error("Cannot write file: " + (staging / (name + ".tdat")).string());
+    }
+    FilePool::sync_path((staging / (name + ".tdat")).string());
+
+    si8 max_entry_size = 0;
+    ui4 max_samples = 0;
+    for (const auto& idx : new_entries) {
+        max_entry_size = std::max(max_entry_size, static_cast<si8>(idx.block_bytes));
+        max_samples = std::max(max_samples, idx.number_of_samples);
+    }
+    size_t entries_bytes = new_entries.size() * TIME_SERIES_INDEX_BYTES;
+    idx_header.number_of_entries = static_cast<si8>(new_entries.size());
+    idx_header.maximum_entry_size = max_entry_size;
+    idx_header.body_CRC = CRC32::calculate(reinterpret_cast<const ui1*>(new_entries.data()),
+                                           entries_bytes);
+    std::vector<ui1> new_index(UNIVERSAL_HEADER_BYTES + entries_bytes);
+    std::memcpy(new_index.data(), &idx_header, UNIVERSAL_HEADER_BYTES);
+    std::memcpy(new_index.data() + UNIVERSAL_HEADER_BYTES, new_entries.data(), entries_bytes);
+
+    // Block statistics in the metadata follow the new blocks
+    auto meta_bytes = read_file(meta_path);
+    if (meta_bytes.size() >= METADATA_SECTION_2_OFFSET + sizeof(TimeSeriesMetadataSection2)) {
+        TimeSeriesMetadataSection2 meta2;
+        std::memcpy(&meta2, meta_bytes.data() + METADATA_SECTION_2_OFFSET, sizeof(meta2));
+        meta2.number_of_blocks = static_cast<si8>(new_entries.size());
+        meta2.maximum_block_bytes = max_entry_size;
+        meta2.maximum_block_samples = max_samples;
+        if (meta2.sampling_frequency > 0) {
+            meta2.block_interval = static_cast<si8>(max_samples * 1e6 / meta2.sampling_frequency);
+        }
+        std::memcpy(meta_bytes.data() + METADATA_SECTION_2_OFFSET, &meta2, sizeof(meta2));
+    }
+
+    // Complete and sync the staging copy, then swap it in
+    write_file(staging / (name + ".tidx"), new_index);
+    write_file(staging / (name + ".tmet"), meta_bytes);
+    for (const auto& entry : fs::directory_iterator(segment)) {
+        // Other files of the segment (e.g. segment records) move along
+        auto file_name = entry.path().filename().string();
+        if (file_name != name + ".tdat" && file_name != name + ".tidx" && file_name != name + ".tmet") {
+            fs::copy(entry.path(), staging / file_name, fs::copy_options::recursive);
+        }
+    }
+    FilePool::sync_directory(staging.string());
+
+    if (!exchange_segment(segment, staging)) {
+        // Replacing the files one by one would let readers pair a new data
+        // file with an old index, so the segment is left as written
+        fs::remove_all(staging);
+        stats.segments_skipped = 1;
+        return stats;
+    }
+    FilePool::sync_directory(segment.parent_path().string());
+    fs::remove_all(staging);
+
+    stats.segments = 1;
+    stats.blocks_before = static_cast<si8>(count);
+    stats.blocks_after = static_cast<si8>(new_entries.size());
+    stats.bytes_before = data_size;
+    stats.bytes_after = new_data_size;
+    stats.seconds = std::chrono::duration<sf8>(std::chrono::steady_clock::now() - started).count();
+    return stats;
+}
+
+CompactionStatistics compact_session(const std::string& session_path, si4 target_block_len) {
+    CompactionStatistics total;
+    std::vector<fs::path> segments;
+    for (const auto& channel : fs::directory_iterator(session_path)) {
+        if (!channel.is_directory() || channel.path().extension() != ".timd") {
+            continue;
+        }
+        for (const auto& segment : fs::directory_iterator(channel.path())) {
+            if (segment.is_directory() && segment.path().extension() == ".segd") {
+                segments.push_back(segment.path());
+            }
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+
+    for (const auto& segment : segments) {
+        auto stats = compact_segment(segment.string(), target_block_len);
+        total.segments += stats.segments;
+        total.segments_skipped += stats.segments_skipped;
+        total.blocks_before += stats.blocks_before;
+        total.blocks_after += stats.blocks_after;
+        total.bytes_before += stats.bytes_before;
+        total.bytes_after += stats.bytes_after;
+        total.seconds += stats.seconds;
+    }
+    return total;
+}
+
+} // namespace brainmaze_mefd
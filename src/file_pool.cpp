@@ -0,0 +1,668 @@
+/**
+ * @file file_pool.cpp
+ * @brief Bounded pool of append-only output files
+ */
+
+#include "brainmaze_mefd/file_pool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <list>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+namespace brainmaze_mefd {
+
+namespace {
+
+struct AlignedDelete {
+    void operator()(ui1* p) const {
+        ::operator delete[](p, std::align_val_t(FilePool::DIRECT_IO_ALIGNMENT));
+    }
+};
+
+using Buffer = std::unique_ptr<ui1[], AlignedDelete>;
+
+Buffer allocate_buffer(size_t bytes) {
+    return Buffer(new (std::align_val_t(FilePool::DIRECT_IO_ALIGNMENT)) ui1[bytes]);
+}
+
+} // namespace
+
+// Locking: each file's entry has its own mutex guarding its buffer and
+// offsets, so appends to different files copy and write concurrently. The
+// pool mutex guards only the bookkeeping shared between files (ids, the
+// descriptor LRU, the buffer budget, the write queue and counters) and is
+// never held across a write. Locks are taken in the order entry, submit,
+// pool; an entry is locked while holding the pool mutex only with try_lock.
+struct FilePool::Impl {
+    struct Entry {
+        std::mutex mutex;
+        FileId id = INVALID_FILE_ID;
+
+        // Guarded by the pool mutex
+        std::string path;
+        bool active = false;
+        bool direct_io = false;         // Opened with O_DIRECT; reopens keep the mode
+        std::shared_ptr<StorageFile> file;  // Open handle, if any
+        std::list<FileId>::iterator lru_position;
+
+        // Guarded by the entry mutex
+        bool resize_on_close = false;   // Preallocated or padded past the logical end
+        si8 offset = 0;                 // Bytes written to the file ahead of the buffer
+        Buffer buffer;                  // Write-combining buffer, if any
+        size_t buffered = 0;            // Bytes in the buffer (or in tail)
+        bool buffered_on_disk = false;  // Buffered bytes also written, zero-padded
+        std::vector<ui1> tail;          // Unaligned tail kept while no buffer is held
+    };
+
+    std::shared_ptr<Storage> storage;
+    Options options;
+    std::deque<Entry> files;  // Entries never move, so references outlive the pool lock
+    std::vector<FileId> free_ids;
+    std::list<FileId> lru;  // Files with an open descriptor, most recent first
+    std::vector<Buffer> free_buffers;
+    size_t buffers_allocated = 0;
+    Statistics statistics;
+    mutable std::mutex mutex;
+
+    // Full buffers waiting to be written as one batch; each keeps its
+    // handle open until then
+    struct QueuedWrite {
+        std::shared_ptr<StorageFile> file;
+        Buffer buffer;
+        si8 offset;
+        size_t length;
+    };
+    std::shared_ptr<IoEngine> io_engine;
+    std::vector<QueuedWrite> queued;
+    std::mutex submit_mutex;  // Held while a batch taken off the queue is written
+
+    void set_options(const Options& new_options) {
+        options = new_options;
+        options.max_open_files = std::max<size_t>(1, options.max_open_files);
+        // Whole alignment units, so full buffers can be written with O_DIRECT
+        size_t units = (std::max<size_t>(1, options.buffer_bytes) + DIRECT_IO_ALIGNMENT - 1) /
+                       DIRECT_IO_ALIGNMENT;
+        options.buffer_bytes = units * DIRECT_IO_ALIGNMENT;
+    }
+
+    size_t max_buffers() const {
+        return std::max<size_t>(1, options.buffer_budget_bytes / options.buffer_bytes);
+    }
+
+    // Called with the pool mutex held
+    Entry& entry_locked(FileId file) {
+        if (file < 0 || static_cast<size_t>(file) >= files.size() ||
+            !files[static_cast<size_t>(file)].active) {
+            throw std::runtime_error("Invalid file id: " + std::to_string(file));
+        }
+        return files[static_cast<size_t>(file)];
+    }
+
+    Entry& entry(FileId file) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entry_locked(file);
+    }
+
+    // Lock a file's entry and check that it is still registered
+    std::unique_lock<std::mutex> lock_entry(Entry& e) {
+        std::unique_lock<std::mutex> lock(e.mutex);
+        std::lock_guard<std::mutex> pool_lock(mutex);
+        if (!e.active) {
+            throw std::runtime_error("Invalid file id: " + std::to_string(e.id));
+        }
+        return lock;
+    }
+
+    // Lock every registered entry, in id order
+    std::vector<std::unique_lock<std::mutex>> lock_all() {
+        size_t count;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            count = files.size();
+        }
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (size_t i = 0; i < count; ++i) {
+            Entry* e;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                e = &files[i];
+            }
+            locks.emplace_back(e->mutex);
+        }
+        return locks;
+    }
+
+    // Registered entries; their mutexes must be held
+    std::vector<Entry*> active_entries() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<Entry*> active;
+        for (auto& e : files) {
+            if (e.active) {
+                active.push_back(&e);
+            }
+        }
+        return active;
+    }
+
+    // Called with the pool mutex held. Evicted handles stay valid for any
+    // write still using them; their descriptors close once it finishes.
+    void close_descriptor(Entry& e) {
+        if (e.file) {
+            e.file.reset();
+            lru.erase(e.lru_position);
+        }
+    }
+
+    void evict_descriptors(size_t keep) {
+        while (lru.size() > keep) {
+            close_descriptor(files[static_cast<size_t>(lru.back())]);
+        }
+    }
+
+    // Open with O_DIRECT if requested, falling back to buffered I/O on
+    // file systems that refuse it
+    std::shared_ptr<StorageFile> open_file(const std::string& path, bool truncate, bool direct_io) {
+        auto mode = truncate ? Storage::OpenMode::TRUNCATE : Storage::OpenMode::WRITE;
+        if (direct_io) {
+            try {
+                return storage->open(path, mode, true);
+            } catch (const std::runtime_error&) {
+            }
+        }
+        return storage->open(path, mode, false);
+    }
+
+    // Handle of a file, reopened if it was evicted
+    std::shared_ptr<StorageFile> handle(Entry& e) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (e.file) {
+            lru.splice(lru.begin(), lru, e.lru_position);
+            return e.file;
+        }
+        // The mode the file was written in so far, not the current option:
+        // a file written at unaligned offsets cannot continue with O_DIRECT
+        evict_descriptors(options.max_open_files - 1);
+        e.file = open_file(e.path, false, e.direct_io);
+        e.direct_io = e.file->direct_io();
+        lru.push_front(e.id);
+        e.lru_position = lru.begin();
+        statistics.reopens++;
+        return e.file;
+    }
+
+    void count_writes(si8 calls, si8 bytes, si8 batches = 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        statistics.write_calls += calls;
+        statistics.bytes_written += bytes;
+        statistics.write_batches += batches;
+    }
+
+    // Write buffered bytes. With O_DIRECT only whole alignment units leave
+    // the buffer; the remaining tail stays buffered and, when complete is
+    // set, is also written zero-padded so it reaches the file now.
+    // Called with the entry mutex held.
+    void write_out(Entry& e, bool complete) {
+        if (e.buffered == 0 || !e.buffer || (e.buffered_on_disk && complete)) {
+            return;
+        }
+        auto file = handle(e);
+
+        size_t aligned = file->direct_io() ? e.buffered - e.buffered % DIRECT_IO_ALIGNMENT : e.buffered;
+        if (aligned > 0) {
+            file->pwrite(e.buffer.get(), aligned, e.offset);
+            count_writes(1, static_cast<si8>(aligned));
+            e.offset += static_cast<si8>(aligned);
+            e.buffered -= aligned;
+            std::memmove(e.buffer.get(), e.buffer.get() + aligned, e.buffered);
+            e.buffered_on_disk = false;
+        }
+        if (complete && e.buffered > 0) {
+            size_t padded = DIRECT_IO_ALIGNMENT;
+            std::memset(e.buffer.get() + e.buffered, 0, padded - e.buffered);
+            file->pwrite(e.buffer.get(), padded, e.offset);
+            count_writes(1, static_cast<si8>(padded));
+            e.buffered_on_disk = true;
+            e.resize_on_close = true;
+        }
+    }
+
+    // Write a batch through the engine, or one request at a time without one
+    void submit(std::vector<IoEngine::Request>& requests, const std::shared_ptr<IoEngine>& engine) {
+        si8 bytes = 0;
+        if (engine) {
+            engine->write(requests);
+        } else {
+            for (auto& request : requests) {
+                request.file->pwrite(request.data, request.length, request.offset);
+            }
+        }
+        for (const auto& request : requests) {
+            bytes += static_cast<si8>(request.length);
+        }
+        count_writes(static_cast<si8>(requests.size()), bytes, engine ? 1 : 0);
+    }
+
+    // Write every queued buffer. Batches are written one at a time, so
+    // when this returns everything queued before the call is written.
+    void submit_queued() {
+        std::lock_guard<std::mutex> submit_lock(submit_mutex);
+        std::vector<QueuedWrite> writes;
+        std::shared_ptr<IoEngine> engine;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queued.empty()) {
+                return;
+            }
+            writes = std::move(queued);
+            queued.clear();
+            engine = io_engine;
+        }
+        std::vector<IoEngine::Request> requests(writes.size());
+        for (size_t i = 0; i < writes.size(); ++i) {
+            requests[i].file = writes[i].file.get();
+            requests[i].data = writes[i].buffer.get();
+            requests[i].length = writes[i].length;
+            requests[i].offset = writes[i].offset;
+        }
+        std::exception_ptr error;
+        try {
+            submit(requests, engine);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& write : writes) {
+                return_buffer(std::move(write.buffer));
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Hand a full buffer to the queue instead of writing it now. Called
+    // with the entry mutex held.
+    void queue_buffer(Entry& e) {
+        auto file = handle(e);
+        bool full;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued.push_back({std::move(file), std::move(e.buffer), e.offset, e.buffered});
+            full = io_engine && queued.size() >= io_engine->get_options().queue_depth;
+        }
+        e.offset += static_cast<si8>(e.buffered);
+        e.buffered = 0;
+        e.buffered_on_disk = false;
+        if (full) {
+            submit_queued();
+        }
+    }
+
+    // Write out and release the buffers of all files; every entry mutex
+    // must be held. With an engine, the bytes write_out() would write go
+    // out as batches of at most max_open_files requests.
+    void write_out_all() {
+        submit_queued();
+        auto entries = active_entries();
+        std::shared_ptr<IoEngine> engine;
+        size_t batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            engine = io_engine;
+            batch = options.max_open_files;
+        }
+        if (!engine) {
+            for (Entry* e : entries) {
+                write_out(*e, true);
+                release_buffer(*e);
+            }
+            return;
+        }
+
+        std::vector<Entry*> pending;
+        for (Entry* e : entries) {
+            if (e->buffer && e->buffered > 0 && !e->buffered_on_disk) {
+                pending.push_back(e);
+            } else {
+                release_buffer(*e);
+            }
+        }
+        for (size_t begin = 0; begin < pending.size(); begin += batch) {
+            size_t end = std::min(pending.size(), begin + batch);
+            std::vector<std::shared_ptr<StorageFile>> handles;
+            std::vector<IoEngine::Request> requests(end - begin);
+            for (size_t i = begin; i < end; ++i) {
+                Entry& e = *pending[i];
+                handles.push_back(handle(e));
+                size_t aligned = handles.back()->direct_io() ? e.buffered - e.buffered % DIRECT_IO_ALIGNMENT : e.buffered;
+                size_t length = aligned;
+                if (aligned < e.buffered) {
+                    // The O_DIRECT tail goes out zero-padded, as in write_out()
+                    length += DIRECT_IO_ALIGNMENT;
+                    std::memset(e.buffer.get() + e.buffered, 0, length - e.buffered);
+                }
+                requests[i - begin].file = handles.back().get();
+                requests[i - begin].data = e.buffer.get();
+                requests[i - begin].length = length;
+                requests[i - begin].offset = e.offset;
+            }
+            submit(requests, engine);
+            for (size_t i = begin; i < end; ++i) {
+                Entry& e = *pending[i];
+                size_t aligned = handles[i - begin]->direct_io() ? e.buffered - e.buffered % DIRECT_IO_ALIGNMENT : e.buffered;
+                e.offset += static_cast<si8>(aligned);
+                e.buffered -= aligned;
+                std::memmove(e.buffer.get(), e.buffer.get() + aligned, e.buffered);
+                e.buffered_on_disk = e.buffered > 0;
+                if (e.buffered_on_disk) {
+                    e.resize_on_close = true;
+                }
+                release_buffer(e);
+            }
+        }
+    }
+
+    // Called with the pool mutex held. Buffers allocated past the budget
+    // while every other buffer was in use are freed.
+    void return_buffer(Buffer buffer) {
+        if (buffers_allocated > max_buffers()) {
+            buffers_allocated--;
+        } else {
+            free_buffers.push_back(std::move(buffer));
+        }
+    }
+
+    // Called with the entry mutex held
+    void release_buffer(Entry& e) {
+        if (e.buffer) {
+            e.tail.assign(e.buffer.get(), e.buffer.get() + e.buffered);
+            std::lock_guard<std::mutex> lock(mutex);
+            return_buffer(std::move(e.buffer));
+        }
+    }
+
+    // Called with the entry mutex held
+    void acquire_buffer(Entry& e) {
+        Buffer buffer;
+        while (!buffer) {
+            bool drain_queue = false;
+            Entry* victim = nullptr;
+            std::unique_lock<std::mutex> victim_lock;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!free_buffers.empty()) {
+                    buffer = std::move(free_buffers.back());
+                    free_buffers.pop_back();
+                    break;
+                }
+                if (buffers_allocated < max_buffers()) {
+                    buffers_allocated++;
+                    buffer = allocate_buffer(options.buffer_bytes);
+                    break;
+                }
+                if (!queued.empty()) {
+                    // Budget exhausted: writing the queue frees its buffers
+                    drain_queue = true;
+                } else {
+                    // Budget exhausted: write out the fullest buffer of a
+                    // file no other thread is using and take it over
+                    for (auto& other : files) {
+                        if (&other == &e || !other.active) {
+                            continue;
+                        }
+                        std::unique_lock<std::mutex> other_lock(other.mutex, std::try_to_lock);
+                        if (other_lock.owns_lock() && other.buffer &&
+                            (!victim || other.buffered > victim->buffered)) {
+                            victim = &other;
+                            victim_lock = std::move(other_lock);
+                        }
+                    }
+                    if (!victim) {
+                        // Every buffer is in use by another thread; go over
+                        // budget rather than wait for one
+                        buffers_allocated++;
+                        buffer = allocate_buffer(options.buffer_bytes);
+                        break;
+                    }
+                }
+            }
+            if (drain_queue) {
+                submit_queued();
+            } else {
+                write_out(*victim, true);
+                release_buffer(*victim);
+            }
+        }
+
+        std::memcpy(buffer.get(), e.tail.data(), e.tail.size());
+        e.tail.clear();
+        e.buffer = std::move(buffer);
+    }
+};
+
+FilePool::FilePool() : FilePool(Options{}) {}
+
+FilePool::FilePool(const Options& options) : FilePool(options, nullptr) {}
+
+FilePool::FilePool(const Options& options, std::shared_ptr<Storage> storage)
+    : m_impl(std::make_unique<Impl>())
+{
+    m_impl->storage = storage ? std::move(storage) : posix_storage();
+    m_impl->set_options(options);
+}
+
+FilePool::~FilePool() {
+    for (size_t i = 0; i < m_impl->files.size(); ++i) {
+        if (m_impl->files[i].active) {
+            try {
+                close(static_cast<FileId>(i));
+            } catch (...) {
+                // Ignore exceptions in destructor
+            }
+        }
+    }
+}
+
+FilePool::FileId FilePool::create(const std::string& path, si8 expected_bytes) {
+    FileId file;
+    Impl::Entry* e;
+    bool direct_io;
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        if (!m_impl->free_ids.empty()) {
+            file = m_impl->free_ids.back();
+            m_impl->free_ids.pop_back();
+        } else {
+            file = static_cast<FileId>(m_impl->files.size());
+            m_impl->files.emplace_back();
+        }
+        e = &m_impl->files[static_cast<size_t>(file)];
+        direct_io = m_impl->options.direct_io;
+    }
+
+    // The id is not handed out yet, so the entry is ours alone
+    std::lock_guard<std::mutex> entry_lock(e->mutex);
+    std::shared_ptr<StorageFile> handle;
+    try {
+        handle = m_impl->open_file(path, true, direct_io);
+    } catch (const std::runtime_error& error) {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        m_impl->free_ids.push_back(file);
+        throw std::runtime_error(std::string("Cannot create file: ") + error.what());
+    }
+    e->resize_on_close = false;
+    e->offset = 0;
+    e->buffer.reset();
+    e->buffered = 0;
+    e->buffered_on_disk = false;
+    e->tail.clear();
+    if (expected_bytes > 0 && handle->preallocate(expected_bytes)) {
+        e->resize_on_close = true;
+    }
+
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    if (e->resize_on_close) {
+        m_impl->statistics.preallocated_bytes += expected_bytes;
+    }
+    m_impl->evict_descriptors(m_impl->options.max_open_files - 1);
+    e->id = file;
+    e->path = path;
+    e->direct_io = handle->direct_io();
+    e->file = std::move(handle);
+    e->active = true;
+    m_impl->lru.push_front(file);
+    e->lru_position = m_impl->lru.begin();
+    return file;
+}
+
+void FilePool::append(FileId file, const void* data, size_t length) {
+    auto& e = m_impl->entry(file);
+    auto lock = m_impl->lock_entry(e);
+    size_t capacity;
+    bool queue;
+    {
+        std::lock_guard<std::mutex> pool_lock(m_impl->mutex);
+        capacity = m_impl->options.buffer_bytes;
+        queue = m_impl->io_engine != nullptr;
+    }
+
+    const ui1* bytes = static_cast<const ui1*>(data);
+    while (length > 0) {
+        if (!e.buffer) {
+            m_impl->acquire_buffer(e);
+        }
+        size_t chunk = std::min(length, capacity - e.buffered);
+        std::memcpy(e.buffer.get() + e.buffered, bytes, chunk);
+        e.buffered += chunk;
+        e.buffered_on_disk = false;
+        bytes += chunk;
+        length -= chunk;
+        if (e.buffered == capacity) {
+            if (queue) {
+                m_impl->queue_buffer(e);
+            } else {
+                m_impl->write_out(e, false);
+            }
+        }
+    }
+}
+
+si8 FilePool::size(FileId file) const {
+    auto& e = m_impl->entry(file);
+    auto lock = m_impl->lock_entry(e);
+    return e.offset + static_cast<si8>(e.buffered);
+}
+
+void FilePool::flush(FileId file) {
+    auto& e = m_impl->entry(file);
+    auto lock = m_impl->lock_entry(e);
+    m_impl->submit_queued();
+    m_impl->write_out(e, true);
+    m_impl->release_buffer(e);
+}
+
+void FilePool::flush_all() {
+    auto locks = m_impl->lock_all();
+    m_impl->write_out_all();
+}
+
+void FilePool::close(FileId file) {
+    auto& e = m_impl->entry(file);
+    auto lock = m_impl->lock_entry(e);
+    m_impl->submit_queued();
+    m_impl->write_out(e, true);
+    if (e.resize_on_close) {
+        // Drop preallocated extents and O_DIRECT padding past the logical end
+        m_impl->handle(e)->truncate(e.offset + static_cast<si8>(e.buffered));
+    }
+    m_impl->release_buffer(e);
+    e.tail.clear();
+    std::lock_guard<std::mutex> pool_lock(m_impl->mutex);
+    m_impl->close_descriptor(e);
+    e.active = false;
+    m_impl->free_ids.push_back(file);
+}
+
+void FilePool::sync(FileId file) {
+    auto& e = m_impl->entry(file);
+    auto lock = m_impl->lock_entry(e);
+    m_impl->submit_queued();
+    m_impl->write_out(e, true);
+    m_impl->handle(e)->sync();
+}
+
+void FilePool::sync_path(const std::string& path) {
+#ifdef _WIN32
+    // _commit needs a descriptor open for writing
+    if (!posix_storage()->exists(path)) {
+        throw std::runtime_error("Cannot open file for sync: " + path);
+    }
+    posix_storage()->open(path, Storage::OpenMode::WRITE)->sync();
+#else
+    posix_storage()->open(path, Storage::OpenMode::READ)->sync();
+#endif
+}
+
+void FilePool::sync_directory(const std::string& path) {
+    posix_storage()->sync_directory(path);
+}
+
+void FilePool::set_max_open_files(size_t max_open_files) {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    m_impl->options.max_open_files = std::max<size_t>(1, max_open_files);
+    m_impl->evict_descriptors(m_impl->options.max_open_files);
+}
+
+size_t FilePool::get_max_open_files() const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    return m_impl->options.max_open_files;
+}
+
+void FilePool::set_options(const Options& options) {
+    auto locks = m_impl->lock_all();
+    m_impl->write_out_all();
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    m_impl->free_buffers.clear();
+    m_impl->buffers_allocated = 0;
+    m_impl->set_options(options);
+    m_impl->evict_descriptors(m_impl->options.max_open_files);
+}
+
+void FilePool::set_io_engine(std::shared_ptr<IoEngine> engine) {
+    auto locks = m_impl->lock_all();
+    m_impl->submit_queued();
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    m_impl->io_engine = std::move(engine);
+}
+
+std::shared_ptr<IoEngine> FilePool::get_io_engine() const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    return m_impl->io_engine;
+}
+
+FilePool::Options FilePool::get_options() const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    return m_impl->options;
+}
+
+FilePool::Statistics FilePool::get_statistics() const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    Statistics stats = m_impl->statistics;
+    stats.open_files = m_impl->lru.size();
+    stats.files = m_impl->files.size() - m_impl->free_ids.size();
+    stats.direct_io_files = 0;
+    for (const auto& e : m_impl->files) {
+        if (e.active && e.direct_io) {
+            stats.direct_io_files++;
+        }
+    }
+    return stats;
+}
+
+} // namespace brainmaze_mefd
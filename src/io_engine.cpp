@@ -0,0 +1,632 @@
+/**
+ * @file io_engine.cpp
+ * @brief Asynchronous batched file I/O
+ */
+
+#include "brainmaze_mefd/io_engine.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#if defined(__NR_io_uring_setup) && defined(IO_URING_OP_SUPPORTED)
+#define BRAINMAZE_MEFD_IO_URING 1
+#endif
+#endif
+
+namespace brainmaze_mefd {
+
+namespace {
+
+// Counters of one batch, merged into the engine's statistics at its end
+struct BatchCounters {
+    si8 requests = 0;
+    si8 bytes = 0;
+    si8 submissions = 0;
+    si8 submitted_requests = 0;
+    sf8 depth_sum = 0.0;
+    si8 max_depth = 0;
+
+    void submitted(size_t in_flight) {
+        submitted_requests++;
+        depth_sum += static_cast<sf8>(in_flight);
+        max_depth = std::max(max_depth, static_cast<si8>(in_flight));
+    }
+};
+
+#ifdef BRAINMAZE_MEFD_IO_URING
+
+// Clamp a request to the end of files that share a descriptor with others
+// (e.g. files of an archive), so reads stop at the file's end
+size_t native_length(const IoEngine::Request& request) {
+    if (request.file->native_offset() == 0) {
+        return request.length;
+    }
+    si8 available = std::max<si8>(0, request.file->size() - request.offset);
+    return static_cast<size_t>(std::min<si8>(available, static_cast<si8>(request.length)));
+}
+
+// Submission and completion rings of one io_uring instance, driven with
+// raw system calls
+class Ring {
+public:
+    explicit Ring(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd < 0) {
+            throw std::runtime_error(std::string("Cannot set up io_uring: ") + std::strerror(errno));
+        }
+        m_entries = params.sq_entries;
+
+        m_sq_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            m_sq_bytes = m_cq_bytes = std::max(m_sq_bytes, m_cq_bytes);
+        }
+        m_sq = map(m_sq_bytes, IORING_OFF_SQ_RING);
+        m_cq = single_mmap ? m_sq : map(m_cq_bytes, IORING_OFF_CQ_RING);
+        m_sqes_bytes = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = static_cast<io_uring_sqe*>(map(m_sqes_bytes, IORING_OFF_SQES));
+
+        ui1* sq = static_cast<ui1*>(m_sq);
+        m_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        ui1* cq = static_cast<ui1*>(m_cq);
+        m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    ~Ring() {
+        release();
+    }
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    unsigned entries() const { return m_entries; }
+
+    // Whether the kernel implements plain reads and writes (Linux 5.6)
+    bool supports_read_write() const {
+        constexpr unsigned OPS = 256;
+        std::vector<ui1> buffer(sizeof(io_uring_probe) + OPS * sizeof(io_uring_probe_op), 0);
+        auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, OPS) < 0) {
+            return false;
+        }
+        auto supported = [&](unsigned op) {
+            return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+        };
+        return supported(IORING_OP_READ) && supported(IORING_OP_WRITE);
+    }
+
+    void queue(ui1 opcode, int fd, void* data, size_t length, si8 offset, size_t user_data) {
+        unsigned tail = *m_sq_tail;
+        unsigned slot = tail & m_sq_mask;
+        io_uring_sqe& sqe = m_sqes[slot];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<__u64>(data);
+        sqe.len = static_cast<__u32>(length);
+        sqe.off = static_cast<__u64>(offset);
+        sqe.user_data = user_data;
+        m_sq_array[slot] = slot;
+        std::atomic_ref<unsigned>(*m_sq_tail).store(tail + 1, std::memory_order_release);
+        m_unsubmitted++;
+    }
+
+    // Submit queued entries and wait for at least one completion
+    void enter(BatchCounters& counters) {
+        while (true) {
+            int submitted = static_cast<int>(syscall(__NR_io_uring_enter, m_fd, m_unsubmitted, 1,
+                                                     IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (submitted >= 0) {
+                counters.submissions++;
+                m_unsubmitted -= static_cast<unsigned>(submitted);
+                if (m_unsubmitted == 0 || has_completion()) {
+                    return;
+                }
+            } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+            } else if (has_completion()) {
+                return;
+            }
+        }
+    }
+
+    // Take back queued entries the kernel has not consumed yet; returns
+    // how many were withdrawn
+    unsigned withdraw_unsubmitted() {
+        unsigned tail = *m_sq_tail;
+        unsigned count = tail - std::atomic_ref<unsigned>(*m_sq_head).load(std::memory_order_acquire);
+        std::atomic_ref<unsigned>(*m_sq_tail).store(tail - count, std::memory_order_release);
+        m_unsubmitted = 0;
+        return count;
+    }
+
+    // Wait for one completion without submitting; false if the wait failed
+    bool wait() {
+        while (!has_completion()) {
+            if (syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+                errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool has_completion() const {
+        return *m_cq_head != std::atomic_ref<unsigned>(*m_cq_tail).load(std::memory_order_acquire);
+    }
+
+    // Pop one completion; false if none is ready
+    bool reap(size_t& user_data, si4& result) {
+        unsigned head = *m_cq_head;
+        if (head == std::atomic_ref<unsigned>(*m_cq_tail).load(std::memory_order_acquire)) {
+            return false;
+        }
+        const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+        user_data = static_cast<size_t>(cqe.user_data);
+        result = cqe.res;
+        std::atomic_ref<unsigned>(*m_cq_head).store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // Closing the ring cancels anything still in flight
+    void release() {
+        if (m_sqes) munmap(m_sqes, m_sqes_bytes);
+        if (m_cq && m_cq != m_sq) munmap(m_cq, m_cq_bytes);
+        if (m_sq) munmap(m_sq, m_sq_bytes);
+        if (m_fd >= 0) close(m_fd);
+        m_sqes = nullptr;
+        m_cq = m_sq = nullptr;
+        m_fd = -1;
+    }
+
+    void* map(size_t bytes, off_t offset) {
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+        if (p == MAP_FAILED) {
+            int error = errno;
+            release();
+            throw std::runtime_error(std::string("Cannot map io_uring: ") + std::strerror(error));
+        }
+        return p;
+    }
+
+    int m_fd = -1;
+    unsigned m_entries = 0;
+    unsigned m_unsubmitted = 0;
+    void* m_sq = nullptr;
+    void* m_cq = nullptr;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sq_bytes = 0;
+    size_t m_cq_bytes = 0;
+    size_t m_sqes_bytes = 0;
+    unsigned* m_sq_head = nullptr;
+    unsigned* m_sq_tail = nullptr;
+    unsigned m_sq_mask = 0;
+    unsigned* m_sq_array = nullptr;
+    unsigned* m_cq_head = nullptr;
+    unsigned* m_cq_tail = nullptr;
+    unsigned m_cq_mask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+};
+
+#endif // BRAINMAZE_MEFD_IO_URING
+
+} // namespace
+
+struct IoEngine::Impl {
+    Backend backend = Backend::THREAD_POOL;
+    bool fallback = true;   // Thread pool stands in for rings that cannot be set up
+    size_t queue_depth = DEFAULT_QUEUE_DEPTH;
+    size_t threads = DEFAULT_THREADS;
+
+    // Thread pool, started on first use
+    std::mutex pool_mutex;
+    std::condition_variable pool_cv;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+#ifdef BRAINMAZE_MEFD_IO_URING
+    // Idle rings; concurrent batches each take their own
+    std::mutex rings_mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+#endif
+
+    mutable std::mutex statistics_mutex;
+    Statistics statistics;
+    sf8 depth_sum = 0.0;
+    si8 submitted_requests = 0;
+
+    ~Impl() {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            stopping = true;
+        }
+        pool_cv.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void start_workers() {
+        // Called with pool_mutex held
+        if (!workers.empty()) {
+            return;
+        }
+        size_t count = std::max<size_t>(1, threads);
+        for (size_t i = 0; i < count; ++i) {
+            workers.emplace_back([this] {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(pool_mutex);
+                        pool_cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                        if (tasks.empty()) {
+                            return;
+                        }
+                        task = std::move(tasks.front());
+                        tasks.pop_front();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    void run(std::vector<Request>& requests, bool write,
+             const std::function<void(size_t)>& on_complete) {
+        auto start = std::chrono::steady_clock::now();
+        BatchCounters counters;
+        bool native = backend == Backend::IO_URING &&
+                      std::all_of(requests.begin(), requests.end(),
+                                  [](const Request& r) { return r.file->native_handle() >= 0; });
+        std::exception_ptr error;
+        try {
+#ifdef BRAINMAZE_MEFD_IO_URING
+            // A ring that cannot be set up (e.g. memory limits) leaves the
+            // batch to the thread pool in AUTO mode
+            auto ring = native ? take_ring() : nullptr;
+            if (ring) {
+                run_ring(std::move(ring), requests, write, on_complete, counters);
+            } else {
+                run_pool(requests, write, on_complete, counters);
+            }
+#else
+            (void)native;
+            run_pool(requests, write, on_complete, counters);
+#endif
+        } catch (...) {
+            // Failed batches still count what they transferred
+            error = std::current_exception();
+        }
+        sf8 seconds = std::chrono::duration<sf8>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(statistics_mutex);
+        statistics.batches++;
+        (write ? statistics.writes : statistics.reads) += counters.requests;
+        (write ? statistics.bytes_written : statistics.bytes_read) += counters.bytes;
+        statistics.submissions += counters.submissions;
+        statistics.max_queue_depth = std::max(statistics.max_queue_depth, counters.max_depth);
+        statistics.seconds += seconds;
+        depth_sum += counters.depth_sum;
+        submitted_requests += counters.submitted_requests;
+        statistics.mean_queue_depth = submitted_requests > 0 ? depth_sum / static_cast<sf8>(submitted_requests) : 0.0;
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void run_pool(std::vector<Request>& requests, bool write,
+                  const std::function<void(size_t)>& on_complete, BatchCounters& counters) {
+        struct Batch {
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::deque<std::pair<size_t, std::exception_ptr>> completed;
+        };
+        auto batch = std::make_shared<Batch>();
+        size_t depth = std::max<size_t>(1, std::min(queue_depth, std::max<size_t>(1, threads)));
+        size_t next = 0;
+        size_t in_flight = 0;
+        std::exception_ptr error;
+
+        auto submit = [&](size_t index) {
+            Request* request = &requests[index];
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex);
+                start_workers();
+                tasks.push_back([batch, request, index, write] {
+                    std::exception_ptr failure;
+                    try {
+                        if (write) {
+                            request->file->pwrite(request->data, request->length, request->offset);
+                            request->result = request->length;
+                        } else {
+                            request->result = request->file->pread(request->data, request->length, request->offset);
+                        }
+                    } catch (...) {
+                        failure = std::current_exception();
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(batch->mutex);
+                        batch->completed.emplace_back(index, failure);
+                    }
+                    batch->cv.notify_one();
+                });
+            }
+            pool_cv.notify_one();
+            in_flight++;
+            counters.submissions++;
+            counters.submitted(in_flight);
+        };
+
+        while (true) {
+            while (!error && next < requests.size() && in_flight < depth) {
+                submit(next++);
+            }
+            if (in_flight == 0) {
+                break;
+            }
+            std::pair<size_t, std::exception_ptr> done;
+            {
+                std::unique_lock<std::mutex> lock(batch->mutex);
+                batch->cv.wait(lock, [&] { return !batch->completed.empty(); });
+                done = batch->completed.front();
+                batch->completed.pop_front();
+            }
+            in_flight--;
+            if (error) {
+                continue;
+            }
+            if (done.second) {
+                error = done.second;
+                continue;
+            }
+            counters.requests++;
+            counters.bytes += static_cast<si8>(requests[done.first].result);
+            if (on_complete) {
+                try {
+                    on_complete(done.first);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+#ifdef BRAINMAZE_MEFD_IO_URING
+    // An idle ring or a new one; null if none can be set up and the
+    // thread pool may stand in
+    std::unique_ptr<Ring> take_ring() {
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex);
+            if (!rings.empty()) {
+                auto ring = std::move(rings.back());
+                rings.pop_back();
+                return ring;
+            }
+        }
+        try {
+            return std::make_unique<Ring>(static_cast<unsigned>(std::max<size_t>(1, queue_depth)));
+        } catch (const std::runtime_error&) {
+            if (!fallback) {
+                throw;
+            }
+            return nullptr;
+        }
+    }
+
+    void return_ring(std::unique_ptr<Ring> ring) {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        rings.push_back(std::move(ring));
+    }
+
+    void run_ring(std::unique_ptr<Ring> ring, std::vector<Request>& requests, bool write,
+                  const std::function<void(size_t)>& on_complete, BatchCounters& counters) {
+        size_t depth = std::min<size_t>(queue_depth, ring->entries());
+        const ui1 opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+
+        // Short transfers are resubmitted for their remainder
+        std::vector<size_t> lengths(requests.size());
+        std::vector<size_t> retry;
+        size_t next = 0;
+        size_t in_flight = 0;
+        std::exception_ptr error;
+
+        auto finish = [&](size_t index) {
+            counters.requests++;
+            counters.bytes += static_cast<si8>(requests[index].result);
+            if (on_complete && !error) {
+                try {
+                    on_complete(index);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+        };
+        auto fail = [&](size_t index, si4 result) {
+            if (!error) {
+                error = std::make_exception_ptr(std::runtime_error(
+                    std::string(write ? "Asynchronous write failed" : "Asynchronous read failed") +
+                    " at offset " + std::to_string(requests[index].offset) + " (" +
+                    (result < 0 ? std::strerror(-result) : "no progress") + ")"));
+            }
+        };
+
+        while (true) {
+            while (!error && in_flight < depth && (!retry.empty() || next < requests.size())) {
+                size_t index;
+                if (!retry.empty()) {
+                    index = retry.back();
+                    retry.pop_back();
+                } else {
+                    index = next++;
+                    requests[index].result = 0;
+                    lengths[index] = native_length(requests[index]);
+                    if (lengths[index] == 0) {
+                        finish(index);
+                        continue;
+                    }
+                }
+                Request& request = requests[index];
+                ring->queue(opcode, request.file->native_handle(),
+                            static_cast<ui1*>(request.data) + request.result,
+                            lengths[index] - request.result,
+                            request.file->native_offset() + request.offset + static_cast<si8>(request.result),
+                            index);
+                in_flight++;
+                counters.submitted(in_flight);
+            }
+            if (in_flight == 0) {
+                break;
+            }
+
+            try {
+                ring->enter(counters);
+            } catch (...) {
+                // Closing a ring does not stop its requests, so wait for
+                // every one the kernel took before the buffers can go away
+                in_flight -= ring->withdraw_unsubmitted();
+                drain(*ring, in_flight);
+                throw;
+            }
+            size_t index;
+            si4 result;
+            while (ring->reap(index, result)) {
+                in_flight--;
+                Request& request = requests[index];
+                if (result == -EINTR || result == -EAGAIN) {
+                    retry.push_back(index);
+                } else if (result < 0 || (result == 0 && write)) {
+                    fail(index, result);
+                } else if (result == 0) {
+                    finish(index);
+                } else {
+                    request.result += static_cast<size_t>(result);
+                    if (request.result < lengths[index]) {
+                        retry.push_back(index);
+                    } else {
+                        finish(index);
+                    }
+                }
+            }
+        }
+        return_ring(std::move(ring));
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Reap and discard completions until nothing is in flight
+    static void drain(Ring& ring, size_t in_flight) {
+        while (in_flight > 0) {
+            if (!ring.wait()) {
+                // Completions still arrive in the mapped ring; poll for them
+                while (!ring.has_completion()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+            size_t index;
+            si4 result;
+            while (ring.reap(index, result)) {
+                in_flight--;
+            }
+        }
+    }
+#endif // BRAINMAZE_MEFD_IO_URING
+};
+
+IoEngine::IoEngine() : IoEngine(Options{}) {}
+
+IoEngine::IoEngine(const Options& options)
+    : m_impl(std::make_unique<Impl>())
+    , m_options(options)
+{
+    m_options.queue_depth = std::max<size_t>(1, m_options.queue_depth);
+    m_options.threads = std::max<size_t>(1, m_options.threads);
+    m_impl->queue_depth = m_options.queue_depth;
+    m_impl->threads = m_options.threads;
+
+    bool use_ring = false;
+    if (m_options.backend != Backend::THREAD_POOL) {
+        use_ring = io_uring_available();
+        if (!use_ring && m_options.backend == Backend::IO_URING) {
+            throw std::runtime_error("io_uring is not available");
+        }
+    }
+    m_impl->backend = use_ring ? Backend::IO_URING : Backend::THREAD_POOL;
+    m_impl->fallback = m_options.backend == Backend::AUTO;
+}
+
+IoEngine::~IoEngine() = default;
+
+IoEngine::Backend IoEngine::get_backend() const {
+    return m_impl->backend;
+}
+
+bool IoEngine::io_uring_available() {
+#ifdef BRAINMAZE_MEFD_IO_URING
+    static const bool available = [] {
+        try {
+            return Ring(1).supports_read_write();
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+void IoEngine::read(std::vector<Request>& requests, const std::function<void(size_t)>& on_complete) {
+    m_impl->run(requests, false, on_complete);
+}
+
+void IoEngine::write(std::vector<Request>& requests) {
+    m_impl->run(requests, true, nullptr);
+    for (const auto& request : requests) {
+        if (request.result != request.length) {
+            throw std::runtime_error("Short asynchronous write at offset " + std::to_string(request.offset));
+        }
+    }
+}
+
+IoEngine::Statistics IoEngine::get_statistics() const {
+    std::lock_guard<std::mutex> lock(m_impl->statistics_mutex);
+    return m_impl->statistics;
+}
+
+void IoEngine::reset_statistics() {
+    std::lock_guard<std::mutex> lock(m_impl->statistics_mutex);
+    m_impl->statistics = Statistics{};
+    m_impl->depth_sum = 0.0;
+    m_impl->submitted_requests = 0;
+}
+
+} // namespace brainmaze_mefd
@@ -0,0 +1,517 @@
+/**
+ * @file mef_dataset.cpp
+ * @brief Catalog of the MEF 3.0 sessions under a directory tree
+ */
+
+#include "brainmaze_mefd/mef_dataset.hpp"
+#include "brainmaze_mefd/mef_reader.hpp"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace brainmaze_mefd {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr const char* CATALOG_FILE = "mefd_dataset.catalog";
+constexpr const char* CATALOG_MAGIC = "brainmaze_mefd-catalog 1";
+
+// Run task(i) for i in [0, count) with up to `threads` tasks in flight;
+// the first exception is rethrown after the batch it occurred in
+template <typename Task>
+void run_batched(size_t count, size_t threads, Task task) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t first = 0; first < count; first += threads) {
+        size_t last = std::min(count, first + threads);
+        std::vector<std::future<void>> pending;
+        for (size_t i = first + 1; i < last; ++i) {
+            pending.push_back(std::async(std::launch::async, task, i));
+        }
+        std::exception_ptr error;
+        try {
+            task(first);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        for (auto& result : pending) {
+            try {
+                result.get();
+            } catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+// Mixes the modification times of everything a writer touches when a
+// session grows: the session directory (new channels), channel directories
+// (new segments) and the last segment and its index (new blocks)
+ui8 session_fingerprint(const fs::path& session) {
+    ui8 hash = 14695981039346656037ULL;
+    auto mix = [&](const fs::path& path) {
+        std::error_code ec;
+        auto time = fs::last_write_time(path, ec);
+        ui8 value = ec ? 0 : static_cast<ui8>(time.time_since_epoch().count());
+        hash = (hash ^ value) * 1099511628211ULL;
+    };
+
+    mix(session);
+    std::error_code ec;
+    std::vector<fs::path> channels;
+    for (const auto& entry : fs::directory_iterator(session, ec)) {
+        if (entry.is_directory() && entry.path().extension() == ".timd") {
+            channels.push_back(entry.path());
+        }
+    }
+    std::sort(channels.begin(), channels.end());
+    for (const auto& channel : channels) {
+        mix(channel);
+        fs::path last_segment;
+        for (const auto& entry : fs::directory_iterator(channel, ec)) {
+            if (entry.is_directory() && entry.path().extension() == ".segd" &&
+                (last_segment.empty() || entry.path() > last_segment)) {
+                last_segment = entry.path();
+            }
+        }
+        if (!last_segment.empty()) {
+            mix(last_segment);
+            mix(last_segment / (last_segment.stem().string() + ".tidx"));
+        }
+    }
+    return hash;
+}
+
+} // namespace
+
+// ============================================================================
+// Implementation structure
+// ============================================================================
+
+struct MefDataset::Impl {
+    // One cataloged session; spans hold the channel name in their session
+    // field until they are copied into the channel index
+    struct SessionEntry {
+        std::string relative_path;
+        ui8 fingerprint = 0;
+        std::vector<std::pair<std::string, ChannelSpan>> channels;
+    };
+
+    struct ChannelIndex {
+        std::vector<ChannelSpan> spans;   // Sorted by start time
+        std::vector<si8> max_end;         // Latest end time of spans[0..i]
+    };
+
+    struct CachedReader {
+        std::shared_ptr<MefReader> reader;
+        ui8 last_used = 0;
+    };
+
+    std::map<std::string, SessionEntry> sessions;   // Keyed by relative path
+    std::map<std::string, ChannelIndex> channels;
+
+    mutable std::mutex cache_mutex;
+    mutable std::map<std::string, CachedReader> readers;   // Keyed by session path
+    mutable ui8 use_clock = 0;
+
+    mutable std::mutex statistics_mutex;
+    mutable DatasetStatistics statistics;
+
+    fs::path catalog_path;
+};
+
+// ============================================================================
+// MefDataset
+// ============================================================================
+
+MefDataset::MefDataset(const std::string& root, const DatasetOptions& options)
+    : m_impl(std::make_unique<Impl>())
+    , m_root(root)
+    , m_options(options)
+{
+    if (!fs::is_directory(m_root)) {
+        throw std::runtime_error("Dataset root is not a directory: " + m_root);
+    }
+    m_impl->catalog_path = m_options.catalog_path.empty() ? fs::path(m_root) / CATALOG_FILE
+                                                          : fs::path(m_options.catalog_path);
+
+    // The catalog is only a cache: an unreadable or foreign file is ignored
+    // and rebuilt by the scan
+    std::ifstream file(m_impl->catalog_path);
+    std::string line;
+    if (file && std::getline(file, line) && line == CATALOG_MAGIC) {
+        std::map<std::string, Impl::SessionEntry> sessions;
+        Impl::SessionEntry* current = nullptr;
+        bool valid = true;
+        while (valid && std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string kind;
+            fields >> kind;
+            if (kind == "session") {
+                Impl::SessionEntry entry;
+                fields >> entry.fingerprint >> std::ws;
+                std::getline(fields, entry.relative_path);
+                valid = !fields.fail() && !entry.relative_path.empty();
+                current = &(sessions[entry.relative_path] = std::move(entry));
+            } else if (kind == "channel" && current) {
+                ChannelSpan span;
+                std::string name;
+                fields >> span.sampling_frequency >> span.start_time >> span.end_time >>
+                    span.number_of_samples >> std::ws;
+                std::getline(fields, name);
+                valid = !fields.fail() && !name.empty();
+                current->channels.emplace_back(name, span);
+            } else if (!line.empty()) {
+                valid = false;
+            }
+        }
+        if (valid) {
+            m_impl->sessions = std::move(sessions);
+        }
+    }
+
+    rescan();
+}
+
+MefDataset::~MefDataset() = default;
+MefDataset::MefDataset(MefDataset&& other) noexcept = default;
+MefDataset& MefDataset::operator=(MefDataset&& other) noexcept = default;
+
+size_t MefDataset::rescan() {
+    // Sessions are not searched for nested sessions
+    std::vector<std::string> found;
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(m_root, ec);
+         it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            break;
+        }
+        if (it->is_directory() && it->path().extension() == ".mefd") {
+            found.push_back(fs::relative(it->path(), m_root).generic_string());
+            it.disable_recursion_pending();
+        }
+    }
+    std::sort(found.begin(), found.end());
+
+    // Fingerprints decide which sessions must be opened
+    std::vector<Impl::SessionEntry> entries(found.size());
+    std::vector<size_t> stale;
+    size_t reused = 0;
+    for (size_t i = 0; i < found.size(); ++i) {
+        entries[i].relative_path = found[i];
+        entries[i].fingerprint = session_fingerprint(fs::path(m_root) / found[i]);
+        auto it = m_impl->sessions.find(found[i]);
+        if (it != m_impl->sessions.end() && it->second.fingerprint == entries[i].fingerprint) {
+            entries[i].channels = it->second.channels;
+            reused++;
+        } else {
+            stale.push_back(i);
+        }
+    }
+    bool removed = false;
+    for (const auto& [path, entry] : m_impl->sessions) {
+        removed = removed || !std::binary_search(found.begin(), found.end(), path);
+    }
+
+    run_batched(stale.size(), m_options.threads, [&](size_t s) {
+        auto& entry = entries[stale[s]];
+        MefReader reader((fs::path(m_root) / entry.relative_path).string(), m_options.password);
+        if (!reader.is_valid()) {
+            return;
+        }
+        for (const auto& name : reader.get_time_series_channels()) {
+            auto info = reader.get_channel_info(name);
+            if (info.number_of_samples == 0 || info.start_time == UUTC_NO_ENTRY) {
+                continue;
+            }
+            ChannelSpan span;
+            span.sampling_frequency = info.sampling_frequency;
+            span.start_time = info.start_time;
+            span.end_time = info.end_time;
+            span.number_of_samples = info.number_of_samples;
+            entry.channels.emplace_back(name, span);
+        }
+    });
+
+    // Readers of changed or removed sessions no longer match the catalog
+    {
+        std::lock_guard<std::mutex> lock(m_impl->cache_mutex);
+        for (auto it = m_impl->readers.begin(); it != m_impl->readers.end();) {
+            auto relative = fs::relative(it->first, m_root).generic_string();
+            auto pos = std::lower_bound(found.begin(), found.end(), relative);
+            bool current = pos != found.end() && *pos == relative &&
+                           std::find(stale.begin(), stale.end(),
+                                     static_cast<size_t>(pos - found.begin())) == stale.end();
+            it = current ? std::next(it) : m_impl->readers.erase(it);
+        }
+    }
+
+    m_impl->sessions.clear();
+    m_impl->channels.clear();
+    for (auto& entry : entries) {
+        for (const auto& [name, span] : entry.channels) {
+            ChannelSpan located = span;
+            located.session = (fs::path(m_root) / entry.relative_path).string();
+            m_impl->channels[name].spans.push_back(std::move(located));
+        }
+        std::string path = entry.relative_path;
+        m_impl->sessions[path] = std::move(entry);
+    }
+    for (auto& [name, index] : m_impl->channels) {
+        std::stable_sort(index.spans.begin(), index.spans.end(),
+                         [](const ChannelSpan& a, const ChannelSpan& b) {
+                             return a.start_time < b.start_time;
+                         });
+        index.max_end.resize(index.spans.size());
+        si8 max_end = std::numeric_limits<si8>::min();
+        for (size_t i = 0; i < index.spans.size(); ++i) {
+            max_end = std::max(max_end, index.spans[i].end_time);
+            index.max_end[i] = max_end;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_impl->statistics_mutex);
+        m_impl->statistics.sessions = m_impl->sessions.size();
+        m_impl->statistics.sessions_indexed += stale.size();
+        m_impl->statistics.sessions_from_catalog += reused;
+    }
+    if (m_options.save_catalog && (!stale.empty() || removed || !fs::exists(m_impl->catalog_path))) {
+        save_catalog();
+    }
+    return stale.size();
+}
+
+void MefDataset::save_catalog() const {
+    // Written next to the catalog and renamed so a concurrent open reads
+    // either the old or the new catalog
+    fs::path tmp_path = m_impl->catalog_path;
+    tmp_path += ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Cannot create catalog file: " + tmp_path.string());
+        }
+        file << CATALOG_MAGIC << '\n' << std::setprecision(17);
+        for (const auto& [path, entry] : m_impl->sessions) {
+            file << "session " << entry.fingerprint << ' ' << path << '\n';
+            for (const auto& [name, span] : entry.channels) {
+                file << "channel " << span.sampling_frequency << ' ' << span.start_time << ' '
+                     << span.end_time << ' ' << span.number_of_samples << ' ' << name << '\n';
+            }
+        }
+        file.close();
+        if (!file) {
+            throw std::runtime_error("Cannot write catalog file: " + tmp_path.string());
+        }
+    }
+    fs::rename(tmp_path, m_impl->catalog_path);
+}
+
+std::vector<MefDataset::SessionInfo> MefDataset::get_sessions() const {
+    std::vector<SessionInfo> sessions;
+    for (const auto& [path, entry] : m_impl->sessions) {
+        SessionInfo info;
+        info.path = (fs::path(m_root) / path).string();
+        for (const auto& [name, span] : entry.channels) {
+            info.channels.push_back(name);
+            if (info.start_time == UUTC_NO_ENTRY || span.start_time < info.start_time) {
+                info.start_time = span.start_time;
+            }
+            if (info.end_time == UUTC_NO_ENTRY || span.end_time > info.end_time) {
+                info.end_time = span.end_time;
+            }
+        }
+        sessions.push_back(std::move(info));
+    }
+    // Sessions without data sort last
+    std::stable_sort(sessions.begin(), sessions.end(), [](const SessionInfo& a, const SessionInfo& b) {
+        if ((a.start_time == UUTC_NO_ENTRY) != (b.start_time == UUTC_NO_ENTRY)) {
+            return b.start_time == UUTC_NO_ENTRY;
+        }
+        return a.start_time < b.start_time;
+    });
+    return sessions;
+}
+
+std::vector<std::string> MefDataset::get_channels() const {
+    std::vector<std::string> names;
+    names.reserve(m_impl->channels.size());
+    for (const auto& [name, index] : m_impl->channels) {
+        names.push_back(name);
+    }
+    return names;
+}
+
+std::vector<MefDataset::ChannelSpan> MefDataset::get_channel_spans(const std::string& channel_name,
+                                                                   const si8* start_time,
+                                                                   const si8* end_time) const {
+    auto it = m_impl->channels.find(channel_name);
+    if (it == m_impl->channels.end()) {
+        return {};
+    }
+    const auto& index = it->second;
+
+    // Spans before `first` all end before start_time; spans from `last` on
+    // all start at or after end_time
+    size_t first = 0;
+    if (start_time) {
+        first = static_cast<size_t>(std::lower_bound(index.max_end.begin(), index.max_end.end(),
+                                                     *start_time) - index.max_end.begin());
+    }
+    size_t last = index.spans.size();
+    if (end_time) {
+        last = static_cast<size_t>(std::lower_bound(index.spans.begin(), index.spans.end(), *end_time,
+                                                    [](const ChannelSpan& span, si8 t) {
+                                                        return span.start_time < t;
+                                                    }) - index.spans.begin());
+    }
+
+    std::vector<ChannelSpan> spans;
+    for (size_t i = first; i < last; ++i) {
+        if (!start_time || index.spans[i].end_time >= *start_time) {
+            spans.push_back(index.spans[i]);
+        }
+    }
+    return spans;
+}
+
+si8 MefDataset::get_start_time() const {
+    si8 start_time = UUTC_NO_ENTRY;
+    for (const auto& [name, index] : m_impl->channels) {
+        if (start_time == UUTC_NO_ENTRY || index.spans.front().start_time < start_time) {
+            start_time = index.spans.front().start_time;
+        }
+    }
+    return start_time;
+}
+
+si8 MefDataset::get_end_time() const {
+    si8 end_time = UUTC_NO_ENTRY;
+    for (const auto& [name, index] : m_impl->channels) {
+        if (end_time == UUTC_NO_ENTRY || index.max_end.back() > end_time) {
+            end_time = index.max_end.back();
+        }
+    }
+    return end_time;
+}
+
+std::vector<sf8> MefDataset::get_data(const std::string& channel_name,
+                                      const si8* start_time,
+                                      const si8* end_time) const {
+    if (m_impl->channels.count(channel_name) == 0) {
+        throw std::runtime_error("Channel not found in dataset: " + channel_name);
+    }
+    auto spans = get_channel_spans(channel_name, start_time, end_time);
+    if (spans.empty()) {
+        return {};
+    }
+    sf8 sampling_frequency = spans.front().sampling_frequency;
+    for (const auto& span : spans) {
+        if (span.sampling_frequency != sampling_frequency) {
+            throw std::runtime_error("Sampling frequency of channel " + channel_name +
+                                     " differs between sessions " + spans.front().session +
+                                     " and " + span.session);
+        }
+    }
+    sf8 period = 1e6 / sampling_frequency;
+
+    // Each session is read from where the previous one ends, as far as the
+    // catalog tells; overlaps left by rounding are trimmed when stitching
+    std::vector<si8> part_starts;
+    std::vector<const ChannelSpan*> parts;
+    si8 cursor = start_time ? std::max(*start_time, spans.front().start_time) : spans.front().start_time;
+    for (const auto& span : spans) {
+        si8 part_start = std::max(cursor, span.start_time);
+        si8 part_end = span.end_time + static_cast<si8>(period);
+        if (part_start >= part_end || (end_time && part_start >= *end_time)) {
+            continue;
+        }
+        part_starts.push_back(part_start);
+        parts.push_back(&span);
+        cursor = std::max(cursor, part_end);
+    }
+
+    // Sessions are opened through the shared reader cache and read in parallel
+    auto open_reader = [&](const std::string& path) {
+        {
+            std::lock_guard<std::mutex> lock(m_impl->cache_mutex);
+            auto it = m_impl->readers.find(path);
+            if (it != m_impl->readers.end()) {
+                it->second.last_used = ++m_impl->use_clock;
+                std::lock_guard<std::mutex> stats_lock(m_impl->statistics_mutex);
+                m_impl->statistics.reader_cache_hits++;
+                return it->second.reader;
+            }
+        }
+        auto reader = std::make_shared<MefReader>(path, m_options.password);
+        if (!reader->is_valid()) {
+            throw std::runtime_error("Cannot open session: " + path);
+        }
+        std::lock_guard<std::mutex> lock(m_impl->cache_mutex);
+        {
+            std::lock_guard<std::mutex> stats_lock(m_impl->statistics_mutex);
+            m_impl->statistics.readers_opened++;
+        }
+        auto [it, inserted] = m_impl->readers.try_emplace(path);
+        if (inserted) {
+            it->second.reader = reader;
+        }
+        it->second.last_used = ++m_impl->use_clock;
+        while (m_impl->readers.size() > std::max<size_t>(1, m_options.max_open_sessions)) {
+            auto oldest = std::min_element(m_impl->readers.begin(), m_impl->readers.end(),
+                                           [](const auto& a, const auto& b) {
+                                               return a.second.last_used < b.second.last_used;
+                                           });
+            m_impl->readers.erase(oldest);
+        }
+        return it->second.reader;
+    };
+
+    std::vector<std::vector<sf8>> data(parts.size());
+    run_batched(parts.size(), m_options.threads, [&](size_t p) {
+        auto reader = open_reader(parts[p]->session);
+        data[p] = reader->get_data(channel_name, &part_starts[p], end_time);
+    });
+
+    // Stitch on the sample grid: NaN between sessions, overlap dropped
+    std::vector<sf8> result;
+    const sf8 nan = std::numeric_limits<sf8>::quiet_NaN();
+    si8 grid_start = part_starts.empty() ? 0 : part_starts.front();
+    for (size_t p = 0; p < parts.size(); ++p) {
+        si8 offset = static_cast<si8>(std::llround(static_cast<sf8>(part_starts[p] - grid_start) / period));
+        size_t skip = 0;
+        if (offset > static_cast<si8>(result.size())) {
+            result.insert(result.end(), static_cast<size_t>(offset) - result.size(), nan);
+        } else {
+            skip = std::min(data[p].size(), result.size() - static_cast<size_t>(offset));
+        }
+        result.insert(result.end(), data[p].begin() + static_cast<std::ptrdiff_t>(skip), data[p].end());
+    }
+    return result;
+}
+
+DatasetStatistics MefDataset::get_statistics() const {
+    std::lock_guard<std::mutex> lock(m_impl->statistics_mutex);
+    return m_impl->statistics;
+}
+
+} // namespace brainmaze_mefd
@@ -7,46 +7,270 @@
 #include "brainmaze_mefd/red.hpp"
 #include "brainmaze_mefd/crc.hpp"
 #include "brainmaze_mefd/aes.hpp"
-#include <fstream>
 #include <algorithm>
 #include <stdexcept>
 #include <cstring>
+#include <cmath>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <thread>
+#include <atomic>
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 
 namespace brainmaze_mefd {
 
 namespace fs = std::filesystem;
 
+namespace {
+
+// Whether a block read at an index entry's offset is the block it describes
+bool block_matches_index(const ui1* data, size_t size, const TimeSeriesIndex& index) {
+    if (size < RED_BLOCK_HEADER_BYTES) {
+        return false;
+    }
+    REDBlockHeader header;
+    std::memcpy(&header, data, RED_BLOCK_HEADER_BYTES);
+    return header.start_time == index.start_time &&
+           header.number_of_samples == index.number_of_samples &&
+           header.block_bytes == index.block_bytes;
+}
+
+
+// Decrypt the whole 16-byte blocks of a record body in place; false if
+// the password does not grant the body's encryption level
+bool decrypt_record_body(ui1* body, size_t bytes, si1 encryption, const PasswordData& password) {
+    if (encryption <= NO_ENCRYPTION) {
+        return true;
+    }
+    if (password.access_level < encryption) {
+        return false;
+    }
+    const ui1* key = encryption == LEVEL_1_ENCRYPTION ? password.level_1_encryption_key.data()
+                                                      : password.level_2_encryption_key.data();
+    for (size_t offset = 0; offset + ENCRYPTION_BLOCK_BYTES <= bytes; offset += ENCRYPTION_BLOCK_BYTES) {
+        AES128::decrypt_with_key(body + offset, body + offset, key);
+    }
+    return true;
+}
+
+// Time of the last indexed sample of a segment
+si8 indexed_end_time(const std::vector<TimeSeriesIndex>& indices, sf8 sampling_frequency) {
+    if (indices.empty() || sampling_frequency <= 0) {
+        return UUTC_NO_ENTRY;
+    }
+    const auto& last = indices.back();
+    return last.start_time + static_cast<si8>((last.number_of_samples - 1) * 1e6 / sampling_frequency);
+}
+
+// Implicit interval tree over records sorted by time (the cgranges
+// layout): node i at level k has children i -/+ 2^(k-1), and max_end[i]
+// is the latest end time in its subtree. Returns the root level.
+si4 build_interval_tree(const std::vector<RecordInfo>& records, std::vector<si8>& max_end) {
+    si8 n = static_cast<si8>(records.size());
+    max_end.assign(records.size(), 0);
+    if (n == 0) {
+        return -1;
+    }
+    si8 last_i = 0;
+    si8 last = 0;
+    for (si8 i = 0; i < n; i += 2) {
+        last_i = i;
+        last = max_end[i] = records[i].end_time;
+    }
+    si4 k = 1;
+    for (; (si8{1} << k) <= n; ++k) {
+        si8 x = si8{1} << (k - 1);
+        si8 step = x << 2;
+        for (si8 i = (x << 1) - 1; i < n; i += step) {
+            si8 left = max_end[i - x];
+            si8 right = i + x < n ? max_end[i + x] : last;
+            max_end[i] = std::max({records[i].end_time, left, right});
+        }
+        last_i = (last_i >> k & 1) ? last_i - x : last_i + x;
+        if (last_i < n && max_end[last_i] > last) {
+            last = max_end[last_i];
+        }
+    }
+    return k - 1;
+}
+
+// Indices of the records with time < end and end_time >= start, in
+// O(log n + k); subtrees whose latest end is before start are skipped
+void query_interval_tree(const std::vector<RecordInfo>& records, const std::vector<si8>& max_end,
+                         si4 root_level, si8 start, si8 end, std::vector<size_t>& hits) {
+    if (root_level < 0) {
+        return;
+    }
+    struct Node {
+        si8 x;
+        si4 k;
+        bool left_done;
+    };
+    si8 n = static_cast<si8>(records.size());
+    Node stack[64];
+    int top = 0;
+    stack[top++] = {(si8{1} << root_level) - 1, root_level, false};
+    while (top > 0) {
+        Node z = stack[--top];
+        if (z.k <= 3) {
+            // Small subtree: scan it in order
+            si8 i0 = z.x >> z.k << z.k;
+            si8 i1 = std::min(i0 + (si8{1} << (z.k + 1)) - 1, n);
+            for (si8 i = i0; i < i1 && records[i].time < end; ++i) {
+                if (records[i].end_time >= start) {
+                    hits.push_back(static_cast<size_t>(i));
+                }
+            }
+        } else if (!z.left_done) {
+            si8 y = z.x - (si8{1} << (z.k - 1));
+            stack[top++] = {z.x, z.k, true};
+            if (y >= n || max_end[y] >= start) {
+                stack[top++] = {y, z.k - 1, false};
+            }
+        } else if (z.x < n && records[z.x].time < end) {
+            if (records[z.x].end_time >= start) {
+                hits.push_back(static_cast<size_t>(z.x));
+            }
+            stack[top++] = {z.x + (si8{1} << (z.k - 1)), z.k - 1, false};
+        }
+    }
+    std::sort(hits.begin(), hits.end());
+}
+
+} // namespace
+
+// Segment with precomputed data path and block table
+struct MefReader::SegmentRecord {
+    SegmentInfo info;
+    fs::path data_path;
+    std::string cache_id;           // Segment identity in block cache keys
+    std::vector<TimeSeriesIndex> indices;
+    std::vector<si8> block_starts;  // segment-relative first sample of each block
+    si8 first_sample = 0;           // channel-relative first sample of the segment
+};
+
+// Decoded samples that are contiguous in time
+struct MefReader::SampleSpan {
+    si8 start_time;
+    si8 number_of_samples;
+    si8 nan_gap = 0;  // NaN samples the writer dropped right before the span
+};
+
+// Block needed by a read and the samples [first, last) taken from it
+struct MefReader::BlockFetch {
+    const SegmentRecord* segment = nullptr;
+    size_t block = 0;                              // Index into the segment's block table
+    si8 first = 0;
+    si8 last = 0;
+    BlockKey key;
+    std::shared_ptr<const DecodedBlock> decoded;   // Null until found or decoded
+};
+
+// Thrown when a segment's data file no longer matches its loaded index,
+// e.g. after the segment was compacted
+struct MefReader::StaleSegment {
+    const SegmentRecord* segment;
+};
+
+// Records of one level (.rdat/.ridx pair); the index is read on first use
+struct MefReader::RecordFile {
+    fs::path base;                    // Path without extension
+    std::string channel;              // "" for session records
+    si4 segment = -1;                 // -1 for session and channel records
+    bool loaded = false;
+    si8 index_bytes = -1;             // .ridx size when loaded; a writer grows it
+    std::vector<RecordInfo> records;  // Sorted by time
+    std::vector<si8> max_end;         // Interval tree over records
+    si4 root_level = -1;
+};
+
+// Channel with its segments, indexed by ChannelHandle
+struct MefReader::ChannelRecord {
+    ChannelInfo info;
+    fs::path path;
+    std::vector<SegmentRecord> segments;
+    std::vector<RecordFile> record_files;  // Channel level first, then one per segment
+    bool has_metadata = false;
+    TimeSeriesMetadataSection2 metadata_section2;
+    MetadataSection3 metadata_section3;
+};
+
 // Internal implementation details
 struct MefReader::Impl {
     PasswordData password_data;
-    std::map<std::string, std::vector<SegmentInfo>> segment_info;
-    std::map<std::string, std::vector<std::vector<TimeSeriesIndex>>> indices;
-    std::map<std::string, TimeSeriesMetadataSection2> metadata_section2;
-    std::map<std::string, MetadataSection3> metadata_section3;
+    std::deque<ChannelRecord> channels;  // Deque keeps records in place as channels are added
+    std::map<std::string, ChannelHandle> channel_handles;
+    std::shared_mutex mutex;  // Guards channels and block tables updated by reloads and refresh()
+    RecordFile session_records;
+    std::mutex records_mutex;  // Guards lazily loaded record indices; taken before mutex
+    
+    // Serializes refresh() calls; disk reads happen under this lock only
+    mutable std::mutex refresh_mutex;
+    RefreshStatistics refresh_statistics;
+    
+    // Watch thread; the pipe wakes it up for shutdown
+    std::thread watch_thread;
+    std::atomic<bool> watch_stop{false};
+    int wake_fds[2] = {-1, -1};
+    
+    // Decoded blocks, possibly shared with other readers
+    std::shared_ptr<BlockCache> block_cache;
+    std::shared_ptr<DiskBlockCache> disk_block_cache;
+    
+    // Where the session's files live
+    std::shared_ptr<Storage> storage;
+    
+    // Batched block reads, if set
+    std::shared_ptr<IoEngine> io_engine;
 };
 
-MefReader::MefReader(const std::string& path, const std::string& password)
+MefReader::MefReader(const std::string& path, const std::string& password,
+                     std::shared_ptr<Storage> storage)
     : m_impl(std::make_unique<Impl>())
     , m_path(path)
     , m_password(password)
 {
+    m_impl->storage = storage ? std::move(storage) : posix_storage();
+    // The password opens records and blocks of either encryption level
+    if (!password.empty()) {
+        AES128::key_expansion(password.c_str(), m_impl->password_data.level_1_encryption_key.data());
+        AES128::key_expansion(password.c_str(), m_impl->password_data.level_2_encryption_key.data());
+        m_impl->password_data.access_level = LEVEL_2_ACCESS;
+    }
     m_valid = load_session();
 }
 
-MefReader::~MefReader() = default;
+MefReader::~MefReader() {
+    if (m_impl) {
+        stop_watch();
+    }
+}
 
 MefReader::MefReader(MefReader&& other) noexcept = default;
 MefReader& MefReader::operator=(MefReader&& other) noexcept = default;
 
+std::shared_ptr<Storage> MefReader::get_storage() const {
+    return m_impl->storage;
+}
+
 bool MefReader::load_session() {
     fs::path session_path(m_path);
     
     // Verify path exists and is a directory
-    if (!fs::exists(session_path)) {
+    auto& storage = *m_impl->storage;
+    if (!storage.exists(m_path)) {
         return false;
     }
     
-    if (!fs::is_directory(session_path)) {
+    if (!storage.is_directory(m_path)) {
         return false;
     }
     
@@ -56,25 +280,40 @@ bool MefReader::load_session() {
         m_session_name = m_session_name.substr(0, m_session_name.length() - 5);
     }
     
+    m_impl->session_records.base = session_path / m_session_name;
+    
     // Initialize time bounds
     m_start_time = std::numeric_limits<si8>::max();
     m_end_time = std::numeric_limits<si8>::min();
     
-    // Scan for channel directories
-    for (const auto& entry : fs::directory_iterator(session_path)) {
-        if (entry.is_directory()) {
-            std::string ext = entry.path().extension().string();
+    // Scan for channel directories (sorted so handles are deterministic)
+    std::vector<fs::path> channel_paths;
+    for (const auto& entry : storage.list(m_path)) {
+        if (entry.is_directory) {
+            std::string ext = fs::path(entry.name).extension().string();
             if (ext == ".timd") {  // Time series channel
-                if (!load_channel(entry.path())) {
-                    // Continue loading other channels
-                }
+                channel_paths.push_back(session_path / entry.name);
             }
             // Note: Video channels (.vidd) are not supported per requirements
         }
     }
+    std::sort(channel_paths.begin(), channel_paths.end());
     
-    // Update session times from channels
-    for (const auto& [name, info] : m_channels) {
+    for (const auto& channel_path : channel_paths) {
+        if (!load_channel(channel_path)) {
+            // Continue loading other channels
+        }
+    }
+    
+    update_session_times();
+    return !m_impl->channels.empty();
+}
+
+void MefReader::update_session_times() {
+    m_start_time = std::numeric_limits<si8>::max();
+    m_end_time = std::numeric_limits<si8>::min();
+    for (const auto& channel : m_impl->channels) {
+        const auto& info = channel.info;
         if (info.start_time != UUTC_NO_ENTRY && info.start_time < m_start_time) {
             m_start_time = info.start_time;
         }
@@ -89,28 +328,31 @@ bool MefReader::load_session() {
     if (m_end_time == std::numeric_limits<si8>::min()) {
         m_end_time = UUTC_NO_ENTRY;
     }
-    
-    return !m_channels.empty();
 }
 
 bool MefReader::load_channel(const fs::path& channel_path) {
+    ChannelRecord channel = read_channel(channel_path);
+    std::string channel_name = channel.info.name;
+    auto handle = static_cast<ChannelHandle>(m_impl->channels.size());
+    m_impl->channels.push_back(std::move(channel));
+    m_impl->channel_handles[channel_name] = handle;
+    return true;
+}
+
+MefReader::ChannelRecord MefReader::read_channel(const fs::path& channel_path) const {
     std::string channel_name = channel_path.stem().string();
     
-    ChannelInfo info;
+    ChannelRecord channel;
+    channel.path = channel_path;
+    ChannelInfo& info = channel.info;
     info.name = channel_name;
     info.channel_type = TIME_SERIES_CHANNEL_TYPE;
-    info.start_time = std::numeric_limits<si8>::max();
-    info.end_time = std::numeric_limits<si8>::min();
-    
-    // Initialize segment storage
-    m_impl->segment_info[channel_name] = {};
-    m_impl->indices[channel_name] = {};
     
     // Scan for segment directories
     std::vector<fs::path> segments;
-    for (const auto& entry : fs::directory_iterator(channel_path)) {
-        if (entry.is_directory() && entry.path().extension() == ".segd") {
-            segments.push_back(entry.path());
+    for (const auto& entry : m_impl->storage->list(channel_path.string())) {
+        if (entry.is_directory && fs::path(entry.name).extension() == ".segd") {
+            segments.push_back(channel_path / entry.name);
         }
     }
     
@@ -119,30 +361,45 @@ bool MefReader::load_channel(const fs::path& channel_path) {
         return a.filename().string() < b.filename().string();
     });
     
-    info.number_of_segments = static_cast<si4>(segments.size());
+    RecordFile channel_records;
+    channel_records.base = channel_path / channel_name;
+    channel_records.channel = channel_name;
+    channel.record_files.push_back(std::move(channel_records));
     
     // Load each segment
     for (const auto& seg_path : segments) {
-        if (!load_segment(seg_path, channel_name)) {
+        if (!load_segment(seg_path, channel)) {
             // Continue with other segments
         }
     }
     
+    summarize_channel(channel);
+    return channel;
+}
+
+void MefReader::summarize_channel(ChannelRecord& channel) {
+    ChannelInfo& info = channel.info;
+    info.number_of_segments = static_cast<si4>(channel.segments.size());
+    info.number_of_samples = 0;
+    info.start_time = std::numeric_limits<si8>::max();
+    info.end_time = std::numeric_limits<si8>::min();
+    
     // Aggregate segment info
-    for (const auto& seg : m_impl->segment_info[channel_name]) {
-        info.number_of_samples += seg.number_of_samples;
+    for (auto& seg : channel.segments) {
+        seg.first_sample = info.number_of_samples;
+        info.number_of_samples += seg.info.number_of_samples;
         
-        if (seg.start_time != UUTC_NO_ENTRY && seg.start_time < info.start_time) {
-            info.start_time = seg.start_time;
+        if (seg.info.start_time != UUTC_NO_ENTRY && seg.info.start_time < info.start_time) {
+            info.start_time = seg.info.start_time;
         }
-        if (seg.end_time != UUTC_NO_ENTRY && seg.end_time > info.end_time) {
-            info.end_time = seg.end_time;
+        if (seg.info.end_time != UUTC_NO_ENTRY && seg.info.end_time > info.end_time) {
+            info.end_time = seg.info.end_time;
         }
     }
     
     // Copy metadata from first segment
-    if (m_impl->metadata_section2.count(channel_name)) {
-        const auto& meta2 = m_impl->metadata_section2[channel_name];
+    if (channel.has_metadata) {
+        const auto& meta2 = channel.metadata_section2;
         info.sampling_frequency = meta2.sampling_frequency;
         info.units = std::string(meta2.units_description.data(), 
                                   std::strlen(meta2.units_description.data()));
@@ -155,13 +412,11 @@ bool MefReader::load_channel(const fs::path& channel_path) {
     if (info.end_time == std::numeric_limits<si8>::min()) {
         info.end_time = UUTC_NO_ENTRY;
     }
-    
-    m_channels[channel_name] = info;
-    return true;
 }
 
-bool MefReader::load_segment(const fs::path& segment_path, const std::string& channel_name) {
-    SegmentInfo seg_info;
+bool MefReader::load_segment(const fs::path& segment_path, ChannelRecord& channel) const {
+    SegmentRecord segment;
+    SegmentInfo& seg_info = segment.info;
     seg_info.name = segment_path.stem().string();
     
     // Parse segment number from name (format: channel_name-NNNNNN)
@@ -176,132 +431,188 @@ bool MefReader::load_segment(const fs::path& segment_path, const std::string& ch
     
     // Read metadata file
     fs::path meta_path = segment_path / (seg_info.name + ".tmet");
-    if (fs::exists(meta_path)) {
-        std::ifstream meta_file(meta_path, std::ios::binary);
-        if (meta_file) {
+    auto& storage = *m_impl->storage;
+    if (storage.exists(meta_path.string())) {
+        auto meta_file = storage.open(meta_path.string(), Storage::OpenMode::READ);
+        {
             // Read universal header
             UniversalHeader uh;
-            meta_file.read(reinterpret_cast<char*>(&uh), sizeof(uh));
+            bool has_header = meta_file->pread(&uh, sizeof(uh), 0) == sizeof(uh);
             
             seg_info.start_time = uh.start_time;
             seg_info.end_time = uh.end_time;
             
-            // Read metadata section 1
-            MetadataSection1 meta1;
-            meta_file.seekg(UNIVERSAL_HEADER_BYTES);
-            // Section 1 is implicit in the structure
+            // Identify the segment by content rather than location, so copies
+            // of a session and its mount points share cached blocks
+            if (has_header && std::any_of(uh.level_UUID.begin(), uh.level_UUID.end(),
+                                         [](ui1 byte) { return byte != 0; })) {
+                static const char hex[] = "0123456789abcdef";
+                for (ui1 byte : uh.level_UUID) {
+                    segment.cache_id += hex[byte >> 4];
+                    segment.cache_id += hex[byte & 0x0F];
+                }
+                segment.cache_id += ':' + uh.get_channel_name() + ':' + std::to_string(seg_info.segment_number);
+            }
             
             // Read time series metadata section 2
-            meta_file.seekg(METADATA_SECTION_2_OFFSET);
             TimeSeriesMetadataSection2 meta2;
-            meta_file.read(reinterpret_cast<char*>(&meta2), sizeof(meta2));
+            meta_file->pread(&meta2, sizeof(meta2), METADATA_SECTION_2_OFFSET);
             
             seg_info.number_of_samples = meta2.number_of_samples;
             seg_info.start_sample = meta2.start_sample;
             seg_info.number_of_blocks = meta2.number_of_blocks;
             
-            // Store metadata for the channel (from first segment)
-            if (!m_impl->metadata_section2.count(channel_name)) {
-                m_impl->metadata_section2[channel_name] = meta2;
-            }
-            
             // Read metadata section 3
-            meta_file.seekg(METADATA_SECTION_3_OFFSET);
             MetadataSection3 meta3;
-            meta_file.read(reinterpret_cast<char*>(&meta3), sizeof(meta3));
+            meta_file->pread(&meta3, sizeof(meta3), METADATA_SECTION_3_OFFSET);
             
-            if (!m_impl->metadata_section3.count(channel_name)) {
-                m_impl->metadata_section3[channel_name] = meta3;
+            // Store metadata for the channel (from first segment)
+            if (!channel.has_metadata) {
+                channel.metadata_section2 = meta2;
+                channel.metadata_section3 = meta3;
+                channel.has_metadata = true;
             }
         }
     }
     
-    // Read indices file
+    // Read indices file and build the block table
     fs::path idx_path = segment_path / (seg_info.name + ".tidx");
-    if (fs::exists(idx_path)) {
-        auto indices = read_indices(idx_path);
-        m_impl->indices[channel_name].push_back(indices);
+    if (storage.exists(idx_path.string())) {
+        segment.indices = read_indices(idx_path);
+    }
+    si8 block_start = 0;
+    segment.block_starts.reserve(segment.indices.size());
+    for (const auto& idx : segment.indices) {
+        segment.block_starts.push_back(block_start);
+        block_start += idx.number_of_samples;
+    }
+    if (!segment.indices.empty()) {
+        // The index is authoritative for what can be decoded
+        seg_info.number_of_samples = block_start;
+        seg_info.number_of_blocks = static_cast<si8>(segment.indices.size());
+        if (seg_info.start_time == UUTC_NO_ENTRY) {
+            seg_info.start_time = segment.indices.front().start_time;
+        }
+    } else if (seg_info.number_of_samples < 0) {
+        seg_info.number_of_samples = 0;
     }
     
-    m_impl->segment_info[channel_name].push_back(seg_info);
+    segment.data_path = segment_path / (seg_info.name + ".tdat");
+    if (segment.cache_id.empty()) {
+        segment.cache_id = segment.data_path.string();
+    }
+    RecordFile segment_records;
+    segment_records.base = segment_path / seg_info.name;
+    segment_records.channel = channel.info.name;
+    segment_records.segment = seg_info.segment_number;
+    channel.record_files.push_back(std::move(segment_records));
+    channel.segments.push_back(std::move(segment));
     return true;
 }
 
+const MefReader::ChannelRecord& MefReader::channel_record(ChannelHandle channel) const {
+    std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+    if (channel < 0 || static_cast<size_t>(channel) >= m_impl->channels.size()) {
+        throw std::runtime_error("Invalid channel handle: " + std::to_string(channel));
+    }
+    return m_impl->channels[static_cast<size_t>(channel)];
+}
+
 std::vector<TimeSeriesIndex> MefReader::read_indices(const fs::path& indices_path) const {
     std::vector<TimeSeriesIndex> indices;
     
-    std::ifstream file(indices_path, std::ios::binary);
-    if (!file) {
+    std::unique_ptr<StorageFile> file;
+    try {
+        file = m_impl->storage->open(indices_path.string(), Storage::OpenMode::READ);
+    } catch (const std::runtime_error&) {
         return indices;
     }
     
     // Read universal header
     UniversalHeader uh;
-    file.read(reinterpret_cast<char*>(&uh), sizeof(uh));
+    if (file->pread(&uh, sizeof(uh), 0) != sizeof(uh)) {
+        return indices;
+    }
     
-    si8 num_entries = uh.number_of_entries;
+    // Never trust a header that counts more entries than the file holds
+    // (e.g. a writer crashed between appending entries and syncing them)
+    si8 available = (file->size() - UNIVERSAL_HEADER_BYTES) / static_cast<si8>(sizeof(TimeSeriesIndex));
+    si8 num_entries = std::min(uh.number_of_entries, available);
     if (num_entries <= 0) {
         return indices;
     }
     
     // Read index entries
     indices.resize(static_cast<size_t>(num_entries));
-    file.read(reinterpret_cast<char*>(indices.data()), 
-              num_entries * sizeof(TimeSeriesIndex));
+    size_t read = file->pread(indices.data(), indices.size() * sizeof(TimeSeriesIndex), UNIVERSAL_HEADER_BYTES);
+    indices.resize(read / sizeof(TimeSeriesIndex));
     
     return indices;
 }
 
 std::vector<std::string> MefReader::get_channels() const {
+    std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
     std::vector<std::string> names;
-    names.reserve(m_channels.size());
-    for (const auto& [name, info] : m_channels) {
+    names.reserve(m_impl->channel_handles.size());
+    for (const auto& [name, handle] : m_impl->channel_handles) {
         names.push_back(name);
     }
     return names;
 }
 
 std::vector<std::string> MefReader::get_time_series_channels() const {
+    std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
     std::vector<std::string> names;
-    for (const auto& [name, info] : m_channels) {
-        if (info.channel_type == TIME_SERIES_CHANNEL_TYPE) {
+    for (const auto& [name, handle] : m_impl->channel_handles) {
+        if (m_impl->channels[static_cast<size_t>(handle)].info.channel_type == TIME_SERIES_CHANNEL_TYPE) {
             names.push_back(name);
         }
     }
     return names;
 }
 
-MefReader::ChannelInfo MefReader::get_channel_info(const std::string& channel_name) const {
-    auto it = m_channels.find(channel_name);
-    if (it == m_channels.end()) {
+MefReader::ChannelHandle MefReader::get_channel_handle(const std::string& channel_name) const {
+    std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+    auto it = m_impl->channel_handles.find(channel_name);
+    if (it == m_impl->channel_handles.end()) {
         throw std::runtime_error("Channel not found: " + channel_name);
     }
     return it->second;
 }
 
+MefReader::ChannelInfo MefReader::get_channel_info(const std::string& channel_name) const {
+    const auto& record = channel_record(get_channel_handle(channel_name));
+    std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+    return record.info;
+}
+
+MefReader::ChannelInfo MefReader::get_channel_info(ChannelHandle channel) const {
+    const auto& record = channel_record(channel);
+    std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+    return record.info;
+}
+
 std::vector<MefReader::SegmentInfo> MefReader::get_segments(const std::string& channel_name) const {
-    auto it = m_impl->segment_info.find(channel_name);
-    if (it == m_impl->segment_info.end()) {
-        throw std::runtime_error("Channel not found: " + channel_name);
+    const auto& channel = channel_record(get_channel_handle(channel_name));
+    std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+    std::vector<SegmentInfo> segments;
+    segments.reserve(channel.segments.size());
+    for (const auto& seg : channel.segments) {
+        segments.push_back(seg.info);
     }
-    return it->second;
+    return segments;
 }
 
 sf8 MefReader::get_numeric_property(const std::string& property_name,
                                      const std::string& channel_name) const {
     if (channel_name.empty()) {
         // Session-level properties
-        if (property_name == "start_time") return static_cast<sf8>(m_start_time);
-        if (property_name == "end_time") return static_cast<sf8>(m_end_time);
+        if (property_name == "start_time") return static_cast<sf8>(get_start_time());
+        if (property_name == "end_time") return static_cast<sf8>(get_end_time());
         if (property_name == "duration") return static_cast<sf8>(get_duration());
     } else {
         // Channel-level properties
-        auto it = m_channels.find(channel_name);
-        if (it == m_channels.end()) {
-            throw std::runtime_error("Channel not found: " + channel_name);
-        }
-        
-        const auto& info = it->second;
+        auto info = get_channel_info(channel_name);
         if (property_name == "fsamp" || property_name == "sampling_frequency") {
             return info.sampling_frequency;
         }
@@ -330,16 +641,12 @@ std::string MefReader::get_string_property(const std::string& property_name,
         if (property_name == "path") return m_path;
     } else {
         // Channel-level properties
-        auto it = m_channels.find(channel_name);
-        if (it == m_channels.end()) {
-            throw std::runtime_error("Channel not found: " + channel_name);
-        }
-        
+        auto info = get_channel_info(channel_name);
         if (property_name == "unit" || property_name == "units") {
-            return it->second.units;
+            return info.units;
         }
         if (property_name == "channel_name") {
-            return it->second.name;
+            return info.name;
         }
     }
     
@@ -349,149 +656,1101 @@ std::string MefReader::get_string_property(const std::string& property_name,
 std::vector<sf8> MefReader::get_data(const std::string& channel_name,
                                       const si8* start_time,
                                       const si8* end_time) const {
-    auto it = m_channels.find(channel_name);
-    if (it == m_channels.end()) {
-        throw std::runtime_error("Channel not found: " + channel_name);
-    }
+    return get_data(get_channel_handle(channel_name), start_time, end_time);
+}
+
+std::vector<sf8> MefReader::get_data(ChannelHandle channel,
+                                      const si8* start_time,
+                                      const si8* end_time) const {
+    // Calculate sample range from time range and get raw data with the
+    // time of each contiguous span; the channel info is taken from the
+    // same view of the channel as the samples
+    const auto& record = channel_record(channel);
+    ChannelInfo info;
+    std::vector<SampleSpan> spans;
+    auto raw = read_consistent([&] {
+        info = record.info;
+        if (info.sampling_frequency <= 0) {
+            throw std::runtime_error("Invalid sampling frequency for channel: " + info.name);
+        }
+        spans.clear();
+        si8 start_sample = start_time ? sample_at_time(record, *start_time) : 0;
+        si8 end_sample = end_time ? sample_at_time(record, *end_time) : info.number_of_samples;
+        auto samples = read_samples(record, start_sample, end_sample, &spans);
+        add_trailing_nan_gap(record, end_sample, spans);
+        return samples;
+    });
     
-    const auto& info = it->second;
-    sf8 fs = info.sampling_frequency;
-    if (fs <= 0) {
-        throw std::runtime_error("Invalid sampling frequency for channel: " + channel_name);
+    return physical_samples(info, raw, spans, start_time, end_time);
+}
+
+std::vector<std::vector<sf8>> MefReader::get_data(const std::vector<std::string>& channel_names,
+                                                   const si8* start_time,
+                                                   const si8* end_time) const {
+    std::vector<const ChannelRecord*> records;
+    records.reserve(channel_names.size());
+    for (const auto& name : channel_names) {
+        records.push_back(&channel_record(get_channel_handle(name)));
     }
     
-    // Calculate sample range from time range
-    si8 t_start = start_time ? *start_time : info.start_time;
-    si8 t_end = end_time ? *end_time : info.end_time;
-    
-    si8 start_sample = static_cast<si8>((t_start - info.start_time) * fs / 1e6);
-    si8 end_sample = static_cast<si8>((t_end - info.start_time) * fs / 1e6);
-    
-    // Clamp to valid range
-    start_sample = std::max<si8>(0, start_sample);
-    end_sample = std::min(end_sample, info.number_of_samples);
-    
-    // Get raw data
-    auto raw = get_raw_data(channel_name, start_sample, end_sample);
+    // The blocks of all channels are planned first and fetched together
+    std::vector<ChannelInfo> infos(records.size());
+    std::vector<std::vector<SampleSpan>> spans(records.size());
+    auto raw = read_consistent([&] {
+        std::vector<BlockFetch> blocks;
+        std::vector<size_t> ends;
+        std::vector<si8> end_samples;
+        for (size_t c = 0; c < records.size(); ++c) {
+            const auto& record = *records[c];
+            infos[c] = record.info;
+            if (infos[c].sampling_frequency <= 0) {
+                throw std::runtime_error("Invalid sampling frequency for channel: " + infos[c].name);
+            }
+            si8 start_sample = start_time ? sample_at_time(record, *start_time) : 0;
+            si8 end_sample = end_time ? sample_at_time(record, *end_time) : infos[c].number_of_samples;
+            plan_blocks(record, start_sample, end_sample, blocks);
+            ends.push_back(blocks.size());
+            end_samples.push_back(end_sample);
+        }
+        fetch_blocks(blocks);
+        
+        std::vector<std::vector<si4>> samples(records.size());
+        size_t begin = 0;
+        for (size_t c = 0; c < records.size(); ++c) {
+            spans[c].clear();
+            assemble_samples(blocks, begin, ends[c], samples[c], &spans[c], infos[c].sampling_frequency);
+            add_trailing_nan_gap(*records[c], end_samples[c], spans[c]);
+            begin = ends[c];
+        }
+        return samples;
+    });
     
-    // Convert to float and apply units conversion
-    std::vector<sf8> result(raw.size());
+    std::vector<std::vector<sf8>> result;
+    result.reserve(records.size());
+    for (size_t c = 0; c < records.size(); ++c) {
+        result.push_back(physical_samples(infos[c], raw[c], spans[c], start_time, end_time));
+    }
+    return result;
+}
+
+std::vector<sf8> MefReader::physical_samples(const ChannelInfo& info, const std::vector<si4>& raw,
+                                             const std::vector<SampleSpan>& spans,
+                                             const si8* start_time, const si8* end_time) const {
+    // Convert to float and apply units conversion. NaN runs the writer
+    // dropped are returned as NaN where they fall within [start_time,
+    // end_time); recording gaps are not filled
+    std::vector<sf8> result;
+    result.reserve(raw.size());
     sf8 conversion = info.units_conversion_factor;
     if (conversion == 0.0) conversion = 1.0;
+    const sf8 nan = std::numeric_limits<sf8>::quiet_NaN();
+    sf8 period = 1e6 / info.sampling_frequency;
     
-    for (size_t i = 0; i < raw.size(); ++i) {
-        if (raw[i] == RED_NAN) {
-            result[i] = std::numeric_limits<sf8>::quiet_NaN();
-        } else {
-            result[i] = static_cast<sf8>(raw[i]) * conversion;
+    size_t raw_pos = 0;
+    for (const auto& span : spans) {
+        if (span.nan_gap > 0) {
+            // Dropped sample k (1 = last) was at span.start_time - k * period
+            si8 last = span.nan_gap;
+            si8 first = 1;
+            if (start_time) {
+                last = std::min<si8>(last, static_cast<si8>(std::floor(
+                    static_cast<sf8>(span.start_time - *start_time) / period + 1e-9)));
+            }
+            if (end_time) {
+                first = std::max<si8>(first, static_cast<si8>(std::floor(
+                    static_cast<sf8>(span.start_time - *end_time) / period + 1e-9)) + 1);
+            }
+            if (last >= first) {
+                result.insert(result.end(), static_cast<size_t>(last - first + 1), nan);
+            }
+        }
+        for (si8 i = 0; i < span.number_of_samples; ++i, ++raw_pos) {
+            si4 value = raw[raw_pos];
+            result.push_back(value == RED_NAN ? nan : static_cast<sf8>(value) * conversion);
         }
     }
     
     return result;
 }
 
+void MefReader::add_trailing_nan_gap(const ChannelRecord& record, si8 end_sample,
+                                     std::vector<SampleSpan>& spans) const {
+    // A read that ends where a block starts also covers the NaN run dropped
+    // before that block, up to the end of the window
+    const auto& segments = record.segments;
+    auto seg_it = std::upper_bound(segments.begin(), segments.end(), end_sample,
+                                   [](si8 sample, const SegmentRecord& seg) {
+                                       return sample < seg.first_sample;
+                                   });
+    if (seg_it == segments.begin()) {
+        return;
+    }
+    const auto& seg = *(seg_it - 1);
+    const auto& starts = seg.block_starts;
+    auto blk_it = std::lower_bound(starts.begin(), starts.end(), end_sample - seg.first_sample);
+    if (blk_it == starts.end() || *blk_it != end_sample - seg.first_sample) {
+        return;
+    }
+    const auto& idx = seg.indices[static_cast<size_t>(blk_it - starts.begin())];
+    si8 nan_gap = idx.nan_gap_samples();
+    if (nan_gap > 0) {
+        spans.push_back({idx.start_time, 0, nan_gap});
+    }
+}
+
+si8 MefReader::sample_at_time(const ChannelRecord& record, si8 time) const {
+    // First channel sample whose time is >= time
+    const auto& segments = record.segments;
+    sf8 fs = record.info.sampling_frequency;
+    auto seg_it = std::upper_bound(segments.begin(), segments.end(), time,
+                                   [](si8 t, const SegmentRecord& seg) {
+                                       return seg.indices.empty() || t < seg.indices.front().start_time;
+                                   });
+    if (seg_it == segments.begin()) {
+        return 0;
+    }
+    const auto& seg = *(seg_it - 1);
+    
+    // Last block starting at or before time
+    const auto& indices = seg.indices;
+    auto blk_it = std::upper_bound(indices.begin(), indices.end(), time,
+                                   [](si8 t, const TimeSeriesIndex& idx) {
+                                       return t < idx.start_time;
+                                   });
+    size_t blk = static_cast<size_t>(blk_it - indices.begin()) - 1;
+    const auto& idx = indices[blk];
+    
+    sf8 offset = std::ceil(static_cast<sf8>(time - idx.start_time) * fs / 1e6 - 1e-9);
+    si8 within = std::min<si8>(static_cast<si8>(offset), idx.number_of_samples);
+    return seg.first_sample + seg.block_starts[blk] + within;
+}
+
 std::vector<si4> MefReader::get_raw_data(const std::string& channel_name,
                                           si8 start_sample,
                                           si8 end_sample) const {
-    auto ch_it = m_channels.find(channel_name);
-    if (ch_it == m_channels.end()) {
-        throw std::runtime_error("Channel not found: " + channel_name);
+    return get_raw_data(get_channel_handle(channel_name), start_sample, end_sample);
+}
+
+std::vector<si4> MefReader::get_raw_data(ChannelHandle channel,
+                                          si8 start_sample,
+                                          si8 end_sample) const {
+    const auto& record = channel_record(channel);
+    return read_consistent([&] {
+        return read_samples(record, start_sample, end_sample, nullptr);
+    });
+}
+
+template <typename Read>
+auto MefReader::read_consistent(Read read) const -> decltype(read()) {
+    // A segment rewritten since it was loaded is reloaded and the read
+    // retried; a segment still stale after its reload is an error
+    std::vector<const SegmentRecord*> reloaded;
+    while (true) {
+        const SegmentRecord* stale = nullptr;
+        try {
+            std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+            return read();
+        } catch (const StaleSegment& e) {
+            if (std::find(reloaded.begin(), reloaded.end(), e.segment) != reloaded.end()) {
+                throw std::runtime_error("Data file does not match its index: " +
+                                         e.segment->data_path.string());
+            }
+            stale = e.segment;
+        }
+        reloaded.push_back(stale);
+        std::unique_lock<std::shared_mutex> lock(m_impl->mutex);
+        reload_segment(const_cast<SegmentRecord&>(*stale));
     }
-    
-    auto seg_it = m_impl->segment_info.find(channel_name);
-    auto idx_it = m_impl->indices.find(channel_name);
-    if (seg_it == m_impl->segment_info.end() || idx_it == m_impl->indices.end()) {
-        throw std::runtime_error("No segment data for channel: " + channel_name);
+}
+
+void MefReader::reload_segment(SegmentRecord& segment) const {
+    auto indices = read_indices(segment.data_path.parent_path() / (segment.info.name + ".tidx"));
+    std::vector<si8> block_starts;
+    block_starts.reserve(indices.size());
+    si8 samples = 0;
+    for (const auto& idx : indices) {
+        block_starts.push_back(samples);
+        samples += idx.number_of_samples;
     }
-    
+    if (samples != segment.info.number_of_samples) {
+        throw std::runtime_error("Segment changed on disk: " + segment.data_path.parent_path().string());
+    }
+    segment.indices = std::move(indices);
+    segment.block_starts = std::move(block_starts);
+    segment.info.number_of_blocks = static_cast<si8>(segment.indices.size());
+}
+
+std::vector<si4> MefReader::read_samples(const ChannelRecord& record,
+                                         si8 start_sample,
+                                         si8 end_sample,
+                                         std::vector<SampleSpan>* spans) const {
     std::vector<si4> result;
+    if (end_sample <= start_sample) {
+        return result;
+    }
+    
+    std::vector<BlockFetch> blocks;
+    plan_blocks(record, start_sample, end_sample, blocks);
+    fetch_blocks(blocks);
     result.reserve(static_cast<size_t>(end_sample - start_sample));
+    assemble_samples(blocks, 0, blocks.size(), result, spans, record.info.sampling_frequency);
+    return result;
+}
+
+std::vector<CompressedBlock> MefReader::read_compressed_blocks(const std::string& channel_name,
+                                                              const si8* start_time,
+                                                              const si8* end_time) const {
+    return read_compressed_blocks(get_channel_handle(channel_name), start_time, end_time);
+}
+
+std::vector<CompressedBlock> MefReader::read_compressed_blocks(ChannelHandle channel,
+                                                              const si8* start_time,
+                                                              const si8* end_time) const {
+    const auto& record = channel_record(channel);
+    return read_consistent([&] {
+        return read_blocks(record, start_time, end_time);
+    });
+}
+
+std::vector<CompressedBlock> MefReader::read_blocks(const ChannelRecord& record,
+                                                    const si8* start_time,
+                                                    const si8* end_time) const {
+    si8 start_sample = start_time ? sample_at_time(record, *start_time) : 0;
+    si8 end_sample = end_time ? sample_at_time(record, *end_time) : record.info.number_of_samples;
     
-    // Find which segments contain the requested samples
-    si8 accumulated_samples = 0;
+    std::vector<BlockFetch> blocks;
+    plan_blocks(record, start_sample, end_sample, blocks);
+    std::vector<CompressedBlock> result(blocks.size());
+    std::map<const SegmentRecord*, std::unique_ptr<StorageFile>> files;
+    std::vector<IoEngine::Request> requests(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        auto& file = files[blocks[i].segment];
+        if (!file) {
+            file = m_impl->storage->open(blocks[i].segment->data_path.string(), Storage::OpenMode::READ);
+        }
+        result[i].index = blocks[i].segment->indices[blocks[i].block];
+        result[i].data.resize(result[i].index.block_bytes);
+        requests[i].file = file.get();
+        requests[i].data = result[i].data.data();
+        requests[i].length = result[i].data.size();
+        requests[i].offset = result[i].index.file_offset;
+    }
     
-    for (size_t seg_idx = 0; seg_idx < seg_it->second.size(); ++seg_idx) {
-        const auto& seg = seg_it->second[seg_idx];
-        si8 seg_start = accumulated_samples;
-        si8 seg_end = accumulated_samples + seg.number_of_samples;
+    auto check = [&](size_t i) {
+        const auto& block = result[i];
+        if (requests[i].result != block.data.size() ||
+            !block_matches_index(block.data.data(), block.data.size(), block.index)) {
+            throw StaleSegment{blocks[i].segment};
+        }
+    };
+    if (IoEngine* engine = m_impl->io_engine.get()) {
+        engine->read(requests, check);
+    } else {
+        for (size_t i = 0; i < requests.size(); ++i) {
+            requests[i].result = requests[i].file->pread(requests[i].data, requests[i].length, requests[i].offset);
+            check(i);
+        }
+    }
+    
+    return result;
+}
+
+MefReader::RecordFile& MefReader::record_file(const std::string& channel_name, si4 segment) const {
+    if (channel_name.empty()) {
+        return m_impl->session_records;
+    }
+    auto& record = m_impl->channels[static_cast<size_t>(get_channel_handle(channel_name))];
+    for (auto& file : record.record_files) {
+        if (file.segment == segment) {
+            return file;
+        }
+    }
+    throw std::runtime_error("Segment not found: " + channel_name + " " + std::to_string(segment));
+}
+
+const MefReader::RecordFile& MefReader::loaded_records(RecordFile& file) const {
+    // Records appended by a running writer grow the index file
+    fs::path idx_path = file.base;
+    idx_path += ".ridx";
+    auto& storage = *m_impl->storage;
+    si8 file_bytes = storage.file_size(idx_path.string());
+    if (file.loaded && file_bytes == file.index_bytes) {
+        return file;
+    }
+    
+    std::vector<RecordInfo> records;
+    if (file_bytes >= 0) {
+        auto idx_file = storage.open(idx_path.string(), Storage::OpenMode::READ);
+        UniversalHeader uh;
+        if (idx_file->pread(&uh, sizeof(uh), 0) != sizeof(uh)) {
+            throw std::runtime_error("Cannot read record index: " + idx_path.string());
+        }
+        si8 available = file_bytes < UNIVERSAL_HEADER_BYTES
+                        ? 0 : (file_bytes - UNIVERSAL_HEADER_BYTES) / RECORD_INDEX_BYTES;
+        si8 count = uh.number_of_entries >= 0 ? std::min(uh.number_of_entries, available) : available;
+        std::vector<RecordIndex> entries(static_cast<size_t>(std::max<si8>(count, 0)));
+        size_t entry_bytes = entries.size() * sizeof(RecordIndex);
+        if (idx_file->pread(entries.data(), entry_bytes, UNIVERSAL_HEADER_BYTES) != entry_bytes) {
+            throw std::runtime_error("Cannot read record index: " + idx_path.string());
+        }
         
-        // Check if this segment overlaps the requested range
-        if (seg_end > start_sample && seg_start < end_sample) {
-            // Get the indices for this segment
-            const auto& indices = idx_it->second[seg_idx];
-            
-            // Build path to data file
-            fs::path channel_path = fs::path(m_path) / (channel_name + ".timd");
-            fs::path seg_path = channel_path / (seg.name + ".segd");
-            fs::path data_path = seg_path / (seg.name + ".tdat");
-            
-            // Find relevant blocks
-            si8 local_start = std::max<si8>(0, start_sample - seg_start);
-            si8 local_end = std::min(seg.number_of_samples, end_sample - seg_start);
-            
-            // Decompress the required blocks
-            auto samples = decompress_blocks(data_path, indices, local_start, local_end);
+        // Interval records need the extent fields at the start of their body
+        fs::path data_path = file.base;
+        data_path += ".rdat";
+        std::unique_ptr<StorageFile> data_file;
+        std::vector<ui1> prefix;
+        records.reserve(entries.size());
+        for (const auto& entry : entries) {
+            RecordInfo info;
+            info.type = std::string(entry.type_string.data(),
+                                    strnlen(entry.type_string.data(), TYPE_BYTES));
+            info.version_major = entry.version_major;
+            info.version_minor = entry.version_minor;
+            info.encryption = entry.encryption;
+            info.time = entry.time;
+            info.end_time = entry.time;
+            info.channel = file.channel;
+            info.segment = file.segment;
+            info.file_offset = entry.file_offset;
             
-            // Append to result
-            result.insert(result.end(), samples.begin(), samples.end());
+            size_t extent = record_extent_bytes(info.type);
+            if (extent > 0) {
+                if (!data_file) {
+                    data_file = storage.open(data_path.string(), Storage::OpenMode::READ);
+                }
+                size_t bytes = (extent + ENCRYPTION_BLOCK_BYTES - 1) / ENCRYPTION_BLOCK_BYTES *
+                               ENCRYPTION_BLOCK_BYTES;
+                prefix.assign(bytes, 0);
+                size_t read = data_file->pread(prefix.data(), bytes, entry.file_offset + RECORD_HEADER_BYTES);
+                if (decrypt_record_body(prefix.data(), read, info.encryption, m_impl->password_data)) {
+                    info.end_time = record_end_time(info.type, info.time, prefix.data(), read);
+                }
+            }
+            records.push_back(std::move(info));
         }
-        
-        accumulated_samples = seg_end;
     }
     
+    std::stable_sort(records.begin(), records.end(),
+                     [](const RecordInfo& a, const RecordInfo& b) { return a.time < b.time; });
+    file.root_level = build_interval_tree(records, file.max_end);
+    file.records = std::move(records);
+    file.index_bytes = file_bytes;
+    file.loaded = true;
+    return file;
+}
+
+std::vector<RecordInfo> MefReader::get_records(const si8* start_time, const si8* end_time) const {
+    si8 start = start_time ? *start_time : std::numeric_limits<si8>::min();
+    si8 end = end_time ? *end_time : std::numeric_limits<si8>::max();
+    std::lock_guard<std::mutex> lock(m_impl->records_mutex);
+    const auto& file = loaded_records(m_impl->session_records);
+    std::vector<size_t> hits;
+    query_interval_tree(file.records, file.max_end, file.root_level, start, end, hits);
+    std::vector<RecordInfo> result;
+    result.reserve(hits.size());
+    for (size_t i : hits) {
+        result.push_back(file.records[i]);
+    }
     return result;
 }
 
-std::vector<si4> MefReader::decompress_blocks(const fs::path& data_path,
-                                               const std::vector<TimeSeriesIndex>& indices,
-                                               si8 start_idx, si8 end_idx) const {
-    std::vector<si4> result;
+std::vector<RecordInfo> MefReader::get_records(const std::string& channel_name,
+                                               const si8* start_time,
+                                               const si8* end_time) const {
+    si8 start = start_time ? *start_time : std::numeric_limits<si8>::min();
+    si8 end = end_time ? *end_time : std::numeric_limits<si8>::max();
+    auto& record = m_impl->channels[static_cast<size_t>(get_channel_handle(channel_name))];
+    std::lock_guard<std::mutex> lock(m_impl->records_mutex);
+    std::vector<RecordInfo> result;
+    std::vector<size_t> hits;
+    for (auto& file : record.record_files) {
+        const auto& loaded = loaded_records(file);
+        hits.clear();
+        query_interval_tree(loaded.records, loaded.max_end, loaded.root_level, start, end, hits);
+        for (size_t i : hits) {
+            result.push_back(loaded.records[i]);
+        }
+    }
+    std::stable_sort(result.begin(), result.end(),
+                     [](const RecordInfo& a, const RecordInfo& b) { return a.time < b.time; });
+    return result;
+}
+
+Record MefReader::read_record(const RecordInfo& info) const {
+    fs::path data_path;
+    {
+        std::lock_guard<std::mutex> lock(m_impl->records_mutex);
+        data_path = record_file(info.channel, info.segment).base;
+    }
+    data_path += ".rdat";
+    std::unique_ptr<StorageFile> file;
+    try {
+        file = m_impl->storage->open(data_path.string(), Storage::OpenMode::READ);
+    } catch (const std::runtime_error&) {
+        throw std::runtime_error("Cannot open record file: " + data_path.string());
+    }
     
-    if (indices.empty()) {
-        return result;
+    std::vector<ui1> bytes(RECORD_HEADER_BYTES);
+    size_t read = file->pread(bytes.data(), RECORD_HEADER_BYTES, info.file_offset);
+    RecordHeader header;
+    std::memcpy(&header, bytes.data(), RECORD_HEADER_BYTES);
+    if (read != RECORD_HEADER_BYTES || header.time != info.time) {
+        throw std::runtime_error("Record not found at offset " + std::to_string(info.file_offset) +
+                                 " of " + data_path.string());
+    }
+    bytes.resize(RECORD_HEADER_BYTES + static_cast<size_t>(header.bytes));
+    size_t body_bytes = static_cast<size_t>(header.bytes);
+    if (file->pread(bytes.data() + RECORD_HEADER_BYTES, body_bytes,
+                    info.file_offset + RECORD_HEADER_BYTES) != body_bytes) {
+        throw std::runtime_error("Truncated record in " + data_path.string());
     }
     
-    std::ifstream file(data_path, std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Cannot open data file: " + data_path.string());
+    // The CRC covers the body as stored, i.e. encrypted
+    if (header.record_CRC != RECORD_HEADER_RECORD_CRC_NO_ENTRY &&
+        CRC32::calculate(bytes.data() + sizeof(header.record_CRC),
+                         bytes.size() - sizeof(header.record_CRC)) != header.record_CRC) {
+        throw std::runtime_error("Record CRC mismatch at offset " + std::to_string(info.file_offset) +
+                                 " of " + data_path.string());
     }
     
-    // Skip universal header
-    file.seekg(UNIVERSAL_HEADER_BYTES);
+    Record record;
+    record.info = info;
+    record.body.assign(bytes.begin() + RECORD_HEADER_BYTES, bytes.end());
+    record.accessible = decrypt_record_body(record.body.data(), record.body.size(),
+                                            header.encryption, m_impl->password_data);
+    if (!record.accessible) {
+        record.body.clear();
+    }
+    return record;
+}
+
+std::vector<si4> MefReader::decode_block(const CompressedBlock& block) const {
+    auto result = REDCodec::decompress(block.data.data(), block.data.size(),
+                                       &m_impl->password_data);
+    if (!result.success) {
+        throw std::runtime_error("Cannot decode block at start time " +
+                                 std::to_string(block.index.start_time));
+    }
+    return std::move(result.samples);
+}
+
+void MefReader::plan_blocks(const ChannelRecord& record,
+                            si8 start_sample,
+                            si8 end_sample,
+                            std::vector<BlockFetch>& blocks) const {
+    if (end_sample <= start_sample) {
+        return;
+    }
     
-    // Find which blocks contain the requested samples
-    for (size_t blk_idx = 0; blk_idx < indices.size(); ++blk_idx) {
-        const auto& idx = indices[blk_idx];
-        si8 blk_start = idx.start_sample;
-        si8 blk_end = blk_start + idx.number_of_samples;
+    // Find the first segment that contains start_sample
+    const auto& segments = record.segments;
+    auto seg_it = std::upper_bound(segments.begin(), segments.end(), start_sample,
+                                   [](si8 sample, const SegmentRecord& seg) {
+                                       return sample < seg.first_sample;
+                                   });
+    if (seg_it != segments.begin()) {
+        --seg_it;
+    }
+    
+    for (; seg_it != segments.end() && seg_it->first_sample < end_sample; ++seg_it) {
+        const auto& seg = *seg_it;
+        si8 local_start = std::max<si8>(0, start_sample - seg.first_sample);
+        si8 local_end = std::min(seg.info.number_of_samples, end_sample - seg.first_sample);
+        if (seg.indices.empty() || local_end <= local_start) {
+            continue;
+        }
         
-        // Check if this block overlaps the requested range
-        if (blk_end > start_idx && blk_start < end_idx) {
-            // Read and decompress the block
-            std::vector<ui1> compressed(idx.block_bytes);
-            file.seekg(idx.file_offset);
-            file.read(reinterpret_cast<char*>(compressed.data()), idx.block_bytes);
+        // Find the first block that contains local_start
+        const auto& starts = seg.block_starts;
+        size_t blk = static_cast<size_t>(
+            std::upper_bound(starts.begin(), starts.end(), local_start) - starts.begin());
+        if (blk > 0) {
+            --blk;
+        }
+        for (; blk < seg.indices.size() && starts[blk] < local_end; ++blk) {
+            BlockFetch fetch;
+            fetch.segment = &seg;
+            fetch.block = blk;
+            fetch.first = std::max<si8>(0, local_start - starts[blk]);
+            fetch.last = std::min<si8>(seg.indices[blk].number_of_samples, local_end - starts[blk]);
+            blocks.push_back(std::move(fetch));
+        }
+    }
+}
+
+void MefReader::fetch_blocks(std::vector<BlockFetch>& blocks) const {
+    BlockCache* cache = m_impl->block_cache.get();
+    DiskBlockCache* disk_cache = m_impl->disk_block_cache.get();
+    
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        auto& fetch = blocks[i];
+        const auto& idx = fetch.segment->indices[fetch.block];
+        if (cache || disk_cache) {
+            fetch.key.segment = fetch.segment->cache_id;
+            fetch.key.file_offset = idx.file_offset;
+            fetch.key.start_time = idx.start_time;
+            fetch.key.block_bytes = idx.block_bytes;
+        }
+        if (cache) {
+            fetch.decoded = cache->find(fetch.key);
+        }
+        if (!fetch.decoded && disk_cache) {
+            fetch.decoded = disk_cache->find(fetch.key);
+            if (fetch.decoded && cache) {
+                cache->insert(fetch.key, fetch.decoded);
+            }
+        }
+        if (!fetch.decoded) {
+            missing.push_back(i);
+        }
+    }
+    if (missing.empty()) {
+        return;
+    }
+    
+    // Blocks that fail to decode are left out of the samples
+    auto decode = [&](BlockFetch& fetch, const ui1* data, size_t size) {
+        const auto& idx = fetch.segment->indices[fetch.block];
+        if (size != idx.block_bytes || !block_matches_index(data, size, idx)) {
+            throw StaleSegment{fetch.segment};
+        }
+        auto decomp_result = REDCodec::decompress(data, size, &m_impl->password_data);
+        if (!decomp_result.success) {
+            return;
+        }
+        auto decoded = std::make_shared<DecodedBlock>();
+        decoded->samples = std::move(decomp_result.samples);
+        decoded->flags = decomp_result.block_header.flags;
+        fetch.decoded = decoded;
+        if (cache) {
+            cache->insert(fetch.key, fetch.decoded);
+        }
+        if (disk_cache) {
+            disk_cache->insert(fetch.key, *fetch.decoded);
+        }
+    };
+    
+    // Each data file is opened once; blocks past its end belong to a
+    // segment rewritten since it was loaded
+    std::map<const SegmentRecord*, std::pair<std::unique_ptr<StorageFile>, si8>> files;
+    auto open_file = [&](const SegmentRecord* segment) -> StorageFile& {
+        auto& entry = files[segment];
+        if (!entry.first) {
+            entry.first = m_impl->storage->open(segment->data_path.string(), Storage::OpenMode::READ);
+            entry.second = entry.first->size();
+        }
+        return *entry.first;
+    };
+    auto check_range = [&](const SegmentRecord* segment, si8 first, si8 last) {
+        if (first < 0 || last > files[segment].second) {
+            throw StaleSegment{segment};
+        }
+    };
+    
+    if (IoEngine* engine = m_impl->io_engine.get()) {
+        // All missing blocks are in flight at once and each is decoded as
+        // soon as it arrives
+        std::vector<IoEngine::Request> requests(missing.size());
+        std::vector<size_t> buffer_offsets(missing.size());
+        size_t total = 0;
+        for (size_t r = 0; r < missing.size(); ++r) {
+            const auto& fetch = blocks[missing[r]];
+            const auto& idx = fetch.segment->indices[fetch.block];
+            requests[r].file = &open_file(fetch.segment);
+            check_range(fetch.segment, idx.file_offset, idx.file_offset + idx.block_bytes);
+            requests[r].length = idx.block_bytes;
+            requests[r].offset = idx.file_offset;
+            buffer_offsets[r] = total;
+            total += idx.block_bytes;
+        }
+        std::vector<ui1> buffer(total);
+        for (size_t r = 0; r < missing.size(); ++r) {
+            requests[r].data = buffer.data() + buffer_offsets[r];
+        }
+        engine->read(requests, [&](size_t r) {
+            decode(blocks[missing[r]], buffer.data() + buffer_offsets[r], requests[r].result);
+        });
+        return;
+    }
+    
+    // Otherwise the bytes spanning each segment's missing blocks are mapped at once
+    for (size_t m = 0; m < missing.size();) {
+        const SegmentRecord* segment = blocks[missing[m]].segment;
+        size_t group_end = m;
+        si8 first = std::numeric_limits<si8>::max();
+        si8 last = 0;
+        for (; group_end < missing.size() && blocks[missing[group_end]].segment == segment; ++group_end) {
+            const auto& idx = segment->indices[blocks[missing[group_end]].block];
+            first = std::min(first, idx.file_offset);
+            last = std::max(last, idx.file_offset + static_cast<si8>(idx.block_bytes));
+        }
+        const StorageFile& file = open_file(segment);
+        check_range(segment, first, last);
+        StorageMapping mapping = file.map(first, static_cast<size_t>(last - first));
+        for (; m < group_end; ++m) {
+            auto& fetch = blocks[missing[m]];
+            const auto& idx = segment->indices[fetch.block];
+            decode(fetch, mapping.data() + (idx.file_offset - first), idx.block_bytes);
+        }
+    }
+}
+
+void MefReader::assemble_samples(const std::vector<BlockFetch>& blocks,
+                                 size_t begin, size_t end,
+                                 std::vector<si4>& output,
+                                 std::vector<SampleSpan>* spans,
+                                 sf8 sampling_frequency) const {
+    for (size_t i = begin; i < end; ++i) {
+        const auto& fetch = blocks[i];
+        if (!fetch.decoded) {
+            continue;
+        }
+        const auto& block = *fetch.decoded;
+        const auto& idx = fetch.segment->indices[fetch.block];
+        
+        // Ensure we don't exceed the decompressed samples
+        si8 local_start = fetch.first;
+        si8 local_end = std::min(fetch.last, static_cast<si8>(block.samples.size()));
+        
+        if (local_end > local_start) {
+            output.insert(output.end(), block.samples.begin() + local_start,
+                          block.samples.begin() + local_end);
+            if (spans) {
+                si8 slice_time = idx.start_time + static_cast<si8>(
+                    std::llround(local_start * 1e6 / sampling_frequency));
+                // Blocks that continue the previous one extend its span; a
+                // dropped NaN run before the block always starts a new one
+                si8 nan_gap = local_start == 0 ? idx.nan_gap_samples() : 0;
+                if (!spans->empty() && nan_gap == 0 &&
+                    !(block.flags & RED_DISCONTINUITY_MASK) && local_start == 0 &&
+                    std::llabs(slice_time - (spans->back().start_time + static_cast<si8>(std::llround(
+                        spans->back().number_of_samples * 1e6 / sampling_frequency)))) <=
+                        static_cast<si8>(5e5 / sampling_frequency)) {
+                    spans->back().number_of_samples += local_end - local_start;
+                } else {
+                    spans->push_back({slice_time, local_end - local_start, nan_gap});
+                }
+            }
+        }
+    }
+}
+
+// ============================================================================
+// Live tail
+// ============================================================================
+
+si8 MefReader::get_start_time() const {
+    std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+    return m_start_time;
+}
+
+si8 MefReader::get_end_time() const {
+    std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+    return m_end_time;
+}
+
+si8 MefReader::get_duration() const {
+    std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+    return m_end_time - m_start_time;
+}
+
+MefReader::RefreshResult MefReader::refresh() {
+    auto started = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> refresh_lock(m_impl->refresh_mutex);
+    RefreshResult result;
+    
+    // What is loaded, and what the disk holds beyond it
+    struct ChannelUpdate {
+        size_t handle = 0;
+        fs::path path;
+        std::set<std::string> segment_names;
+        std::string last_segment;
+        fs::path index_path;                     // .tidx of the last segment
+        size_t known_entries = 0;
+        TimeSeriesIndex last_entry;
+        std::vector<TimeSeriesIndex> appended;
+        std::vector<TimeSeriesIndex> replaced;
+        bool rewritten = false;
+        ChannelRecord added;                     // New segments, and metadata found with them
+    };
+    std::vector<ChannelUpdate> updates;
+    std::set<std::string> known_channels;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+        for (size_t handle = 0; handle < m_impl->channels.size(); ++handle) {
+            const auto& channel = m_impl->channels[handle];
+            ChannelUpdate update;
+            update.handle = handle;
+            update.path = channel.path;
+            update.added.info.name = channel.info.name;
+            for (const auto& seg : channel.segments) {
+                update.segment_names.insert(seg.info.name);
+            }
+            if (!channel.segments.empty()) {
+                const auto& last = channel.segments.back();
+                update.last_segment = last.info.name;
+                update.index_path = last.data_path.parent_path() / (last.info.name + ".tidx");
+                update.known_entries = last.indices.size();
+                if (!last.indices.empty()) {
+                    update.last_entry = last.indices.back();
+                }
+            }
+            updates.push_back(std::move(update));
+        }
+        for (const auto& [name, handle] : m_impl->channel_handles) {
+            known_channels.insert(name);
+        }
+    }
+    
+    // Disk reads happen without blocking readers
+    auto& storage = *m_impl->storage;
+    bool any_write = false;
+    fs::file_time_type newest_write;
+    auto note_write = [&](const fs::path& path) {
+        auto time = storage.modification_time(path.string());
+        if (time != fs::file_time_type::min() && (!any_write || time > newest_write)) {
+            newest_write = time;
+            any_write = true;
+        }
+    };
+    
+    std::vector<fs::path> channel_paths;
+    for (const auto& entry : storage.list(m_path)) {
+        fs::path name(entry.name);
+        if (entry.is_directory && name.extension() == ".timd" &&
+            known_channels.count(name.stem().string()) == 0) {
+            channel_paths.push_back(fs::path(m_path) / name);
+        }
+    }
+    std::sort(channel_paths.begin(), channel_paths.end());
+    std::vector<ChannelRecord> new_channels;
+    for (const auto& path : channel_paths) {
+        new_channels.push_back(read_channel(path));
+        for (const auto& seg : new_channels.back().segments) {
+            note_write(seg.data_path.parent_path() / (seg.info.name + ".tidx"));
+        }
+    }
+    
+    for (auto& update : updates) {
+        std::vector<fs::path> segment_paths;
+        for (const auto& entry : storage.list(update.path.string())) {
+            fs::path name(entry.name);
+            if (entry.is_directory && name.extension() == ".segd" &&
+                update.segment_names.count(name.stem().string()) == 0) {
+                segment_paths.push_back(update.path / name);
+            }
+        }
+        std::sort(segment_paths.begin(), segment_paths.end());
+        for (const auto& path : segment_paths) {
+            load_segment(path, update.added);
+            note_write(path / (path.stem().string() + ".tidx"));
+        }
+        if (update.index_path.empty()) {
+            continue;
+        }
+        
+        // Only entries past the known ones are read; the last known entry
+        // is read again to tell an append from a rewritten index
+        si8 file_bytes = storage.file_size(update.index_path.string());
+        si8 known_bytes = UNIVERSAL_HEADER_BYTES +
+                          static_cast<si8>(update.known_entries * sizeof(TimeSeriesIndex));
+        if (file_bytes < 0 || file_bytes == known_bytes) {
+            continue;
+        }
+        std::unique_ptr<StorageFile> file;
+        try {
+            file = m_impl->storage->open(update.index_path.string(), Storage::OpenMode::READ);
+        } catch (const std::runtime_error&) {
+            continue;
+        }
+        UniversalHeader uh;
+        if (file->pread(&uh, sizeof(uh), 0) != sizeof(uh)) {
+            continue;
+        }
+        result.bytes_read += UNIVERSAL_HEADER_BYTES;
+        si8 available = (file_bytes - UNIVERSAL_HEADER_BYTES) / static_cast<si8>(sizeof(TimeSeriesIndex));
+        size_t count = static_cast<size_t>(std::max<si8>(std::min(uh.number_of_entries, available), 0));
+        if (count == update.known_entries) {
+            continue;
+        }
+        if (count > update.known_entries) {
+            size_t first = update.known_entries > 0 ? update.known_entries - 1 : 0;
+            std::vector<TimeSeriesIndex> entries(count - first);
+            size_t entry_bytes = entries.size() * sizeof(TimeSeriesIndex);
+            if (file->pread(entries.data(), entry_bytes,
+                            static_cast<si8>(UNIVERSAL_HEADER_BYTES + first * sizeof(TimeSeriesIndex))) != entry_bytes) {
+                continue;
+            }
+            result.bytes_read += static_cast<si8>(entries.size() * sizeof(TimeSeriesIndex));
+            if (update.known_entries == 0) {
+                update.appended = std::move(entries);
+            } else if (std::memcmp(&entries.front(), &update.last_entry, sizeof(TimeSeriesIndex)) == 0) {
+                update.appended.assign(entries.begin() + 1, entries.end());
+            } else {
+                update.rewritten = true;
+            }
+        } else {
+            update.rewritten = true;
+        }
+        if (update.rewritten) {
+            update.replaced = read_indices(update.index_path);
+            result.bytes_read += static_cast<si8>(update.replaced.size() * sizeof(TimeSeriesIndex));
+        }
+        note_write(update.index_path);
+    }
+    
+    // Install everything in one step under the exclusive lock
+    {
+        std::scoped_lock lock(m_impl->records_mutex, m_impl->mutex);
+        for (auto& update : updates) {
+            auto& channel = m_impl->channels[update.handle];
+            bool changed = false;
             
-            auto decomp_result = REDCodec::decompress(compressed.data(), compressed.size(),
-                                                       &m_impl->password_data);
+            // A read that reloaded the segment since the snapshot wins; the
+            // next refresh starts from its index
+            if ((update.rewritten || !update.appended.empty()) && !channel.segments.empty() &&
+                channel.segments.back().info.name == update.last_segment &&
+                channel.segments.back().indices.size() == update.known_entries) {
+                auto& seg = channel.segments.back();
+                if (update.rewritten) {
+                    seg.indices = std::move(update.replaced);
+                    seg.block_starts.clear();
+                    result.rewritten_segments++;
+                }
+                si8 samples = seg.block_starts.empty() ? 0
+                              : seg.block_starts.back() + seg.indices[seg.block_starts.size() - 1].number_of_samples;
+                for (const auto& entry : update.appended) {
+                    seg.indices.push_back(entry);
+                    result.new_blocks++;
+                    result.new_samples += entry.number_of_samples;
+                }
+                for (size_t i = seg.block_starts.size(); i < seg.indices.size(); ++i) {
+                    seg.block_starts.push_back(samples);
+                    samples += seg.indices[i].number_of_samples;
+                }
+                seg.info.number_of_samples = samples;
+                seg.info.number_of_blocks = static_cast<si8>(seg.indices.size());
+                if (!seg.indices.empty()) {
+                    seg.info.start_time = seg.indices.front().start_time;
+                    seg.info.end_time = std::max(seg.info.end_time,
+                                                 indexed_end_time(seg.indices, channel.info.sampling_frequency));
+                }
+                changed = true;
+            }
             
-            if (decomp_result.success) {
-                // Extract only the samples we need from this block
-                si8 local_start = std::max<si8>(0, start_idx - blk_start);
-                si8 local_end = std::min<si8>(idx.number_of_samples, end_idx - blk_start);
-                
-                // Ensure we don't exceed the decompressed samples
-                si8 max_i = static_cast<si8>(decomp_result.samples.size());
-                local_end = std::min(local_end, max_i);
-                
-                for (si8 i = local_start; i < local_end; ++i) {
-                    result.push_back(decomp_result.samples[static_cast<size_t>(i)]);
+            if (!channel.has_metadata && update.added.has_metadata) {
+                channel.metadata_section2 = update.added.metadata_section2;
+                channel.metadata_section3 = update.added.metadata_section3;
+                channel.has_metadata = true;
+                changed = true;
+            }
+            for (auto& seg : update.added.segments) {
+                result.new_segments++;
+                result.new_blocks += static_cast<si8>(seg.indices.size());
+                result.new_samples += seg.info.number_of_samples;
+                channel.segments.push_back(std::move(seg));
+                changed = true;
+            }
+            for (auto& file : update.added.record_files) {
+                channel.record_files.push_back(std::move(file));
+            }
+            if (changed) {
+                std::sort(channel.segments.begin(), channel.segments.end(),
+                          [](const SegmentRecord& a, const SegmentRecord& b) {
+                              return a.info.name < b.info.name;
+                          });
+                summarize_channel(channel);
+            }
+        }
+        
+        for (auto& channel : new_channels) {
+            result.new_channels++;
+            for (const auto& seg : channel.segments) {
+                result.new_blocks += static_cast<si8>(seg.indices.size());
+                result.new_samples += seg.info.number_of_samples;
+            }
+            std::string name = channel.info.name;
+            m_impl->channel_handles[name] = static_cast<ChannelHandle>(m_impl->channels.size());
+            m_impl->channels.push_back(std::move(channel));
+        }
+        
+        if (result.changed()) {
+            update_session_times();
+            if (m_session_name.empty()) {
+                // Opened before the session directory existed
+                m_session_name = fs::path(m_path).stem().string();
+                if (m_session_name.ends_with(".mefd")) {
+                    m_session_name = m_session_name.substr(0, m_session_name.length() - 5);
                 }
+                m_impl->session_records.base = fs::path(m_path) / m_session_name;
             }
+            m_valid = !m_impl->channels.empty();
+        }
+        
+        auto finished = std::chrono::steady_clock::now();
+        if (result.changed() && any_write) {
+            result.latency_seconds = std::max(
+                0.0, std::chrono::duration<sf8>(fs::file_time_type::clock::now() - newest_write).count());
+        }
+        result.seconds = std::chrono::duration<sf8>(finished - started).count();
+        
+        auto& stats = m_impl->refresh_statistics;
+        stats.refreshes++;
+        if (result.changed()) {
+            stats.updates++;
+            stats.new_blocks += result.new_blocks;
+            stats.mean_latency_seconds += (result.latency_seconds - stats.mean_latency_seconds) /
+                                          static_cast<sf8>(stats.updates);
+            stats.max_latency_seconds = std::max(stats.max_latency_seconds, result.latency_seconds);
         }
     }
-    
     return result;
 }
 
+void MefReader::set_block_cache(std::shared_ptr<BlockCache> cache) {
+    std::unique_lock<std::shared_mutex> lock(m_impl->mutex);
+    m_impl->block_cache = std::move(cache);
+}
+
+std::shared_ptr<BlockCache> MefReader::get_block_cache() const {
+    std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+    return m_impl->block_cache;
+}
+
+void MefReader::set_disk_block_cache(std::shared_ptr<DiskBlockCache> cache) {
+    std::unique_lock<std::shared_mutex> lock(m_impl->mutex);
+    m_impl->disk_block_cache = std::move(cache);
+}
+
+std::shared_ptr<DiskBlockCache> MefReader::get_disk_block_cache() const {
+    std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+    return m_impl->disk_block_cache;
+}
+
+void MefReader::set_io_engine(std::shared_ptr<IoEngine> engine) {
+    std::unique_lock<std::shared_mutex> lock(m_impl->mutex);
+    m_impl->io_engine = std::move(engine);
+}
+
+std::shared_ptr<IoEngine> MefReader::get_io_engine() const {
+    std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+    return m_impl->io_engine;
+}
+
+MefReader::RefreshStatistics MefReader::get_refresh_statistics() const {
+    std::lock_guard<std::mutex> lock(m_impl->refresh_mutex);
+    return m_impl->refresh_statistics;
+}
+
+void MefReader::watch(std::function<void(const RefreshResult&)> callback, sf8 poll_seconds) {
+    if (m_impl->watch_thread.joinable()) {
+        throw std::runtime_error("Reader is already watching");
+    }
+    m_impl->watch_stop = false;
+#ifdef __linux__
+    if (pipe2(m_impl->wake_fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+        m_impl->wake_fds[0] = m_impl->wake_fds[1] = -1;
+    }
+#endif
+    m_impl->watch_thread = std::thread([this, callback = std::move(callback), poll_seconds] {
+        watch_loop(callback, poll_seconds);
+    });
+}
+
+void MefReader::stop_watch() {
+    if (!m_impl->watch_thread.joinable()) {
+        return;
+    }
+    m_impl->watch_stop = true;
+#ifdef __linux__
+    if (m_impl->wake_fds[1] >= 0) {
+        char byte = 1;
+        if (write(m_impl->wake_fds[1], &byte, 1) < 0) {
+            // The watch thread still sees the stop flag within a poll interval
+        }
+    }
+#endif
+    m_impl->watch_thread.join();
+#ifdef __linux__
+    for (int& fd : m_impl->wake_fds) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+#endif
+}
+
+bool MefReader::is_watching() const {
+    return m_impl->watch_thread.joinable();
+}
+
+void MefReader::watch_loop(std::function<void(const RefreshResult&)> callback, sf8 poll_seconds) {
+    auto poll_interval = std::chrono::duration<sf8>(std::max(poll_seconds, 0.001));
+    
+    auto refresh_and_notify = [&] {
+        try {
+            auto result = refresh();
+            if (result.changed() && callback) {
+                callback(result);
+            }
+        } catch (const std::exception&) {
+            // A directory swapped mid-scan is picked up by the next refresh
+        }
+    };
+    
+#ifdef __linux__
+    // Other storages have no change notification and are polled
+    int notify_fd = m_impl->storage->is_local() ? inotify_init1(IN_NONBLOCK | IN_CLOEXEC) : -1;
+    const uint32_t mask = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO;
+    int timeout_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(poll_interval).count());
+    while (!m_impl->watch_stop) {
+        // New channels appear in the session directory, new segments in
+        // channel directories, and new blocks in the last segment's index
+        if (notify_fd >= 0) {
+            std::vector<fs::path> directories{fs::path(m_path)};
+            {
+                std::shared_lock<std::shared_mutex> lock(m_impl->mutex);
+                for (const auto& channel : m_impl->channels) {
+                    directories.push_back(channel.path);
+                    if (!channel.segments.empty()) {
+                        directories.push_back(channel.segments.back().data_path.parent_path());
+                    }
+                }
+            }
+            for (const auto& directory : directories) {
+                inotify_add_watch(notify_fd, directory.c_str(), mask);
+            }
+        }
+        
+        pollfd fds[2] = {{notify_fd, POLLIN, 0}, {m_impl->wake_fds[0], POLLIN, 0}};
+        int ready = poll(fds, 2, std::max(timeout_ms, 1));
+        if (m_impl->watch_stop) {
+            break;
+        }
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            // One refresh covers the whole burst of events
+            alignas(inotify_event) char buffer[4096];
+            while (read(notify_fd, buffer, sizeof(buffer)) > 0) {
+            }
+        }
+        refresh_and_notify();
+    }
+    if (notify_fd >= 0) {
+        close(notify_fd);
+    }
+#else
+    while (!m_impl->watch_stop) {
+        auto deadline = std::chrono::steady_clock::now() + poll_interval;
+        while (!m_impl->watch_stop && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (!m_impl->watch_stop) {
+            refresh_and_notify();
+        }
+    }
+#endif
+}
+
 } // namespace brainmaze_mefd
@@ -0,0 +1,814 @@
+/**
+ * @file mef_server.cpp
+ * @brief Local read server sharing decoded blocks between processes
+ */
+
+#include "brainmaze_mefd/mef_server.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace brainmaze_mefd {
+
+namespace {
+
+// Requests and responses are an 8-byte header (opcode or status, payload
+// size) followed by the payload; sample responses carry a shared memory
+// file descriptor with the header
+constexpr ui4 OP_OPEN = 1;
+constexpr ui4 OP_GET_DATA = 2;
+constexpr ui4 OP_GET_RAW_DATA = 3;
+constexpr ui4 OP_STATISTICS = 4;
+
+constexpr ui4 STATUS_OK = 0;
+constexpr ui4 STATUS_ERROR = 1;
+
+constexpr ui4 MAX_PAYLOAD_BYTES = 1u << 20;
+
+struct MessageHeader {
+    ui4 code;
+    ui4 payload_bytes;
+};
+
+class MessageWriter {
+public:
+    template <typename T>
+    MessageWriter& put(T value) {
+        append(&value, sizeof(T));
+        return *this;
+    }
+
+    MessageWriter& put(const std::string& text) {
+        put(static_cast<ui4>(text.size()));
+        append(text.data(), text.size());
+        return *this;
+    }
+
+    std::vector<ui1>& data() { return m_data; }
+
+private:
+    std::vector<ui1> m_data;
+
+    void append(const void* bytes, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        size_t offset = m_data.size();
+        m_data.resize(offset + size);
+        std::memcpy(m_data.data() + offset, bytes, size);
+    }
+};
+
+class MessageReader {
+public:
+    explicit MessageReader(const std::vector<ui1>& data) : m_data(data) {}
+
+    template <typename T>
+    T get() {
+        check(sizeof(T));
+        T value;
+        std::memcpy(&value, m_data.data() + m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return value;
+    }
+
+    std::string get_string() {
+        ui4 size = get<ui4>();
+        check(size);
+        std::string text(reinterpret_cast<const char*>(m_data.data() + m_pos), size);
+        m_pos += size;
+        return text;
+    }
+
+private:
+    const std::vector<ui1>& m_data;
+    size_t m_pos = 0;
+
+    void check(size_t bytes) const {
+        if (m_pos + bytes > m_data.size()) {
+            throw std::runtime_error("Truncated server message");
+        }
+    }
+};
+
+void write_statistics(MessageWriter& message, const ServerStatistics& stats) {
+    message.put(stats.connections).put(stats.requests).put(stats.errors)
+           .put(stats.sessions_opened).put(stats.samples_served).put(stats.bytes_served)
+           .put(stats.cache.hits).put(stats.cache.misses).put(stats.cache.insertions)
+           .put(stats.cache.evictions).put(stats.cache.blocks).put(stats.cache.bytes)
+           .put(stats.cache.capacity_bytes);
+}
+
+ServerStatistics read_statistics(MessageReader& message) {
+    ServerStatistics stats;
+    stats.connections = message.get<si8>();
+    stats.requests = message.get<si8>();
+    stats.errors = message.get<si8>();
+    stats.sessions_opened = message.get<si8>();
+    stats.samples_served = message.get<si8>();
+    stats.bytes_served = message.get<si8>();
+    stats.cache.hits = message.get<si8>();
+    stats.cache.misses = message.get<si8>();
+    stats.cache.insertions = message.get<si8>();
+    stats.cache.evictions = message.get<si8>();
+    stats.cache.blocks = message.get<si8>();
+    stats.cache.bytes = message.get<si8>();
+    stats.cache.capacity_bytes = message.get<si8>();
+    return stats;
+}
+
+#ifndef _WIN32
+
+bool send_all(int fd, const ui1* data, size_t bytes) {
+    while (bytes > 0) {
+        ssize_t sent = send(fd, data, bytes, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        bytes -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool receive_all(int fd, ui1* data, size_t bytes) {
+    while (bytes > 0) {
+        ssize_t received = recv(fd, data, bytes, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        bytes -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+// Sends a message, attaching shared_fd (if >= 0) to its first byte
+bool send_message(int fd, ui4 code, const std::vector<ui1>& payload, int shared_fd = -1) {
+    MessageHeader header{code, static_cast<ui4>(payload.size())};
+    iovec parts[2] = {{&header, sizeof(header)},
+                      {const_cast<ui1*>(payload.data()), payload.size()}};
+    msghdr message{};
+    message.msg_iov = parts;
+    message.msg_iovlen = payload.empty() ? 1 : 2;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    if (shared_fd >= 0) {
+        std::memset(control, 0, sizeof(control));
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &shared_fd, sizeof(int));
+    }
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent < 0) {
+        return false;
+    }
+    // The descriptor went with the first byte; the rest is plain data
+    const ui1* header_bytes = reinterpret_cast<const ui1*>(&header);
+    size_t total = sizeof(header) + payload.size();
+    size_t done = static_cast<size_t>(sent);
+    if (done < sizeof(header)) {
+        if (!send_all(fd, header_bytes + done, sizeof(header) - done)) {
+            return false;
+        }
+        done = sizeof(header);
+    }
+    return done == total || send_all(fd, payload.data() + (done - sizeof(header)), total - done);
+}
+
+// Receives a message; the first descriptor attached to it is stored in
+// shared_fd, which must be -1 on entry (or closed if shared_fd is null)
+bool receive_message(int fd, MessageHeader& header, std::vector<ui1>& payload, int* shared_fd) {
+    iovec part{&header, sizeof(header)};
+    msghdr message{};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    do {
+        received = recvmsg(fd, &message, 0);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        return false;
+    }
+    // Only the first descriptor passed is kept; any others are closed
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i) {
+            int passed;
+            std::memcpy(&passed, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (shared_fd && *shared_fd < 0) {
+                *shared_fd = passed;
+            } else {
+                close(passed);
+            }
+        }
+    }
+    if (static_cast<size_t>(received) < sizeof(header) &&
+        !receive_all(fd, reinterpret_cast<ui1*>(&header) + received, sizeof(header) - received)) {
+        return false;
+    }
+    if (header.payload_bytes > MAX_PAYLOAD_BYTES) {
+        return false;
+    }
+    payload.resize(header.payload_bytes);
+    return receive_all(fd, payload.data(), payload.size());
+}
+
+// Anonymous shared memory file holding a copy of the samples; this is the
+// one copy a request costs on the server side
+int shared_memory_file(const void* data, size_t bytes) {
+#ifdef __linux__
+    int fd = memfd_create("mefd_serve", MFD_CLOEXEC);
+#else
+    std::string name = "/mefd_serve." + std::to_string(getpid()) + "." +
+                       std::to_string(reinterpret_cast<uintptr_t>(data));
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+        shm_unlink(name.c_str());
+    }
+#endif
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create shared memory: " + std::string(std::strerror(errno)));
+    }
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot size shared memory: " + std::string(std::strerror(errno)));
+    }
+    void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("Cannot map shared memory: " + std::string(std::strerror(errno)));
+    }
+    std::memcpy(mapping, data, bytes);
+    munmap(mapping, bytes);
+    return fd;
+}
+
+sockaddr_un socket_address(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+#endif
+
+} // namespace
+
+// ============================================================================
+// MefServer
+// ============================================================================
+
+struct MefServer::Impl {
+    std::shared_ptr<BlockCache> cache;
+
+    // Readers keyed by session path and password
+    struct OpenSession {
+        std::shared_ptr<MefReader> reader;
+        ui8 last_used = 0;
+    };
+    std::mutex sessions_mutex;
+    std::map<std::pair<std::string, std::string>, OpenSession> sessions;
+    ui8 use_clock = 0;
+
+    mutable std::mutex statistics_mutex;
+    ServerStatistics statistics;
+
+    int listen_fd = -1;
+    int wake_fds[2] = {-1, -1};
+    std::atomic<bool> running{false};
+    std::thread accept_thread;
+
+    // Client threads flag themselves done so the accept loop can join them
+    struct Client {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+    std::mutex clients_mutex;
+    std::set<int> client_fds;
+    std::vector<Client> clients;
+
+    // Sessions are opened and refreshed outside the map lock, so a slow
+    // session does not hold up clients of other sessions
+    std::shared_ptr<MefReader> open_session(const std::string& path, const std::string& password,
+                                            size_t max_sessions) {
+        auto key = std::make_pair(path, password);
+        std::shared_ptr<MefReader> reader;
+        {
+            std::lock_guard<std::mutex> lock(sessions_mutex);
+            auto it = sessions.find(key);
+            if (it != sessions.end()) {
+                it->second.last_used = ++use_clock;
+                reader = it->second.reader;
+            }
+        }
+        if (reader) {
+            reader->refresh();
+            return reader;
+        }
+
+        reader = std::make_shared<MefReader>(path, password);
+        reader->set_block_cache(cache);
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        auto it = sessions.find(key);
+        if (it != sessions.end()) {
+            // Another client opened the session meanwhile; share its reader
+            it->second.last_used = ++use_clock;
+            return it->second.reader;
+        }
+        {
+            std::lock_guard<std::mutex> stats_lock(statistics_mutex);
+            statistics.sessions_opened++;
+        }
+        sessions[key] = {reader, ++use_clock};
+        while (sessions.size() > std::max<size_t>(1, max_sessions)) {
+            auto oldest = std::min_element(sessions.begin(), sessions.end(),
+                                           [](const auto& a, const auto& b) {
+                                               return a.second.last_used < b.second.last_used;
+                                           });
+            sessions.erase(oldest);
+        }
+        return reader;
+    }
+};
+
+#ifdef _WIN32
+
+MefServer::MefServer(const std::string& socket_path, const ServerOptions& options)
+    : m_socket_path(socket_path)
+    , m_options(options)
+{
+    throw std::runtime_error("MefServer requires Unix domain sockets");
+}
+
+MefServer::~MefServer() = default;
+void MefServer::start() {}
+void MefServer::stop() {}
+bool MefServer::is_running() const { return false; }
+void MefServer::accept_loop() {}
+void MefServer::serve_client(int) {}
+
+ServerStatistics MefServer::get_statistics() const {
+    return ServerStatistics{};
+}
+
+#else
+
+MefServer::MefServer(const std::string& socket_path, const ServerOptions& options)
+    : m_impl(std::make_unique<Impl>())
+    , m_socket_path(socket_path)
+    , m_options(options)
+{
+    m_impl->cache = std::make_shared<BlockCache>(options.cache_bytes);
+}
+
+MefServer::~MefServer() {
+    stop();
+}
+
+void MefServer::start() {
+    if (m_impl->running) {
+        throw std::runtime_error("Server is already running");
+    }
+    sockaddr_un address = socket_address(m_socket_path);
+
+    // Only a stale socket is replaced, never another kind of file
+    struct stat existing;
+    if (lstat(m_socket_path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(m_socket_path.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create socket: " + std::string(std::strerror(errno)));
+    }
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 64) != 0) {
+        std::string error = std::strerror(errno);
+        close(fd);
+        throw std::runtime_error("Cannot listen on " + m_socket_path + ": " + error);
+    }
+    if (pipe(m_impl->wake_fds) != 0) {
+        close(fd);
+        unlink(m_socket_path.c_str());
+        throw std::runtime_error("Cannot create wake pipe: " + std::string(std::strerror(errno)));
+    }
+    m_impl->listen_fd = fd;
+    m_impl->running = true;
+    m_impl->accept_thread = std::thread([this] { accept_loop(); });
+}
+
+void MefServer::stop() {
+    if (!m_impl || !m_impl->running.exchange(false)) {
+        return;
+    }
+    char byte = 1;
+    if (write(m_impl->wake_fds[1], &byte, 1) < 0) {
+        // The accept loop also polls with a timeout
+    }
+    m_impl->accept_thread.join();
+    close(m_impl->listen_fd);
+    m_impl->listen_fd = -1;
+    unlink(m_socket_path.c_str());
+    for (int& fd : m_impl->wake_fds) {
+        close(fd);
+        fd = -1;
+    }
+
+    // Clients blocked in recv() return once their socket is shut down
+    std::vector<Impl::Client> clients;
+    {
+        std::lock_guard<std::mutex> lock(m_impl->clients_mutex);
+        for (int fd : m_impl->client_fds) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        clients.swap(m_impl->clients);
+    }
+    for (auto& client : clients) {
+        client.thread.join();
+    }
+}
+
+bool MefServer::is_running() const {
+    return m_impl && m_impl->running;
+}
+
+ServerStatistics MefServer::get_statistics() const {
+    std::lock_guard<std::mutex> lock(m_impl->statistics_mutex);
+    ServerStatistics stats = m_impl->statistics;
+    stats.cache = m_impl->cache->get_statistics();
+    return stats;
+}
+
+void MefServer::accept_loop() {
+    while (m_impl->running) {
+        pollfd fds[2] = {{m_impl->listen_fd, POLLIN, 0}, {m_impl->wake_fds[0], POLLIN, 0}};
+        if (poll(fds, 2, 1000) <= 0 || !(fds[0].revents & POLLIN)) {
+            continue;
+        }
+        int client = accept(m_impl->listen_fd, nullptr, nullptr);
+        if (client < 0) {
+            continue;
+        }
+        fcntl(client, F_SETFD, FD_CLOEXEC);
+        {
+            std::lock_guard<std::mutex> lock(m_impl->statistics_mutex);
+            m_impl->statistics.connections++;
+        }
+        std::lock_guard<std::mutex> lock(m_impl->clients_mutex);
+        auto& clients = m_impl->clients;
+        for (auto it = clients.begin(); it != clients.end();) {
+            if (*it->done) {
+                it->thread.join();
+                it = clients.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        m_impl->client_fds.insert(client);
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        clients.push_back({std::thread([this, client, done] {
+            serve_client(client);
+            *done = true;
+        }), done});
+    }
+}
+
+void MefServer::serve_client(int fd) {
+    std::shared_ptr<MefReader> reader;
+    MessageHeader header;
+    std::vector<ui1> payload;
+    while (m_impl->running && receive_message(fd, header, payload, nullptr)) {
+        MessageWriter response;
+        int shared_fd = -1;
+        si8 samples = 0;
+        si8 bytes = 0;
+        bool ok = true;
+        try {
+            MessageReader request(payload);
+            if (header.code == OP_OPEN) {
+                std::string path = request.get_string();
+                std::string password = request.get_string();
+                reader = m_impl->open_session(path, password, m_options.max_sessions);
+                response.put(static_cast<ui1>(reader->is_valid() ? 1 : 0))
+                        .put(reader->get_start_time()).put(reader->get_end_time());
+                auto names = reader->get_channels();
+                response.put(static_cast<ui4>(names.size()));
+                for (const auto& name : names) {
+                    auto info = reader->get_channel_info(name);
+                    response.put(info.name).put(info.channel_type).put(info.sampling_frequency)
+                            .put(info.number_of_samples).put(info.start_time).put(info.end_time)
+                            .put(info.units).put(info.units_conversion_factor)
+                            .put(info.number_of_segments);
+                }
+            } else if (header.code == OP_GET_DATA || header.code == OP_GET_RAW_DATA) {
+                if (!reader) {
+                    throw std::runtime_error("No session opened");
+                }
+                std::string channel = request.get_string();
+                if (header.code == OP_GET_DATA) {
+                    bool has_start = request.get<ui1>() != 0;
+                    si8 start_time = request.get<si8>();
+                    bool has_end = request.get<ui1>() != 0;
+                    si8 end_time = request.get<si8>();
+                    auto data = reader->get_data(channel, has_start ? &start_time : nullptr,
+                                                 has_end ? &end_time : nullptr);
+                    samples = static_cast<si8>(data.size());
+                    bytes = samples * static_cast<si8>(sizeof(sf8));
+                    if (!data.empty()) {
+                        shared_fd = shared_memory_file(data.data(), static_cast<size_t>(bytes));
+                    }
+                } else {
+                    si8 start_sample = request.get<si8>();
+                    si8 end_sample = request.get<si8>();
+                    auto data = reader->get_raw_data(channel, start_sample, end_sample);
+                    samples = static_cast<si8>(data.size());
+                    bytes = samples * static_cast<si8>(sizeof(si4));
+                    if (!data.empty()) {
+                        shared_fd = shared_memory_file(data.data(), static_cast<size_t>(bytes));
+                    }
+                }
+                response.put(samples);
+            } else if (header.code == OP_STATISTICS) {
+                write_statistics(response, get_statistics());
+            } else {
+                throw std::runtime_error("Unknown request " + std::to_string(header.code));
+            }
+        } catch (const std::exception& e) {
+            ok = false;
+            response = MessageWriter();
+            response.put(std::string(e.what()));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_impl->statistics_mutex);
+            m_impl->statistics.requests++;
+            m_impl->statistics.errors += ok ? 0 : 1;
+            m_impl->statistics.samples_served += samples;
+            m_impl->statistics.bytes_served += bytes;
+        }
+        bool sent = send_message(fd, ok ? STATUS_OK : STATUS_ERROR, response.data(), shared_fd);
+        if (shared_fd >= 0) {
+            close(shared_fd);
+        }
+        if (!sent) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_impl->clients_mutex);
+    m_impl->client_fds.erase(fd);
+    close(fd);
+}
+
+#endif
+
+// ============================================================================
+// SharedSamples
+// ============================================================================
+
+template <typename T>
+void SharedSamples<T>::release() {
+#ifndef _WIN32
+    if (m_data) {
+        munmap(const_cast<T*>(m_data), m_mapped_bytes);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped_bytes = 0;
+}
+
+template class SharedSamples<sf8>;
+template class SharedSamples<si4>;
+
+// ============================================================================
+// MefClient
+// ============================================================================
+
+#ifdef _WIN32
+
+MefClient::MefClient(const std::string&, const std::string& session_path, const std::string&)
+    : m_path(session_path)
+{
+    throw std::runtime_error("MefClient requires Unix domain sockets");
+}
+
+MefClient::~MefClient() = default;
+
+std::vector<ui1> MefClient::request(ui4, const std::vector<ui1>&, int*) const {
+    throw std::runtime_error("MefClient requires Unix domain sockets");
+}
+
+template <typename T>
+SharedSamples<T> MefClient::receive_samples(ui4, const std::vector<ui1>&) const {
+    throw std::runtime_error("MefClient requires Unix domain sockets");
+}
+
+#else
+
+MefClient::MefClient(const std::string& socket_path, const std::string& session_path,
+                     const std::string& password)
+    : m_path(session_path)
+{
+    sockaddr_un address = socket_address(socket_path);
+    m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0) {
+        throw std::runtime_error("Cannot create socket: " + std::string(std::strerror(errno)));
+    }
+    if (connect(m_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::string error = std::strerror(errno);
+        close(m_fd);
+        m_fd = -1;
+        throw std::runtime_error("Cannot connect to " + socket_path + ": " + error);
+    }
+
+    MessageWriter message;
+    message.put(session_path).put(password);
+    std::vector<ui1> payload;
+    try {
+        payload = request(OP_OPEN, message.data(), nullptr);
+    } catch (...) {
+        close(m_fd);
+        m_fd = -1;
+        throw;
+    }
+    MessageReader response(payload);
+    m_valid = response.get<ui1>() != 0;
+    m_start_time = response.get<si8>();
+    m_end_time = response.get<si8>();
+    ui4 count = response.get<ui4>();
+    for (ui4 c = 0; c < count; ++c) {
+        MefReader::ChannelInfo info;
+        info.name = response.get_string();
+        info.channel_type = response.get<si4>();
+        info.sampling_frequency = response.get<sf8>();
+        info.number_of_samples = response.get<si8>();
+        info.start_time = response.get<si8>();
+        info.end_time = response.get<si8>();
+        info.units = response.get_string();
+        info.units_conversion_factor = response.get<sf8>();
+        info.number_of_segments = response.get<si4>();
+        m_channels.push_back(std::move(info));
+    }
+}
+
+MefClient::~MefClient() {
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+std::vector<ui1> MefClient::request(ui4 opcode, const std::vector<ui1>& payload, int* shared_fd) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    MessageHeader header;
+    std::vector<ui1> response;
+    if (!send_message(m_fd, opcode, payload) || !receive_message(m_fd, header, response, shared_fd)) {
+        throw std::runtime_error("Connection to server lost");
+    }
+    if (header.code != STATUS_OK) {
+        if (shared_fd && *shared_fd >= 0) {
+            close(*shared_fd);
+            *shared_fd = -1;
+        }
+        MessageReader error(response);
+        throw std::runtime_error(error.get_string());
+    }
+    return response;
+}
+
+template <typename T>
+SharedSamples<T> MefClient::receive_samples(ui4 opcode, const std::vector<ui1>& payload) const {
+    int shared_fd = -1;
+    auto response = request(opcode, payload, &shared_fd);
+    MessageReader reader(response);
+    si8 count = reader.get<si8>();
+    if (count <= 0) {
+        if (shared_fd >= 0) {
+            close(shared_fd);
+        }
+        return SharedSamples<T>();
+    }
+    if (shared_fd < 0) {
+        throw std::runtime_error("Server response without shared memory");
+    }
+    size_t bytes = static_cast<size_t>(count) * sizeof(T);
+    void* mapping = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, shared_fd, 0);
+    close(shared_fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Cannot map shared memory: " + std::string(std::strerror(errno)));
+    }
+    return SharedSamples<T>(static_cast<const T*>(mapping), static_cast<size_t>(count), bytes);
+}
+
+#endif
+
+std::vector<std::string> MefClient::get_channels() const {
+    std::vector<std::string> names;
+    for (const auto& info : m_channels) {
+        names.push_back(info.name);
+    }
+    return names;
+}
+
+std::vector<std::string> MefClient::get_time_series_channels() const {
+    std::vector<std::string> names;
+    for (const auto& info : m_channels) {
+        if (info.channel_type == TIME_SERIES_CHANNEL_TYPE) {
+            names.push_back(info.name);
+        }
+    }
+    return names;
+}
+
+MefReader::ChannelInfo MefClient::get_channel_info(const std::string& channel_name) const {
+    for (const auto& info : m_channels) {
+        if (info.name == channel_name) {
+            return info;
+        }
+    }
+    throw std::runtime_error("Channel not found: " + channel_name);
+}
+
+SharedSamples<sf8> MefClient::get_data_view(const std::string& channel_name,
+                                            const si8* start_time,
+                                            const si8* end_time) const {
+    MessageWriter message;
+    message.put(channel_name)
+           .put(static_cast<ui1>(start_time ? 1 : 0)).put(start_time ? *start_time : si8(0))
+           .put(static_cast<ui1>(end_time ? 1 : 0)).put(end_time ? *end_time : si8(0));
+    return receive_samples<sf8>(OP_GET_DATA, message.data());
+}
+
+SharedSamples<si4> MefClient::get_raw_data_view(const std::string& channel_name,
+                                                si8 start_sample,
+                                                si8 end_sample) const {
+    MessageWriter message;
+    message.put(channel_name).put(start_sample).put(end_sample);
+    return receive_samples<si4>(OP_GET_RAW_DATA, message.data());
+}
+
+std::vector<sf8> MefClient::get_data(const std::string& channel_name,
+                                     const si8* start_time,
+                                     const si8* end_time) const {
+    auto view = get_data_view(channel_name, start_time, end_time);
+    return std::vector<sf8>(view.begin(), view.end());
+}
+
+std::vector<si4> MefClient::get_raw_data(const std::string& channel_name,
+                                         si8 start_sample,
+                                         si8 end_sample) const {
+    auto view = get_raw_data_view(channel_name, start_sample, end_sample);
+    return std::vector<si4>(view.begin(), view.end());
+}
+
+ServerStatistics MefClient::get_server_statistics() const {
+    auto response = request(OP_STATISTICS, {}, nullptr);
+    MessageReader reader(response);
+    return read_statistics(reader);
+}
+
+} // namespace brainmaze_mefd
@@ -8,25 +8,257 @@
 #include "brainmaze_mefd/crc.hpp"
 #include "brainmaze_mefd/aes.hpp"
 #include "brainmaze_mefd/sha256.hpp"
-#include <fstream>
+#include "brainmaze_mefd/file_pool.hpp"
+#include "brainmaze_mefd/compaction.hpp"
 #include <algorithm>
+#include <atomic>
 #include <stdexcept>
 #include <cstring>
 #include <cmath>
+#include <limits>
 #include <random>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
 
 namespace brainmaze_mefd {
 
 namespace fs = std::filesystem;
 
+// Per-channel writer state; everything a block write touches lives here
+struct MefWriter::ChannelState {
+    std::string name;
+    fs::path path;
+    sf8 sampling_frequency = 0.0;
+    si4 current_segment = -1;
+    
+    // Open segment data file (owned by the writer's file pool)
+    FilePool::FileId data_file = FilePool::INVALID_FILE_ID;
+    si8 data_file_offset = 0;
+    std::vector<TimeSeriesIndex> indices;
+    
+    // Samples not yet compressed into a block
+    std::vector<si4> pending;
+    si8 pending_start_time = UUTC_NO_ENTRY;
+    bool pending_discontinuity = false;
+    si8 nan_gap_samples = 0;                // NaN samples dropped before the next block
+    
+    si8 last_sample_index = 0;
+    si8 last_end_time = UUTC_NO_ENTRY;
+    si8 segment_end_time = UUTC_NO_ENTRY;   // Time-based rollover boundary
+    si8 block_end_time = UUTC_NO_ENTRY;     // Aligned boundary of the block in progress
+    sf8 compressed_bytes_per_sample = 0.0;  // Measured on the previous segment
+    
+    // Index entries already in the segment's .tidx file, and their CRC
+    size_t indices_persisted = 0;
+    ui4 indices_crc = CRC32::CRC_START_VALUE;
+    std::chrono::steady_clock::time_point last_sync;
+    si8 total_samples = 0;
+    si4 total_blocks = 0;
+    sf8 units_conversion_factor = 0.0;  // 0 = use writer default
+    ResolutionEstimate resolution;
+    si8 clipped_samples = 0;            // Samples beyond the range of the fixed factor
+    si4 block_len = 0;                  // 0 = use writer default
+    bool block_len_tuned = false;
+    BlockLengthEstimate block_len_estimate;
+    
+    // Serializes writes to this channel; no lock is shared between channels
+    std::mutex mutex;
+    bool closed = false;
+};
+
+// Record file of the session or of one channel; the index is kept in
+// memory, sorted by time, so late records can be merged into it
+struct MefWriter::RecordFileState {
+    fs::path base;                        // Path without the .rdat/.ridx extension
+    std::string channel;                  // "" for session records
+    std::vector<RecordIndex> entries;     // Sorted by time
+    size_t entries_persisted = 0;         // Leading entries unchanged in the .ridx file
+    ui4 index_crc = CRC32::CRC_START_VALUE;
+    si8 data_bytes = 0;                   // Size of the .rdat file (0 = not created)
+    ui4 data_crc = CRC32::CRC_START_VALUE;
+    si8 maximum_record_bytes = 0;
+};
+
+namespace {
+
+bool record_before(const RecordIndex& a, const RecordIndex& b) {
+    return a.time < b.time;
+}
+
+// Universal header of a session or channel record file
+UniversalHeader record_file_header(const char* file_type, const std::string& channel,
+                                   const std::string& session,
+                                   const std::array<ui1, UUID_BYTES>& uuid,
+                                   const std::vector<RecordIndex>& entries) {
+    UniversalHeader uh;
+    uh.set_file_type(file_type);
+    uh.set_channel_name(channel);
+    uh.set_session_name(session);
+    uh.segment_number = channel.empty() ? UNIVERSAL_HEADER_SESSION_LEVEL_CODE
+                                        : UNIVERSAL_HEADER_CHANNEL_LEVEL_CODE;
+    if (!entries.empty()) {
+        uh.start_time = entries.front().time;
+        uh.end_time = entries.back().time;
+    }
+    uh.number_of_entries = static_cast<si8>(entries.size());
+    std::memcpy(uh.level_UUID.data(), uuid.data(), UUID_BYTES);
+    return uh;
+}
+
+void set_header_crc(UniversalHeader& uh) {
+    uh.header_CRC = CRC32::calculate(reinterpret_cast<const ui1*>(&uh) + sizeof(ui4),
+                                     UNIVERSAL_HEADER_BYTES - sizeof(ui4));
+}
+
+// Segment name with zero-padded number, e.g. "ch1-000003"
+std::string segment_name(const MefWriter::ChannelState& state) {
+    char seg_num_str[16];
+    snprintf(seg_num_str, sizeof(seg_num_str), "%06d", state.current_segment);
+    return state.name + "-" + seg_num_str;
+}
+
+fs::path segment_path(const MefWriter::ChannelState& state) {
+    return state.path / (segment_name(state) + ".segd");
+}
+
+} // namespace
+
 // Internal implementation details
 struct MefWriter::Impl {
     PasswordData password_data;
     std::array<ui1, UUID_BYTES> session_uuid;
     
-    std::map<std::string, std::ofstream> data_files;
-    std::map<std::string, si8> data_file_offsets;
+    // Channel states indexed by handle (deque keeps references stable).
+    // The registry lock guards only the containers, not the channel states.
+    std::deque<ChannelState> channels;
+    std::map<std::string, ChannelHandle> channel_handles;
+    mutable std::shared_mutex registry_mutex;
+    
+    // Set by close() before any channel is finalized; write paths check it
+    // without holding a lock
+    std::atomic<bool> closed{false};
+    
+    // Storage of the session, and the segment data files on it; the pool
+    // bounds the number of open files
+    std::shared_ptr<Storage> storage;
+    FilePool file_pool;
+    
+    explicit Impl(std::shared_ptr<Storage> session_storage)
+        : storage(session_storage ? std::move(session_storage) : posix_storage())
+        , file_pool(FilePool::Options{}, storage)
+    {
+    }
+    
+    // Resolution detection settings
+    static constexpr size_t RESOLUTION_TRAINING_SAMPLES = 65536;
+    static constexpr si4 RESOLUTION_MAX_DIVISOR = 16;
+    static constexpr sf8 RESOLUTION_TOLERANCE = 1e-3;  // in counts
+    
+    // Block length tuning: training window, default candidate durations and
+    // timed decode passes per candidate (the fastest pass counts)
+    static constexpr size_t BLOCK_TUNING_SAMPLES = 262144;
+    static constexpr sf8 BLOCK_TUNING_MIN_SECONDS = 0.125;
+    static constexpr sf8 BLOCK_TUNING_MAX_SECONDS = 8.0;
+    static constexpr si4 BLOCK_TUNING_MIN_LEN = 16;
+    static constexpr int BLOCK_TUNING_DECODE_PASSES = 3;
+    
+    // Largest integer scale factor exactly representable in the sf4 header field
+    static constexpr sf8 MAXIMUM_BLOCK_SCALE_FACTOR = 16777216.0;
+    
+    // With a block relative precision, the peak of the first write is
+    // stored with this many precision steps; the rest of the integer range
+    // is headroom for louder blocks, which their scale factor coarsens
+    static constexpr sf8 BLOCK_PRECISION_PEAK_STEPS = 256.0;
+    
+    // Sync timing, shared by all channels
+    mutable std::mutex sync_mutex;
+    SyncStatistics sync_statistics;
+    
+    template <typename Sync>
+    void timed_sync(Sync&& sync) {
+        auto start = std::chrono::steady_clock::now();
+        sync();
+        sf8 seconds = std::chrono::duration<sf8>(std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<std::mutex> lock(sync_mutex);
+        sync_statistics.sync_calls++;
+        sync_statistics.sync_seconds += seconds;
+        sync_statistics.max_sync_seconds = std::max(sync_statistics.max_sync_seconds, seconds);
+    }
+    
+    // Session and channel record files by channel name ("" = session);
+    // record writes do not take any channel lock
+    std::mutex records_mutex;
+    std::map<std::string, RecordFileState> record_files;
+    
+    // Preallocation guess before a channel's first segment has been measured
+    static constexpr sf8 DEFAULT_COMPRESSED_BYTES_PER_SAMPLE = 2.0;
+    
+    // Background compaction of finalized segments, started on first use
+    std::thread compaction_thread;
+    std::mutex compaction_mutex;
+    std::condition_variable compaction_cv;
+    std::deque<std::pair<std::string, si4>> compaction_queue;
+    bool compaction_stop = false;
+    CompactionStatistics compaction_statistics;
+    
+    ~Impl() { stop_compaction(); }
+    
+    void enqueue_compaction(const std::string& segment, si4 block_len) {
+        std::lock_guard<std::mutex> lock(compaction_mutex);
+        if (!compaction_thread.joinable()) {
+            compaction_stop = false;
+            compaction_thread = std::thread([this] { compaction_worker(); });
+        }
+        compaction_queue.emplace_back(segment, block_len);
+        compaction_cv.notify_one();
+    }
+    
+    // Compacts queued segments until stopped and the queue is drained
+    void compaction_worker() {
+        std::unique_lock<std::mutex> lock(compaction_mutex);
+        while (true) {
+            compaction_cv.wait(lock, [&] { return compaction_stop || !compaction_queue.empty(); });
+            if (compaction_queue.empty()) {
+                return;
+            }
+            auto [segment, block_len] = compaction_queue.front();
+            compaction_queue.pop_front();
+            lock.unlock();
+            CompactionStatistics stats;
+            bool failed = false;
+            try {
+                stats = compact_segment(segment, block_len);
+            } catch (const std::exception&) {
+                // The segment is left as written
+                failed = true;
+            }
+            lock.lock();
+            auto& total = compaction_statistics;
+            total.segments += stats.segments;
+            total.segments_failed += failed ? 1 : 0;
+            total.segments_skipped += stats.segments_skipped;
+            total.blocks_before += stats.blocks_before;
+            total.blocks_after += stats.blocks_after;
+            total.bytes_before += stats.bytes_before;
+            total.bytes_after += stats.bytes_after;
+            total.seconds += stats.seconds;
+        }
+    }
+    
+    void stop_compaction() {
+        {
+            std::lock_guard<std::mutex> lock(compaction_mutex);
+            compaction_stop = true;
+        }
+        compaction_cv.notify_all();
+        if (compaction_thread.joinable()) {
+            compaction_thread.join();
+        }
+    }
     
     // Generate a random UUID
     static void generate_uuid(std::array<ui1, UUID_BYTES>& uuid) {
@@ -45,8 +277,9 @@ struct MefWriter::Impl {
 };
 
 MefWriter::MefWriter(const std::string& path, bool overwrite,
-                     const std::string& password1, const std::string& password2)
-    : m_impl(std::make_unique<Impl>())
+                     const std::string& password1, const std::string& password2,
+                     std::shared_ptr<Storage> storage)
+    : m_impl(std::make_unique<Impl>(std::move(storage)))
     , m_path(path)
     , m_overwrite(overwrite)
     , m_password1(password1)
@@ -80,7 +313,7 @@ MefWriter::MefWriter(const std::string& path, bool overwrite,
 }
 
 MefWriter::~MefWriter() {
-    if (m_valid && !m_closed) {
+    if (m_impl && m_valid && !m_impl->closed) {
         try {
             close();
         } catch (...) {
@@ -101,17 +334,15 @@ bool MefWriter::create_session() {
         m_path = session_path.string();
     }
     
-    // Handle existing session
-    if (fs::exists(session_path)) {
-        if (m_overwrite) {
-            fs::remove_all(session_path);
-        }
-        // If not overwriting, we'll append to existing
-    }
-    
-    // Create session directory
+    // Handle existing session; if not overwriting, we'll append to it
+    auto& storage = *m_impl->storage;
     try {
-        fs::create_directories(session_path);
+        if (m_overwrite && storage.exists(m_path)) {
+            storage.remove_all(m_path);
+        }
+        
+        // Create session directory
+        storage.create_directories(m_path);
     } catch (const std::exception& e) {
         return false;
     }
@@ -119,60 +350,128 @@ bool MefWriter::create_session() {
     return true;
 }
 
-void MefWriter::ensure_channel(const std::string& channel_name, sf8 sampling_freq) {
-    if (m_channel_states.count(channel_name)) {
+std::shared_ptr<Storage> MefWriter::get_storage() const {
+    return m_impl->storage;
+}
+
+size_t MefWriter::get_max_open_files() const {
+    return m_impl->file_pool.get_max_open_files();
+}
+
+void MefWriter::set_max_open_files(size_t value) {
+    m_impl->file_pool.set_max_open_files(value);
+}
+
+size_t MefWriter::get_write_buffer_bytes() const {
+    return m_impl->file_pool.get_options().buffer_bytes;
+}
+
+void MefWriter::set_write_buffer_bytes(size_t value) {
+    auto options = m_impl->file_pool.get_options();
+    options.buffer_bytes = value;
+    m_impl->file_pool.set_options(options);
+}
+
+bool MefWriter::get_direct_io() const {
+    return m_impl->file_pool.get_options().direct_io;
+}
+
+void MefWriter::set_direct_io(bool value) {
+    auto options = m_impl->file_pool.get_options();
+    options.direct_io = value;
+    m_impl->file_pool.set_options(options);
+}
+
+std::shared_ptr<IoEngine> MefWriter::get_io_engine() const {
+    return m_impl->file_pool.get_io_engine();
+}
+
+void MefWriter::set_io_engine(std::shared_ptr<IoEngine> engine) {
+    m_impl->file_pool.set_io_engine(std::move(engine));
+}
+
+MefWriter::ChannelHandle MefWriter::open_channel(const std::string& channel_name,
+                                                 sf8 sampling_freq) {
+    std::unique_lock<std::shared_mutex> lock(m_impl->registry_mutex);
+    auto it = m_impl->channel_handles.find(channel_name);
+    if (it != m_impl->channel_handles.end()) {
         // Channel already exists, verify sampling frequency matches
-        auto& state = m_channel_states[channel_name];
+        auto& state = m_impl->channels[static_cast<size_t>(it->second)];
         if (state.sampling_frequency != 0.0 && state.sampling_frequency != sampling_freq) {
             throw std::runtime_error("Sampling frequency mismatch for channel: " + channel_name);
         }
-        return;
+        return it->second;
+    }
+    
+    if (sampling_freq <= 0.0) {
+        throw std::runtime_error("Invalid sampling frequency for channel: " + channel_name);
+    }
+    if (m_impl->closed) {
+        throw std::runtime_error("Writer is closed");
     }
     
     // Create new channel
     fs::path channel_path = fs::path(m_path) / (channel_name + ".timd");
-    fs::create_directories(channel_path);
+    m_impl->storage->create_directories(channel_path.string());
     
-    ChannelState state;
+    auto& state = m_impl->channels.emplace_back();
+    state.name = channel_name;
     state.path = channel_path;
     state.sampling_frequency = sampling_freq;
     state.current_segment = -1;  // No segment created yet
     
-    m_channel_states[channel_name] = state;
+    auto handle = static_cast<ChannelHandle>(m_impl->channels.size() - 1);
+    m_impl->channel_handles[channel_name] = handle;
+    return handle;
+}
+
+MefWriter::ChannelState& MefWriter::channel_state(ChannelHandle channel) const {
+    std::shared_lock<std::shared_mutex> lock(m_impl->registry_mutex);
+    if (channel < 0 || static_cast<size_t>(channel) >= m_impl->channels.size()) {
+        throw std::runtime_error("Invalid channel handle: " + std::to_string(channel));
+    }
+    return m_impl->channels[static_cast<size_t>(channel)];
 }
 
-void MefWriter::create_segment(const std::string& channel_name) {
-    auto& state = m_channel_states[channel_name];
+void MefWriter::create_segment(ChannelState& state) {
     state.current_segment++;
     
-    // Format segment number with leading zeros (buffer sized for max int value)
-    char seg_num_str[16];
-    snprintf(seg_num_str, sizeof(seg_num_str), "%06d", state.current_segment);
-    
-    std::string segment_name = channel_name + "-" + seg_num_str;
-    fs::path segment_path = state.path / (segment_name + ".segd");
-    fs::create_directories(segment_path);
+    fs::path seg_path = segment_path(state);
+    m_impl->storage->create_directories(seg_path.string());
     
     // Create data file
-    fs::path data_path = segment_path / (segment_name + ".tdat");
+    fs::path data_path = seg_path / (segment_name(state) + ".tdat");
     
     // Close any existing data file for this channel
-    auto file_it = m_impl->data_files.find(channel_name);
-    if (file_it != m_impl->data_files.end()) {
-        file_it->second.close();
-        m_impl->data_files.erase(file_it);
+    if (state.data_file != FilePool::INVALID_FILE_ID) {
+        m_impl->file_pool.close(state.data_file);
+        state.data_file = FilePool::INVALID_FILE_ID;
     }
     
-    // Open new data file
-    std::ofstream data_file(data_path, std::ios::binary);
-    if (!data_file) {
-        throw std::runtime_error("Cannot create data file: " + data_path.string());
+    // Open new data file, preallocated for the expected segment size
+    si8 expected_bytes = 0;
+    if (m_preallocation_seconds > 0.0) {
+        sf8 bytes_per_sample = state.compressed_bytes_per_sample > 0.0
+                               ? state.compressed_bytes_per_sample
+                               : Impl::DEFAULT_COMPRESSED_BYTES_PER_SAMPLE;
+        expected_bytes = UNIVERSAL_HEADER_BYTES + static_cast<si8>(
+            std::ceil(m_preallocation_seconds * state.sampling_frequency * bytes_per_sample));
+    }
+    state.data_file = m_impl->file_pool.create(data_path.string(), expected_bytes);
+    
+    // Make the new directory entries durable before any data depends on them
+    if (m_durability_mode != DurabilityMode::NONE) {
+        sync_directory(seg_path);
+        sync_directory(state.path);
+        if (state.current_segment == 0) {
+            sync_directory(state.path.parent_path());
+        }
     }
     
     // Write universal header placeholder
     UniversalHeader uh;
     uh.set_file_type(TIME_SERIES_DATA_FILE_TYPE_STRING);
-    uh.set_channel_name(channel_name);
+    uh.set_channel_name(state.name);
     uh.set_session_name(m_session_name);
     uh.segment_number = state.current_segment;
     std::memcpy(uh.level_UUID.data(), m_impl->session_uuid.data(), UUID_BYTES);
@@ -182,14 +481,16 @@ void MefWriter::create_segment(const std::string& channel_name) {
         reinterpret_cast<const ui1*>(&uh) + sizeof(ui4),
         UNIVERSAL_HEADER_BYTES - sizeof(ui4));
     
-    data_file.write(reinterpret_cast<const char*>(&uh), sizeof(uh));
-    
-    m_impl->data_files[channel_name] = std::move(data_file);
-    m_impl->data_file_offsets[channel_name] = UNIVERSAL_HEADER_BYTES;
+    m_impl->file_pool.append(state.data_file, &uh, sizeof(uh));
+    state.data_file_offset = UNIVERSAL_HEADER_BYTES;
     
     // Reset segment-specific counters (but preserve total)
     state.indices.clear();
+    state.indices_persisted = 0;
+    state.indices_crc = CRC32::CRC_START_VALUE;
+    state.segment_end_time = UUTC_NO_ENTRY;
     state.last_sample_index = state.total_samples;
+    state.last_sync = std::chrono::steady_clock::now();
 }
 
 void MefWriter::write_data(const std::vector<sf8>& data,
@@ -209,7 +510,25 @@ void MefWriter::write_data(const sf8* data,
                             sf8 sampling_freq,
                             si4 precision,
                             bool new_segment) {
-    if (m_closed) {
+    if (m_impl->closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    
+    if (num_samples == 0) {
+        return;
+    }
+    
+    write_data(open_channel(channel_name, sampling_freq), data, num_samples,
+               start_uutc, precision, new_segment);
+}
+
+void MefWriter::write_data(ChannelHandle channel,
+                            const sf8* data,
+                            size_t num_samples,
+                            si8 start_uutc,
+                            si4 precision,
+                            bool new_segment) {
+    if (m_impl->closed) {
         throw std::runtime_error("Writer is closed");
     }
     
@@ -217,21 +536,46 @@ void MefWriter::write_data(const sf8* data,
         return;
     }
     
+    auto& state = channel_state(channel);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    append_data(state, data, num_samples, start_uutc, precision, new_segment);
+}
+
+void MefWriter::append_data(ChannelState& state,
+                             const sf8* data,
+                             size_t num_samples,
+                             si8 start_uutc,
+                             si4 precision,
+                             bool new_segment,
+                             const si8* timestamps) {
     // Calculate conversion factor based on precision
     sf8 scale_factor = 1.0;
     if (precision >= 0) {
         scale_factor = std::pow(10.0, precision);
+    } else if (state.units_conversion_factor > 0.0) {
+        // Factor was fixed by the first write to this channel
+        scale_factor = 1.0 / state.units_conversion_factor;
     } else {
-        // Auto-detect precision from data
-        sf8 max_val = 0.0;
-        for (size_t i = 0; i < num_samples; ++i) {
-            if (!std::isnan(data[i])) {
-                max_val = std::max(max_val, std::abs(data[i]));
+        if (m_auto_resolution) {
+            state.resolution = estimate_resolution(data, num_samples, m_block_len);
+            if (state.resolution.found) {
+                scale_factor = 1.0 / state.resolution.resolution;
             }
         }
-        // Scale to use full si4 range (approximately)
-        if (max_val > 0) {
-            scale_factor = static_cast<sf8>(RED_MAXIMUM_SAMPLE_VALUE) / max_val * 0.9;
+        if (!state.resolution.found) {
+            scale_factor = full_range_scale(data, num_samples);
+            if (m_block_relative_precision > 0.0) {
+                // A fine resolution rather than the full range, so later
+                // excursions fit and are absorbed by per-block scale factors
+                sf8 peak = static_cast<sf8>(RED_MAXIMUM_SAMPLE_VALUE) * 0.9 / scale_factor;
+                sf8 peak_counts = Impl::BLOCK_PRECISION_PEAK_STEPS / m_block_relative_precision;
+                if (peak > 0.0 && peak_counts < peak * scale_factor) {
+                    scale_factor = peak_counts / peak;
+                }
+            }
         }
     }
     
@@ -242,7 +586,12 @@ void MefWriter::write_data(const sf8* data,
             samples[i] = RED_NAN;
         } else {
             sf8 scaled = data[i] * scale_factor;
-            // Clamp to valid range
+            // Clamp to valid range; samples beyond the range of a factor
+            // fixed by an earlier write are counted, not silently lost
+            if (scaled < static_cast<sf8>(RED_MINIMUM_SAMPLE_VALUE) ||
+                scaled > static_cast<sf8>(RED_MAXIMUM_SAMPLE_VALUE)) {
+                state.clipped_samples++;
+            }
             scaled = std::clamp(scaled, 
                                static_cast<sf8>(RED_MINIMUM_SAMPLE_VALUE),
                                static_cast<sf8>(RED_MAXIMUM_SAMPLE_VALUE));
@@ -250,12 +599,242 @@ void MefWriter::write_data(const sf8* data,
         }
     }
     
-    // Store conversion factor in units
+    // Store conversion factor for this channel's metadata
     if (scale_factor != 1.0) {
-        m_units_conversion_factor = 1.0 / scale_factor;
+        state.units_conversion_factor = 1.0 / scale_factor;
     }
     
-    write_raw_data(samples, channel_name, start_uutc, sampling_freq, new_segment);
+    if (timestamps) {
+        append_timestamped_data(state, samples.data(), timestamps, samples.size());
+    } else {
+        append_raw_data(state, samples.data(), samples.size(), start_uutc, new_segment);
+    }
+}
+
+sf8 MefWriter::full_range_scale(const sf8* data, size_t num_samples) {
+    sf8 max_val = 0.0;
+    for (size_t i = 0; i < num_samples; ++i) {
+        if (!std::isnan(data[i])) {
+            max_val = std::max(max_val, std::abs(data[i]));
+        }
+    }
+    // Scale to use full si4 range (approximately)
+    if (max_val > 0) {
+        return static_cast<sf8>(RED_MAXIMUM_SAMPLE_VALUE) / max_val * 0.9;
+    }
+    return 1.0;
+}
+
+MefWriter::ResolutionEstimate MefWriter::estimate_resolution(const sf8* data,
+                                                             size_t num_samples,
+                                                             si4 block_len) {
+    ResolutionEstimate estimate;
+    size_t n = std::min(num_samples, Impl::RESOLUTION_TRAINING_SAMPLES);
+    
+    // Collect finite training values and non-zero differences
+    std::vector<sf8> values;
+    std::vector<sf8> differences;
+    values.reserve(n);
+    differences.reserve(n);
+    sf8 max_abs = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!std::isfinite(data[i])) continue;
+        if (!values.empty()) {
+            sf8 diff = std::abs(data[i] - values.back());
+            if (diff > 0.0) differences.push_back(diff);
+        }
+        values.push_back(data[i]);
+        max_abs = std::max(max_abs, std::abs(data[i]));
+    }
+    estimate.samples_used = static_cast<si8>(values.size());
+    if (differences.empty()) {
+        return estimate;
+    }
+    
+    auto is_multiple = [](sf8 value, sf8 step) {
+        sf8 counts = value / step;
+        return std::abs(counts - std::round(counts)) <= Impl::RESOLUTION_TOLERANCE;
+    };
+    
+    // The smallest difference is k * LSB for some small k; try the largest
+    // step first so that a coarse ADC is not mistaken for a finer one.
+    sf8 min_diff = *std::min_element(differences.begin(), differences.end());
+    for (si4 divisor = 1; divisor <= Impl::RESOLUTION_MAX_DIVISOR; ++divisor) {
+        sf8 step = min_diff / divisor;
+        if (max_abs / step > static_cast<sf8>(RED_MAXIMUM_SAMPLE_VALUE)) {
+            break;
+        }
+        bool consistent = std::all_of(differences.begin(), differences.end(),
+                                      [&](sf8 d) { return is_multiple(d, step); }) &&
+                          std::all_of(values.begin(), values.end(),
+                                      [&](sf8 v) { return is_multiple(v, step); });
+        if (consistent) {
+            estimate.found = true;
+            estimate.resolution = step;
+            break;
+        }
+    }
+    if (!estimate.found) {
+        return estimate;
+    }
+    
+    // Compare encoded sizes of the training window under both scalings
+    auto encoded_bytes = [&](sf8 scale) {
+        std::vector<si4> samples(values.size());
+        for (size_t i = 0; i < values.size(); ++i) {
+            samples[i] = static_cast<si4>(std::round(values[i] * scale));
+        }
+        size_t bytes = 0;
+        size_t len = static_cast<size_t>(std::max(block_len, 1));
+        for (size_t pos = 0; pos < samples.size(); pos += len) {
+            ui4 count = static_cast<ui4>(std::min(len, samples.size() - pos));
+            bytes += REDCodec::compress(samples.data() + pos, count, 0).compressed_data.size();
+        }
+        return bytes;
+    };
+    size_t full_range_bytes = encoded_bytes(full_range_scale(values.data(), values.size()));
+    size_t resolution_bytes = encoded_bytes(1.0 / estimate.resolution);
+    if (resolution_bytes > 0) {
+        estimate.expected_compression_gain =
+            static_cast<sf8>(full_range_bytes) / static_cast<sf8>(resolution_bytes);
+    }
+    
+    return estimate;
+}
+
+si8 MefWriter::get_clipped_samples(const std::string& channel_name) const {
+    ChannelHandle handle = INVALID_CHANNEL_HANDLE;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_impl->registry_mutex);
+        auto it = m_impl->channel_handles.find(channel_name);
+        if (it == m_impl->channel_handles.end()) {
+            throw std::runtime_error("Channel not found: " + channel_name);
+        }
+        handle = it->second;
+    }
+    auto& state = channel_state(handle);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.clipped_samples;
+}
+
+MefWriter::ResolutionEstimate MefWriter::get_resolution_estimate(
+    const std::string& channel_name) const {
+    ChannelHandle handle = INVALID_CHANNEL_HANDLE;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_impl->registry_mutex);
+        auto it = m_impl->channel_handles.find(channel_name);
+        if (it == m_impl->channel_handles.end()) {
+            throw std::runtime_error("Channel not found: " + channel_name);
+        }
+        handle = it->second;
+    }
+    auto& state = channel_state(handle);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.resolution;
+}
+
+MefWriter::BlockLengthEstimate MefWriter::estimate_block_len(const si4* samples,
+                                                             size_t num_samples,
+                                                             sf8 sampling_frequency,
+                                                             sf8 query_seconds,
+                                                             sf8 latency_weight,
+                                                             const std::vector<si4>& candidates) {
+    BlockLengthEstimate estimate;
+    size_t n = std::min(num_samples, Impl::BLOCK_TUNING_SAMPLES);
+    estimate.samples_used = static_cast<si8>(n);
+    if (n == 0 || sampling_frequency <= 0.0) {
+        return estimate;
+    }
+    
+    std::vector<si4> lengths = candidates;
+    if (lengths.empty()) {
+        for (sf8 seconds = Impl::BLOCK_TUNING_MIN_SECONDS; seconds <= Impl::BLOCK_TUNING_MAX_SECONDS;
+             seconds *= 2.0) {
+            lengths.push_back(std::max(Impl::BLOCK_TUNING_MIN_LEN,
+                                       static_cast<si4>(std::lround(seconds * sampling_frequency))));
+        }
+    }
+    std::sort(lengths.begin(), lengths.end());
+    lengths.erase(std::unique(lengths.begin(), lengths.end()), lengths.end());
+    
+    // Expected blocks touched by a window of query_samples at a random offset
+    sf8 query_samples = std::max(1.0, query_seconds * sampling_frequency);
+    std::vector<std::vector<ui1>> blocks;
+    for (si4 len : lengths) {
+        if (len <= 0 || static_cast<size_t>(len) * 2 > n) {
+            continue;
+        }
+        
+        BlockLengthCandidate candidate;
+        candidate.block_len = len;
+        blocks.clear();
+        for (size_t pos = 0; pos < n; pos += static_cast<size_t>(len)) {
+            ui4 count = static_cast<ui4>(std::min(static_cast<size_t>(len), n - pos));
+            auto result = REDCodec::compress(samples + pos, count, 0);
+            if (!result.success) {
+                throw std::runtime_error("Compression failed");
+            }
+            candidate.compressed_bytes += static_cast<si8>(result.compressed_data.size());
+            blocks.push_back(std::move(result.compressed_data));
+        }
+        candidate.index_bytes = static_cast<si8>(blocks.size()) * TIME_SERIES_INDEX_BYTES;
+        candidate.bytes_per_sample = static_cast<sf8>(candidate.compressed_bytes + candidate.index_bytes) /
+                                     static_cast<sf8>(n);
+        
+        sf8 decode_seconds = std::numeric_limits<sf8>::max();
+        for (int pass = 0; pass < Impl::BLOCK_TUNING_DECODE_PASSES; ++pass) {
+            auto start = std::chrono::steady_clock::now();
+            for (const auto& block : blocks) {
+                auto result = REDCodec::decompress(block.data(), block.size());
+                if (!result.success) {
+                    throw std::runtime_error("Decompression failed");
+                }
+            }
+            decode_seconds = std::min(decode_seconds, std::chrono::duration<sf8>(
+                std::chrono::steady_clock::now() - start).count());
+        }
+        sf8 query_blocks = (query_samples - 1.0) / len + 1.0;
+        candidate.query_seconds = query_blocks * decode_seconds / static_cast<sf8>(blocks.size());
+        estimate.candidates.push_back(candidate);
+    }
+    if (estimate.candidates.empty()) {
+        return estimate;
+    }
+    
+    sf8 min_bytes = std::numeric_limits<sf8>::max();
+    sf8 min_seconds = std::numeric_limits<sf8>::max();
+    for (const auto& candidate : estimate.candidates) {
+        min_bytes = std::min(min_bytes, candidate.bytes_per_sample);
+        min_seconds = std::min(min_seconds, candidate.query_seconds);
+    }
+    min_seconds = std::max(min_seconds, 1e-12);
+    const BlockLengthCandidate* best = nullptr;
+    for (auto& candidate : estimate.candidates) {
+        candidate.cost = candidate.bytes_per_sample / min_bytes +
+                         latency_weight * candidate.query_seconds / min_seconds;
+        if (!best || candidate.cost < best->cost) {
+            best = &candidate;
+        }
+    }
+    estimate.found = true;
+    estimate.block_len = best->block_len;
+    return estimate;
+}
+
+MefWriter::BlockLengthEstimate MefWriter::get_block_len_estimate(
+    const std::string& channel_name) const {
+    ChannelHandle handle = INVALID_CHANNEL_HANDLE;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_impl->registry_mutex);
+        auto it = m_impl->channel_handles.find(channel_name);
+        if (it == m_impl->channel_handles.end()) {
+            throw std::runtime_error("Channel not found: " + channel_name);
+        }
+        handle = it->second;
+    }
+    auto& state = channel_state(handle);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.block_len_estimate;
 }
 
 void MefWriter::write_raw_data(const std::vector<si4>& data,
@@ -263,7 +842,7 @@ void MefWriter::write_raw_data(const std::vector<si4>& data,
                                 si8 start_uutc,
                                 sf8 sampling_freq,
                                 bool new_segment) {
-    if (m_closed) {
+    if (m_impl->closed) {
         throw std::runtime_error("Writer is closed");
     }
     
@@ -271,122 +850,561 @@ void MefWriter::write_raw_data(const std::vector<si4>& data,
         return;
     }
     
-    // Ensure channel exists
-    ensure_channel(channel_name, sampling_freq);
-    auto& state = m_channel_states[channel_name];
+    write_raw_data(open_channel(channel_name, sampling_freq), data.data(), data.size(),
+                   start_uutc, new_segment);
+}
+
+void MefWriter::write_raw_data(ChannelHandle channel,
+                                const si4* data,
+                                size_t num_samples,
+                                si8 start_uutc,
+                                bool new_segment) {
+    if (m_impl->closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    
+    if (num_samples == 0) {
+        return;
+    }
+    
+    auto& state = channel_state(channel);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    append_raw_data(state, data, num_samples, start_uutc, new_segment);
+}
+
+void MefWriter::write_data(ChannelHandle channel,
+                           const sf8* data,
+                           const si8* timestamps,
+                           size_t num_samples,
+                           si4 precision) {
+    if (m_impl->closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    if (num_samples == 0) {
+        return;
+    }
+    
+    auto& state = channel_state(channel);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    append_data(state, data, num_samples, timestamps[0], precision, false, timestamps);
+}
+
+void MefWriter::write_raw_data(ChannelHandle channel,
+                               const si4* data,
+                               const si8* timestamps,
+                               size_t num_samples) {
+    if (m_impl->closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    if (num_samples == 0) {
+        return;
+    }
+    
+    auto& state = channel_state(channel);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    append_timestamped_data(state, data, timestamps, num_samples);
+}
+
+void MefWriter::set_units_conversion_factor(ChannelHandle channel, sf8 value) {
+    auto& state = channel_state(channel);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.units_conversion_factor = value;
+}
+
+void MefWriter::set_channel_block_len(ChannelHandle channel, si4 value) {
+    auto& state = channel_state(channel);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.block_len = value;
+}
+
+si4 MefWriter::channel_block_len(const ChannelState& state) const {
+    return state.block_len > 0 ? state.block_len : m_block_len;
+}
+
+void MefWriter::write_compressed_blocks(ChannelHandle channel,
+                                        const std::vector<CompressedBlock>& blocks) {
+    if (m_impl->closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    if (blocks.empty()) {
+        return;
+    }
+    
+    auto& state = channel_state(channel);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    append_compressed_blocks(state, blocks.data(), blocks.size());
+}
+
+void MefWriter::append_compressed_blocks(ChannelState& state,
+                                         const CompressedBlock* blocks,
+                                         size_t num_blocks) {
+    sf8 sample_period = 1e6 / state.sampling_frequency;
+    si8 max_gap = static_cast<si8>(2.0 * channel_block_len(state) * sample_period);
+    flush_pending(state);
+    
+    std::vector<ui1> flagged;
+    for (size_t b = 0; b < num_blocks; ++b) {
+        const auto& block = blocks[b];
+        if (!REDCodec::validate_block(block.data.data(), block.data.size())) {
+            throw std::runtime_error("Invalid RED block (size or CRC mismatch) at start time " +
+                                     std::to_string(block.index.start_time));
+        }
+        REDBlockHeader header;
+        std::memcpy(&header, block.data.data(), RED_BLOCK_HEADER_BYTES);
+        if (header.number_of_samples != block.index.number_of_samples ||
+            header.start_time != block.index.start_time) {
+            throw std::runtime_error("RED block header does not match its index entry at start time " +
+                                     std::to_string(block.index.start_time));
+        }
+        if (header.number_of_samples == 0) {
+            continue;
+        }
+        
+        // Same segment and gap rules as sample data, applied at block starts
+        bool discontinuity = false;
+        if (state.current_segment < 0) {
+            create_segment(state);
+            discontinuity = true;
+        } else if (state.last_end_time != UUTC_NO_ENTRY) {
+            si8 gap = header.start_time - (state.last_end_time + static_cast<si8>(sample_period));
+            if (std::abs(gap) > max_gap) {
+                finalize_segment(state);
+                create_segment(state);
+                discontinuity = true;
+            } else if (std::abs(gap) > static_cast<si8>(sample_period / 2)) {
+                discontinuity = true;
+            }
+        }
+        state.pending_discontinuity = discontinuity;
+        roll_over_if_due(state, header.start_time);
+        discontinuity = state.pending_discontinuity;
+        state.pending_discontinuity = false;
+        
+        TimeSeriesIndex index = block.index;
+        if (discontinuity && !header.is_discontinuity()) {
+            // Flags are covered by the block CRC
+            flagged = block.data;
+            header.set_discontinuity(true);
+            std::memcpy(flagged.data(), &header, RED_BLOCK_HEADER_BYTES);
+            header.block_CRC = CRC32::calculate(flagged.data() + 4, flagged.size() - 4);
+            std::memcpy(flagged.data(), &header.block_CRC, sizeof(ui4));
+            index.RED_block_flags = header.flags;
+            append_block(state, flagged.data(), flagged.size(), index);
+        } else {
+            index.RED_block_flags = header.flags;
+            append_block(state, block.data.data(), block.data.size(), index);
+        }
+        state.last_end_time = header.start_time +
+            static_cast<si8>((header.number_of_samples - 1) * sample_period);
+    }
+    
+    if (m_durability_mode == DurabilityMode::PERIODIC &&
+        std::chrono::duration<sf8>(std::chrono::steady_clock::now() - state.last_sync).count() >=
+            m_sync_interval) {
+        checkpoint(state);
+    }
+}
+
+void MefWriter::append_timestamped_data(ChannelState& state,
+                                         const si4* data,
+                                         const si8* timestamps,
+                                         size_t num_samples) {
+    sf8 sample_period = 1e6 / state.sampling_frequency;
+    sf8 tolerance = m_timestamp_tolerance > 0 ? static_cast<sf8>(m_timestamp_tolerance)
+                                              : sample_period / 2.0;
+    si8 min_step = std::max<si8>(1, static_cast<si8>(std::floor(sample_period - tolerance)));
+    si8 max_step = static_cast<si8>(std::ceil(sample_period + tolerance));
+    
+    // Write each run of regularly spaced samples as contiguous data
+    size_t run_start = 0;
+    while (run_start < num_samples) {
+        size_t run_length = find_timestamp_break(timestamps + run_start, num_samples - run_start,
+                                                 min_step, max_step);
+        append_raw_data(state, data + run_start, run_length, timestamps[run_start], false,
+                        timestamps + run_start);
+        run_start += run_length;
+    }
+}
+
+size_t MefWriter::find_timestamp_break(const si8* timestamps, size_t num_samples,
+                                       si8 min_step, si8 max_step) {
+    // Scan fixed-width chunks with a branch-free body the compiler turns
+    // into SIMD compares; only a chunk with a hit is rescanned serially
+    constexpr size_t LANES = 16;
+    size_t i = 0;
+    while (i + LANES < num_samples) {
+        unsigned hits = 0;
+        for (size_t k = 0; k < LANES; ++k) {
+            si8 step = timestamps[i + k + 1] - timestamps[i + k];
+            hits |= static_cast<unsigned>(step < min_step) | static_cast<unsigned>(step > max_step);
+        }
+        if (hits) {
+            break;
+        }
+        i += LANES;
+    }
+    for (; i + 1 < num_samples; ++i) {
+        si8 step = timestamps[i + 1] - timestamps[i];
+        if (step < min_step || step > max_step) {
+            return i + 1;
+        }
+    }
+    return num_samples;
+}
+
+void MefWriter::append_raw_data(ChannelState& state,
+                                 const si4* data,
+                                 size_t num_samples,
+                                 si8 start_uutc,
+                                 bool new_segment,
+                                 const si8* timestamps) {
+    if (m_auto_block_len && !state.block_len_tuned) {
+        state.block_len_tuned = true;
+        if (state.block_len == 0) {
+            state.block_len_estimate = estimate_block_len(data, num_samples, state.sampling_frequency,
+                                                          m_block_query_seconds,
+                                                          m_block_latency_weight);
+            if (state.block_len_estimate.found) {
+                state.block_len = state.block_len_estimate.block_len;
+            }
+        }
+    }
+    
+    const si4* end = data + num_samples;
+    const si4* nan = m_max_nans < 0 ? end : std::find(data, end, RED_NAN);
+    if (nan == end) {
+        append_run(state, data, num_samples, start_uutc, new_segment, timestamps);
+        return;
+    }
+    
+    // NaN runs longer than max_nans_written are not stored: the samples
+    // around them are written as separate runs, leaving a time gap
+    sf8 sample_period = 1e6 / state.sampling_frequency;
+    auto sample_time = [&](size_t i) {
+        return timestamps ? timestamps[i] : start_uutc + static_cast<si8>(i * sample_period);
+    };
+    size_t run_start = 0;
+    while (nan != end) {
+        const si4* nan_end = std::find_if(nan, end, [](si4 v) { return v != RED_NAN; });
+        size_t nan_first = static_cast<size_t>(nan - data);
+        size_t nan_count = static_cast<size_t>(nan_end - nan);
+        if (nan_count > static_cast<size_t>(m_max_nans)) {
+            if (nan_first > run_start) {
+                append_run(state, data + run_start, nan_first - run_start, sample_time(run_start),
+                           new_segment && run_start == 0,
+                           timestamps ? timestamps + run_start : nullptr);
+            }
+            // The run is recorded on the first block written after it
+            flush_pending(state);
+            state.nan_gap_samples += static_cast<si8>(nan_count);
+            run_start = nan_first + nan_count;
+        }
+        nan = std::find(nan_end, end, RED_NAN);
+    }
+    if (run_start < num_samples) {
+        append_run(state, data + run_start, num_samples - run_start, sample_time(run_start),
+                   new_segment && run_start == 0,
+                   timestamps ? timestamps + run_start : nullptr);
+    }
+}
+
+void MefWriter::append_run(ChannelState& state,
+                           const si4* data,
+                           size_t num_samples,
+                           si8 start_uutc,
+                           bool new_segment,
+                           const si8* timestamps) {
+    sf8 sampling_freq = state.sampling_frequency;
+    sf8 sample_period = 1e6 / sampling_freq;
     
     // Check if we need a new segment
     bool need_new_segment = new_segment || (state.current_segment < 0);
+    bool contiguous = false;
     
     // Check for time discontinuity (more than 2 blocks worth of gap)
     if (!need_new_segment && state.last_end_time != UUTC_NO_ENTRY) {
-        si8 expected_start = state.last_end_time + static_cast<si8>(1e6 / sampling_freq);
+        si8 expected_start = state.last_end_time + static_cast<si8>(sample_period);
         si8 gap = start_uutc - expected_start;
-        si8 max_gap = static_cast<si8>(2.0 * m_block_len * 1e6 / sampling_freq);
+        si8 max_gap = static_cast<si8>(2.0 * channel_block_len(state) * sample_period);
         
         if (std::abs(gap) > max_gap) {
             need_new_segment = true;
         }
+        contiguous = std::abs(gap) <= static_cast<si8>(sample_period / 2);
     }
     
     if (need_new_segment) {
         // Finalize current segment if exists
         if (state.current_segment >= 0) {
-            finalize_segment(channel_name, state.current_segment);
+            flush_pending(state);
+            finalize_segment(state);
         }
-        create_segment(channel_name);
+        create_segment(state);
+        state.pending_discontinuity = true;
+    } else if (!contiguous) {
+        // Pending samples cannot be joined with data that starts elsewhere
+        flush_pending(state);
+        state.pending_discontinuity = true;
     }
     
-    // Write data in blocks
-    size_t samples_written = 0;
-    bool first_block_in_write = true;
-    
-    while (samples_written < data.size()) {
-        // Determine block size
-        size_t remaining = data.size() - samples_written;
-        ui4 block_samples = static_cast<ui4>(std::min(remaining, 
-                                                       static_cast<size_t>(m_block_len)));
-        
-        // Calculate block start time
-        si8 block_time = start_uutc + static_cast<si8>(samples_written * 1e6 / sampling_freq);
+    // Cut blocks at the block length, at aligned block boundaries and at
+    // segment rollover boundaries;
+    // keep the remainder pending for the next call
+    size_t block_len = static_cast<size_t>(std::max(channel_block_len(state), 1));
+    size_t consumed = 0;
+    while (consumed < num_samples) {
+        si8 sample_time = timestamps ? timestamps[consumed]
+                                     : start_uutc + static_cast<si8>(consumed * sample_period);
+        if (state.pending.empty()) {
+            roll_over_if_due(state, sample_time);
+            state.pending_start_time = sample_time;
+            state.block_end_time = UUTC_NO_ENTRY;
+            if (m_block_alignment > 0) {
+                state.block_end_time = sample_time -
+                    ((sample_time % m_block_alignment) + m_block_alignment) % m_block_alignment +
+                    m_block_alignment;
+            }
+        }
         
-        // Write block
-        bool is_discontinuity = first_block_in_write && need_new_segment;
-        write_block(channel_name, data.data() + samples_written, block_samples, 
-                    block_time, is_discontinuity);
+        size_t take = std::min(block_len - state.pending.size(), num_samples - consumed);
+        bool at_boundary = false;
+        for (si8 boundary : {state.segment_end_time, state.block_end_time}) {
+            if (boundary == UUTC_NO_ENTRY) {
+                continue;
+            }
+            size_t before = timestamps
+                ? static_cast<size_t>(std::lower_bound(timestamps + consumed, timestamps + num_samples,
+                                                       boundary) - (timestamps + consumed))
+                : samples_before(boundary, start_uutc, consumed, sample_period);
+            if (before <= take) {
+                take = before;
+                at_boundary = true;
+            }
+        }
+        if (take == 0) {
+            // The pending block ends right at the boundary
+            flush_pending(state);
+            continue;
+        }
         
-        samples_written += block_samples;
-        first_block_in_write = false;
+        bool complete = at_boundary || state.pending.size() + take == block_len;
+        if (!complete) {
+            state.pending.insert(state.pending.end(), data + consumed, data + consumed + take);
+        } else if (state.pending.empty()) {
+            write_block(state, data + consumed, static_cast<ui4>(take),
+                        state.pending_start_time, state.pending_discontinuity);
+            state.pending_discontinuity = false;
+        } else {
+            state.pending.insert(state.pending.end(), data + consumed, data + consumed + take);
+            flush_pending(state);
+        }
+        consumed += take;
     }
     
     // Update state
-    state.last_end_time = start_uutc + static_cast<si8>((data.size() - 1) * 1e6 / sampling_freq);
-    state.total_samples += static_cast<si8>(data.size());
+    state.last_end_time = timestamps ? timestamps[num_samples - 1]
+                                     : start_uutc + static_cast<si8>((num_samples - 1) * sample_period);
+    
+    if (m_durability_mode == DurabilityMode::PERIODIC &&
+        std::chrono::duration<sf8>(std::chrono::steady_clock::now() - state.last_sync).count() >=
+            m_sync_interval) {
+        checkpoint(state);
+    }
+}
+
+size_t MefWriter::samples_before(si8 boundary, si8 start_uutc, size_t consumed,
+                                 sf8 sample_period) {
+    // Samples k >= consumed with start_uutc + k * period < boundary
+    sf8 limit = std::ceil(static_cast<sf8>(boundary - start_uutc) / sample_period - 1e-9);
+    if (limit <= static_cast<sf8>(consumed)) {
+        return 0;
+    }
+    sf8 count = limit - static_cast<sf8>(consumed);
+    return count >= static_cast<sf8>(std::numeric_limits<size_t>::max())
+           ? std::numeric_limits<size_t>::max() : static_cast<size_t>(count);
+}
+
+void MefWriter::roll_over_if_due(ChannelState& state, si8 sample_time) {
+    bool due = (state.segment_end_time != UUTC_NO_ENTRY && sample_time >= state.segment_end_time) ||
+               (m_segment_rollover_bytes > 0 && !state.indices.empty() &&
+                state.data_file_offset >= m_segment_rollover_bytes);
+    if (due) {
+        finalize_segment(state);
+        create_segment(state);
+        state.pending_discontinuity = true;
+    }
+    
+    // The first sample of a segment fixes when it ends
+    if (state.segment_end_time == UUTC_NO_ENTRY && m_segment_rollover_seconds > 0.0) {
+        si8 duration = std::max<si8>(1, static_cast<si8>(std::llround(m_segment_rollover_seconds * 1e6)));
+        if (m_segment_rollover_aligned) {
+            si8 boundary = sample_time - ((sample_time % duration) + duration) % duration;
+            state.segment_end_time = boundary + duration;
+        } else {
+            state.segment_end_time = sample_time + duration;
+        }
+    }
+}
+
+void MefWriter::flush_pending(ChannelState& state) {
+    if (state.pending.empty()) {
+        return;
+    }
+    write_block(state, state.pending.data(), static_cast<ui4>(state.pending.size()),
+                state.pending_start_time, state.pending_discontinuity);
+    state.pending.clear();
+    state.pending_discontinuity = false;
 }
 
-void MefWriter::write_block(const std::string& channel_name,
+void MefWriter::write_block(ChannelState& state,
                              const si4* samples, ui4 num_samples, si8 start_time,
                              bool is_discontinuity) {
-    auto& state = m_channel_states[channel_name];
-    
     // Compress the block
     REDCodec::CompressionParams params;
     params.discontinuity = is_discontinuity;
+    params.nan_gap_samples = state.nan_gap_samples;
+    state.nan_gap_samples = 0;
+    
+    // Pick a block scale factor that holds the requested relative precision
+    if (m_block_relative_precision > 0.0) {
+        sf8 max_abs = 0.0;
+        for (ui4 i = 0; i < num_samples; ++i) {
+            if (samples[i] != RED_NAN) {
+                max_abs = std::max(max_abs, std::abs(static_cast<sf8>(samples[i])));
+            }
+        }
+        sf8 scale = std::floor(m_block_relative_precision * max_abs);
+        if (scale > 1.0) {
+            params.mode = RED_FIXED_SCALE_FACTOR;
+            params.scale_factor = static_cast<sf4>(std::min(scale, Impl::MAXIMUM_BLOCK_SCALE_FACTOR));
+        }
+    }
     
     auto result = REDCodec::compress(samples, num_samples, start_time, params);
     if (!result.success) {
         throw std::runtime_error("Compression failed");
     }
     
-    // Get current file offset
-    si8 file_offset = m_impl->data_file_offsets[channel_name];
-    
+    append_block(state, result.compressed_data.data(), result.compressed_data.size(),
+                 result.index);
+}
+
+void MefWriter::append_block(ChannelState& state, const ui1* block_data, size_t block_bytes,
+                             TimeSeriesIndex index) {
     // Update index
-    result.index.file_offset = file_offset;
-    result.index.start_sample = state.last_sample_index;
-    state.indices.push_back(result.index);
+    index.file_offset = state.data_file_offset;
+    index.start_sample = state.last_sample_index;
+    state.indices.push_back(index);
     
     // Write compressed data
-    auto& data_file = m_impl->data_files[channel_name];
-    data_file.write(reinterpret_cast<const char*>(result.compressed_data.data()),
-                    static_cast<std::streamsize>(result.compressed_data.size()));
+    m_impl->file_pool.append(state.data_file, block_data, block_bytes);
     
     // Update offset
-    m_impl->data_file_offsets[channel_name] += static_cast<si8>(result.compressed_data.size());
+    state.data_file_offset += static_cast<si8>(block_bytes);
     
     // Update sample index
-    state.last_sample_index += num_samples;
+    state.last_sample_index += index.number_of_samples;
+    state.total_samples += index.number_of_samples;
     state.total_blocks++;
 }
 
-void MefWriter::finalize_segment(const std::string& channel_name, si4 segment_num) {
-    // Close data file
-    auto file_it = m_impl->data_files.find(channel_name);
-    if (file_it != m_impl->data_files.end()) {
-        file_it->second.close();
-        m_impl->data_files.erase(file_it);
+void MefWriter::finalize_segment(ChannelState& state) {
+    // Remember the compression density to size the next preallocation
+    si8 segment_samples = 0;
+    for (const auto& idx : state.indices) {
+        segment_samples += idx.number_of_samples;
+    }
+    if (segment_samples > 0) {
+        state.compressed_bytes_per_sample =
+            static_cast<sf8>(state.data_file_offset - UNIVERSAL_HEADER_BYTES) /
+            static_cast<sf8>(segment_samples);
+    }
+    
+    // Close data file (truncates any preallocated space); data reaches
+    // the disk before the index and metadata that describe it
+    bool durable = m_durability_mode != DurabilityMode::NONE;
+    if (state.data_file != FilePool::INVALID_FILE_ID) {
+        if (durable) {
+            m_impl->timed_sync([&] { m_impl->file_pool.sync(state.data_file); });
+        }
+        m_impl->file_pool.close(state.data_file);
+        state.data_file = FilePool::INVALID_FILE_ID;
+        if (durable) {
+            // Truncation of preallocated space changes the file size
+            fs::path data_path = segment_path(state) / (segment_name(state) + ".tdat");
+            sync_file(data_path.string());
+        }
     }
     
-    // Write metadata and indices
-    write_metadata(channel_name, segment_num);
-    write_indices(channel_name, segment_num);
+    // Write indices, then the metadata that summarizes them
+    write_indices(state, durable);
+    write_metadata(state, durable);
+    
+    // The closed segment is no longer touched by this writer
+    if (m_compaction_block_len > 0 && state.indices.size() > 1 && m_impl->storage->is_local()) {
+        m_impl->enqueue_compaction(segment_path(state).string(), m_compaction_block_len);
+    }
 }
 
-void MefWriter::write_metadata(const std::string& channel_name, si4 segment_num) {
-    auto& state = m_channel_states[channel_name];
+void MefWriter::checkpoint(ChannelState& state) {
+    if (state.current_segment < 0) {
+        return;
+    }
     
-    // Format segment name
-    char seg_num_str[16];
-    snprintf(seg_num_str, sizeof(seg_num_str), "%06d", segment_num);
-    std::string segment_name = channel_name + "-" + seg_num_str;
+    flush_pending(state);
+    if (state.data_file != FilePool::INVALID_FILE_ID) {
+        m_impl->timed_sync([&] { m_impl->file_pool.sync(state.data_file); });
+    }
+    write_indices(state, true);
+    write_metadata(state, true);
     
-    fs::path segment_path = state.path / (segment_name + ".segd");
-    fs::path meta_path = segment_path / (segment_name + ".tmet");
+    state.last_sync = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_impl->sync_mutex);
+    m_impl->sync_statistics.checkpoints++;
+}
+
+void MefWriter::sync_file(const std::string& path) {
+    // Opened for writing, as some platforms only flush writable descriptors
+    m_impl->timed_sync([&] { m_impl->storage->open(path, Storage::OpenMode::WRITE)->sync(); });
+}
+
+void MefWriter::sync_directory(const fs::path& path) {
+    m_impl->timed_sync([&] { m_impl->storage->sync_directory(path.string()); });
+}
+
+MefWriter::SyncStatistics MefWriter::get_sync_statistics() const {
+    std::lock_guard<std::mutex> lock(m_impl->sync_mutex);
+    return m_impl->sync_statistics;
+}
+
+CompactionStatistics MefWriter::get_compaction_statistics() const {
+    std::lock_guard<std::mutex> lock(m_impl->compaction_mutex);
+    return m_impl->compaction_statistics;
+}
+
+void MefWriter::write_metadata(ChannelState& state, bool durable) {
+    fs::path seg_path = segment_path(state);
+    fs::path meta_path = seg_path / (segment_name(state) + ".tmet");
     
-    std::ofstream file(meta_path, std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Cannot create metadata file: " + meta_path.string());
-    }
+    // Rewrites go through a temporary file and a rename, so live readers and
+    // crashes (when durable) see either the old or the new metadata
+    fs::path write_path = meta_path;
+    write_path += ".tmp";
+    
+    // The file is assembled in memory and written at once
+    std::vector<ui1> bytes(METADATA_FILE_BYTES, 0);
     
     // Calculate time bounds from indices
     si8 start_time = UUTC_NO_ENTRY;
@@ -407,31 +1425,28 @@ void MefWriter::write_metadata(const std::string& channel_name, si4 segment_num)
     // Create and write universal header
     UniversalHeader uh;
     uh.set_file_type(TIME_SERIES_METADATA_FILE_TYPE_STRING);
-    uh.set_channel_name(channel_name);
+    uh.set_channel_name(state.name);
     uh.set_session_name(m_session_name);
-    uh.segment_number = segment_num;
+    uh.segment_number = state.current_segment;
     uh.start_time = start_time;
     uh.end_time = end_time;
     uh.number_of_entries = 1;
     std::memcpy(uh.level_UUID.data(), m_impl->session_uuid.data(), UUID_BYTES);
     
-    file.write(reinterpret_cast<const char*>(&uh), sizeof(uh));
-    
-    // Write metadata section 1
-    MetadataSection1 meta1;
-    file.seekp(UNIVERSAL_HEADER_BYTES);
+    std::memcpy(bytes.data(), &uh, sizeof(uh));
     
-    // Pad to section 2 offset
-    std::vector<ui1> padding(METADATA_SECTION_2_OFFSET - file.tellp(), PAD_BYTE_VALUE);
-    file.write(reinterpret_cast<const char*>(padding.data()), 
-               static_cast<std::streamsize>(padding.size()));
+    // Metadata section 1 is left as padding up to the section 2 offset
+    std::fill(bytes.begin() + UNIVERSAL_HEADER_BYTES, bytes.begin() + METADATA_SECTION_2_OFFSET,
+              PAD_BYTE_VALUE);
     
     // Write time series metadata section 2
     TimeSeriesMetadataSection2 meta2;
     meta2.sampling_frequency = state.sampling_frequency;
     meta2.number_of_samples = total_samples;
     meta2.number_of_blocks = static_cast<si8>(state.indices.size());
-    meta2.units_conversion_factor = m_units_conversion_factor;
+    meta2.units_conversion_factor = state.units_conversion_factor > 0.0
+                                        ? state.units_conversion_factor
+                                        : m_units_conversion_factor;
     meta2.set_units_description(m_data_units);
     
     // Copy description strings
@@ -462,10 +1477,9 @@ void MefWriter::write_metadata(const std::string& channel_name, si4 segment_num)
         }
     }
     
-    file.write(reinterpret_cast<const char*>(&meta2), sizeof(meta2));
+    std::memcpy(bytes.data() + METADATA_SECTION_2_OFFSET, &meta2, sizeof(meta2));
     
     // Write metadata section 3
-    file.seekp(METADATA_SECTION_3_OFFSET);
     MetadataSection3 meta3;
     meta3.recording_time_offset = m_recording_time_offset;
     meta3.GMT_offset = m_gmt_offset;
@@ -477,32 +1491,50 @@ void MefWriter::write_metadata(const std::string& channel_name, si4 segment_num)
     std::strncpy(meta3.recording_location.data(), m_recording_location.c_str(),
                  METADATA_RECORDING_LOCATION_BYTES - 1);
     
-    file.write(reinterpret_cast<const char*>(&meta3), sizeof(meta3));
+    std::memcpy(bytes.data() + METADATA_SECTION_3_OFFSET, &meta3, sizeof(meta3));
     
     // Pad to full metadata file size
-    file.seekp(0, std::ios::end);
-    si8 current_size = file.tellp();
-    if (current_size < METADATA_FILE_BYTES) {
-        padding.resize(METADATA_FILE_BYTES - current_size, PAD_BYTE_VALUE);
-        file.write(reinterpret_cast<const char*>(padding.data()),
-                   static_cast<std::streamsize>(padding.size()));
+    std::fill(bytes.begin() + METADATA_SECTION_3_OFFSET + sizeof(meta3), bytes.end(), PAD_BYTE_VALUE);
+    
+    {
+        auto file = m_impl->storage->open(write_path.string(), Storage::OpenMode::TRUNCATE);
+        file->pwrite(bytes.data(), bytes.size(), 0);
+    }
+    if (durable) {
+        sync_file(write_path.string());
+    }
+    m_impl->storage->rename(write_path.string(), meta_path.string());
+    if (durable) {
+        sync_directory(seg_path);
     }
 }
 
-void MefWriter::write_indices(const std::string& channel_name, si4 segment_num) {
-    auto& state = m_channel_states[channel_name];
-    
-    // Format segment name
-    char seg_num_str[16];
-    snprintf(seg_num_str, sizeof(seg_num_str), "%06d", segment_num);
-    std::string segment_name = channel_name + "-" + seg_num_str;
-    
-    fs::path segment_path = state.path / (segment_name + ".segd");
-    fs::path idx_path = segment_path / (segment_name + ".tidx");
+void MefWriter::write_indices(ChannelState& state, bool durable) {
+    fs::path idx_path = segment_path(state) / (segment_name(state) + ".tidx");
+    
+    // Entries are appended after those already in the file; a new file
+    // starts with an empty header so it never counts unwritten entries
+    bool append = state.indices_persisted > 0 && m_impl->storage->exists(idx_path.string());
+    if (!append) {
+        state.indices_persisted = 0;
+        state.indices_crc = CRC32::CRC_START_VALUE;
+    }
+    auto file = m_impl->storage->open(idx_path.string(), append ? Storage::OpenMode::WRITE
+                                                                : Storage::OpenMode::TRUNCATE);
+    if (!append) {
+        UniversalHeader empty;
+        file->pwrite(&empty, sizeof(empty), 0);
+    }
     
-    std::ofstream file(idx_path, std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Cannot create index file: " + idx_path.string());
+    // Append new entries
+    const TimeSeriesIndex* new_entries = state.indices.data() + state.indices_persisted;
+    size_t new_bytes = (state.indices.size() - state.indices_persisted) * sizeof(TimeSeriesIndex);
+    file->pwrite(new_entries, new_bytes,
+                 static_cast<si8>(UNIVERSAL_HEADER_BYTES + state.indices_persisted * sizeof(TimeSeriesIndex)));
+    state.indices_crc = CRC32::update(reinterpret_cast<const ui1*>(new_entries), new_bytes,
+                                      state.indices_crc);
+    if (durable) {
+        m_impl->timed_sync([&] { file->sync(); });
     }
     
     // Calculate time bounds
@@ -524,48 +1556,442 @@ void MefWriter::write_indices(const std::string& channel_name, si4 segment_num)
     // Create universal header
     UniversalHeader uh;
     uh.set_file_type(TIME_SERIES_INDICES_FILE_TYPE_STRING);
-    uh.set_channel_name(channel_name);
+    uh.set_channel_name(state.name);
     uh.set_session_name(m_session_name);
-    uh.segment_number = segment_num;
+    uh.segment_number = state.current_segment;
     uh.start_time = start_time;
     uh.end_time = end_time;
     uh.number_of_entries = static_cast<si8>(state.indices.size());
     uh.maximum_entry_size = max_entry_size;
+    uh.body_CRC = state.indices_crc;
     std::memcpy(uh.level_UUID.data(), m_impl->session_uuid.data(), UUID_BYTES);
     
-    // Calculate CRCs
-    uh.body_CRC = CRC32::calculate(
-        reinterpret_cast<const ui1*>(state.indices.data()),
-        state.indices.size() * sizeof(TimeSeriesIndex));
+    // The header is updated only after the entries it counts are written
+    file->pwrite(&uh, sizeof(uh), 0);
+    if (durable) {
+        m_impl->timed_sync([&] { file->sync(); });
+    }
+    state.indices_persisted = state.indices.size();
+}
+
+// ============================================================================
+// Records
+// ============================================================================
+
+void MefWriter::write_record(const Record& record, const std::string& channel_name) {
+    write_records(std::vector<Record>{record}, channel_name);
+}
+
+void MefWriter::write_records(const std::vector<Record>& records, const std::string& channel_name) {
+    if (!channel_name.empty()) {
+        std::shared_lock<std::shared_mutex> lock(m_impl->registry_mutex);
+        if (m_impl->channel_handles.find(channel_name) == m_impl->channel_handles.end()) {
+            throw std::runtime_error("Channel not open: " + channel_name);
+        }
+    }
+    
+    // Within a batch records are stored in time order
+    std::vector<size_t> order(records.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return records[a].info.time < records[b].info.time;
+    });
+    
+    std::lock_guard<std::mutex> lock(m_impl->records_mutex);
+    if (m_impl->closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    if (records.empty()) {
+        return;
+    }
+    auto& file = record_file_state(channel_name);
+    bool durable = m_durability_mode != DurabilityMode::NONE;
+    
+    fs::path data_path = file.base;
+    data_path += ".rdat";
+    std::unique_ptr<StorageFile> data_file;
+    if (file.data_bytes == 0) {
+        data_file = m_impl->storage->open(data_path.string(), Storage::OpenMode::TRUNCATE);
+        UniversalHeader empty;
+        data_file->pwrite(&empty, sizeof(empty), 0);
+        file.data_bytes = UNIVERSAL_HEADER_BYTES;
+        file.data_crc = CRC32::CRC_START_VALUE;
+        if (durable) {
+            sync_directory(file.base.parent_path());
+        }
+    } else {
+        data_file = m_impl->storage->open(data_path.string(), Storage::OpenMode::WRITE);
+    }
+    
+    // Serialize the batch; the record CRC covers the body as stored
+    std::vector<ui1> data;
+    std::vector<RecordIndex> batch;
+    batch.reserve(records.size());
+    for (size_t i : order) {
+        const auto& info = records[i].info;
+        const auto& body = records[i].body;
+        if (info.type.empty() || info.type.size() >= TYPE_BYTES) {
+            throw std::runtime_error("Invalid record type: " + info.type);
+        }
+        bool has_key = info.encryption == NO_ENCRYPTION ||
+                       (info.encryption == LEVEL_1_ENCRYPTION && !m_password1.empty()) ||
+                       (info.encryption == LEVEL_2_ENCRYPTION && !m_password2.empty());
+        if (!has_key) {
+            throw std::runtime_error("No password for record encryption level " +
+                                     std::to_string(info.encryption));
+        }
+        
+        RecordHeader header;
+        header.set_type(info.type);
+        header.version_major = info.version_major;
+        header.version_minor = info.version_minor;
+        header.encryption = info.encryption;
+        header.bytes = static_cast<ui4>((body.size() + ENCRYPTION_BLOCK_BYTES - 1) /
+                                        ENCRYPTION_BLOCK_BYTES * ENCRYPTION_BLOCK_BYTES);
+        header.time = info.time;
+        
+        size_t offset = data.size();
+        data.resize(offset + RECORD_HEADER_BYTES + header.bytes, 0);
+        ui1* record_body = data.data() + offset + RECORD_HEADER_BYTES;
+        std::copy(body.begin(), body.end(), record_body);
+        if (info.encryption > NO_ENCRYPTION) {
+            const ui1* key = info.encryption == LEVEL_1_ENCRYPTION
+                             ? m_impl->password_data.level_1_encryption_key.data()
+                             : m_impl->password_data.level_2_encryption_key.data();
+            for (size_t block = 0; block < header.bytes; block += ENCRYPTION_BLOCK_BYTES) {
+                AES128::encrypt_with_key(record_body + block, record_body + block, key);
+            }
+        }
+        std::memcpy(data.data() + offset, &header, RECORD_HEADER_BYTES);
+        header.record_CRC = CRC32::calculate(data.data() + offset + sizeof(header.record_CRC),
+                                             RECORD_HEADER_BYTES + header.bytes -
+                                             sizeof(header.record_CRC));
+        std::memcpy(data.data() + offset, &header.record_CRC, sizeof(header.record_CRC));
+        
+        RecordIndex entry;
+        entry.type_string = header.type_string;
+        entry.version_major = header.version_major;
+        entry.version_minor = header.version_minor;
+        entry.encryption = header.encryption;
+        entry.file_offset = file.data_bytes + static_cast<si8>(offset);
+        entry.time = header.time;
+        batch.push_back(entry);
+        file.maximum_record_bytes = std::max(file.maximum_record_bytes,
+                                             static_cast<si8>(RECORD_HEADER_BYTES + header.bytes));
+    }
+    
+    // Records first, then the header that counts them
+    data_file->pwrite(data.data(), data.size(), file.data_bytes);
+    file.data_crc = CRC32::update(data.data(), data.size(), file.data_crc);
+    file.data_bytes += static_cast<si8>(data.size());
+    
+    // Merge the batch into the index; equal times keep arrival order
+    size_t old_count = file.entries.size();
+    size_t first_changed = static_cast<size_t>(
+        std::upper_bound(file.entries.begin(), file.entries.end(), batch.front(), record_before) -
+        file.entries.begin());
+    file.entries.insert(file.entries.end(), batch.begin(), batch.end());
+    std::inplace_merge(file.entries.begin(), file.entries.begin() + static_cast<std::ptrdiff_t>(old_count),
+                       file.entries.end(), record_before);
+    
+    UniversalHeader uh = record_file_header(RECORD_DATA_FILE_TYPE_STRING, file.channel,
+                                            m_session_name, m_impl->session_uuid, file.entries);
+    uh.maximum_entry_size = file.maximum_record_bytes;
+    uh.body_CRC = file.data_crc;
+    set_header_crc(uh);
+    data_file->pwrite(&uh, sizeof(uh), 0);
+    if (durable) {
+        m_impl->timed_sync([&] { data_file->sync(); });
+    }
     
-    file.write(reinterpret_cast<const char*>(&uh), sizeof(uh));
+    // The index only refers to records already written
+    write_record_index(file, first_changed, durable);
+}
+
+MefWriter::RecordFileState& MefWriter::record_file_state(const std::string& channel_name) {
+    auto it = m_impl->record_files.find(channel_name);
+    if (it != m_impl->record_files.end()) {
+        return it->second;
+    }
+    
+    RecordFileState file;
+    file.channel = channel_name;
+    file.base = channel_name.empty()
+                ? fs::path(m_path) / m_session_name
+                : fs::path(m_path) / (channel_name + ".timd") / channel_name;
+    
+    // Continue the record files of a session opened without overwrite
+    fs::path data_path = file.base;
+    data_path += ".rdat";
+    fs::path idx_path = file.base;
+    idx_path += ".ridx";
+    auto& storage = *m_impl->storage;
+    std::unique_ptr<StorageFile> data_file;
+    std::unique_ptr<StorageFile> idx_file;
+    if (storage.exists(data_path.string()) && storage.exists(idx_path.string())) {
+        data_file = storage.open(data_path.string(), Storage::OpenMode::READ);
+        idx_file = storage.open(idx_path.string(), Storage::OpenMode::READ);
+    }
+    UniversalHeader data_header;
+    UniversalHeader idx_header;
+    if (data_file && data_file->pread(&data_header, sizeof(data_header), 0) == sizeof(data_header) &&
+        idx_file->pread(&idx_header, sizeof(idx_header), 0) == sizeof(idx_header)) {
+        si8 available = (idx_file->size() - UNIVERSAL_HEADER_BYTES) / RECORD_INDEX_BYTES;
+        si8 count = idx_header.number_of_entries >= 0
+                    ? std::min(idx_header.number_of_entries, available) : available;
+        file.entries.resize(static_cast<size_t>(count));
+        size_t entry_bytes = file.entries.size() * sizeof(RecordIndex);
+        if (idx_file->pread(file.entries.data(), entry_bytes, UNIVERSAL_HEADER_BYTES) != entry_bytes) {
+            throw std::runtime_error("Cannot read record index: " + idx_path.string());
+        }
+        
+        // An index out of time order is rewritten on the next write
+        if (std::is_sorted(file.entries.begin(), file.entries.end(), record_before)) {
+            file.entries_persisted = file.entries.size();
+            file.index_crc = CRC32::update(reinterpret_cast<const ui1*>(file.entries.data()),
+                                           file.entries.size() * sizeof(RecordIndex),
+                                           CRC32::CRC_START_VALUE);
+        } else {
+            std::stable_sort(file.entries.begin(), file.entries.end(), record_before);
+        }
+        
+        std::vector<ui1> buffer(1 << 16);
+        si8 offset = UNIVERSAL_HEADER_BYTES;
+        while (size_t got = data_file->pread(buffer.data(), buffer.size(), offset)) {
+            file.data_crc = CRC32::update(buffer.data(), got, file.data_crc);
+            offset += static_cast<si8>(got);
+        }
+        file.data_bytes = offset;
+        file.maximum_record_bytes = std::max<si8>(data_header.maximum_entry_size, 0);
+    }
     
-    // Write indices
-    file.write(reinterpret_cast<const char*>(state.indices.data()),
-               static_cast<std::streamsize>(state.indices.size() * sizeof(TimeSeriesIndex)));
+    return m_impl->record_files.emplace(channel_name, std::move(file)).first->second;
+}
+
+void MefWriter::write_record_index(RecordFileState& file, size_t first_changed, bool durable) {
+    fs::path idx_path = file.base;
+    idx_path += ".ridx";
+    UniversalHeader uh = record_file_header(RECORD_INDICES_FILE_TYPE_STRING, file.channel,
+                                            m_session_name, m_impl->session_uuid, file.entries);
+    uh.maximum_entry_size = RECORD_INDEX_BYTES;
+    const auto* entries = reinterpret_cast<const ui1*>(file.entries.data());
+    
+    if (file.entries_persisted == 0 || first_changed < file.entries_persisted) {
+        // New file, or entries inserted before written ones: replace the
+        // whole index so readers never see a partly shifted one
+        file.index_crc = CRC32::update(entries, file.entries.size() * sizeof(RecordIndex),
+                                       CRC32::CRC_START_VALUE);
+        uh.body_CRC = file.index_crc;
+        set_header_crc(uh);
+        fs::path write_path = idx_path;
+        write_path += ".tmp";
+        {
+            auto out = m_impl->storage->open(write_path.string(), Storage::OpenMode::TRUNCATE);
+            out->pwrite(&uh, sizeof(uh), 0);
+            out->pwrite(entries, file.entries.size() * sizeof(RecordIndex), UNIVERSAL_HEADER_BYTES);
+            if (durable) {
+                m_impl->timed_sync([&] { out->sync(); });
+            }
+        }
+        m_impl->storage->rename(write_path.string(), idx_path.string());
+        if (durable) {
+            sync_directory(idx_path.parent_path());
+        }
+    } else {
+        // Entries are appended after those already in the file, and the
+        // header is updated only after the entries it counts are written
+        auto out = m_impl->storage->open(idx_path.string(), Storage::OpenMode::WRITE);
+        const ui1* new_entries = entries + file.entries_persisted * sizeof(RecordIndex);
+        size_t new_bytes = (file.entries.size() - file.entries_persisted) * sizeof(RecordIndex);
+        out->pwrite(new_entries, new_bytes,
+                    static_cast<si8>(UNIVERSAL_HEADER_BYTES + file.entries_persisted * sizeof(RecordIndex)));
+        file.index_crc = CRC32::update(new_entries, new_bytes, file.index_crc);
+        if (durable) {
+            m_impl->timed_sync([&] { out->sync(); });
+        }
+        uh.body_CRC = file.index_crc;
+        set_header_crc(uh);
+        out->pwrite(&uh, sizeof(uh), 0);
+        if (durable) {
+            m_impl->timed_sync([&] { out->sync(); });
+        }
+    }
+    file.entries_persisted = file.entries.size();
 }
 
 void MefWriter::flush() {
-    for (auto& [channel_name, file] : m_impl->data_files) {
-        if (file.is_open()) {
-            file.flush();
+    std::shared_lock<std::shared_mutex> registry_lock(m_impl->registry_mutex);
+    for (auto& state : m_impl->channels) {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        flush_pending(state);
+        if (state.data_file != FilePool::INVALID_FILE_ID) {
+            m_impl->file_pool.flush(state.data_file);
+        }
+        // Blocks are in the data file before the index points at them
+        if (state.current_segment >= 0 && !state.closed) {
+            write_indices(state, false);
+            write_metadata(state, false);
+        }
+    }
+}
+
+void MefWriter::sync() {
+    std::shared_lock<std::shared_mutex> registry_lock(m_impl->registry_mutex);
+    for (auto& state : m_impl->channels) {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (!state.closed) {
+            checkpoint(state);
         }
     }
 }
 
 void MefWriter::close() {
-    if (m_closed) {
-        return;
+    // Closed before anything is finalized, and under the registry lock so
+    // no channel is added after the loop below
+    {
+        std::unique_lock<std::shared_mutex> registry_lock(m_impl->registry_mutex);
+        if (m_impl->closed.exchange(true)) {
+            return;
+        }
     }
     
-    // Finalize all channels
-    for (auto& [channel_name, state] : m_channel_states) {
-        if (state.current_segment >= 0) {
-            finalize_segment(channel_name, state.current_segment);
+    // Finalize all channels; each is locked so in-flight channel writes
+    // complete before their segment is finalized
+    std::shared_lock<std::shared_mutex> registry_lock(m_impl->registry_mutex);
+    for (auto& state : m_impl->channels) {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (!state.closed && state.current_segment >= 0) {
+            flush_pending(state);
+            finalize_segment(state);
         }
+        state.closed = true;
     }
+    registry_lock.unlock();
     
-    m_closed = true;
+    // Wait for the compaction of the segments finalized above
+    m_impl->stop_compaction();
+    
+    // Record batches in flight complete; later ones were rejected above
+    std::lock_guard<std::mutex> records_lock(m_impl->records_mutex);
+}
+
+// ============================================================================
+// ChannelWriter
+// ============================================================================
+
+MefWriter::ChannelWriter MefWriter::channel_writer(const std::string& channel_name,
+                                                   sf8 sampling_freq) {
+    if (m_impl->closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    ChannelHandle handle = open_channel(channel_name, sampling_freq);
+    return ChannelWriter(this, &channel_state(handle), handle);
+}
+
+MefWriter::ChannelWriter::ChannelWriter(MefWriter* writer, ChannelState* state,
+                                        ChannelHandle handle)
+    : m_writer(writer)
+    , m_state(state)
+    , m_handle(handle)
+{
+}
+
+const std::string& MefWriter::ChannelWriter::get_channel_name() const {
+    return m_state->name;
+}
+
+void MefWriter::ChannelWriter::write_data(const sf8* data,
+                                          size_t num_samples,
+                                          si8 start_uutc,
+                                          si4 precision,
+                                          bool new_segment) {
+    if (num_samples == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    if (m_state->closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    m_writer->append_data(*m_state, data, num_samples, start_uutc, precision, new_segment);
+}
+
+void MefWriter::ChannelWriter::write_raw_data(const si4* data,
+                                              size_t num_samples,
+                                              si8 start_uutc,
+                                              bool new_segment) {
+    if (num_samples == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    if (m_state->closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    m_writer->append_raw_data(*m_state, data, num_samples, start_uutc, new_segment);
+}
+
+void MefWriter::ChannelWriter::write_data(const sf8* data,
+                                          const si8* timestamps,
+                                          size_t num_samples,
+                                          si4 precision) {
+    if (num_samples == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    if (m_state->closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    m_writer->append_data(*m_state, data, num_samples, timestamps[0], precision, false,
+                          timestamps);
+}
+
+void MefWriter::ChannelWriter::write_raw_data(const si4* data,
+                                              const si8* timestamps,
+                                              size_t num_samples) {
+    if (num_samples == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    if (m_state->closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    m_writer->append_timestamped_data(*m_state, data, timestamps, num_samples);
+}
+
+void MefWriter::ChannelWriter::write_compressed_blocks(const std::vector<CompressedBlock>& blocks) {
+    if (blocks.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    if (m_state->closed) {
+        throw std::runtime_error("Writer is closed");
+    }
+    m_writer->append_compressed_blocks(*m_state, blocks.data(), blocks.size());
+}
+
+void MefWriter::ChannelWriter::flush() {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_writer->flush_pending(*m_state);
+    if (m_state->data_file != FilePool::INVALID_FILE_ID) {
+        m_writer->m_impl->file_pool.flush(m_state->data_file);
+    }
+    if (m_state->current_segment >= 0 && !m_state->closed) {
+        m_writer->write_indices(*m_state, false);
+        m_writer->write_metadata(*m_state, false);
+    }
+}
+
+void MefWriter::ChannelWriter::close() {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    if (m_state->closed) {
+        return;
+    }
+    if (m_state->current_segment >= 0) {
+        m_writer->flush_pending(*m_state);
+        m_writer->finalize_segment(*m_state);
+    }
+    m_state->closed = true;
 }
 
 } // namespace brainmaze_mefd
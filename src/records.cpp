@@ -0,0 +1,252 @@
+/**
+ * @file records.cpp
+ * @brief MEF 3.0 record body decoding
+ */
+
+#include "brainmaze_mefd/records.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace brainmaze_mefd {
+
+namespace {
+
+// Body offsets of the fields that give a record its extent
+constexpr size_t EDFA_DURATION_OFFSET = 0;
+constexpr size_t SEIZ_LATEST_OFFSET_OFFSET = 8;
+constexpr size_t SEIZ_DURATION_OFFSET = 16;
+constexpr size_t CSTI_DURATION_OFFSET = 64;
+constexpr size_t EPOC_END_TIMESTAMP_OFFSET = 16;
+
+template <typename T>
+T read_value(const ui1* body, size_t offset) {
+    T value;
+    std::memcpy(&value, body + offset, sizeof(T));
+    return value;
+}
+
+// NUL-terminated string in a fixed-size field
+std::string read_string(const ui1* body, size_t offset, size_t bytes) {
+    const char* text = reinterpret_cast<const char*>(body + offset);
+    return std::string(text, strnlen(text, bytes));
+}
+
+template <typename T>
+void write_value(ui1* body, size_t offset, T value) {
+    std::memcpy(body + offset, &value, sizeof(T));
+}
+
+// Truncated to leave room for the terminating NUL
+void write_string(ui1* body, size_t offset, size_t bytes, const std::string& text) {
+    std::memcpy(body + offset, text.data(), std::min(text.size(), bytes - 1));
+}
+
+// Record with a zeroed body of at least the given size, padded to whole
+// encryption blocks
+Record new_record(const char* type, si8 time, size_t bytes) {
+    Record record;
+    record.info.type = type;
+    record.info.time = time;
+    record.body.assign((bytes + ENCRYPTION_BLOCK_BYTES - 1) / ENCRYPTION_BLOCK_BYTES *
+                       ENCRYPTION_BLOCK_BYTES, 0);
+    return record;
+}
+
+void set_end_time(Record& record) {
+    record.info.end_time = record_end_time(record.info.type, record.info.time,
+                                           record.body.data(), record.body.size());
+}
+
+const ui1* checked_body(const Record& record, const char* type, size_t bytes) {
+    if (record.info.type != type) {
+        throw std::runtime_error("Record is not of type " + std::string(type) + ": " +
+                                 record.info.type);
+    }
+    if (!record.accessible) {
+        throw std::runtime_error("Record body is encrypted");
+    }
+    if (record.body.size() < bytes) {
+        throw std::runtime_error("Record body too short for type " + record.info.type);
+    }
+    return record.body.data();
+}
+
+} // namespace
+
+size_t record_extent_bytes(const std::string& type) {
+    if (type == RECORD_TYPE_EDF_ANNOTATION) {
+        return EDFA_DURATION_OFFSET + sizeof(si8);
+    }
+    if (type == RECORD_TYPE_SEIZURE) {
+        return SEIZ_DURATION_OFFSET + sizeof(si8);
+    }
+    if (type == RECORD_TYPE_COGNITIVE_STIMULUS) {
+        return CSTI_DURATION_OFFSET + sizeof(si8);
+    }
+    if (type == RECORD_TYPE_EPOCH) {
+        return EPOC_END_TIMESTAMP_OFFSET + sizeof(si8);
+    }
+    return 0;
+}
+
+si8 record_end_time(const std::string& type, si8 time, const ui1* body, size_t size) {
+    size_t needed = record_extent_bytes(type);
+    if (needed == 0 || size < needed || time == UUTC_NO_ENTRY) {
+        return time;
+    }
+    si8 end_time = time;
+    if (type == RECORD_TYPE_EDF_ANNOTATION) {
+        end_time = time + read_value<si8>(body, EDFA_DURATION_OFFSET);
+    } else if (type == RECORD_TYPE_SEIZURE) {
+        si8 latest_offset = read_value<si8>(body, SEIZ_LATEST_OFFSET_OFFSET);
+        si8 duration = read_value<si8>(body, SEIZ_DURATION_OFFSET);
+        end_time = latest_offset > time ? latest_offset : time + duration;
+    } else if (type == RECORD_TYPE_COGNITIVE_STIMULUS) {
+        end_time = time + read_value<si8>(body, CSTI_DURATION_OFFSET);
+    } else if (type == RECORD_TYPE_EPOCH) {
+        end_time = read_value<si8>(body, EPOC_END_TIMESTAMP_OFFSET);
+    }
+    // Missing or negative extents leave the record instantaneous
+    return end_time > time ? end_time : time;
+}
+
+std::string decode_note(const Record& record) {
+    if (record.info.type != RECORD_TYPE_NOTE && record.info.type != RECORD_TYPE_SYSTEM_LOG) {
+        throw std::runtime_error("Record is not a text record: " + record.info.type);
+    }
+    if (!record.accessible) {
+        throw std::runtime_error("Record body is encrypted");
+    }
+    return read_string(record.body.data(), 0, record.body.size());
+}
+
+EdfAnnotationRecord decode_edf_annotation(const Record& record) {
+    const ui1* body = checked_body(record, RECORD_TYPE_EDF_ANNOTATION, RECORD_EDFA_BYTES);
+    EdfAnnotationRecord result;
+    result.duration = read_value<si8>(body, EDFA_DURATION_OFFSET);
+    result.annotation = read_string(body, RECORD_EDFA_BYTES, record.body.size() - RECORD_EDFA_BYTES);
+    return result;
+}
+
+SeizureRecord decode_seizure(const Record& record) {
+    const ui1* body = checked_body(record, RECORD_TYPE_SEIZURE, RECORD_SEIZ_BYTES);
+    SeizureRecord result;
+    result.earliest_onset = read_value<si8>(body, 0);
+    result.latest_offset = read_value<si8>(body, SEIZ_LATEST_OFFSET_OFFSET);
+    result.duration = read_value<si8>(body, SEIZ_DURATION_OFFSET);
+    si4 number_of_channels = read_value<si4>(body, 24);
+    result.onset_code = read_value<si4>(body, 28);
+    result.marker_name_1 = read_string(body, 32, RECORD_SEIZ_MARKER_NAME_BYTES);
+    result.marker_name_2 = read_string(body, 160, RECORD_SEIZ_MARKER_NAME_BYTES);
+    result.annotation = read_string(body, 288, RECORD_SEIZ_ANNOTATION_BYTES);
+
+    size_t available = (record.body.size() - RECORD_SEIZ_BYTES) / RECORD_SEIZ_CHANNEL_BYTES;
+    size_t count = number_of_channels > 0
+                   ? std::min(static_cast<size_t>(number_of_channels), available)
+                   : 0;
+    for (size_t c = 0; c < count; ++c) {
+        const ui1* channel = body + RECORD_SEIZ_BYTES + c * RECORD_SEIZ_CHANNEL_BYTES;
+        SeizureChannel entry;
+        entry.name = read_string(channel, 0, MEF_BASE_FILE_NAME_BYTES);
+        entry.onset = read_value<si8>(channel, 256);
+        entry.offset = read_value<si8>(channel, 264);
+        result.channels.push_back(entry);
+    }
+    return result;
+}
+
+CognitiveStimulusRecord decode_cognitive_stimulus(const Record& record) {
+    const ui1* body = checked_body(record, RECORD_TYPE_COGNITIVE_STIMULUS, RECORD_CSTI_BYTES);
+    CognitiveStimulusRecord result;
+    result.task_type = read_string(body, 0, RECORD_CSTI_STRING_BYTES);
+    result.stimulus_duration = read_value<si8>(body, CSTI_DURATION_OFFSET);
+    result.stimulus_type = read_string(body, 72, RECORD_CSTI_STRING_BYTES);
+    result.patient_response = read_string(body, 136, RECORD_CSTI_STRING_BYTES);
+    return result;
+}
+
+ElectricalStimulusRecord decode_electrical_stimulus(const Record& record) {
+    const ui1* body = checked_body(record, RECORD_TYPE_ELECTRICAL_STIMULUS, RECORD_ESTI_BYTES);
+    ElectricalStimulusRecord result;
+    result.amplitude = read_value<sf8>(body, 0);
+    result.frequency = read_value<sf8>(body, 8);
+    result.pulse_width = read_value<si8>(body, 16);
+    result.amplitude_unit_code = read_value<si4>(body, 24);
+    result.mode_code = read_value<si4>(body, 28);
+    result.waveform = read_string(body, 32, RECORD_ESTI_STRING_BYTES);
+    result.anode = read_string(body, 160, RECORD_ESTI_STRING_BYTES);
+    result.cathode = read_string(body, 288, RECORD_ESTI_STRING_BYTES);
+    return result;
+}
+
+Record encode_note(si8 time, const std::string& text, const char* type) {
+    if (std::strcmp(type, RECORD_TYPE_NOTE) != 0 && std::strcmp(type, RECORD_TYPE_SYSTEM_LOG) != 0) {
+        throw std::runtime_error("Record is not a text record: " + std::string(type));
+    }
+    Record record = new_record(type, time, text.size() + 1);
+    write_string(record.body.data(), 0, record.body.size(), text);
+    set_end_time(record);
+    return record;
+}
+
+Record encode_edf_annotation(si8 time, const EdfAnnotationRecord& annotation) {
+    Record record = new_record(RECORD_TYPE_EDF_ANNOTATION, time,
+                               RECORD_EDFA_BYTES + annotation.annotation.size() + 1);
+    ui1* body = record.body.data();
+    write_value(body, EDFA_DURATION_OFFSET, annotation.duration);
+    write_string(body, RECORD_EDFA_BYTES, record.body.size() - RECORD_EDFA_BYTES,
+                 annotation.annotation);
+    set_end_time(record);
+    return record;
+}
+
+Record encode_seizure(si8 time, const SeizureRecord& seizure) {
+    Record record = new_record(RECORD_TYPE_SEIZURE, time,
+                               RECORD_SEIZ_BYTES + seizure.channels.size() * RECORD_SEIZ_CHANNEL_BYTES);
+    ui1* body = record.body.data();
+    write_value(body, 0, seizure.earliest_onset);
+    write_value(body, SEIZ_LATEST_OFFSET_OFFSET, seizure.latest_offset);
+    write_value(body, SEIZ_DURATION_OFFSET, seizure.duration);
+    write_value(body, 24, static_cast<si4>(seizure.channels.size()));
+    write_value(body, 28, seizure.onset_code);
+    write_string(body, 32, RECORD_SEIZ_MARKER_NAME_BYTES, seizure.marker_name_1);
+    write_string(body, 160, RECORD_SEIZ_MARKER_NAME_BYTES, seizure.marker_name_2);
+    write_string(body, 288, RECORD_SEIZ_ANNOTATION_BYTES, seizure.annotation);
+    for (size_t c = 0; c < seizure.channels.size(); ++c) {
+        ui1* channel = body + RECORD_SEIZ_BYTES + c * RECORD_SEIZ_CHANNEL_BYTES;
+        write_string(channel, 0, MEF_BASE_FILE_NAME_BYTES, seizure.channels[c].name);
+        write_value(channel, 256, seizure.channels[c].onset);
+        write_value(channel, 264, seizure.channels[c].offset);
+    }
+    set_end_time(record);
+    return record;
+}
+
+Record encode_cognitive_stimulus(si8 time, const CognitiveStimulusRecord& stimulus) {
+    Record record = new_record(RECORD_TYPE_COGNITIVE_STIMULUS, time, RECORD_CSTI_BYTES);
+    ui1* body = record.body.data();
+    write_string(body, 0, RECORD_CSTI_STRING_BYTES, stimulus.task_type);
+    write_value(body, CSTI_DURATION_OFFSET, stimulus.stimulus_duration);
+    write_string(body, 72, RECORD_CSTI_STRING_BYTES, stimulus.stimulus_type);
+    write_string(body, 136, RECORD_CSTI_STRING_BYTES, stimulus.patient_response);
+    set_end_time(record);
+    return record;
+}
+
+Record encode_electrical_stimulus(si8 time, const ElectricalStimulusRecord& stimulus) {
+    Record record = new_record(RECORD_TYPE_ELECTRICAL_STIMULUS, time, RECORD_ESTI_BYTES);
+    ui1* body = record.body.data();
+    write_value(body, 0, stimulus.amplitude);
+    write_value(body, 8, stimulus.frequency);
+    write_value(body, 16, stimulus.pulse_width);
+    write_value(body, 24, stimulus.amplitude_unit_code);
+    write_value(body, 28, stimulus.mode_code);
+    write_string(body, 32, RECORD_ESTI_STRING_BYTES, stimulus.waveform);
+    write_string(body, 160, RECORD_ESTI_STRING_BYTES, stimulus.anode);
+    write_string(body, 288, RECORD_ESTI_STRING_BYTES, stimulus.cathode);
+    set_end_time(record);
+    return record;
+}
+
+} // namespace brainmaze_mefd
@@ -189,6 +189,25 @@ REDCodec::CompressionResult REDCodec::compress(const si4* samples, ui4 num_sampl
         return result;
     }
     
+    // Quantize by the scale factor for fixed scale factor (lossy) mode.
+    // Reserved values (NaN, infinities) are passed through unchanged.
+    sf4 scale_factor = RED_SCALE_FACTOR_DEFAULT;
+    const si4* encoded_samples = samples;
+    std::vector<si4> scaled;
+    if ((params.mode & RED_FIXED_SCALE_FACTOR) && params.scale_factor > 1.0f) {
+        scale_factor = params.scale_factor;
+        scaled.resize(num_samples);
+        for (ui4 i = 0; i < num_samples; ++i) {
+            si4 val = samples[i];
+            if (val == RED_NAN || val == RED_NEGATIVE_INFINITY || val == RED_POSITIVE_INFINITY) {
+                scaled[i] = val;
+            } else {
+                scaled[i] = static_cast<si4>(std::round(static_cast<sf8>(val) / scale_factor));
+            }
+        }
+        encoded_samples = scaled.data();
+    }
+    
     // Reserve space for compressed output
     result.compressed_data.reserve(RED_BLOCK_HEADER_BYTES + RED_MAX_DIFFERENCE_BYTES(num_samples));
     result.compressed_data.resize(RED_BLOCK_HEADER_BYTES);  // Make space for header
@@ -197,7 +216,7 @@ REDCodec::CompressionResult REDCodec::compress(const si4* samples, ui4 num_sampl
     std::array<ui4, 257> counts{};
     std::vector<ui1> diff_encoded;
     diff_encoded.reserve(RED_MAX_DIFFERENCE_BYTES(num_samples));
-    encode_differences(samples, num_samples, diff_encoded, counts);
+    encode_differences(encoded_samples, num_samples, diff_encoded, counts);
     
     // Append encoded differences to output
     result.compressed_data.insert(result.compressed_data.end(), 
@@ -215,7 +234,8 @@ REDCodec::CompressionResult REDCodec::compress(const si4* samples, ui4 num_sampl
     // Fill block header
     result.block_header.clear();
     result.block_header.flags = params.discontinuity ? RED_DISCONTINUITY_MASK : 0;
-    result.block_header.scale_factor = 1.0f;
+    result.block_header.set_nan_gap_samples(params.nan_gap_samples);
+    result.block_header.scale_factor = scale_factor;
     result.block_header.difference_bytes = static_cast<ui4>(diff_encoded.size());
     result.block_header.number_of_samples = num_samples;
     result.block_header.block_bytes = static_cast<ui4>(result.compressed_data.size());
@@ -223,9 +243,9 @@ REDCodec::CompressionResult REDCodec::compress(const si4* samples, ui4 num_sampl
     
     // Compute and store statistics
     std::vector<si4> differences(num_samples);
-    differences[0] = samples[0];
+    differences[0] = encoded_samples[0];
     for (ui4 i = 1; i < num_samples; ++i) {
-        differences[i] = samples[i] - samples[i - 1];
+        differences[i] = encoded_samples[i] - encoded_samples[i - 1];
     }
     compute_statistics(differences.data(), num_samples, result.block_header.statistics);
     
@@ -251,11 +271,24 @@ REDCodec::CompressionResult REDCodec::compress(const si4* samples, ui4 num_sampl
     result.index.maximum_sample_value = max_val;
     result.index.minimum_sample_value = min_val;
     result.index.RED_block_flags = result.block_header.flags;
+    result.index.RED_block_discretionary_region = result.block_header.discretionary_region;
     
     result.success = true;
     return result;
 }
 
+bool REDCodec::validate_block(const ui1* block_data, size_t block_size) {
+    if (block_data == nullptr || block_size < RED_BLOCK_HEADER_BYTES) {
+        return false;
+    }
+    REDBlockHeader header;
+    std::memcpy(&header, block_data, RED_BLOCK_HEADER_BYTES);
+    if (header.block_bytes != block_size) {
+        return false;
+    }
+    return header.block_CRC == CRC32::calculate(block_data + 4, block_size - 4);
+}
+
 REDCodec::DecompressionResult REDCodec::decompress(const ui1* compressed_data,
                                                     size_t compressed_size,
                                                     const PasswordData* password_data) {
@@ -299,7 +332,11 @@ REDCodec::DecompressionResult REDCodec::decompress(const REDBlockHeader& block_h
     // Apply scale factor if needed (for lossy compression)
     if (block_header.scale_factor != 1.0f && block_header.scale_factor != 0.0f) {
         for (auto& sample : result.samples) {
-            sample = static_cast<si4>(std::round(sample * block_header.scale_factor));
+            if (sample == RED_NAN || sample == RED_NEGATIVE_INFINITY ||
+                sample == RED_POSITIVE_INFINITY) {
+                continue;
+            }
+            sample = static_cast<si4>(std::round(sample * static_cast<sf8>(block_header.scale_factor)));
         }
     }
     
@@ -0,0 +1,423 @@
+/**
+ * @file session_tools.cpp
+ * @brief Whole-session operations built on MefReader and MefWriter
+ */
+
+#include "brainmaze_mefd/session_tools.hpp"
+#include "brainmaze_mefd/mef_reader.hpp"
+#include "brainmaze_mefd/mef_writer.hpp"
+#include "brainmaze_mefd/file_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+namespace brainmaze_mefd {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Completed channels of an interrupted repack, one name per line
+constexpr const char* REPACK_JOURNAL = "repack.journal";
+
+// Run task(i) for i in [0, count) on up to `threads` threads; the first
+// exception thrown by a task is rethrown once all threads have stopped
+template <typename Task>
+void parallel_for(size_t count, size_t threads, Task task) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min(threads, count);
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&] {
+        for (size_t i = next++; i < count && !failed; i = next++) {
+            try {
+                task(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// One source channel feeding a destination channel
+struct ChannelPart {
+    const MefReader* reader;
+    MefReader::ChannelHandle handle;
+};
+
+// Reads one channel's blocks holding samples in [start_time, end_time) in
+// bounded time chunks; a block spanning a chunk edge is returned by both
+// reads and yielded once
+class BlockChunkReader {
+public:
+    BlockChunkReader(const MefReader& reader, MefReader::ChannelHandle handle,
+                     si8 start_time, si8 end_time, si8 chunk_seconds)
+        : m_reader(reader)
+        , m_handle(handle)
+        , m_end_time(end_time)
+        , m_chunk(std::max<si8>(1, chunk_seconds) * 1000000)
+    {
+        auto info = reader.get_channel_info(handle);
+        m_info_end = info.end_time;
+        m_done = info.start_time == UUTC_NO_ENTRY || info.number_of_samples == 0 ||
+                 (end_time != UUTC_NO_ENTRY && end_time <= info.start_time) ||
+                 (start_time != UUTC_NO_ENTRY && info.end_time != UUTC_NO_ENTRY &&
+                  start_time > info.end_time);
+        m_cursor = start_time != UUTC_NO_ENTRY ? std::max(start_time, info.start_time)
+                                               : info.start_time;
+    }
+
+    // Next chunk of blocks (possibly empty); false once the range is read
+    bool next(std::vector<CompressedBlock>& blocks) {
+        blocks.clear();
+        if (m_done) {
+            return false;
+        }
+        si8 chunk_end = m_cursor + m_chunk;
+        const si8* read_end = &chunk_end;
+        if (m_end_time != UUTC_NO_ENTRY && chunk_end >= m_end_time) {
+            read_end = &m_end_time;
+            m_done = true;
+        } else if (m_info_end == UUTC_NO_ENTRY || chunk_end > m_info_end) {
+            read_end = m_end_time != UUTC_NO_ENTRY ? &m_end_time : nullptr;
+            m_done = true;
+        }
+
+        for (auto& block : m_reader.read_compressed_blocks(m_handle, &m_cursor, read_end)) {
+            if (m_last_block_start != UUTC_NO_ENTRY &&
+                block.index.start_time <= m_last_block_start) {
+                continue;
+            }
+            m_last_block_start = block.index.start_time;
+            blocks.push_back(std::move(block));
+        }
+        m_cursor = chunk_end;
+        return true;
+    }
+
+private:
+    const MefReader& m_reader;
+    MefReader::ChannelHandle m_handle;
+    si8 m_end_time;
+    si8 m_chunk;
+    si8 m_info_end = UUTC_NO_ENTRY;
+    si8 m_cursor = UUTC_NO_ENTRY;
+    si8 m_last_block_start = UUTC_NO_ENTRY;
+    bool m_done = false;
+};
+
+// Copy one channel's blocks in [start_time, end_time) from all its sources
+void copy_channel(const std::vector<ChannelPart>& parts,
+                  MefWriter::ChannelWriter& writer,
+                  const SessionCopyOptions& options,
+                  SessionCopyStatistics& stats) {
+    const bool has_start = options.start_time != UUTC_NO_ENTRY;
+    const bool has_end = options.end_time != UUTC_NO_ENTRY;
+
+    std::vector<CompressedBlock> blocks;
+    std::vector<CompressedBlock> batch;
+    for (const auto& part : parts) {
+        sf8 period = 1e6 / part.reader->get_channel_info(part.handle).sampling_frequency;
+        BlockChunkReader chunks(*part.reader, part.handle, options.start_time, options.end_time,
+                                options.chunk_seconds);
+        while (chunks.next(blocks)) {
+            for (auto& block : blocks) {
+                // Samples of this block inside the requested range
+                si8 block_start = block.index.start_time;
+                si8 n = block.index.number_of_samples;
+                auto first_at = [&](si8 t) {
+                    sf8 k = std::ceil(static_cast<sf8>(t - block_start) / period - 1e-9);
+                    return std::clamp<si8>(static_cast<si8>(k), 0, n);
+                };
+                si8 first = has_start ? first_at(options.start_time) : 0;
+                si8 last = has_end ? first_at(options.end_time) : n;
+                if (last <= first) {
+                    continue;
+                }
+
+                if (first == 0 && last == n) {
+                    stats.blocks_copied++;
+                    stats.bytes_copied += static_cast<si8>(block.data.size());
+                    batch.push_back(std::move(block));
+                } else {
+                    // Edge block: decode and re-encode only the kept samples
+                    if (!batch.empty()) {
+                        writer.write_compressed_blocks(batch);
+                        batch.clear();
+                    }
+                    auto samples = part.reader->decode_block(block);
+                    last = std::min<si8>(last, static_cast<si8>(samples.size()));
+                    writer.write_raw_data(samples.data() + first, static_cast<size_t>(last - first),
+                                          block_start + static_cast<si8>(std::llround(first * period)));
+                    stats.blocks_decoded++;
+                }
+                stats.samples += last - first;
+            }
+            if (!batch.empty()) {
+                writer.write_compressed_blocks(batch);
+                batch.clear();
+            }
+        }
+    }
+    writer.flush();
+}
+
+// Decoded blocks of one time chunk
+struct DecodedChunk {
+    std::vector<std::pair<si8, std::vector<si4>>> blocks;  // start time, samples
+    si8 source_bytes = 0;
+    bool more = false;
+};
+
+// Re-encode one channel; the next chunk is decoded while the current one
+// is written
+void repack_channel(const MefReader& reader, MefReader::ChannelHandle handle,
+                    MefWriter::ChannelWriter& writer, const RepackOptions& options,
+                    RepackStatistics& stats) {
+    BlockChunkReader chunks(reader, handle, UUTC_NO_ENTRY, UUTC_NO_ENTRY, options.chunk_seconds);
+    auto load = [&] {
+        DecodedChunk chunk;
+        std::vector<CompressedBlock> blocks;
+        chunk.more = chunks.next(blocks);
+        for (const auto& block : blocks) {
+            chunk.source_bytes += static_cast<si8>(block.data.size());
+            chunk.blocks.emplace_back(block.index.start_time, reader.decode_block(block));
+        }
+        return chunk;
+    };
+
+    auto pending = std::async(std::launch::async, load);
+    while (true) {
+        DecodedChunk chunk = pending.get();
+        if (!chunk.more) {
+            break;
+        }
+        pending = std::async(std::launch::async, load);
+        for (const auto& [start_time, samples] : chunk.blocks) {
+            writer.write_raw_data(samples.data(), samples.size(), start_time);
+            stats.samples += static_cast<si8>(samples.size());
+        }
+        stats.source_bytes += chunk.source_bytes;
+    }
+    writer.close();
+}
+
+// Total size of the .tdat files below a directory
+si8 data_bytes(const fs::path& path) {
+    si8 bytes = 0;
+    if (fs::exists(path)) {
+        for (const auto& entry : fs::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".tdat") {
+                bytes += static_cast<si8>(entry.file_size());
+            }
+        }
+    }
+    return bytes;
+}
+
+} // namespace
+
+SessionCopyStatistics copy_sessions(const std::vector<std::string>& sources,
+                                    const std::string& destination,
+                                    const SessionCopyOptions& options) {
+    auto started = std::chrono::steady_clock::now();
+    if (sources.empty()) {
+        throw std::runtime_error("No source sessions given");
+    }
+
+    std::vector<std::unique_ptr<MefReader>> readers;
+    for (const auto& source : sources) {
+        auto reader = std::make_unique<MefReader>(source, options.password);
+        if (!reader->is_valid()) {
+            throw std::runtime_error("Cannot open source session: " + source);
+        }
+        readers.push_back(std::move(reader));
+    }
+
+    // Requested channels, or every time series channel in order of appearance
+    std::vector<std::string> channels = options.channels;
+    if (channels.empty()) {
+        for (const auto& reader : readers) {
+            for (const auto& name : reader->get_time_series_channels()) {
+                if (std::find(channels.begin(), channels.end(), name) == channels.end()) {
+                    channels.push_back(name);
+                }
+            }
+        }
+    }
+
+    std::vector<std::vector<ChannelPart>> parts(channels.size());
+    for (size_t c = 0; c < channels.size(); ++c) {
+        for (const auto& reader : readers) {
+            auto names = reader->get_channels();
+            if (std::find(names.begin(), names.end(), channels[c]) != names.end()) {
+                parts[c].push_back({reader.get(), reader->get_channel_handle(channels[c])});
+            }
+        }
+        if (parts[c].empty()) {
+            throw std::runtime_error("Channel not found in any source session: " + channels[c]);
+        }
+    }
+
+    MefWriter writer(destination, options.overwrite);
+    if (!parts.empty()) {
+        const auto& first = parts.front().front();
+        writer.set_data_units(first.reader->get_channel_info(first.handle).units);
+
+        // Gap detection uses the source block length
+        auto segments = first.reader->get_segments(channels.front());
+        if (!segments.empty() && segments.front().number_of_blocks > 0) {
+            const auto& seg = segments.front();
+            writer.set_mef_block_len(static_cast<si4>(
+                (seg.number_of_samples + seg.number_of_blocks - 1) / seg.number_of_blocks));
+        }
+    }
+
+    // Channels are opened up front; each worker then only touches its own
+    std::vector<MefWriter::ChannelWriter> channel_writers;
+    for (size_t c = 0; c < channels.size(); ++c) {
+        const auto& first = parts[c].front();
+        auto info = first.reader->get_channel_info(first.handle);
+        channel_writers.push_back(writer.channel_writer(channels[c], info.sampling_frequency));
+        writer.set_units_conversion_factor(channel_writers.back().get_handle(),
+                                           info.units_conversion_factor);
+    }
+
+    std::vector<SessionCopyStatistics> channel_stats(channels.size());
+    parallel_for(channels.size(), options.threads, [&](size_t c) {
+        copy_channel(parts[c], channel_writers[c], options, channel_stats[c]);
+    });
+    writer.close();
+
+    SessionCopyStatistics stats;
+    stats.channels = channels.size();
+    for (const auto& s : channel_stats) {
+        stats.blocks_copied += s.blocks_copied;
+        stats.blocks_decoded += s.blocks_decoded;
+        stats.bytes_copied += s.bytes_copied;
+        stats.samples += s.samples;
+    }
+    stats.seconds = std::chrono::duration<sf8>(std::chrono::steady_clock::now() - started).count();
+    return stats;
+}
+
+RepackStatistics repack_session(const std::string& source,
+                                const std::string& destination,
+                                const RepackOptions& options) {
+    auto started = std::chrono::steady_clock::now();
+    MefReader reader(source, options.password);
+    if (!reader.is_valid()) {
+        throw std::runtime_error("Cannot open source session: " + source);
+    }
+    std::vector<std::string> channels = options.channels;
+    if (channels.empty()) {
+        channels = reader.get_time_series_channels();
+    }
+
+    // A resumed repack keeps the destination and the channels it completed
+    MefWriter writer(destination, !options.resume, options.password1, options.password2);
+    if (!writer.is_valid()) {
+        throw std::runtime_error("Cannot create destination session: " + destination);
+    }
+    fs::path session_path(writer.get_path());
+    fs::path journal_path = session_path / REPACK_JOURNAL;
+    std::set<std::string> completed;
+    if (options.resume) {
+        std::ifstream journal(journal_path);
+        std::string name;
+        while (std::getline(journal, name)) {
+            completed.insert(name);
+        }
+    }
+
+    if (options.block_len > 0) {
+        writer.set_mef_block_len(options.block_len);
+    }
+    writer.set_auto_block_len(options.auto_block_len);
+    writer.set_block_relative_precision(options.block_relative_precision);
+    writer.set_durability_mode(MefWriter::DurabilityMode::ON_SEGMENT_CLOSE);
+
+    // Channels still to do restart from an empty channel directory
+    RepackStatistics stats;
+    std::vector<std::string> todo;
+    std::vector<MefReader::ChannelHandle> handles;
+    std::vector<MefWriter::ChannelWriter> channel_writers;
+    for (const auto& name : channels) {
+        auto handle = reader.get_channel_handle(name);
+        if (completed.count(name)) {
+            stats.channels_skipped++;
+            continue;
+        }
+        fs::remove_all(session_path / (name + ".timd"));
+        auto info = reader.get_channel_info(handle);
+        if (todo.empty()) {
+            writer.set_data_units(info.units);
+        }
+        todo.push_back(name);
+        handles.push_back(handle);
+        channel_writers.push_back(writer.channel_writer(name, info.sampling_frequency));
+        writer.set_units_conversion_factor(channel_writers.back().get_handle(),
+                                           info.units_conversion_factor);
+    }
+
+    std::mutex journal_mutex;
+    std::vector<RepackStatistics> channel_stats(todo.size());
+    parallel_for(todo.size(), options.threads, [&](size_t c) {
+        repack_channel(reader, handles[c], channel_writers[c], options, channel_stats[c]);
+
+        // The channel's segments are durable; record it as done
+        std::lock_guard<std::mutex> lock(journal_mutex);
+        {
+            std::ofstream journal(journal_path, std::ios::app);
+            journal << todo[c] << '\n';
+            if (!journal) {
+                throw std::runtime_error("Cannot write repack journal: " + journal_path.string());
+            }
+        }
+        FilePool::sync_path(journal_path.string());
+    });
+    writer.close();
+    fs::remove(journal_path);
+
+    stats.channels = todo.size();
+    for (size_t c = 0; c < todo.size(); ++c) {
+        stats.samples += channel_stats[c].samples;
+        stats.source_bytes += channel_stats[c].source_bytes;
+        stats.destination_bytes += data_bytes(session_path / (todo[c] + ".timd"));
+    }
+    stats.seconds = std::chrono::duration<sf8>(std::chrono::steady_clock::now() - started).count();
+    return stats;
+}
+
+} // namespace brainmaze_mefd
@@ -0,0 +1,921 @@
+/**
+ * @file storage.cpp
+ * @brief Storage backends for MefReader and MefWriter
+ */
+
+#include "brainmaze_mefd/storage.hpp"
+#include "brainmaze_mefd/crc.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace brainmaze_mefd {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string error_text(const std::string& what, const std::string& path) {
+    return what + ": " + path + " (" + std::strerror(errno) + ")";
+}
+
+} // namespace
+
+StorageMapping StorageFile::map(si8 offset, size_t length) const {
+    if (offset < 0 || offset + static_cast<si8>(length) > size()) {
+        throw std::runtime_error("Mapping past the end of the file");
+    }
+    auto buffer = std::make_shared<std::vector<ui1>>(length);
+    if (pread(buffer->data(), length, offset) != length) {
+        throw std::runtime_error("Short read while mapping");
+    }
+    const ui1* data = buffer->data();
+    return StorageMapping(data, length, std::move(buffer));
+}
+
+// ============================================================================
+// PosixStorage
+// ============================================================================
+
+namespace {
+
+class PosixFile : public StorageFile {
+public:
+    PosixFile(int fd, std::string path, bool direct_io)
+        : m_fd(fd), m_path(std::move(path)), m_direct_io(direct_io) {}
+
+    ~PosixFile() override {
+#ifdef _WIN32
+        _close(m_fd);
+#else
+        ::close(m_fd);
+#endif
+    }
+
+    si8 size() const override {
+#ifdef _WIN32
+        struct _stat64 st;
+        if (_fstat64(m_fd, &st) != 0) {
+            throw std::runtime_error(error_text("Cannot stat file", m_path));
+        }
+#else
+        struct stat st;
+        if (::fstat(m_fd, &st) != 0) {
+            throw std::runtime_error(error_text("Cannot stat file", m_path));
+        }
+#endif
+        return static_cast<si8>(st.st_size);
+    }
+
+    size_t pread(void* data, size_t length, si8 offset) const override {
+        ui1* bytes = static_cast<ui1*>(data);
+        size_t done = 0;
+#ifdef _WIN32
+        // The CRT has no positional read; seek and read under a lock
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (_lseeki64(m_fd, offset, SEEK_SET) < 0) {
+            throw std::runtime_error(error_text("Read failed", m_path));
+        }
+#endif
+        while (done < length) {
+#ifdef _WIN32
+            int got = _read(m_fd, bytes + done, static_cast<unsigned int>(std::min<size_t>(length - done, 1u << 30)));
+#else
+            ssize_t got = ::pread(m_fd, bytes + done, length - done, static_cast<off_t>(offset) + static_cast<off_t>(done));
+#endif
+            if (got < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(error_text("Read failed", m_path));
+            }
+            if (got == 0) {
+                break;
+            }
+            done += static_cast<size_t>(got);
+        }
+        return done;
+    }
+
+    void pwrite(const void* data, size_t length, si8 offset) override {
+        const ui1* bytes = static_cast<const ui1*>(data);
+#ifdef _WIN32
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (_lseeki64(m_fd, offset, SEEK_SET) < 0) {
+            throw std::runtime_error(error_text("Write failed", m_path));
+        }
+#endif
+        while (length > 0) {
+#ifdef _WIN32
+            int written = _write(m_fd, bytes, static_cast<unsigned int>(std::min<size_t>(length, 1u << 30)));
+#else
+            ssize_t written = ::pwrite(m_fd, bytes, length, static_cast<off_t>(offset));
+#endif
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(error_text("Write failed", m_path));
+            }
+            bytes += written;
+            length -= static_cast<size_t>(written);
+            offset += written;
+        }
+    }
+
+    void truncate(si8 length) override {
+#ifdef _WIN32
+        bool ok = _chsize_s(m_fd, length) == 0;
+#else
+        bool ok = ::ftruncate(m_fd, static_cast<off_t>(length)) == 0;
+#endif
+        if (!ok) {
+            throw std::runtime_error(error_text("Cannot truncate file", m_path));
+        }
+    }
+
+    // Flush file data (and the metadata needed to read it back)
+    void sync() override {
+#ifdef _WIN32
+        bool ok = _commit(m_fd) == 0;
+#elif defined(__APPLE__)
+        bool ok = ::fsync(m_fd) == 0;
+#else
+        bool ok = true;
+        while (::fdatasync(m_fd) != 0) {
+            if (errno != EINTR) {
+                ok = false;
+                break;
+            }
+        }
+#endif
+        if (!ok) {
+            throw std::runtime_error(error_text("Cannot sync file", m_path));
+        }
+    }
+
+    // Reserve extents up front; failure only costs fragmentation
+    bool preallocate(si8 length) override {
+#if defined(__linux__)
+        while (::fallocate(m_fd, 0, 0, static_cast<off_t>(length)) != 0) {
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+        return true;
+#else
+        (void)length;
+        return false;
+#endif
+    }
+
+    bool direct_io() const override { return m_direct_io; }
+    int native_handle() const override { return m_fd; }
+
+#ifndef _WIN32
+    StorageMapping map(si8 offset, size_t length) const override {
+        if (offset < 0 || offset + static_cast<si8>(length) > size()) {
+            throw std::runtime_error("Mapping past the end of the file: " + m_path);
+        }
+        if (length == 0) {
+            return StorageMapping();
+        }
+        static const si8 page = static_cast<si8>(::sysconf(_SC_PAGESIZE));
+        si8 start = offset / page * page;
+        size_t mapped = length + static_cast<size_t>(offset - start);
+        void* address = ::mmap(nullptr, mapped, PROT_READ, MAP_SHARED, m_fd, static_cast<off_t>(start));
+        if (address == MAP_FAILED) {
+            throw std::runtime_error(error_text("Cannot map file", m_path));
+        }
+        std::shared_ptr<const void> owner(address, [mapped](const void* p) {
+            ::munmap(const_cast<void*>(p), mapped);
+        });
+        return StorageMapping(static_cast<const ui1*>(address) + (offset - start), length, std::move(owner));
+    }
+#endif
+
+private:
+    int m_fd;
+    std::string m_path;
+    bool m_direct_io;
+#ifdef _WIN32
+    mutable std::mutex m_mutex;
+#endif
+};
+
+} // namespace
+
+std::unique_ptr<StorageFile> PosixStorage::open(const std::string& path, OpenMode mode, bool direct_io) {
+#ifdef _WIN32
+    direct_io = false;
+    int flags = _O_BINARY | (mode == OpenMode::READ ? _O_RDONLY : _O_RDWR | _O_CREAT);
+    if (mode == OpenMode::TRUNCATE) {
+        flags |= _O_TRUNC;
+    }
+    int fd = _open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+    int flags = O_CLOEXEC | (mode == OpenMode::READ ? O_RDONLY : O_RDWR | O_CREAT);
+    if (mode == OpenMode::TRUNCATE) {
+        flags |= O_TRUNC;
+    }
+#ifdef O_DIRECT
+    if (direct_io) {
+        flags |= O_DIRECT;
+    }
+#else
+    direct_io = false;
+#endif
+    int fd = ::open(path.c_str(), flags, 0644);
+#endif
+    if (fd < 0) {
+        throw std::runtime_error(error_text("Cannot open file", path));
+    }
+    return std::make_unique<PosixFile>(fd, path, direct_io);
+}
+
+bool PosixStorage::exists(const std::string& path) const {
+    std::error_code ec;
+    return fs::exists(path, ec);
+}
+
+bool PosixStorage::is_directory(const std::string& path) const {
+    std::error_code ec;
+    return fs::is_directory(path, ec);
+}
+
+std::vector<StorageEntry> PosixStorage::list(const std::string& path) const {
+    std::vector<StorageEntry> entries;
+    std::error_code ec;
+    for (auto it = fs::directory_iterator(path, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        std::error_code type_ec;
+        entries.push_back({it->path().filename().string(), it->is_directory(type_ec)});
+    }
+    return entries;
+}
+
+si8 PosixStorage::file_size(const std::string& path) const {
+    std::error_code ec;
+    auto bytes = fs::file_size(path, ec);
+    return ec ? -1 : static_cast<si8>(bytes);
+}
+
+fs::file_time_type PosixStorage::modification_time(const std::string& path) const {
+    std::error_code ec;
+    auto time = fs::last_write_time(path, ec);
+    return ec ? fs::file_time_type::min() : time;
+}
+
+void PosixStorage::create_directories(const std::string& path) {
+    std::error_code ec;
+    fs::create_directories(path, ec);
+    if (ec && !fs::is_directory(path)) {
+        throw std::runtime_error("Cannot create directory: " + path + " (" + ec.message() + ")");
+    }
+}
+
+void PosixStorage::remove_all(const std::string& path) {
+    std::error_code ec;
+    fs::remove_all(path, ec);
+    if (ec) {
+        throw std::runtime_error("Cannot remove: " + path + " (" + ec.message() + ")");
+    }
+}
+
+void PosixStorage::rename(const std::string& from, const std::string& to) {
+    std::error_code ec;
+    fs::rename(from, to, ec);
+    if (ec) {
+        throw std::runtime_error("Cannot rename " + from + " to " + to + " (" + ec.message() + ")");
+    }
+}
+
+void PosixStorage::sync_directory(const std::string& path) {
+#ifdef _WIN32
+    // Directory entries cannot be flushed separately on Windows
+    (void)path;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error(error_text("Cannot open directory for sync", path));
+    }
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok) {
+        throw std::runtime_error(error_text("Cannot sync directory", path));
+    }
+#endif
+}
+
+std::shared_ptr<Storage> posix_storage() {
+    static const std::shared_ptr<Storage> storage = std::make_shared<PosixStorage>();
+    return storage;
+}
+
+// ============================================================================
+// MemoryStorage
+// ============================================================================
+
+namespace {
+
+using Bytes = std::vector<ui1>;
+
+// "a/./b/" and "a/b" name the same entry; "" and "." are the root
+std::string normalize(const std::string& path) {
+    std::string key = fs::path(path).lexically_normal().generic_string();
+    while (key.size() > 1 && key.back() == '/') {
+        key.pop_back();
+    }
+    return key.empty() ? "." : key;
+}
+
+std::string parent_key(const std::string& key) {
+    std::string parent = fs::path(key).parent_path().generic_string();
+    return parent.empty() ? "." : parent;
+}
+
+bool is_root(const std::string& key) {
+    return key == "." || key == "/";
+}
+
+// Prefix of the keys inside a directory
+std::string child_prefix(const std::string& key) {
+    if (key == ".") {
+        return "";
+    }
+    return key == "/" ? "/" : key + "/";
+}
+
+// Contents shared by open handles and mappings; writers copy them first
+// while a mapping still refers to them
+struct MemoryData {
+    mutable std::mutex mutex;
+    std::shared_ptr<Bytes> bytes = std::make_shared<Bytes>();
+    fs::file_time_type mtime = fs::file_time_type::clock::now();
+
+    Bytes& writable() {
+        if (bytes.use_count() > 1) {
+            bytes = std::make_shared<Bytes>(*bytes);
+        }
+        return *bytes;
+    }
+};
+
+class MemoryFile : public StorageFile {
+public:
+    MemoryFile(std::shared_ptr<MemoryData> data, std::string path, bool writable)
+        : m_data(std::move(data)), m_path(std::move(path)), m_writable(writable) {}
+
+    si8 size() const override {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        return static_cast<si8>(m_data->bytes->size());
+    }
+
+    size_t pread(void* data, size_t length, si8 offset) const override {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        const Bytes& bytes = *m_data->bytes;
+        if (offset < 0 || static_cast<size_t>(offset) >= bytes.size()) {
+            return 0;
+        }
+        size_t count = std::min(length, bytes.size() - static_cast<size_t>(offset));
+        std::memcpy(data, bytes.data() + offset, count);
+        return count;
+    }
+
+    void pwrite(const void* data, size_t length, si8 offset) override {
+        check_writable();
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        Bytes& bytes = m_data->writable();
+        size_t end = static_cast<size_t>(offset) + length;
+        if (bytes.size() < end) {
+            bytes.resize(end, 0);
+        }
+        std::memcpy(bytes.data() + offset, data, length);
+        m_data->mtime = fs::file_time_type::clock::now();
+    }
+
+    void truncate(si8 length) override {
+        check_writable();
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        m_data->writable().resize(static_cast<size_t>(length), 0);
+        m_data->mtime = fs::file_time_type::clock::now();
+    }
+
+    StorageMapping map(si8 offset, size_t length) const override {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        const auto& bytes = m_data->bytes;
+        if (offset < 0 || static_cast<size_t>(offset) + length > bytes->size()) {
+            throw std::runtime_error("Mapping past the end of the file: " + m_path);
+        }
+        return StorageMapping(bytes->data() + offset, length, bytes);
+    }
+
+private:
+    std::shared_ptr<MemoryData> m_data;
+    std::string m_path;
+    bool m_writable;
+
+    void check_writable() const {
+        if (!m_writable) {
+            throw std::runtime_error("File opened read-only: " + m_path);
+        }
+    }
+};
+
+} // namespace
+
+struct MemoryStorage::Impl {
+    struct Node {
+        std::shared_ptr<MemoryData> file;  // nullptr for directories
+        fs::file_time_type mtime = fs::file_time_type::clock::now();
+    };
+
+    mutable std::mutex mutex;
+    std::map<std::string, Node> nodes;  // Sorted, so a directory's entries are one range
+
+    const Node* find(const std::string& key) const {
+        auto it = nodes.find(key);
+        return it == nodes.end() ? nullptr : &it->second;
+    }
+
+    bool directory_exists(const std::string& key) const {
+        if (is_root(key)) {
+            return true;
+        }
+        const Node* node = find(key);
+        return node && !node->file;
+    }
+
+    void touch_parent(const std::string& key) {
+        auto it = nodes.find(parent_key(key));
+        if (it != nodes.end()) {
+            it->second.mtime = fs::file_time_type::clock::now();
+        }
+    }
+
+    // Keys of an entry and everything below it
+    std::vector<std::string> subtree(const std::string& key) const {
+        std::vector<std::string> keys;
+        if (nodes.count(key)) {
+            keys.push_back(key);
+        }
+        std::string prefix = child_prefix(key);
+        for (auto it = nodes.lower_bound(prefix); it != nodes.end() && it->first.starts_with(prefix); ++it) {
+            keys.push_back(it->first);
+        }
+        return keys;
+    }
+};
+
+MemoryStorage::MemoryStorage() : m_impl(std::make_unique<Impl>()) {}
+
+MemoryStorage::~MemoryStorage() = default;
+
+std::unique_ptr<StorageFile> MemoryStorage::open(const std::string& path, OpenMode mode, bool direct_io) {
+    (void)direct_io;
+    std::string key = normalize(path);
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    auto it = m_impl->nodes.find(key);
+    if (it != m_impl->nodes.end() && !it->second.file) {
+        throw std::runtime_error("Cannot open file: " + path + " (is a directory)");
+    }
+    if (it == m_impl->nodes.end()) {
+        if (mode == OpenMode::READ) {
+            throw std::runtime_error("Cannot open file: " + path + " (no such file)");
+        }
+        if (!m_impl->directory_exists(parent_key(key))) {
+            throw std::runtime_error("Cannot open file: " + path + " (no such directory)");
+        }
+        Impl::Node node;
+        node.file = std::make_shared<MemoryData>();
+        it = m_impl->nodes.emplace(key, std::move(node)).first;
+        m_impl->touch_parent(key);
+    } else if (mode == OpenMode::TRUNCATE) {
+        auto& data = *it->second.file;
+        std::lock_guard<std::mutex> data_lock(data.mutex);
+        data.bytes = std::make_shared<Bytes>();
+        data.mtime = fs::file_time_type::clock::now();
+    }
+    return std::make_unique<MemoryFile>(it->second.file, path, mode != OpenMode::READ);
+}
+
+bool MemoryStorage::exists(const std::string& path) const {
+    std::string key = normalize(path);
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    return is_root(key) || m_impl->find(key) != nullptr;
+}
+
+bool MemoryStorage::is_directory(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    return m_impl->directory_exists(normalize(path));
+}
+
+std::vector<StorageEntry> MemoryStorage::list(const std::string& path) const {
+    std::string key = normalize(path);
+    std::vector<StorageEntry> entries;
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    if (!m_impl->directory_exists(key)) {
+        return entries;
+    }
+    std::string prefix = child_prefix(key);
+    const auto& nodes = m_impl->nodes;
+    for (auto it = nodes.lower_bound(prefix); it != nodes.end() && it->first.starts_with(prefix); ++it) {
+        std::string name = it->first.substr(prefix.size());
+        if (!name.empty() && name.find('/') == std::string::npos) {
+            entries.push_back({name, !it->second.file});
+        }
+    }
+    return entries;
+}
+
+si8 MemoryStorage::file_size(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    const auto* node = m_impl->find(normalize(path));
+    if (!node || !node->file) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> data_lock(node->file->mutex);
+    return static_cast<si8>(node->file->bytes->size());
+}
+
+fs::file_time_type MemoryStorage::modification_time(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    const auto* node = m_impl->find(normalize(path));
+    if (!node) {
+        return fs::file_time_type::min();
+    }
+    if (!node->file) {
+        return node->mtime;
+    }
+    std::lock_guard<std::mutex> data_lock(node->file->mutex);
+    return node->file->mtime;
+}
+
+void MemoryStorage::create_directories(const std::string& path) {
+    std::string key = normalize(path);
+    std::vector<std::string> missing;
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    for (std::string dir = key; !is_root(dir); dir = parent_key(dir)) {
+        const auto* node = m_impl->find(dir);
+        if (node && node->file) {
+            throw std::runtime_error("Cannot create directory: " + path + " (not a directory)");
+        }
+        if (node) {
+            break;
+        }
+        missing.push_back(dir);
+    }
+    for (auto it = missing.rbegin(); it != missing.rend(); ++it) {
+        m_impl->nodes.emplace(*it, Impl::Node{});
+        m_impl->touch_parent(*it);
+    }
+}
+
+void MemoryStorage::remove_all(const std::string& path) {
+    std::string key = normalize(path);
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    for (const auto& victim : m_impl->subtree(key)) {
+        m_impl->nodes.erase(victim);
+    }
+    m_impl->touch_parent(key);
+}
+
+void MemoryStorage::rename(const std::string& from, const std::string& to) {
+    std::string from_key = normalize(from);
+    std::string to_key = normalize(to);
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    const auto* source = m_impl->find(from_key);
+    if (!source) {
+        throw std::runtime_error("Cannot rename " + from + " to " + to + " (no such file)");
+    }
+    if (!m_impl->directory_exists(parent_key(to_key))) {
+        throw std::runtime_error("Cannot rename " + from + " to " + to + " (no such directory)");
+    }
+    const auto* target = m_impl->find(to_key);
+    if (target && (!target->file || !source->file)) {
+        throw std::runtime_error("Cannot rename " + from + " to " + to + " (target exists)");
+    }
+    if (from_key == to_key) {
+        return;
+    }
+    // A directory moves with everything below it
+    for (const auto& old_key : m_impl->subtree(from_key)) {
+        auto node = m_impl->nodes.extract(old_key);
+        node.key() = to_key + old_key.substr(from_key.size());
+        m_impl->nodes.erase(node.key());
+        m_impl->nodes.insert(std::move(node));
+    }
+    m_impl->touch_parent(from_key);
+    m_impl->touch_parent(to_key);
+}
+
+si8 MemoryStorage::get_bytes() const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    si8 bytes = 0;
+    for (const auto& [key, node] : m_impl->nodes) {
+        if (node.file) {
+            std::lock_guard<std::mutex> data_lock(node.file->mutex);
+            bytes += static_cast<si8>(node.file->bytes->size());
+        }
+    }
+    return bytes;
+}
+
+// ============================================================================
+// PackedStorage
+// ============================================================================
+
+namespace {
+
+// Archive layout: header, file contents (each at a 64-byte aligned offset)
+// and the entry table, whose position the header records
+constexpr char PACK_MAGIC[8] = {'M', 'E', 'F', 'D', 'P', 'A', 'K', '1'};
+constexpr si8 PACK_ALIGNMENT = 64;
+constexpr size_t PACK_COPY_BYTES = 1 << 20;
+
+struct PackHeader {
+    char magic[8];
+    ui4 entries;
+    ui4 table_crc;
+    si8 table_offset;
+    si8 table_bytes;
+    ui1 reserved[32];
+};
+static_assert(sizeof(PackHeader) == 64, "PackHeader must be 64 bytes");
+
+// Followed by path_bytes of path, padded to 8 bytes
+struct PackEntry {
+    ui4 path_bytes;
+    ui4 is_directory;
+    si8 offset;
+    si8 size;
+    si8 mtime;   // file_time_type ticks
+};
+static_assert(sizeof(PackEntry) == 32, "PackEntry must be 32 bytes");
+
+si8 align_up(si8 value, si8 alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Archive paths are relative: "" is the root, "/s.mefd" and "s.mefd/" are "s.mefd"
+std::string packed_key(const std::string& path) {
+    std::string key = normalize(path);
+    while (!key.empty() && key.front() == '/') {
+        key.erase(0, 1);
+    }
+    return key == "." ? "" : key;
+}
+
+class PackedFile : public StorageFile {
+public:
+    PackedFile(std::shared_ptr<StorageFile> archive, si8 offset, si8 size, std::string path)
+        : m_archive(std::move(archive)), m_offset(offset), m_size(size), m_path(std::move(path)) {}
+
+    si8 size() const override { return m_size; }
+
+    size_t pread(void* data, size_t length, si8 offset) const override {
+        if (offset < 0 || offset >= m_size) {
+            return 0;
+        }
+        size_t count = static_cast<size_t>(std::min<si8>(static_cast<si8>(length), m_size - offset));
+        return m_archive->pread(data, count, m_offset + offset);
+    }
+
+    void pwrite(const void*, size_t, si8) override {
+        throw std::runtime_error("Packed storage is read-only: " + m_path);
+    }
+
+    void truncate(si8) override {
+        throw std::runtime_error("Packed storage is read-only: " + m_path);
+    }
+
+    StorageMapping map(si8 offset, size_t length) const override {
+        if (offset < 0 || offset + static_cast<si8>(length) > m_size) {
+            throw std::runtime_error("Mapping past the end of the file: " + m_path);
+        }
+        return m_archive->map(m_offset + offset, length);
+    }
+
+    int native_handle() const override { return m_archive->native_handle(); }
+    si8 native_offset() const override { return m_archive->native_offset() + m_offset; }
+
+private:
+    std::shared_ptr<StorageFile> m_archive;
+    si8 m_offset;
+    si8 m_size;
+    std::string m_path;
+};
+
+} // namespace
+
+struct PackedStorage::Impl {
+    struct Entry {
+        bool is_directory = false;
+        si8 offset = 0;
+        si8 size = 0;
+        fs::file_time_type mtime;
+    };
+
+    std::shared_ptr<StorageFile> archive;
+    std::map<std::string, Entry> entries;
+
+    const Entry* find(const std::string& key) const {
+        auto it = entries.find(key);
+        return it == entries.end() ? nullptr : &it->second;
+    }
+};
+
+PackedStorage::PackedStorage(const std::string& archive_path)
+    : m_impl(std::make_unique<Impl>())
+    , m_archive_path(archive_path)
+{
+    m_impl->archive = posix_storage()->open(archive_path, OpenMode::READ);
+    const auto& archive = *m_impl->archive;
+
+    PackHeader header;
+    if (archive.pread(&header, sizeof(header), 0) != sizeof(header) ||
+        std::memcmp(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 ||
+        header.table_offset < static_cast<si8>(sizeof(header)) || header.table_bytes < 0 ||
+        header.table_offset + header.table_bytes > archive.size()) {
+        throw std::runtime_error("Not a packed session archive: " + archive_path);
+    }
+    std::vector<ui1> table(static_cast<size_t>(header.table_bytes));
+    if (archive.pread(table.data(), table.size(), header.table_offset) != table.size() ||
+        CRC32::calculate(table.data(), table.size()) != header.table_crc) {
+        throw std::runtime_error("Damaged archive entry table: " + archive_path);
+    }
+
+    size_t position = 0;
+    for (ui4 i = 0; i < header.entries; ++i) {
+        PackEntry entry;
+        if (position + sizeof(entry) > table.size()) {
+            throw std::runtime_error("Damaged archive entry table: " + archive_path);
+        }
+        std::memcpy(&entry, table.data() + position, sizeof(entry));
+        position += sizeof(entry);
+        if (position + entry.path_bytes > table.size()) {
+            throw std::runtime_error("Damaged archive entry table: " + archive_path);
+        }
+        std::string path(reinterpret_cast<const char*>(table.data() + position), entry.path_bytes);
+        position += static_cast<size_t>(align_up(entry.path_bytes, 8));
+
+        Impl::Entry loaded;
+        loaded.is_directory = entry.is_directory != 0;
+        loaded.offset = entry.offset;
+        loaded.size = entry.size;
+        loaded.mtime = fs::file_time_type(fs::file_time_type::duration(entry.mtime));
+        m_impl->entries.emplace(std::move(path), loaded);
+    }
+}
+
+PackedStorage::~PackedStorage() = default;
+
+void PackedStorage::pack(Storage& source, const std::string& source_path, const std::string& archive_path) {
+    if (!source.is_directory(source_path)) {
+        throw std::runtime_error("Not a directory: " + source_path);
+    }
+
+    // Entries in path order, directories before their contents
+    struct Item {
+        std::string key;      // Path in the archive
+        std::string path;     // Path in the source storage
+        bool is_directory;
+    };
+    std::vector<Item> items;
+    fs::path root = fs::path(normalize(source_path));
+    std::vector<Item> pending{{root.filename().generic_string(), root.generic_string(), true}};
+    while (!pending.empty()) {
+        Item item = std::move(pending.back());
+        pending.pop_back();
+        if (item.is_directory) {
+            for (const auto& child : source.list(item.path)) {
+                pending.push_back({item.key + "/" + child.name,
+                                   (fs::path(item.path) / child.name).generic_string(),
+                                   child.is_directory});
+            }
+        }
+        items.push_back(std::move(item));
+    }
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.key < b.key; });
+
+    std::string tmp_path = archive_path + ".tmp";
+    auto out = posix_storage()->open(tmp_path, OpenMode::TRUNCATE);
+    std::vector<ui1> table;
+    std::vector<ui1> buffer(PACK_COPY_BYTES);
+    si8 offset = sizeof(PackHeader);
+    for (const auto& item : items) {
+        PackEntry entry{};
+        entry.path_bytes = static_cast<ui4>(item.key.size());
+        entry.is_directory = item.is_directory ? 1 : 0;
+        entry.mtime = static_cast<si8>(source.modification_time(item.path).time_since_epoch().count());
+        if (!item.is_directory) {
+            auto in = source.open(item.path, OpenMode::READ);
+            offset = align_up(offset, PACK_ALIGNMENT);
+            entry.offset = offset;
+            si8 copied = 0;
+            while (true) {
+                size_t got = in->pread(buffer.data(), buffer.size(), copied);
+                if (got == 0) {
+                    break;
+                }
+                out->pwrite(buffer.data(), got, offset + copied);
+                copied += static_cast<si8>(got);
+            }
+            entry.size = copied;
+            offset += copied;
+        }
+        size_t position = table.size();
+        table.resize(position + sizeof(entry) + static_cast<size_t>(align_up(entry.path_bytes, 8)), 0);
+        std::memcpy(table.data() + position, &entry, sizeof(entry));
+        std::memcpy(table.data() + position + sizeof(entry), item.key.data(), item.key.size());
+    }
+
+    PackHeader header{};
+    std::memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+    header.entries = static_cast<ui4>(items.size());
+    header.table_offset = align_up(offset, PACK_ALIGNMENT);
+    header.table_bytes = static_cast<si8>(table.size());
+    header.table_crc = CRC32::calculate(table.data(), table.size());
+    out->pwrite(table.data(), table.size(), header.table_offset);
+    out->pwrite(&header, sizeof(header), 0);
+    out->sync();
+    out.reset();
+    posix_storage()->rename(tmp_path, archive_path);
+}
+
+std::unique_ptr<StorageFile> PackedStorage::open(const std::string& path, OpenMode mode, bool direct_io) {
+    (void)direct_io;
+    if (mode != OpenMode::READ) {
+        throw std::runtime_error("Packed storage is read-only: " + path);
+    }
+    const auto* entry = m_impl->find(packed_key(path));
+    if (!entry || entry->is_directory) {
+        throw std::runtime_error("Cannot open file: " + path + " (not in " + m_archive_path + ")");
+    }
+    return std::make_unique<PackedFile>(m_impl->archive, entry->offset, entry->size, path);
+}
+
+bool PackedStorage::exists(const std::string& path) const {
+    std::string key = packed_key(path);
+    return key.empty() || m_impl->find(key) != nullptr;
+}
+
+bool PackedStorage::is_directory(const std::string& path) const {
+    std::string key = packed_key(path);
+    const auto* entry = m_impl->find(key);
+    return key.empty() || (entry && entry->is_directory);
+}
+
+std::vector<StorageEntry> PackedStorage::list(const std::string& path) const {
+    std::vector<StorageEntry> entries;
+    if (!is_directory(path)) {
+        return entries;
+    }
+    std::string key = packed_key(path);
+    std::string prefix = key.empty() ? "" : key + "/";
+    for (auto it = m_impl->entries.lower_bound(prefix);
+         it != m_impl->entries.end() && it->first.starts_with(prefix); ++it) {
+        std::string name = it->first.substr(prefix.size());
+        if (!name.empty() && name.find('/') == std::string::npos) {
+            entries.push_back({name, it->second.is_directory});
+        }
+    }
+    return entries;
+}
+
+si8 PackedStorage::file_size(const std::string& path) const {
+    const auto* entry = m_impl->find(packed_key(path));
+    return entry && !entry->is_directory ? entry->size : -1;
+}
+
+fs::file_time_type PackedStorage::modification_time(const std::string& path) const {
+    const auto* entry = m_impl->find(packed_key(path));
+    return entry ? entry->mtime : fs::file_time_type::min();
+}
+
+void PackedStorage::create_directories(const std::string& path) {
+    throw std::runtime_error("Packed storage is read-only: " + path);
+}
+
+void PackedStorage::remove_all(const std::string& path) {
+    throw std::runtime_error("Packed storage is read-only: " + path);
+}
+
+void PackedStorage::rename(const std::string& from, const std::string&) {
+    throw std::runtime_error("Packed storage is read-only: " + from);
+}
+
+} // namespace brainmaze_mefd
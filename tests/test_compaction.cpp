@@ -0,0 +1,180 @@
+/**
+ * @file test_compaction.cpp
+ * @brief Segment compaction tests
+ */
+
+#include "test_helpers.hpp"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+using namespace brainmaze_mefd;
+using namespace brainmaze_mefd::test;
+namespace fs = std::filesystem;
+
+namespace {
+
+std::vector<si4> make_signal(size_t count) {
+    std::vector<si4> samples(count);
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = static_cast<si4>(std::sin(i * 0.01) * 15000.0) + static_cast<si4>((i * 7) % 23);
+    }
+    return samples;
+}
+
+size_t count_discontinuities(const std::vector<CompressedBlock>& blocks) {
+    size_t count = 0;
+    for (const auto& block : blocks) {
+        count += (block.index.RED_block_flags & RED_DISCONTINUITY_MASK) ? 1 : 0;
+    }
+    return count;
+}
+
+si8 count_blocks(MefReader& reader, const std::string& channel) {
+    si8 blocks = 0;
+    for (const auto& segment : reader.get_segments(channel)) {
+        blocks += segment.number_of_blocks;
+    }
+    return blocks;
+}
+
+} // namespace
+
+bool test_compaction() {
+    bool all_passed = true;
+
+    fs::path test_dir = fs::temp_directory_path() / "brainmaze_mefd_compaction_test";
+    if (fs::exists(test_dir)) {
+        fs::remove_all(test_dir);
+    }
+    fs::create_directories(test_dir);
+
+    // 24 s at 500 Hz in 100-sample blocks, with a 0.1 s gap after 6 s
+    const si8 start_time = 1700000000000000LL;
+    const sf8 fs_hz = 500.0;
+    const size_t gap_sample = 3000;
+    const si8 gap_us = 100000;
+    auto signal = make_signal(12000);
+    auto session_spec = [&](si4 compaction_block_len) {
+        return SessionSpec{
+            .channels = {"ch"},
+            .sampling_freq = fs_hz,
+            .bursts = {{start_time, gap_sample},
+                       {start_time + static_cast<si8>(gap_sample * 2000) + gap_us, signal.size() - gap_sample}},
+            .block_len = 100,
+            .sample = [&](size_t, size_t i) { return signal[i]; },
+            .configure = [compaction_block_len](MefWriter& writer) {
+                writer.set_segment_rollover_seconds(10.0);
+                writer.set_compaction_block_len(compaction_block_len);
+            }};
+    };
+
+    // Reference session without compaction
+    fs::path plain_path = test_dir / "plain.mefd";
+    write_session(plain_path.string(), session_spec(0));
+    size_t plain_discontinuities = 0;
+    si8 plain_blocks = 0;
+    {
+        MefReader reader(plain_path.string());
+        plain_discontinuities = count_discontinuities(reader.read_compressed_blocks("ch"));
+        plain_blocks = count_blocks(reader, "ch");
+    }
+
+    // Test 1: Background compaction of the segments closed by the writer
+    {
+        fs::path path = test_dir / "compacted.mefd";
+        auto stats = write_session(path.string(), session_spec(1000));
+        MefReader reader(path.string());
+        auto blocks = reader.read_compressed_blocks("ch");
+        bool ok = reader.is_valid() && stats.segments_failed == 0 && stats.segments >= 2 &&
+                  stats.blocks_after < stats.blocks_before && stats.bytes_after < stats.bytes_before &&
+                  count_blocks(reader, "ch") < plain_blocks &&
+                  count_discontinuities(blocks) == plain_discontinuities &&
+                  reader.get_raw_data("ch", 0, static_cast<si8>(signal.size())) == signal;
+        for (const auto& block : blocks) {
+            ok = ok && block.index.number_of_samples <= 1000;
+        }
+        for (const auto& entry : fs::directory_iterator(path / "ch.timd")) {
+            ok = ok && entry.path().extension() == ".segd";
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Background compaction mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Background compaction: OK (" << stats.blocks_before << " -> "
+                      << stats.blocks_after << " blocks, " << stats.bytes_before << " -> "
+                      << stats.bytes_after << " bytes)" << std::endl;
+        }
+    }
+
+    // Test 2: A reader opened before compaction reloads the swapped segments
+    {
+        MefReader reader(plain_path.string());
+        auto before = reader.get_raw_data("ch", 0, static_cast<si8>(signal.size()));
+        auto stats = compact_session(plain_path.string(), 1000);
+        auto after = reader.get_raw_data("ch", 0, static_cast<si8>(signal.size()));
+        auto blocks = reader.read_compressed_blocks("ch");
+        MefReader fresh(plain_path.string());
+        bool ok = before == signal && after == signal && stats.segments >= 2 &&
+                  count_discontinuities(blocks) == plain_discontinuities &&
+                  count_blocks(fresh, "ch") < plain_blocks &&
+                  fresh.get_raw_data("ch", 0, static_cast<si8>(signal.size())) == signal;
+
+        // Compacting again finds nothing to merge
+        auto again = compact_session(plain_path.string(), 1000);
+        ok = ok && again.segments == 0;
+        if (!ok) {
+            std::cout << "  ERROR: Compaction under an open reader mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Open reader across compaction: OK" << std::endl;
+        }
+    }
+
+    // Test 3: Blocks stored with a scale factor are merged at that factor
+    {
+        fs::path path = test_dir / "scaled.mefd";
+        const size_t count = 6000;
+        write_session(path.string(),
+                      {.channels = {"ch"},
+                       .sampling_freq = fs_hz,
+                       .bursts = {{start_time, count}},
+                       .block_len = 100,
+                       .value = [](size_t, size_t i) {
+                           sf8 amplitude = i < 3000 ? 1.0 : 50.0;
+                           return amplitude * std::sin(2 * M_PI * static_cast<sf8>(i) / 50.0);
+                       },
+                       .configure = [](MefWriter& writer) { writer.set_block_relative_precision(1e-3); }});
+        MefReader reader(path.string());
+        auto before = reader.get_raw_data("ch", 0, static_cast<si8>(count));
+        auto stats = compact_session(path.string(), 1000);
+        MefReader fresh(path.string());
+        auto blocks = fresh.read_compressed_blocks("ch");
+        bool ok = stats.segments == 1 && stats.blocks_after < stats.blocks_before &&
+                  stats.bytes_after < stats.bytes_before &&
+                  fresh.get_raw_data("ch", 0, static_cast<si8>(count)) == before;
+        for (const auto& block : blocks) {
+            REDBlockHeader header;
+            std::memcpy(&header, block.data.data(), sizeof(header));
+            ok = ok && header.scale_factor > 1.0f;
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Compaction of scaled blocks mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Scaled blocks: OK (" << stats.blocks_before << " -> " << stats.blocks_after
+                      << " blocks, " << stats.bytes_before << " -> " << stats.bytes_after << " bytes)"
+                      << std::endl;
+        }
+    }
+
+    try {
+        fs::remove_all(test_dir);
+    } catch (...) {
+        // Ignore cleanup errors
+    }
+
+    return all_passed;
+}
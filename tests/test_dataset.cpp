@@ -0,0 +1,160 @@
+/**
+ * @file test_dataset.cpp
+ * @brief Multi-session dataset catalog tests
+ */
+
+#include "test_helpers.hpp"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <filesystem>
+
+using namespace brainmaze_mefd;
+using namespace brainmaze_mefd::test;
+namespace fs = std::filesystem;
+
+namespace {
+
+// Raw samples counting up from offset
+std::function<si4(size_t, size_t)> ramp(si4 offset) {
+    return [offset](size_t, size_t i) { return offset + static_cast<si4>(i); };
+}
+
+} // namespace
+
+bool test_dataset() {
+    bool all_passed = true;
+
+    fs::path test_dir = fs::temp_directory_path() / "brainmaze_mefd_dataset_test";
+    if (fs::exists(test_dir)) {
+        fs::remove_all(test_dir);
+    }
+    fs::create_directories(test_dir / "patient" / "restart");
+
+    // Three sessions of 10 s at 100 Hz with a 5 s gap between the first
+    // two; the third, in a subdirectory, starts 1 s before the second ends
+    const si8 start_time = 1700000000000000LL;
+    const sf8 fs_hz = 100.0;
+    write_session((test_dir / "patient" / "day1.mefd").string(),
+                  {.sampling_freq = fs_hz, .bursts = {{start_time, 1000}}, .block_len = 100,
+                   .sample = ramp(0)});
+    write_session((test_dir / "patient" / "day2.mefd").string(),
+                  {.channels = {"eeg", "ecg"}, .sampling_freq = fs_hz,
+                   .bursts = {{start_time + 15000000, 1000}}, .block_len = 100, .sample = ramp(10000)});
+    write_session((test_dir / "patient" / "restart" / "day2b.mefd").string(),
+                  {.sampling_freq = fs_hz, .bursts = {{start_time + 24000000, 1000}}, .block_len = 100,
+                   .sample = ramp(20000)});
+
+    // Test 1: catalog and reads across session boundaries
+    {
+        MefDataset dataset(test_dir.string());
+        auto stats = dataset.get_statistics();
+        auto spans = dataset.get_channel_spans("eeg");
+        bool ok = stats.sessions == 3 && stats.sessions_indexed == 3 &&
+                  dataset.get_channels() == std::vector<std::string>{"ecg", "eeg"} &&
+                  spans.size() == 3 && dataset.get_channel_spans("ecg").size() == 1 &&
+                  dataset.get_start_time() == start_time &&
+                  dataset.get_end_time() == start_time + 33990000 &&
+                  fs::exists(test_dir / "mefd_dataset.catalog");
+
+        // Only the sessions overlapping a range are listed
+        si8 t0 = start_time + 12000000, t1 = start_time + 16000000;
+        auto overlapping = dataset.get_channel_spans("eeg", &t0, &t1);
+        ok = ok && overlapping.size() == 1 && overlapping[0].start_time == start_time + 15000000;
+
+        // 8 s to 18 s: 2 s of day1, 5 s gap, 3 s of day2
+        si8 a = start_time + 8000000, b = start_time + 18000000;
+        auto data = dataset.get_data("eeg", &a, &b);
+        ok = ok && data.size() == 1000 && data[0] == 800.0 && data[199] == 999.0 &&
+             std::isnan(data[200]) && std::isnan(data[699]) && data[700] == 10000.0 &&
+             data[999] == 10299.0;
+
+        // Within one session the result matches MefReader
+        si8 c = start_time + 2000000, d = start_time + 3000000;
+        MefReader reader((test_dir / "patient" / "day1.mefd").string());
+        ok = ok && same_samples(dataset.get_data("eeg", &c, &d), reader.get_data("eeg", &c, &d));
+
+        // Overlapping sessions: the earlier one wins, the later continues it
+        auto all = dataset.get_data("eeg");
+        ok = ok && all.size() == 3400 && all[1500] == 10000.0 && all[2499] == 10999.0 &&
+             all[2500] == 20100.0 && all[3399] == 20999.0;
+        if (!ok) {
+            std::cout << "  FAILED: Cross-session catalog and reads" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Cross-session reads: OK (" << spans.size() << " sessions)" << std::endl;
+        }
+    }
+
+    // Test 2: reopening uses the catalog; only new sessions are opened
+    {
+        DatasetOptions options;
+        options.max_open_sessions = 1;
+        options.threads = 1;
+        MefDataset dataset(test_dir.string(), options);
+        auto stats = dataset.get_statistics();
+        bool ok = stats.sessions == 3 && stats.sessions_indexed == 0 && stats.sessions_from_catalog == 3 &&
+                  dataset.get_data("eeg").size() == 3400;
+
+        si8 t0 = start_time + 1000000, t1 = start_time + 2000000;
+        dataset.get_data("eeg", &t0, &t1);
+        stats = dataset.get_statistics();
+        ok = ok && stats.readers_opened == 4 && stats.reader_cache_hits == 0;
+        dataset.get_data("eeg", &t0, &t1);
+        dataset.get_data("eeg", &t0, &t1);
+        stats = dataset.get_statistics();
+        ok = ok && stats.readers_opened == 4 && stats.reader_cache_hits == 2;
+
+        write_session((test_dir / "patient" / "day3.mefd").string(),
+                      {.sampling_freq = fs_hz, .bursts = {{start_time + 40000000, 500}}, .block_len = 100,
+                       .sample = ramp(30000)});
+        ok = ok && dataset.rescan() == 1 && dataset.get_statistics().sessions == 4 &&
+             dataset.get_channel_spans("eeg").size() == 4 &&
+             dataset.get_end_time() == start_time + 44990000;
+
+        // Removed sessions leave the catalog
+        fs::remove_all(test_dir / "patient" / "restart");
+        ok = ok && dataset.rescan() == 0 && dataset.get_sessions().size() == 3 &&
+             dataset.get_data("eeg").size() == 4500;
+        MefDataset reopened(test_dir.string());
+        ok = ok && reopened.get_statistics().sessions_indexed == 0 &&
+             reopened.get_sessions().size() == 3;
+        if (!ok) {
+            std::cout << "  FAILED: Catalog reuse and rescan" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Catalog reuse: OK" << std::endl;
+        }
+    }
+
+    // Test 3: errors
+    {
+        write_session((test_dir / "other.mefd").string(),
+                      {.sampling_freq = 200.0, .bursts = {{start_time + 50000000, 100}}, .block_len = 100,
+                       .sample = ramp(0)});
+        MefDataset dataset(test_dir.string());
+        int failures = 0;
+        try {
+            dataset.get_data("eeg");
+        } catch (const std::runtime_error&) {
+            failures++;
+        }
+        try {
+            dataset.get_data("missing");
+        } catch (const std::runtime_error&) {
+            failures++;
+        }
+        si8 before = start_time + 45000000;
+        bool ok = failures == 2 && dataset.get_data("eeg", nullptr, &before).size() == 4500 &&
+                  dataset.get_statistics().sessions_indexed == 1;
+        if (!ok) {
+            std::cout << "  FAILED: Dataset errors" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Errors: OK" << std::endl;
+        }
+    }
+
+    fs::remove_all(test_dir);
+    return all_passed;
+}
@@ -0,0 +1,157 @@
+/**
+ * @file test_disk_cache.cpp
+ * @brief On-disk decoded block cache tests
+ */
+
+#include "test_helpers.hpp"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <filesystem>
+
+using namespace brainmaze_mefd;
+using namespace brainmaze_mefd::test;
+namespace fs = std::filesystem;
+
+namespace {
+
+std::vector<fs::path> block_files(const fs::path& directory) {
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::recursive_directory_iterator(directory)) {
+        if (entry.is_regular_file()) {
+            files.push_back(entry.path());
+        }
+    }
+    return files;
+}
+
+} // namespace
+
+bool test_disk_cache() {
+    bool all_passed = true;
+
+    fs::path test_dir = fs::temp_directory_path() / "brainmaze_mefd_disk_cache_test";
+    if (fs::exists(test_dir)) {
+        fs::remove_all(test_dir);
+    }
+    fs::create_directories(test_dir);
+
+    // One channel of 20 s at 1 kHz in 1000-sample blocks
+    const si8 start_time = 1700000000000000LL;
+    fs::path session = test_dir / "cached.mefd";
+    write_session(session.string(), {.bursts = {{start_time, 20000}}});
+    fs::path cache_dir = test_dir / "cache";
+    auto expected = MefReader(session.string()).get_data("eeg");
+
+    // Test 1: disk hits skip the data file and are promoted to the memory cache
+    {
+        auto disk = std::make_shared<DiskBlockCache>(cache_dir.string(), 64LL << 20);
+        MefReader first(session.string());
+        first.set_disk_block_cache(disk);
+        auto start = std::chrono::steady_clock::now();
+        auto cold = first.get_data("eeg");
+        sf8 cold_ms = std::chrono::duration<sf8, std::milli>(std::chrono::steady_clock::now() - start).count();
+        auto cold_stats = disk->get_statistics();
+
+        auto memory = std::make_shared<BlockCache>(64LL << 20);
+        MefReader second(session.string());
+        second.set_block_cache(memory);
+        second.set_disk_block_cache(disk);
+        start = std::chrono::steady_clock::now();
+        auto warm = second.get_data("eeg");
+        sf8 warm_ms = std::chrono::duration<sf8, std::milli>(std::chrono::steady_clock::now() - start).count();
+        auto warm_stats = disk->get_statistics();
+        auto again = second.get_data("eeg");
+
+        bool ok = same_samples(cold, expected) && same_samples(warm, expected) && same_samples(again, expected) &&
+                  cold_stats.misses == 20 && cold_stats.insertions == 20 && cold_stats.blocks == 20 &&
+                  warm_stats.hits == 20 && warm_stats.misses == 20 &&
+                  memory->get_statistics().insertions == 20 && memory->get_statistics().hits == 20 &&
+                  disk->get_statistics().hits == 20 && block_files(cache_dir).size() == 20;
+        if (!ok) {
+            std::cout << "  FAILED: Disk cache hits" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Disk cache hits: OK (cold " << cold_ms << " ms, disk " << warm_ms << " ms)" << std::endl;
+        }
+    }
+
+    // Test 2: entries survive reopening and are shared by copies of the session
+    {
+        std::ofstream(cache_dir / "leftover.blk.tmp") << "partial";
+        fs::path copy = test_dir / "copy.mefd";
+        fs::copy(session, copy, fs::copy_options::recursive);
+
+        auto disk = std::make_shared<DiskBlockCache>(cache_dir.string(), 64LL << 20);
+        auto reopened = disk->get_statistics();
+        MefReader reader(copy.string());
+        reader.set_disk_block_cache(disk);
+        bool ok = reopened.blocks == 20 && reopened.bytes > 20 * 1000 * static_cast<si8>(sizeof(si4)) &&
+                  !fs::exists(cache_dir / "leftover.blk.tmp") &&
+                  same_samples(reader.get_data("eeg"), expected) &&
+                  disk->get_statistics().hits == 20 && disk->get_statistics().misses == 0;
+        if (!ok) {
+            std::cout << "  FAILED: Disk cache reopen" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Disk cache reopen: OK" << std::endl;
+        }
+    }
+
+    // Test 3: a damaged file is a miss and the block is decoded again
+    {
+        auto files = block_files(cache_dir);
+        {
+            std::fstream file(files.front(), std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(-4, std::ios::end);
+            file.write("\x7f\x7f\x7f\x7f", 4);
+        }
+        auto disk = std::make_shared<DiskBlockCache>(cache_dir.string(), 64LL << 20);
+        MefReader reader(session.string());
+        reader.set_disk_block_cache(disk);
+        auto stats_before = disk->get_statistics();
+        bool ok = same_samples(reader.get_data("eeg"), expected);
+        auto stats = disk->get_statistics();
+        ok = ok && stats_before.blocks == 20 && stats.hits == 19 && stats.misses == 1 &&
+             stats.insertions == 1 && stats.blocks == 20;
+        if (!ok) {
+            std::cout << "  FAILED: Disk cache corruption" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Disk cache corruption: OK" << std::endl;
+        }
+    }
+
+    // Test 4: the size cap evicts the least recently used files
+    {
+        auto disk = std::make_shared<DiskBlockCache>(cache_dir.string(), 64LL << 20);
+        si8 file_bytes = disk->get_statistics().bytes / 20;
+        MefReader reader(session.string());
+        reader.set_disk_block_cache(disk);
+        si8 t0 = start_time + 15000000, t1 = start_time + 17000000;
+        reader.get_data("eeg", &t0, &t1);
+        disk->set_capacity(5 * file_bytes);
+        auto shrunk = disk->get_statistics();
+        bool ok = shrunk.blocks == 5 && shrunk.evictions == 15 && block_files(cache_dir).size() == 5;
+
+        // The blocks just read are among the survivors
+        auto before = disk->get_statistics();
+        reader.get_data("eeg", &t0, &t1);
+        ok = ok && disk->get_statistics().misses == before.misses &&
+             disk->get_statistics().hits > before.hits;
+
+        disk->clear();
+        ok = ok && disk->get_statistics().blocks == 0 && block_files(cache_dir).empty();
+        if (!ok) {
+            std::cout << "  FAILED: Disk cache eviction" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Disk cache eviction: OK" << std::endl;
+        }
+    }
+
+    fs::remove_all(test_dir);
+    return all_passed;
+}
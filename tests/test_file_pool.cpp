@@ -0,0 +1,284 @@
+/**
+ * @file test_file_pool.cpp
+ * @brief File pool tests
+ */
+
+#include <brainmaze_mefd/file_pool.hpp>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <filesystem>
+
+using namespace brainmaze_mefd;
+namespace fs = std::filesystem;
+
+namespace {
+
+std::vector<ui1> read_file(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<ui1>(std::istreambuf_iterator<char>(file),
+                            std::istreambuf_iterator<char>());
+}
+
+// In-memory files whose writes take a fixed time, like a busy disk
+class SlowStorage : public MemoryStorage {
+public:
+    std::unique_ptr<StorageFile> open(const std::string& path, OpenMode mode, bool direct_io = false) override {
+        return std::make_unique<SlowFile>(MemoryStorage::open(path, mode, direct_io));
+    }
+
+private:
+    class SlowFile : public StorageFile {
+    public:
+        explicit SlowFile(std::unique_ptr<StorageFile> file) : m_file(std::move(file)) {}
+        si8 size() const override { return m_file->size(); }
+        size_t pread(void* data, size_t length, si8 offset) const override {
+            return m_file->pread(data, length, offset);
+        }
+        void pwrite(const void* data, size_t length, si8 offset) override {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            m_file->pwrite(data, length, offset);
+        }
+        void truncate(si8 length) override { m_file->truncate(length); }
+
+    private:
+        std::unique_ptr<StorageFile> m_file;
+    };
+};
+
+// Append to one file per thread; returns seconds taken and whether every
+// file holds what was appended
+std::pair<double, bool> append_concurrently(FilePool& pool, Storage& storage, size_t threads) {
+    const size_t chunk = 1000;
+    const size_t chunks = 40;
+    std::vector<FilePool::FileId> ids;
+    for (size_t t = 0; t < threads; ++t) {
+        ids.push_back(pool.create("thread_" + std::to_string(t)));
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::vector<ui1> bytes(chunk);
+            for (size_t c = 0; c < chunks; ++c) {
+                for (size_t i = 0; i < chunk; ++i) {
+                    bytes[i] = static_cast<ui1>(t * 31 + c * 7 + i);
+                }
+                pool.append(ids[t], bytes.data(), bytes.size());
+            }
+            pool.close(ids[t]);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bool ok = true;
+    for (size_t t = 0; t < threads; ++t) {
+        auto file = storage.open("thread_" + std::to_string(t), Storage::OpenMode::READ);
+        std::vector<ui1> actual(chunk * chunks);
+        ok = ok && file->size() == static_cast<si8>(actual.size()) &&
+             file->pread(actual.data(), actual.size(), 0) == actual.size();
+        for (size_t i = 0; i < actual.size() && ok; ++i) {
+            ok = actual[i] == static_cast<ui1>(t * 31 + (i / chunk) * 7 + i % chunk);
+        }
+    }
+    return {seconds, ok};
+}
+
+} // namespace
+
+bool test_file_pool() {
+    bool all_passed = true;
+
+    fs::path test_dir = fs::temp_directory_path() / "brainmaze_mefd_pool_test";
+    if (fs::exists(test_dir)) {
+        fs::remove_all(test_dir);
+    }
+    fs::create_directories(test_dir);
+
+    // Test 1: More files than descriptors, interleaved appends
+    {
+        const size_t num_files = 32;
+        FilePool::Options options;
+        options.max_open_files = 4;
+        options.buffer_bytes = 1024;
+        options.buffer_budget_bytes = 8 * 1024;
+        FilePool pool(options);
+
+        std::vector<FilePool::FileId> ids;
+        std::vector<std::vector<ui1>> expected(num_files);
+        for (size_t f = 0; f < num_files; ++f) {
+            ids.push_back(pool.create((test_dir / ("file_" + std::to_string(f))).string()));
+        }
+
+        bool ok = true;
+        for (int round = 0; round < 50; ++round) {
+            for (size_t f = 0; f < num_files; ++f) {
+                std::vector<ui1> chunk(100 + (f * 37 + round * 11) % 300);
+                for (size_t i = 0; i < chunk.size(); ++i) {
+                    chunk[i] = static_cast<ui1>(f * 7 + round + i);
+                }
+                pool.append(ids[f], chunk.data(), chunk.size());
+                expected[f].insert(expected[f].end(), chunk.begin(), chunk.end());
+                ok = ok && pool.size(ids[f]) == static_cast<si8>(expected[f].size());
+            }
+            ok = ok && pool.get_statistics().open_files <= options.max_open_files;
+        }
+
+        pool.flush_all();
+        for (size_t f = 0; f < num_files; ++f) {
+            ok = ok && read_file(test_dir / ("file_" + std::to_string(f))) == expected[f];
+        }
+
+        auto stats = pool.get_statistics();
+        ok = ok && stats.files == num_files && stats.reopens > 0;
+        for (auto id : ids) {
+            pool.close(id);
+        }
+        ok = ok && pool.get_statistics().open_files == 0;
+
+        if (!ok) {
+            std::cout << "  ERROR: Pooled file contents mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Pooled appends: OK (" << num_files << " files, "
+                      << stats.reopens << " reopens, " << stats.write_calls
+                      << " writes)" << std::endl;
+        }
+    }
+
+    // Test 2: Invalid ids are rejected
+    {
+        FilePool pool;
+        bool threw = false;
+        try {
+            pool.append(3, "x", 1);
+        } catch (const std::exception&) {
+            threw = true;
+        }
+        if (!threw) {
+            std::cout << "  ERROR: Invalid file id accepted" << std::endl;
+            all_passed = false;
+        }
+    }
+
+    // Test 3: Preallocated, O_DIRECT files end at their logical size
+    {
+        FilePool::Options options;
+        options.buffer_bytes = 3000;  // Rounded up to one alignment unit
+        options.direct_io = true;
+        FilePool pool(options);
+
+        fs::path path = test_dir / "direct";
+        auto id = pool.create(path.string(), 1 << 20);
+        std::vector<ui1> expected;
+        bool ok = pool.get_options().buffer_bytes == FilePool::DIRECT_IO_ALIGNMENT;
+        for (int round = 0; round < 40; ++round) {
+            std::vector<ui1> chunk(333 + round * 17);
+            for (size_t i = 0; i < chunk.size(); ++i) {
+                chunk[i] = static_cast<ui1>(round * 3 + i);
+            }
+            pool.append(id, chunk.data(), chunk.size());
+            expected.insert(expected.end(), chunk.begin(), chunk.end());
+            if (round % 7 == 0) {
+                pool.flush(id);  // Padded tail is rewritten by later appends
+            }
+        }
+        auto stats = pool.get_statistics();
+        pool.close(id);
+
+        ok = ok && fs::file_size(path) == expected.size() && read_file(path) == expected;
+        if (!ok) {
+            std::cout << "  ERROR: Direct/preallocated file mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Preallocated writes: OK (O_DIRECT "
+                      << (stats.direct_io_files > 0 ? "used" : "unsupported, buffered fallback")
+                      << ", " << stats.preallocated_bytes << " bytes reserved)" << std::endl;
+        }
+    }
+
+    // Test 4: appends to different files from different threads write concurrently
+    {
+        FilePool::Options options;
+        options.buffer_bytes = 4096;
+        auto storage = std::make_shared<SlowStorage>();
+        FilePool pool(options, storage);
+        auto [one, ok_one] = append_concurrently(pool, *storage, 1);
+        auto [eight, ok_eight] = append_concurrently(pool, *storage, 8);
+
+        // A budget of two buffers shared by eight threads
+        options.buffer_budget_bytes = 2 * options.buffer_bytes;
+        FilePool tight(options, storage);
+        auto [contended, ok_contended] = append_concurrently(tight, *storage, 8);
+
+        // Serialized, eight threads would take eight times as long as one
+        bool ok = ok_one && ok_eight && ok_contended && eight < one * 3.0;
+        if (!ok) {
+            std::cout << "  ERROR: Concurrent appends serialized or corrupted (1 thread "
+                      << one * 1000.0 << " ms, 8 threads " << eight * 1000.0 << " ms)" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Concurrent appends: OK (1 thread " << one * 1000.0 << " ms, 8 threads "
+                      << eight * 1000.0 << " ms, 8 threads on 2 buffers " << contended * 1000.0 << " ms)"
+                      << std::endl;
+        }
+    }
+
+    // Test 5: files evicted and reopened after direct I/O is switched on
+    // keep writing in the mode they were created in
+    {
+        FilePool::Options options;
+        options.max_open_files = 1;
+        options.buffer_bytes = 1024;
+        FilePool pool(options);
+        std::vector<FilePool::FileId> ids;
+        std::vector<std::vector<ui1>> expected(2);
+        for (size_t f = 0; f < expected.size(); ++f) {
+            ids.push_back(pool.create((test_dir / ("mode_" + std::to_string(f))).string()));
+        }
+
+        bool ok = true;
+        try {
+            for (int round = 0; round < 20; ++round) {
+                if (round == 5) {
+                    options.direct_io = true;
+                    pool.set_options(options);
+                }
+                for (size_t f = 0; f < expected.size(); ++f) {
+                    std::vector<ui1> chunk(777 + round, static_cast<ui1>(f * 50 + round));
+                    pool.append(ids[f], chunk.data(), chunk.size());
+                    expected[f].insert(expected[f].end(), chunk.begin(), chunk.end());
+                }
+            }
+            for (auto id : ids) {
+                pool.close(id);
+            }
+        } catch (const std::exception& e) {
+            std::cout << "  ERROR: " << e.what() << std::endl;
+            ok = false;
+        }
+        for (size_t f = 0; ok && f < expected.size(); ++f) {
+            ok = read_file(test_dir / ("mode_" + std::to_string(f))) == expected[f];
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Reopened file changed its I/O mode" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Reopen keeps I/O mode: OK" << std::endl;
+        }
+    }
+
+    try {
+        fs::remove_all(test_dir);
+    } catch (...) {
+        // Ignore cleanup errors
+    }
+
+    return all_passed;
+}
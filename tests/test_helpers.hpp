@@ -0,0 +1,113 @@
+/**
+ * @file test_helpers.hpp
+ * @brief Comparisons and session fixtures shared by the tests
+ */
+
+#ifndef BRAINMAZE_MEFD_TEST_HELPERS_HPP
+#define BRAINMAZE_MEFD_TEST_HELPERS_HPP
+
+#include <brainmaze_mefd/mef.hpp>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace brainmaze_mefd {
+namespace test {
+
+/**
+ * @brief Compare two sample vectors, with NaN (gap) equal to NaN
+ */
+inline bool same_samples(const std::vector<sf8>& a, const std::vector<sf8>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (!(a[i] == b[i] || (std::isnan(a[i]) && std::isnan(b[i])))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Session written by write_session()
+ *
+ * Each channel is written as a series of bursts; the sample index runs on
+ * across bursts, so a later burst continues the signal after a gap.
+ * Samples come from value() (physical, written at precision) if set, else
+ * from sample() (raw), else a sine with a small sawtooth that differs per
+ * channel and block.
+ */
+struct SessionSpec {
+    /** @brief Samples written contiguously from one start time */
+    struct Burst {
+        si8 start_time = 0;
+        size_t samples = 0;
+    };
+
+    std::vector<std::string> channels{"eeg"};
+    sf8 sampling_freq = 1000.0;
+    std::vector<Burst> bursts{{1700000000000000LL, 10000}};
+    si4 block_len = 1000;
+    std::function<si4(size_t channel, size_t index)> sample{};
+    std::function<sf8(size_t channel, size_t index)> value{};
+    si4 precision = -1;
+    std::vector<std::pair<si8, std::string>> notes{};
+    std::shared_ptr<Storage> storage{};
+    std::shared_ptr<IoEngine> io_engine{};
+    size_t write_buffer_bytes = 0;
+    std::function<void(MefWriter&)> configure{};  ///< Further writer options
+};
+
+/**
+ * @brief Write a new session at path as described by spec
+ * @return The writer's compaction counters after close()
+ */
+inline CompactionStatistics write_session(const std::string& path, const SessionSpec& spec) {
+    MefWriter writer(path, true, "", "", spec.storage);
+    writer.set_mef_block_len(spec.block_len);
+    if (spec.write_buffer_bytes > 0) {
+        writer.set_write_buffer_bytes(spec.write_buffer_bytes);
+    }
+    writer.set_io_engine(spec.io_engine);
+    if (spec.configure) {
+        spec.configure(writer);
+    }
+    for (size_t c = 0; c < spec.channels.size(); ++c) {
+        auto channel = writer.open_channel(spec.channels[c], spec.sampling_freq);
+        size_t index = 0;
+        for (const auto& burst : spec.bursts) {
+            if (spec.value) {
+                std::vector<sf8> values(burst.samples);
+                for (size_t i = 0; i < values.size(); ++i) {
+                    values[i] = spec.value(c, index + i);
+                }
+                writer.write_data(channel, values.data(), values.size(), burst.start_time,
+                                  spec.precision);
+            } else {
+                std::vector<si4> samples(burst.samples);
+                for (size_t i = 0; i < samples.size(); ++i) {
+                    size_t n = index + i;
+                    samples[i] = spec.sample ? spec.sample(c, n)
+                                             : static_cast<si4>(std::sin(n * 0.003 * (c + 1)) * 20000.0) +
+                                                   static_cast<si4>(n % 17);
+                }
+                writer.write_raw_data(channel, samples.data(), samples.size(), burst.start_time);
+            }
+            index += burst.samples;
+        }
+    }
+    for (const auto& note : spec.notes) {
+        writer.write_record(encode_note(note.first, note.second));
+    }
+    writer.close();
+    return writer.get_compaction_statistics();
+}
+
+} // namespace test
+} // namespace brainmaze_mefd
+
+#endif // BRAINMAZE_MEFD_TEST_HELPERS_HPP
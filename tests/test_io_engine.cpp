@@ -0,0 +1,236 @@
+/**
+ * @file test_io_engine.cpp
+ * @brief Asynchronous I/O engine tests
+ */
+
+#include "test_helpers.hpp"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <filesystem>
+
+using namespace brainmaze_mefd;
+using namespace brainmaze_mefd::test;
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* backend_name(IoEngine::Backend backend) {
+    return backend == IoEngine::Backend::IO_URING ? "io_uring" : "thread pool";
+}
+
+// Four channels of 30 s at 1 kHz in 500-sample blocks
+SessionSpec four_channels(std::shared_ptr<IoEngine> engine) {
+    return {.channels = {"ch0", "ch1", "ch2", "ch3"}, .bursts = {{1700000000000000LL, 30000}},
+            .block_len = 500, .io_engine = std::move(engine), .write_buffer_bytes = 4096};
+}
+
+} // namespace
+
+bool test_io_engine() {
+    bool all_passed = true;
+
+    fs::path test_dir = fs::temp_directory_path() / "brainmaze_mefd_io_engine_test";
+    if (fs::exists(test_dir)) {
+        fs::remove_all(test_dir);
+    }
+    fs::create_directories(test_dir);
+
+    std::vector<IoEngine::Backend> backends{IoEngine::Backend::THREAD_POOL};
+    if (IoEngine::io_uring_available()) {
+        backends.push_back(IoEngine::Backend::IO_URING);
+    }
+
+    // Test 1: batched reads and writes on each backend
+    {
+        const size_t chunk = 16384;
+        const size_t chunks = 512;
+        std::vector<ui1> expected(chunk * chunks);
+        ui4 state = 12345;
+        for (auto& byte : expected) {
+            state = state * 1664525u + 1013904223u;
+            byte = static_cast<ui1>(state >> 24);
+        }
+        std::string path = (test_dir / "data.bin").string();
+
+        for (auto backend : backends) {
+            IoEngine::Options options;
+            options.backend = backend;
+            options.queue_depth = 32;
+            IoEngine engine(options);
+            bool ok = engine.get_backend() == backend;
+
+            // Chunks written out of order in one batch
+            auto file = posix_storage()->open(path, Storage::OpenMode::TRUNCATE);
+            std::vector<IoEngine::Request> writes(chunks);
+            for (size_t i = 0; i < chunks; ++i) {
+                size_t c = (i * 37) % chunks;
+                writes[i].file = file.get();
+                writes[i].data = expected.data() + c * chunk;
+                writes[i].length = chunk;
+                writes[i].offset = static_cast<si8>(c * chunk);
+            }
+            engine.write(writes);
+            ok = ok && file->size() == static_cast<si8>(expected.size());
+
+            // Reads, including one running past the end of the file
+            std::vector<ui1> actual(expected.size() + chunk, 0);
+            std::vector<IoEngine::Request> reads(chunks + 1);
+            for (size_t i = 0; i <= chunks; ++i) {
+                size_t c = (i * 101) % (chunks + 1);
+                reads[i].file = file.get();
+                reads[i].data = actual.data() + c * chunk;
+                reads[i].length = chunk;
+                reads[i].offset = static_cast<si8>(c * chunk - (c == chunks ? chunk / 2 : 0));
+            }
+            std::vector<int> completions(reads.size(), 0);
+            engine.read(reads, [&](size_t i) { completions[i]++; });
+            for (size_t i = 0; i <= chunks; ++i) {
+                size_t c = (i * 101) % (chunks + 1);
+                ok = ok && completions[i] == 1 && reads[i].result == (c == chunks ? chunk / 2 : chunk);
+            }
+            ok = ok && std::equal(expected.begin(), expected.end(), actual.begin());
+
+            // A throwing callback stops the batch after its reads finished
+            bool threw = false;
+            size_t callbacks = 0;
+            try {
+                engine.read(reads, [&](size_t) {
+                    if (++callbacks == 3) {
+                        throw std::runtime_error("stop");
+                    }
+                });
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            ok = ok && threw && callbacks == 3;
+
+            auto stats = engine.get_statistics();
+            ok = ok && stats.batches == 3 && stats.writes == static_cast<si8>(chunks) &&
+                 stats.bytes_written == static_cast<si8>(expected.size()) &&
+                 stats.reads >= static_cast<si8>(chunks + 1) && stats.max_queue_depth > 1 &&
+                 stats.max_queue_depth <= 32 && stats.mean_queue_depth > 1.0;
+            if (!ok) {
+                std::cout << "  FAILED: Batched I/O (" << backend_name(backend) << ")" << std::endl;
+                all_passed = false;
+            } else {
+                std::cout << "  Batched I/O: OK (" << backend_name(backend) << ", mean queue depth "
+                          << stats.mean_queue_depth << ", " << stats.gigabytes_per_second() << " GB/s)"
+                          << std::endl;
+            }
+        }
+    }
+
+    // Test 2: batches whose ring cannot be set up fall back to the thread pool in AUTO mode
+    if (IoEngine::io_uring_available()) {
+        // More entries than io_uring accepts, so every ring setup fails
+        IoEngine::Options options;
+        options.queue_depth = 1 << 20;
+        IoEngine engine(options);
+        auto file = posix_storage()->open((test_dir / "data.bin").string(), Storage::OpenMode::READ);
+        std::vector<ui1> buffer(4096);
+        std::vector<IoEngine::Request> reads(4);
+        for (size_t i = 0; i < reads.size(); ++i) {
+            reads[i].file = file.get();
+            reads[i].data = buffer.data() + i * 1024;
+            reads[i].length = 1024;
+            reads[i].offset = static_cast<si8>(i * 1024);
+        }
+        engine.read(reads);
+        bool ok = engine.get_backend() == IoEngine::Backend::IO_URING &&
+                  engine.get_statistics().reads == 4 && reads.back().result == 1024;
+
+        options.backend = IoEngine::Backend::IO_URING;
+        IoEngine strict(options);
+        try {
+            strict.read(reads);
+            ok = false;
+        } catch (const std::runtime_error&) {
+        }
+        if (!ok) {
+            std::cout << "  FAILED: Ring setup fallback" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Ring setup fallback: OK" << std::endl;
+        }
+    }
+
+    // Test 3: readers fetch the blocks of several channels as one batch
+    {
+        fs::path session = test_dir / "session.mefd";
+        write_session(session.string(), four_channels(nullptr));
+        std::vector<std::string> channels{"ch0", "ch1", "ch2", "ch3"};
+        MefReader plain(session.string());
+        std::vector<std::vector<sf8>> expected;
+        for (const auto& name : channels) {
+            expected.push_back(plain.get_data(name));
+        }
+
+        std::string archive = (test_dir / "session.mefpack").string();
+        PackedStorage::pack(*posix_storage(), session.string(), archive);
+        std::vector<std::pair<std::string, std::shared_ptr<Storage>>> storages{
+            {session.string(), nullptr},
+            {"session.mefd", std::make_shared<PackedStorage>(archive)}};
+
+        for (auto backend : backends) {
+            IoEngine::Options options;
+            options.backend = backend;
+            auto engine = std::make_shared<IoEngine>(options);
+            bool ok = true;
+            for (const auto& [path, storage] : storages) {
+                MefReader reader(path, "", storage);
+                reader.set_io_engine(engine);
+                engine->reset_statistics();
+                auto data = reader.get_data(channels);
+                auto stats = engine->get_statistics();
+                ok = ok && data.size() == channels.size() && stats.batches == 1 && stats.reads == 4 * 60;
+                for (size_t c = 0; c < channels.size() && ok; ++c) {
+                    ok = same_samples(data[c], expected[c]);
+                }
+
+                // Windows within blocks and compressed block reads go through the engine too
+                si8 t0 = 1700000000000000LL + 1234567, t1 = t0 + 4321000;
+                ok = ok && same_samples(reader.get_data("ch2", &t0, &t1), plain.get_data("ch2", &t0, &t1));
+                auto blocks = reader.read_compressed_blocks("ch1", &t0, &t1);
+                auto plain_blocks = plain.read_compressed_blocks("ch1", &t0, &t1);
+                ok = ok && blocks.size() == plain_blocks.size() && !blocks.empty() &&
+                     blocks.back().data == plain_blocks.back().data;
+            }
+            if (!ok) {
+                std::cout << "  FAILED: Multi-channel reads (" << backend_name(backend) << ")" << std::endl;
+                all_passed = false;
+            } else {
+                std::cout << "  Multi-channel reads: OK (" << backend_name(backend) << ", 240 blocks per batch)"
+                          << std::endl;
+            }
+        }
+    }
+
+    // Test 4: writers queue full buffers and write them in batches
+    {
+        IoEngine::Options options;
+        options.queue_depth = 8;
+        auto engine = std::make_shared<IoEngine>(options);
+        fs::path queued = test_dir / "queued.mefd";
+        write_session(queued.string(), four_channels(engine));
+        auto stats = engine->get_statistics();
+
+        MefReader reference((test_dir / "session.mefd").string());
+        MefReader reader(queued.string());
+        bool ok = stats.writes > 0 && stats.batches > 1 && stats.batches < stats.writes &&
+                  stats.max_queue_depth > 1 && stats.max_queue_depth <= 8;
+        for (const auto& name : reference.get_channels()) {
+            ok = ok && same_samples(reader.get_data(name), reference.get_data(name));
+        }
+        if (!ok) {
+            std::cout << "  FAILED: Queued writes" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Queued writes: OK (" << stats.writes << " writes in " << stats.batches
+                      << " batches, " << backend_name(engine->get_backend()) << ")" << std::endl;
+        }
+    }
+
+    fs::remove_all(test_dir);
+    return all_passed;
+}
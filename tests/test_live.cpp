@@ -0,0 +1,179 @@
+/**
+ * @file test_live.cpp
+ * @brief Live tail tests: a reader following a session while it is written
+ */
+
+#include <brainmaze_mefd/mef.hpp>
+#include <iostream>
+#include <vector>
+#include <filesystem>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+using namespace brainmaze_mefd;
+namespace fs = std::filesystem;
+
+namespace {
+
+std::vector<si4> make_ramp(size_t count, si4 offset) {
+    std::vector<si4> samples(count);
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = offset + static_cast<si4>(i % 1000);
+    }
+    return samples;
+}
+
+} // namespace
+
+bool test_live() {
+    bool all_passed = true;
+
+    fs::path test_dir = fs::temp_directory_path() / "brainmaze_mefd_live_test";
+    if (fs::exists(test_dir)) {
+        fs::remove_all(test_dir);
+    }
+    fs::create_directories(test_dir);
+
+    const si8 start_time = 1700000000000000LL;
+    const sf8 fs_hz = 1000.0;
+
+    // Test 1: refresh() picks up flushed blocks, new segments and new channels
+    {
+        fs::path path = test_dir / "tail.mefd";
+        MefWriter writer(path.string(), true);
+        writer.set_mef_block_len(100);
+        auto eeg = writer.open_channel("eeg", fs_hz);
+        auto first = make_ramp(2000, 0);
+        writer.write_raw_data(eeg, first.data(), first.size(), start_time);
+        writer.flush();
+
+        MefReader reader(path.string());
+        bool ok = reader.is_valid() && reader.get_channel_info("eeg").number_of_samples == 2000;
+        auto idle = reader.refresh();
+        ok = ok && !idle.changed() && idle.bytes_read == 0;
+
+        // Appended blocks: only the new index entries are read
+        auto second = make_ramp(3000, 5000);
+        writer.write_raw_data(eeg, second.data(), second.size(), start_time + 2000000);
+        writer.flush();
+        auto appended = reader.refresh();
+        si8 second_start = start_time + 2000000;
+        auto tail = reader.get_data("eeg", &second_start);
+        ok = ok && appended.new_blocks == 30 && appended.new_samples == 3000 &&
+             appended.new_segments == 0 && appended.rewritten_segments == 0 &&
+             appended.bytes_read < 40 * static_cast<si8>(sizeof(TimeSeriesIndex)) + UNIVERSAL_HEADER_BYTES &&
+             appended.latency_seconds >= 0.0 &&
+             reader.get_channel_info("eeg").number_of_samples == 5000 &&
+             reader.get_end_time() == start_time + 4999000 &&
+             tail.size() == 3000 && tail.front() == 5000.0 && tail.back() == 5999.0;
+
+        // A new segment and a new channel
+        auto third = make_ramp(1000, 9000);
+        writer.write_raw_data(eeg, third.data(), third.size(), start_time + 5000000, true);
+        auto emg = writer.open_channel("emg", fs_hz);
+        writer.write_raw_data(emg, third.data(), third.size(), start_time + 5000000);
+        writer.flush();
+        auto grown = reader.refresh();
+        ok = ok && grown.new_segments == 1 && grown.new_channels == 1 &&
+             reader.get_segments("eeg").size() == 2 &&
+             reader.get_channel_info("eeg").number_of_samples == 6000 &&
+             reader.get_channel_info("emg").number_of_samples == 1000 &&
+             reader.get_data("emg").back() == 9999.0 &&
+             reader.get_end_time() == start_time + 5999000;
+
+        auto stats = reader.get_refresh_statistics();
+        ok = ok && stats.refreshes == 3 && stats.updates == 2 &&
+             stats.new_blocks == appended.new_blocks + grown.new_blocks;
+        writer.close();
+
+        // Finalizing publishes nothing new to a reader that is up to date
+        auto final_refresh = reader.refresh();
+        ok = ok && final_refresh.new_blocks == 0 &&
+             reader.get_channel_info("eeg").number_of_samples == 6000;
+        if (!ok) {
+            std::cout << "  FAILED: Refresh did not follow the growing session" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Refresh: OK (+" << appended.new_blocks << " blocks from "
+                      << appended.bytes_read << " index bytes)" << std::endl;
+        }
+    }
+
+    // Test 2: watch() notifies while the writer appends
+    {
+        fs::path path = test_dir / "watch.mefd";
+        MefWriter writer(path.string(), true);
+        writer.set_mef_block_len(100);
+        auto eeg = writer.open_channel("eeg", fs_hz);
+        auto block = make_ramp(1000, 0);
+        writer.write_raw_data(eeg, block.data(), block.size(), start_time);
+        writer.flush();
+
+        MefReader reader(path.string());
+        std::mutex mutex;
+        std::condition_variable cv;
+        si8 notified_samples = 0;
+        reader.watch([&](const MefReader::RefreshResult& result) {
+            std::lock_guard<std::mutex> lock(mutex);
+            notified_samples += result.new_samples;
+            cv.notify_all();
+        }, 0.05);
+
+        bool threw = false;
+        try {
+            reader.watch();
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+
+        for (int i = 1; i <= 5; ++i) {
+            writer.write_raw_data(eeg, block.data(), block.size(), start_time + i * 1000000LL);
+            writer.flush();
+        }
+        bool arrived = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            arrived = cv.wait_for(lock, std::chrono::seconds(10), [&] { return notified_samples == 5000; });
+        }
+        bool watching = reader.is_watching();
+        reader.stop_watch();
+        writer.close();
+
+        bool ok = threw && arrived && watching && !reader.is_watching() &&
+                  reader.get_channel_info("eeg").number_of_samples == 6000 &&
+                  reader.get_refresh_statistics().max_latency_seconds < 10.0;
+        if (!ok) {
+            std::cout << "  FAILED: Watch did not deliver appended blocks" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Watch: OK (mean latency "
+                      << reader.get_refresh_statistics().mean_latency_seconds * 1000.0 << " ms)" << std::endl;
+        }
+    }
+
+    // Test 3: a reader opened before the session exists follows it once created
+    {
+        fs::path path = test_dir / "late.mefd";
+        MefReader reader(path.string());
+        bool ok = !reader.is_valid() && !reader.refresh().changed();
+        MefWriter writer(path.string(), true);
+        auto eeg = writer.open_channel("eeg", fs_hz);
+        auto block = make_ramp(1000, 0);
+        writer.write_raw_data(eeg, block.data(), block.size(), start_time);
+        writer.flush();
+        auto result = reader.refresh();
+        ok = ok && result.new_channels == 1 && reader.is_valid() &&
+             reader.get_start_time() == start_time && reader.get_data("eeg").size() == 1000;
+        writer.close();
+        if (!ok) {
+            std::cout << "  FAILED: Refresh did not pick up a newly created session" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Session created after open: OK" << std::endl;
+        }
+    }
+
+    fs::remove_all(test_dir);
+    return all_passed;
+}
@@ -11,7 +11,17 @@ bool test_crc();
 bool test_aes();
 bool test_sha256();
 bool test_red();
+bool test_file_pool();
 bool test_mef();
+bool test_session_tools();
+bool test_compaction();
+bool test_records();
+bool test_live();
+bool test_dataset();
+bool test_server();
+bool test_disk_cache();
+bool test_storage();
+bool test_io_engine();
 
 int main() {
     std::cout << "=== brainmaze_mefd Test Suite ===" << std::endl;
@@ -50,6 +60,14 @@ int main() {
         std::cout << "PASSED: RED tests" << std::endl;
     }
     
+    std::cout << "\n--- File Pool Tests ---" << std::endl;
+    if (!test_file_pool()) {
+        failures++;
+        std::cout << "FAILED: File pool tests" << std::endl;
+    } else {
+        std::cout << "PASSED: File pool tests" << std::endl;
+    }
+    
     std::cout << "\n--- MEF Tests ---" << std::endl;
     if (!test_mef()) {
         failures++;
@@ -58,6 +76,78 @@ int main() {
         std::cout << "PASSED: MEF tests" << std::endl;
     }
     
+    std::cout << "\n--- Session Tools Tests ---" << std::endl;
+    if (!test_session_tools()) {
+        failures++;
+        std::cout << "FAILED: Session tools tests" << std::endl;
+    } else {
+        std::cout << "PASSED: Session tools tests" << std::endl;
+    }
+    
+    std::cout << "\n--- Compaction Tests ---" << std::endl;
+    if (!test_compaction()) {
+        failures++;
+        std::cout << "FAILED: Compaction tests" << std::endl;
+    } else {
+        std::cout << "PASSED: Compaction tests" << std::endl;
+    }
+    
+    std::cout << "\n--- Records Tests ---" << std::endl;
+    if (!test_records()) {
+        failures++;
+        std::cout << "FAILED: Records tests" << std::endl;
+    } else {
+        std::cout << "PASSED: Records tests" << std::endl;
+    }
+    
+    std::cout << "\n--- Live Tail Tests ---" << std::endl;
+    if (!test_live()) {
+        failures++;
+        std::cout << "FAILED: Live tail tests" << std::endl;
+    } else {
+        std::cout << "PASSED: Live tail tests" << std::endl;
+    }
+    
+    std::cout << "\n--- Dataset Tests ---" << std::endl;
+    if (!test_dataset()) {
+        failures++;
+        std::cout << "FAILED: Dataset tests" << std::endl;
+    } else {
+        std::cout << "PASSED: Dataset tests" << std::endl;
+    }
+    
+    std::cout << "\n--- Server Tests ---" << std::endl;
+    if (!test_server()) {
+        failures++;
+        std::cout << "FAILED: Server tests" << std::endl;
+    } else {
+        std::cout << "PASSED: Server tests" << std::endl;
+    }
+    
+    std::cout << "\n--- Disk Cache Tests ---" << std::endl;
+    if (!test_disk_cache()) {
+        failures++;
+        std::cout << "FAILED: Disk cache tests" << std::endl;
+    } else {
+        std::cout << "PASSED: Disk cache tests" << std::endl;
+    }
+    
+    std::cout << "\n--- Storage Tests ---" << std::endl;
+    if (!test_storage()) {
+        failures++;
+        std::cout << "FAILED: Storage tests" << std::endl;
+    } else {
+        std::cout << "PASSED: Storage tests" << std::endl;
+    }
+    
+    std::cout << "\n--- I/O Engine Tests ---" << std::endl;
+    if (!test_io_engine()) {
+        failures++;
+        std::cout << "FAILED: I/O engine tests" << std::endl;
+    } else {
+        std::cout << "PASSED: I/O engine tests" << std::endl;
+    }
+    
     std::cout << "\n=== Test Summary ===" << std::endl;
     if (failures == 0) {
         std::cout << "All tests passed!" << std::endl;
@@ -3,16 +3,36 @@
  * @brief MEF reader/writer tests
  */
 
-#include <brainmaze_mefd/mef.hpp>
+#include "test_helpers.hpp"
 #include <iostream>
 #include <vector>
 #include <cmath>
 #include <filesystem>
+#include <fstream>
 #include <chrono>
+#include <random>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <atomic>
 
 using namespace brainmaze_mefd;
 namespace fs = std::filesystem;
 
+namespace {
+
+std::vector<TimeSeriesIndex> read_index_file(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    UniversalHeader uh;
+    file.read(reinterpret_cast<char*>(&uh), sizeof(uh));
+    std::vector<TimeSeriesIndex> entries(static_cast<size_t>(std::max<si8>(0, uh.number_of_entries)));
+    file.read(reinterpret_cast<char*>(entries.data()),
+              static_cast<std::streamsize>(entries.size() * sizeof(TimeSeriesIndex)));
+    return entries;
+}
+
+} // namespace
+
 bool test_mef() {
     bool all_passed = true;
     
@@ -162,6 +182,928 @@ bool test_mef() {
         }
     }
     
+    // Test 4: ADC resolution detection
+    {
+        fs::path lsb_session = test_dir / "resolution.mefd";
+        const sf8 lsb = 0.195;  // uV per count
+        std::vector<sf8> data(5000);
+        std::mt19937 gen(7);
+        std::normal_distribution<sf8> noise(0.0, 40.0);
+        si4 counts = 0;
+        for (size_t i = 0; i < data.size(); ++i) {
+            counts += static_cast<si4>(std::round(noise(gen)));
+            counts = std::clamp(counts, -32768, 32767);
+            data[i] = counts * lsb;
+        }
+        
+        MefWriter::ResolutionEstimate estimate;
+        {
+            MefWriter writer(lsb_session.string(), true);
+            writer.set_auto_resolution(true);
+            writer.set_mef_block_len(500);
+            writer.write_data(data, "lsb_ch", 4000000000000LL, 1000.0);
+            estimate = writer.get_resolution_estimate("lsb_ch");
+            writer.close();
+        }
+        
+        if (!estimate.found || std::abs(estimate.resolution - lsb) > 1e-9) {
+            std::cout << "  ERROR: Resolution not detected" << std::endl;
+            all_passed = false;
+        } else {
+            MefReader reader(lsb_session.string());
+            auto read_back = reader.get_data("lsb_ch");
+            bool exact = read_back.size() == data.size();
+            for (size_t i = 0; exact && i < data.size(); ++i) {
+                exact = std::abs(read_back[i] - data[i]) < 1e-9;
+            }
+            if (!exact) {
+                std::cout << "  ERROR: Resolution round-trip not lossless" << std::endl;
+                all_passed = false;
+            } else {
+                std::cout << "  Resolution detection: OK (step=" << estimate.resolution
+                          << ", expected gain=" << estimate.expected_compression_gain
+                          << "x)" << std::endl;
+            }
+        }
+    }
+    
+    // Test 4b: later writes beyond the range fixed by the first write are counted
+    {
+        fs::path clip_session = test_dir / "clipped.mefd";
+        std::vector<sf8> quiet(1000), loud(1000);
+        for (size_t i = 0; i < quiet.size(); ++i) {
+            quiet[i] = std::sin(i * 0.01);
+            loud[i] = i % 20 == 0 ? 5.0 : quiet[i];
+        }
+        si8 after_quiet, after_loud;
+        {
+            MefWriter writer(clip_session.string(), true);
+            writer.write_data(quiet, "clip_ch", 4000000000000LL, 1000.0);
+            after_quiet = writer.get_clipped_samples("clip_ch");
+            writer.write_data(loud, "clip_ch", 4000001000000LL, 1000.0);
+            after_loud = writer.get_clipped_samples("clip_ch");
+            writer.close();
+        }
+        if (after_quiet != 0 || after_loud != 50) {
+            std::cout << "  ERROR: Clipped samples not counted (" << after_loud << ")" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Clipped sample count: OK (" << after_loud << " samples)" << std::endl;
+        }
+    }
+    
+    // Test 5: Per-block adaptive scale factor
+    {
+        const size_t BLOCK = 500;
+        const sf8 REL = 1e-3;
+        std::vector<sf8> data(BLOCK * 20);
+        std::mt19937 gen(11);
+        std::normal_distribution<sf8> noise(0.0, 1.0);
+        for (size_t i = 0; i < data.size(); ++i) {
+            bool loud = (i / BLOCK) % 2 == 1;
+            data[i] = loud ? 1e-3 * std::sin(2 * M_PI * i / 50.0) + 1e-5 * noise(gen)
+                           : 1e-6 * noise(gen);
+        }
+        
+        auto session_bytes = [](const fs::path& session) {
+            uintmax_t bytes = 0;
+            for (const auto& entry : fs::recursive_directory_iterator(session)) {
+                if (entry.path().extension() == ".tdat") bytes += entry.file_size();
+            }
+            return bytes;
+        };
+        
+        fs::path lossless_session = test_dir / "hdr_lossless.mefd";
+        fs::path adaptive_session = test_dir / "hdr_adaptive.mefd";
+        for (const auto& session : {lossless_session, adaptive_session}) {
+            MefWriter writer(session.string(), true);
+            writer.set_mef_block_len(static_cast<si4>(BLOCK));
+            if (session == adaptive_session) {
+                writer.set_block_relative_precision(REL);
+            }
+            writer.write_data(data, "hdr_ch", 5000000000000LL, 1000.0);
+            writer.close();
+        }
+        
+        MefReader reader(adaptive_session.string());
+        auto read_back = reader.get_data("hdr_ch");
+        bool within_bound = read_back.size() == data.size();
+        for (size_t b = 0; within_bound && b < data.size() / BLOCK; ++b) {
+            sf8 peak = 0.0;
+            for (size_t i = b * BLOCK; i < (b + 1) * BLOCK; ++i) {
+                peak = std::max(peak, std::abs(data[i]));
+            }
+            for (size_t i = b * BLOCK; within_bound && i < (b + 1) * BLOCK; ++i) {
+                within_bound = std::abs(read_back[i] - data[i]) <= REL * peak;
+            }
+        }
+        
+        auto lossless_bytes = session_bytes(lossless_session);
+        auto adaptive_bytes = session_bytes(adaptive_session);
+        if (!within_bound) {
+            std::cout << "  ERROR: Adaptive scale factor exceeded precision bound" << std::endl;
+            all_passed = false;
+        } else if (adaptive_bytes >= lossless_bytes) {
+            std::cout << "  ERROR: Adaptive scale factor did not reduce size" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Adaptive block scale: OK (" << lossless_bytes << " -> "
+                      << adaptive_bytes << " bytes)" << std::endl;
+        }
+    }
+    
+    // Test 5b: a loud write after a quiet one is absorbed by block scale factors
+    {
+        const size_t BLOCK = 500;
+        const sf8 REL = 1e-3;
+        std::vector<sf8> quiet(BLOCK * 4), loud(BLOCK * 4);
+        for (size_t i = 0; i < quiet.size(); ++i) {
+            quiet[i] = 1e-6 * std::sin(2 * M_PI * i / 37.0);
+            loud[i] = 1e-3 * std::sin(2 * M_PI * i / 50.0);
+        }
+        fs::path session = test_dir / "hdr_later.mefd";
+        si8 clipped;
+        {
+            MefWriter writer(session.string(), true);
+            writer.set_mef_block_len(static_cast<si4>(BLOCK));
+            writer.set_block_relative_precision(REL);
+            writer.write_data(quiet, "hdr_ch", 5000000000000LL, 1000.0);
+            writer.write_data(loud, "hdr_ch", 5000002000000LL, 1000.0);
+            clipped = writer.get_clipped_samples("hdr_ch");
+            writer.close();
+        }
+        
+        std::vector<sf8> data = quiet;
+        data.insert(data.end(), loud.begin(), loud.end());
+        MefReader reader(session.string());
+        auto read_back = reader.get_data("hdr_ch");
+        bool ok = clipped == 0 && read_back.size() == data.size();
+        for (size_t b = 0; ok && b < data.size() / BLOCK; ++b) {
+            sf8 peak = 0.0;
+            for (size_t i = b * BLOCK; i < (b + 1) * BLOCK; ++i) {
+                peak = std::max(peak, std::abs(data[i]));
+            }
+            for (size_t i = b * BLOCK; ok && i < (b + 1) * BLOCK; ++i) {
+                ok = std::abs(read_back[i] - data[i]) <= REL * peak;
+            }
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Later loud write clipped or beyond precision bound" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Adaptive scale after quiet start: OK (1000x louder, no clipping)" << std::endl;
+        }
+    }
+    
+    // Test 6: Channel handles with small packets
+    {
+        fs::path handle_session = test_dir / "handles.mefd";
+        const si4 BLOCK = 100;
+        const size_t PACKET = 37;
+        const size_t NUM_SAMPLES = PACKET * 30;
+        const sf8 FS = 1000.0;
+        std::vector<std::vector<si4>> written(4);
+        
+        {
+            MefWriter writer(handle_session.string(), true);
+            writer.set_mef_block_len(BLOCK);
+            std::vector<MefWriter::ChannelHandle> handles;
+            for (int ch = 0; ch < 4; ++ch) {
+                handles.push_back(writer.open_channel("h_ch" + std::to_string(ch), FS));
+            }
+            if (writer.open_channel("h_ch2", FS) != handles[2]) {
+                std::cout << "  ERROR: open_channel returned a new handle" << std::endl;
+                all_passed = false;
+            }
+            
+            si8 start_time = 6000000000000LL;
+            for (size_t pos = 0; pos < NUM_SAMPLES; pos += PACKET) {
+                si8 packet_time = start_time + static_cast<si8>(pos * 1e6 / FS);
+                for (int ch = 0; ch < 4; ++ch) {
+                    std::vector<si4> packet(PACKET);
+                    for (size_t i = 0; i < PACKET; ++i) {
+                        packet[i] = static_cast<si4>(ch * 1000 + (pos + i) % 97);
+                    }
+                    writer.write_raw_data(handles[ch], packet.data(), packet.size(), packet_time);
+                    written[ch].insert(written[ch].end(), packet.begin(), packet.end());
+                }
+            }
+            writer.close();
+        }
+        
+        MefReader reader(handle_session.string());
+        bool ok = reader.get_channels().size() == 4;
+        for (int ch = 0; ok && ch < 4; ++ch) {
+            std::string name = "h_ch" + std::to_string(ch);
+            auto raw = reader.get_raw_data(name, 0, static_cast<si8>(NUM_SAMPLES));
+            auto segments = reader.get_segments(name);
+            ok = raw == written[ch] && segments.size() == 1 &&
+                 segments[0].number_of_blocks == (static_cast<si8>(NUM_SAMPLES) + BLOCK - 1) / BLOCK;
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Channel handle writes mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Channel handles: OK (packets merged into full blocks)" << std::endl;
+        }
+    }
+    
+    // Test 7: Reader channel handles across segments
+    {
+        fs::path seg_session = test_dir / "reader_handles.mefd";
+        std::vector<si4> written;
+        {
+            MefWriter writer(seg_session.string(), true);
+            writer.set_mef_block_len(64);
+            auto channel = writer.open_channel("r_ch", 512.0);
+            si8 start_time = 7000000000000LL;
+            for (int seg = 0; seg < 3; ++seg) {
+                std::vector<si4> chunk(1000);
+                for (size_t i = 0; i < chunk.size(); ++i) {
+                    chunk[i] = static_cast<si4>(seg * 100000 + static_cast<si4>(i) * 3);
+                }
+                si8 seg_time = start_time + seg * 10000000LL;
+                writer.write_raw_data(channel, chunk.data(), chunk.size(), seg_time, true);
+                written.insert(written.end(), chunk.begin(), chunk.end());
+            }
+            writer.close();
+        }
+        
+        MefReader reader(seg_session.string());
+        auto handle = reader.get_channel_handle("r_ch");
+        bool ok = reader.get_channel_info(handle).number_of_samples == 3000 &&
+                  reader.get_segments("r_ch").size() == 3;
+        for (si8 start : {0LL, 63LL, 990LL, 1999LL, 2950LL}) {
+            si8 end = std::min<si8>(start + 77, 3000);
+            auto raw = reader.get_raw_data(handle, start, end);
+            ok = ok && raw == std::vector<si4>(written.begin() + start, written.begin() + end);
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Handle reads across segments mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Reader channel handles: OK (3 segments)" << std::endl;
+        }
+    }
+    
+    // Test 8: Concurrent per-channel writers
+    {
+        fs::path mt_session = test_dir / "threaded.mefd";
+        const int num_channels = 4;
+        const size_t packet = 250;
+        const int num_packets = 40;
+        const si8 start_time = 8000000000000LL;
+        auto sample_value = [](int ch, size_t i) {
+            return static_cast<si4>(ch * 1000000 + static_cast<si4>(i % 5000) - 2500);
+        };
+        
+        auto t0 = std::chrono::steady_clock::now();
+        {
+            MefWriter writer(mt_session.string(), true);
+            writer.set_mef_block_len(500);
+            std::vector<MefWriter::ChannelWriter> channel_writers;
+            for (int ch = 0; ch < num_channels; ++ch) {
+                channel_writers.push_back(writer.channel_writer("mt_" + std::to_string(ch), 1000.0));
+            }
+            std::vector<std::thread> threads;
+            for (int ch = 0; ch < num_channels; ++ch) {
+                threads.emplace_back([&, ch]() {
+                    std::vector<si4> chunk(packet);
+                    for (int p = 0; p < num_packets; ++p) {
+                        for (size_t i = 0; i < packet; ++i) {
+                            chunk[i] = sample_value(ch, p * packet + i);
+                        }
+                        si8 t = start_time + static_cast<si8>(p * packet) * 1000;
+                        channel_writers[ch].write_raw_data(chunk.data(), chunk.size(), t);
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            writer.close();
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        
+        MefReader reader(mt_session.string());
+        bool ok = reader.get_channels().size() == num_channels;
+        for (int ch = 0; ch < num_channels && ok; ++ch) {
+            auto raw = reader.get_raw_data("mt_" + std::to_string(ch), 0, packet * num_packets);
+            ok = raw.size() == packet * num_packets;
+            for (size_t i = 0; i < raw.size() && ok; ++i) {
+                ok = raw[i] == sample_value(ch, i);
+            }
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Concurrent channel writes mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            sf8 seconds = std::chrono::duration<sf8>(t1 - t0).count();
+            sf8 msamples = num_channels * packet * num_packets / 1e6;
+            std::cout << "  Concurrent channel writers: OK (" << num_channels << " threads, "
+                      << msamples / seconds << " MS/s)" << std::endl;
+        }
+    }
+    
+    // Test 8b: Close while channel writers are active
+    {
+        fs::path race_session = test_dir / "close_race.mefd";
+        const int num_channels = 4;
+        const size_t packet = 100;
+        const si8 start_time = 8100000000000LL;
+        std::atomic<int> rejected{0};
+        std::atomic<int> other_errors{0};
+        std::vector<size_t> written(num_channels, 0);
+        {
+            MefWriter writer(race_session.string(), true);
+            writer.set_mef_block_len(100);
+            std::vector<MefWriter::ChannelWriter> channel_writers;
+            for (int ch = 0; ch < num_channels; ++ch) {
+                channel_writers.push_back(writer.channel_writer("race_" + std::to_string(ch), 1000.0));
+            }
+            std::atomic<bool> started{false};
+            std::vector<std::thread> threads;
+            for (int ch = 0; ch < num_channels; ++ch) {
+                threads.emplace_back([&, ch]() {
+                    std::vector<si4> chunk(packet, ch * 100);
+                    for (int p = 0; p < 100000; ++p) {
+                        si8 t = start_time + static_cast<si8>(p * packet) * 1000;
+                        try {
+                            channel_writers[ch].write_raw_data(chunk.data(), chunk.size(), t);
+                        } catch (const std::runtime_error& e) {
+                            if (std::string(e.what()) == "Writer is closed") {
+                                ++rejected;
+                            } else {
+                                ++other_errors;
+                            }
+                            return;
+                        }
+                        written[ch] += packet;
+                        started = true;
+                    }
+                });
+            }
+            while (!started) {
+                std::this_thread::yield();
+            }
+            writer.close();
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+        
+        MefReader reader(race_session.string());
+        bool ok = other_errors == 0 && reader.get_channels().size() == num_channels;
+        for (int ch = 0; ch < num_channels && ok; ++ch) {
+            auto raw = reader.get_raw_data("race_" + std::to_string(ch), 0, written[ch]);
+            ok = raw.size() == written[ch];
+            for (size_t i = 0; i < raw.size() && ok; ++i) {
+                ok = raw[i] == ch * 100;
+            }
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Writes racing close() were lost or corrupted" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Close with active writers: OK (" << rejected << " writers rejected)"
+                      << std::endl;
+        }
+    }
+    
+    // Test 9: More channels than open data files
+    {
+        fs::path pool_session = test_dir / "pooled.mefd";
+        const int num_channels = 48;
+        const si8 start_time = 9000000000000LL;
+        {
+            MefWriter writer(pool_session.string(), true);
+            writer.set_mef_block_len(100);
+            writer.set_max_open_files(8);
+            std::vector<MefWriter::ChannelHandle> handles;
+            for (int ch = 0; ch < num_channels; ++ch) {
+                handles.push_back(writer.open_channel("p_" + std::to_string(ch), 1000.0));
+            }
+            std::vector<si4> chunk(150);
+            for (int p = 0; p < 20; ++p) {
+                for (int ch = 0; ch < num_channels; ++ch) {
+                    for (size_t i = 0; i < chunk.size(); ++i) {
+                        chunk[i] = static_cast<si4>(ch * 10000 + p * 150 + static_cast<si4>(i));
+                    }
+                    writer.write_raw_data(handles[ch], chunk.data(), chunk.size(),
+                                          start_time + p * 150000LL);
+                }
+            }
+            writer.close();
+        }
+        
+        MefReader reader(pool_session.string());
+        bool ok = reader.get_channels().size() == num_channels;
+        for (int ch = 0; ch < num_channels && ok; ++ch) {
+            auto raw = reader.get_raw_data("p_" + std::to_string(ch), 0, 3000);
+            ok = raw.size() == 3000;
+            for (size_t i = 0; i < raw.size() && ok; ++i) {
+                ok = raw[i] == static_cast<si4>(ch * 10000 + static_cast<si4>(i));
+            }
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Pooled channel data mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Bounded open files: OK (" << num_channels << " channels, 8 files)" << std::endl;
+        }
+    }
+    
+    // Test 10: Preallocated data files are truncated at segment close
+    {
+        fs::path prealloc_session = test_dir / "prealloc.mefd";
+        std::vector<si4> written(5000);
+        for (size_t i = 0; i < written.size(); ++i) {
+            written[i] = static_cast<si4>((i * 7919) % 2001) - 1000;
+        }
+        {
+            MefWriter writer(prealloc_session.string(), true);
+            writer.set_preallocation_seconds(60.0);
+            writer.set_direct_io(true);
+            writer.set_write_buffer_bytes(64 * 1024);
+            auto channel = writer.open_channel("pa", 1000.0);
+            writer.write_raw_data(channel, written.data(), 2500, 10000000000000LL);
+            writer.write_raw_data(channel, written.data() + 2500, 2500,
+                                  10000000000000LL + 20000000LL, true);
+            writer.close();
+        }
+        
+        MefReader reader(prealloc_session.string());
+        bool ok = reader.get_raw_data("pa", 0, 5000) == written;
+        for (const auto& entry : fs::recursive_directory_iterator(prealloc_session)) {
+            if (entry.path().extension() == ".tdat") {
+                // Header + blocks only: far below the 60 s preallocation
+                ok = ok && entry.file_size() < 60000;
+            }
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Preallocated segment mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Preallocated segments: OK" << std::endl;
+        }
+    }
+    
+    // Test 11: Periodic durability checkpoints are readable before close
+    {
+        fs::path durable_session = test_dir / "durable.mefd";
+        std::vector<si4> chunk(300);
+        for (size_t i = 0; i < chunk.size(); ++i) {
+            chunk[i] = static_cast<si4>(i) - 150;
+        }
+        const si8 start_time = 11000000000000LL;
+        
+        MefWriter writer(durable_session.string(), true);
+        writer.set_mef_block_len(200);
+        writer.set_durability_mode(MefWriter::DurabilityMode::PERIODIC);
+        writer.set_sync_interval(0.0);  // Checkpoint after every write
+        auto channel = writer.open_channel("dur", 1000.0);
+        for (int p = 0; p < 5; ++p) {
+            writer.write_raw_data(channel, chunk.data(), chunk.size(), start_time + p * 300000LL);
+        }
+        
+        // Everything written so far is on disk while the writer is still open
+        bool ok = false;
+        {
+            MefReader reader(durable_session.string());
+            ok = reader.get_channel_info("dur").number_of_samples == 1500;
+            auto raw = reader.get_raw_data("dur", 1400, 1500);
+            ok = ok && raw == std::vector<si4>(chunk.begin() + 200, chunk.end());
+        }
+        writer.close();
+        
+        fs::path idx_path = durable_session / "dur.timd" / "dur-000000.segd" / "dur-000000.tidx";
+        std::ifstream idx_file(idx_path, std::ios::binary);
+        UniversalHeader uh;
+        idx_file.read(reinterpret_cast<char*>(&uh), sizeof(uh));
+        std::vector<TimeSeriesIndex> entries(static_cast<size_t>(uh.number_of_entries));
+        idx_file.read(reinterpret_cast<char*>(entries.data()),
+                      static_cast<std::streamsize>(entries.size() * sizeof(TimeSeriesIndex)));
+        ok = ok && uh.body_CRC == CRC32::calculate(reinterpret_cast<const ui1*>(entries.data()),
+                                                   entries.size() * sizeof(TimeSeriesIndex));
+        
+        auto stats = writer.get_sync_statistics();
+        ok = ok && stats.checkpoints >= 5 && stats.sync_calls > 0;
+        if (!ok) {
+            std::cout << "  ERROR: Periodic durability checkpoints" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Durability checkpoints: OK (" << stats.sync_calls << " syncs, "
+                      << stats.sync_seconds * 1e3 << " ms)" << std::endl;
+        }
+    }
+    
+    // Test 12: Time- and size-based segment rollover
+    {
+        fs::path roll_session = test_dir / "rollover.mefd";
+        const si8 start_time = 12000000000000000LL + 3500000LL;  // 3.5 s past a 10 s boundary
+        std::vector<si4> written(2500);
+        for (size_t i = 0; i < written.size(); ++i) {
+            written[i] = static_cast<si4>((i * 37) % 1000);
+        }
+        {
+            MefWriter writer(roll_session.string(), true);
+            writer.set_mef_block_len(300);
+            writer.set_segment_rollover_seconds(10.0);
+            writer.set_segment_rollover_aligned(true);
+            auto timed = writer.open_channel("timed", 100.0);
+            for (size_t off = 0; off < written.size(); off += 37) {
+                size_t n = std::min<size_t>(37, written.size() - off);
+                writer.write_raw_data(timed, written.data() + off, n,
+                                      start_time + static_cast<si8>(off) * 10000);
+            }
+            writer.close();
+        }
+        {
+            MefWriter writer(roll_session.string(), false);
+            writer.set_mef_block_len(300);
+            writer.set_segment_rollover_bytes(2048);
+            auto sized = writer.open_channel("sized", 100.0);
+            writer.write_raw_data(sized, written.data(), written.size(), start_time);
+            writer.close();
+        }
+        
+        MefReader reader(roll_session.string());
+        auto segments = reader.get_segments("timed");
+        bool ok = segments.size() == 3 &&
+                  segments[0].number_of_samples == 650 &&
+                  segments[1].number_of_samples == 1000 &&
+                  segments[2].number_of_samples == 850 &&
+                  segments[1].start_time == 12000000010000000LL;
+        ok = ok && reader.get_raw_data("timed", 0, 2500) == written;
+        
+        auto sized_segments = reader.get_segments("sized");
+        ok = ok && sized_segments.size() > 1 && reader.get_raw_data("sized", 0, 2500) == written;
+        if (!ok) {
+            std::cout << "  ERROR: Segment rollover mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Segment rollover: OK (" << segments.size() << " timed, "
+                      << sized_segments.size() << " sized segments)" << std::endl;
+        }
+    }
+    
+    // Test 13: Time-aligned block boundaries and time-based reads
+    {
+        fs::path aligned_session = test_dir / "aligned.mefd";
+        const si8 start_time = 13000000000250000LL;  // 0.25 s past a whole second
+        std::vector<si4> written(5000);
+        for (size_t i = 0; i < written.size(); ++i) {
+            written[i] = static_cast<si4>(i);
+        }
+        {
+            MefWriter writer(aligned_session.string(), true);
+            writer.set_mef_block_len(4000);
+            writer.set_block_alignment(1000000);
+            auto channel = writer.open_channel("al", 1000.0);
+            for (size_t off = 0; off < written.size(); off += 333) {
+                size_t n = std::min<size_t>(333, written.size() - off);
+                writer.write_raw_data(channel, written.data() + off, n,
+                                      start_time + static_cast<si8>(off) * 1000);
+            }
+            // Second chunk after a 0.5 s gap, within the same segment
+            writer.write_raw_data(channel, written.data(), 1000, start_time + 5500000LL);
+            writer.close();
+        }
+        
+        auto entries = read_index_file(aligned_session / "al.timd" / "al-000000.segd" /
+                                       "al-000000.tidx");
+        bool ok = entries.size() > 2 && entries[0].number_of_samples == 750;
+        for (size_t b = 1; b < entries.size(); ++b) {
+            // Blocks after the gap start off the grid, then realign
+            ok = ok && (entries[b].start_time % 1000000 == 0 ||
+                        entries[b].start_time == start_time + 5500000LL);
+        }
+        
+        MefReader reader(aligned_session.string());
+        si8 t0 = 13000000002000000LL;
+        si8 t1 = t0 + 1000000;
+        auto window = reader.get_data("al", &t0, &t1);
+        ok = ok && window.size() == 1000 && window.front() == 1750.0 && window.back() == 2749.0;
+        
+        si8 after_gap = start_time + 5500000LL;
+        si8 after_gap_end = after_gap + 10000;
+        auto gap_window = reader.get_data("al", &after_gap, &after_gap_end);
+        ok = ok && gap_window.size() == 10 && gap_window.front() == 0.0;
+        if (!ok) {
+            std::cout << "  ERROR: Aligned block boundaries mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Aligned blocks: OK (" << entries.size() << " blocks)" << std::endl;
+        }
+    }
+    
+    // Test 14: Timestamped samples with jitter and dropped packets
+    {
+        fs::path ts_session = test_dir / "timestamped.mefd";
+        const si8 start_time = 14000000000000000LL;
+        std::mt19937 rng(14);
+        std::uniform_int_distribution<si8> jitter(-100, 100);
+        std::vector<si4> samples;
+        std::vector<si8> timestamps;
+        si8 clock = start_time;
+        for (int packet = 0; packet < 30; ++packet) {
+            if (packet == 10 || packet == 21) {
+                clock += 50000;  // Dropped packet: 50 ms gap
+            }
+            for (int i = 0; i < 100; ++i) {
+                samples.push_back(packet * 100 + i);
+                timestamps.push_back(clock + (i == 0 ? 0 : jitter(rng)));
+                clock += 1000;
+            }
+        }
+        {
+            MefWriter writer(ts_session.string(), true);
+            writer.set_mef_block_len(400);
+            auto channel = writer.open_channel("ts", 1000.0);
+            // Deliver in uneven chunks that do not match the packets
+            for (size_t off = 0; off < samples.size(); off += 733) {
+                size_t n = std::min<size_t>(733, samples.size() - off);
+                writer.write_raw_data(channel, samples.data() + off, timestamps.data() + off, n);
+            }
+            writer.close();
+        }
+        
+        fs::path seg_dir = ts_session / "ts.timd" / "ts-000000.segd";
+        auto entries = read_index_file(seg_dir / "ts-000000.tidx");
+        std::ifstream data_file(seg_dir / "ts-000000.tdat", std::ios::binary);
+        bool ok = !entries.empty();
+        si8 first = 0;
+        int discontinuities = 0;
+        for (const auto& entry : entries) {
+            REDBlockHeader header;
+            data_file.seekg(entry.file_offset);
+            data_file.read(reinterpret_cast<char*>(&header), sizeof(header));
+            bool discontinuity = (header.flags & RED_DISCONTINUITY_MASK) != 0;
+            discontinuities += discontinuity ? 1 : 0;
+            bool after_gap = first == 1000 || first == 2100;
+            ok = ok && entry.start_time == timestamps[static_cast<size_t>(first)] &&
+                 (first == 0 || discontinuity == after_gap);
+            first += entry.number_of_samples;
+        }
+        ok = ok && first == 3000 && discontinuities == 3;
+        
+        MefReader reader(ts_session.string());
+        ok = ok && reader.get_raw_data("ts", 0, 3000) == samples;
+        if (!ok) {
+            std::cout << "  ERROR: Timestamped ingestion mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Timestamped ingestion: OK (" << entries.size() << " blocks, "
+                      << discontinuities - 1 << " gaps)" << std::endl;
+        }
+    }
+    
+    // Test 15: Long NaN runs are dropped and read back as NaN-filled gaps
+    {
+        const si8 start_time = 15000000000000000LL;
+        std::vector<sf8> data(4000);
+        for (size_t i = 0; i < data.size(); ++i) {
+            data[i] = std::sin(i * 0.05) * 100.0;
+        }
+        const sf8 nan = std::numeric_limits<sf8>::quiet_NaN();
+        std::fill(data.begin() + 1500, data.begin() + 2100, nan);  // Dropped
+        std::fill(data.begin() + 3000, data.begin() + 3003, nan);  // Stored as RED_NAN
+        
+        auto nan_session = [&](si4 max_nans) {
+            return test::SessionSpec{
+                .channels = {"nan"},
+                .bursts = {{start_time, data.size()}},
+                .block_len = 400,
+                .value = [&](size_t, size_t i) { return data[i]; },
+                .precision = 2,
+                .configure = [max_nans](MefWriter& writer) { writer.set_max_nans_written(max_nans); }};
+        };
+        fs::path dropped = test_dir / "nan_dropped.mefd";
+        fs::path stored = test_dir / "nan_stored.mefd";
+        test::write_session(dropped.string(), nan_session(10));
+        test::write_session(stored.string(), nan_session(-1));
+        
+        fs::path seg_dir = dropped / "nan.timd" / "nan-000000.segd";
+        auto entries = read_index_file(seg_dir / "nan-000000.tidx");
+        std::ifstream data_file(seg_dir / "nan-000000.tdat", std::ios::binary);
+        bool ok = true;
+        bool flagged = false;
+        si8 samples = 0;
+        for (const auto& entry : entries) {
+            REDBlockHeader header;
+            data_file.seekg(entry.file_offset);
+            data_file.read(reinterpret_cast<char*>(&header), sizeof(header));
+            if (entry.start_time == start_time + 2100000) {
+                flagged = header.is_discontinuity() && header.nan_gap_samples() == 600 &&
+                          entry.nan_gap_samples() == 600;
+            }
+            samples += entry.number_of_samples;
+        }
+        ok = ok && flagged && samples == 3400;
+        ok = ok && fs::file_size(seg_dir / "nan-000000.tdat") <
+                   fs::file_size(stored / "nan.timd" / "nan-000000.segd" / "nan-000000.tdat");
+        
+        // Whole-channel and windowed reads return the dropped run as NaN
+        MefReader reader(dropped.string());
+        si8 end_time = start_time + 4000000;
+        auto result = reader.get_data("nan");
+        ok = ok && test::same_samples(reader.get_data("nan", &start_time, &end_time), result) &&
+             result.size() == data.size();
+        for (size_t i = 0; ok && i < data.size(); ++i) {
+            ok = std::isnan(data[i]) ? std::isnan(result[i])
+                                     : std::abs(result[i] - data[i]) < 0.01;
+        }
+        auto window_of = [&](si8 from_ms, si8 to_ms) {
+            si8 window_start = start_time + from_ms * 1000;
+            si8 window_end = start_time + to_ms * 1000;
+            return reader.get_data("nan", &window_start, &window_end);
+        };
+        auto window = window_of(1400, 2200);
+        auto inside = window_of(1600, 1700);
+        auto ending = window_of(1000, 1800);
+        auto starting = window_of(2000, 2500);
+        ok = ok && window.size() == 800 && !std::isnan(window[99]) &&
+             std::isnan(window[100]) && std::isnan(window[699]) && !std::isnan(window[700]) &&
+             inside.size() == 100 && std::isnan(inside.front()) && std::isnan(inside.back()) &&
+             ending.size() == 800 && !std::isnan(ending[499]) && std::isnan(ending[500]) &&
+             std::isnan(ending.back()) && starting.size() == 500 && std::isnan(starting[99]) &&
+             !std::isnan(starting[100]);
+        
+        // Writers keep every NaN unless a limit is set
+        {
+            MefWriter writer((test_dir / "nan_default.mefd").string(), true);
+            ok = ok && writer.get_max_nans_written() < 0;
+            writer.close();
+        }
+        
+        // A two-hour recording gap is not a dropped NaN run and stays unfilled
+        fs::path gap = test_dir / "nan_gap.mefd";
+        {
+            MefWriter writer(gap.string(), true);
+            writer.set_mef_block_len(400);
+            auto channel = writer.open_channel("gap", 1000.0);
+            writer.write_data(channel, data.data(), 1000, start_time, 2);
+            writer.write_data(channel, data.data(), 1000, start_time + 7200000000LL, 2);
+            writer.close();
+        }
+        MefReader gap_reader(gap.string());
+        si8 gap_start = start_time + 500000;
+        si8 gap_end = start_time + 10500000;
+        auto gap_window = gap_reader.get_data("gap", &gap_start, &gap_end);
+        ok = ok && gap_reader.get_data("gap").size() == 2000 && gap_window.size() == 500 &&
+             std::none_of(gap_window.begin(), gap_window.end(), [](sf8 v) { return std::isnan(v); });
+        if (!ok) {
+            std::cout << "  ERROR: NaN run handling mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  NaN runs: OK (" << entries.size() << " blocks, "
+                      << result.size() << " samples read back)" << std::endl;
+        }
+    }
+    
+    // Test 16: Compressed blocks are copied between sessions without decoding
+    {
+        fs::path source = test_dir / "passthrough_source.mefd";
+        fs::path copy = test_dir / "passthrough_copy.mefd";
+        const si8 start_time = 16000000000000000LL;
+        std::vector<si4> samples(3000);
+        for (size_t i = 0; i < samples.size(); ++i) {
+            samples[i] = static_cast<si4>(std::sin(i * 0.01) * 5000.0) + static_cast<si4>(i % 7);
+        }
+        {
+            MefWriter writer(source.string(), true);
+            writer.set_mef_block_len(400);
+            auto channel = writer.open_channel("pass", 1000.0);
+            writer.write_raw_data(channel, samples.data(), samples.size(), start_time);
+            writer.close();
+        }
+        
+        MefReader reader(source.string());
+        si8 window_start = start_time + 1000000;
+        si8 window_end = start_time + 2500000;
+        auto blocks = reader.read_compressed_blocks("pass", &window_start, &window_end);
+        bool ok = blocks.size() == 5 && blocks.front().index.start_sample == 800;
+        
+        {
+            MefWriter writer(copy.string(), true);
+            writer.set_mef_block_len(400);
+            auto channel = writer.open_channel("pass", 1000.0);
+            writer.write_compressed_blocks(channel, blocks);
+            
+            // Corrupted blocks are rejected
+            auto corrupted = blocks;
+            corrupted.back().data.back() ^= 0xFF;
+            bool threw = false;
+            try {
+                writer.write_compressed_blocks(channel, {corrupted.back()});
+            } catch (const std::exception&) {
+                threw = true;
+            }
+            ok = ok && threw;
+            writer.close();
+        }
+        
+        MefReader copied(copy.string());
+        auto copied_blocks = copied.read_compressed_blocks("pass");
+        ok = ok && copied_blocks.size() == blocks.size();
+        for (size_t b = 0; ok && b < copied_blocks.size(); ++b) {
+            const auto& block = copied_blocks[b];
+            ok = REDCodec::validate_block(block.data.data(), block.data.size()) &&
+                 block.index.start_sample == static_cast<si8>(b) * 400 &&
+                 block.index.start_time == blocks[b].index.start_time &&
+                 (b == 0 ? (block.index.RED_block_flags & RED_DISCONTINUITY_MASK) != 0
+                         : block.data == blocks[b].data);
+        }
+        ok = ok && copied.get_raw_data("pass", 0, 2000) ==
+                   std::vector<si4>(samples.begin() + 800, samples.begin() + 2800);
+        if (!ok) {
+            std::cout << "  ERROR: Compressed block passthrough mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Compressed passthrough: OK (" << blocks.size() << " blocks)" << std::endl;
+        }
+    }
+    
+    // Test 17: Block length tuning per channel
+    {
+        fs::path tuned = test_dir / "tuned.mefd";
+        const si8 start_time = 16100000000000000LL;
+        auto make_samples = [](size_t count, sf8 cycles_per_sample) {
+            std::vector<si4> samples(count);
+            for (size_t i = 0; i < count; ++i) {
+                samples[i] = static_cast<si4>(std::sin(i * cycles_per_sample) * 8000.0) +
+                             static_cast<si4>((i * 31) % 11);
+            }
+            return samples;
+        };
+        auto scalp = make_samples(15000, 0.05);   // 60 s at 250 Hz
+        auto micro = make_samples(96000, 0.002);  // 3 s at 32 kHz
+        
+        // Size only: the candidate with the fewest bytes per sample wins
+        auto estimate = MefWriter::estimate_block_len(scalp.data(), scalp.size(), 250.0, 1.0, 0.0);
+        bool ok = estimate.found && estimate.candidates.size() == 7 &&
+                  estimate.candidates.front().block_len == 31 &&
+                  estimate.candidates.back().block_len == 2000 &&
+                  estimate.candidates.front().bytes_per_sample >
+                      estimate.candidates.back().bytes_per_sample;
+        sf8 best_bytes = 0.0;
+        for (const auto& candidate : estimate.candidates) {
+            if (candidate.block_len == estimate.block_len) {
+                best_bytes = candidate.bytes_per_sample;
+            }
+        }
+        for (const auto& candidate : estimate.candidates) {
+            ok = ok && candidate.bytes_per_sample >= best_bytes &&
+                 candidate.query_seconds > 0.0 && candidate.index_bytes > 0;
+        }
+        
+        // Too short a training window leaves the writer default; the
+        // channel's later contiguous samples still go into 500-sample blocks
+        auto too_short = MefWriter::estimate_block_len(scalp.data(), 40, 250.0);
+        ok = ok && !too_short.found;
+        
+        {
+            MefWriter writer(tuned.string(), true);
+            writer.set_mef_block_len(500);
+            writer.set_auto_block_len(true);
+            writer.set_block_latency_weight(0.0);
+            auto scalp_channel = writer.open_channel("scalp", 250.0);
+            auto micro_channel = writer.open_channel("micro", 32000.0);
+            auto fixed_channel = writer.open_channel("fixed", 250.0);
+            auto short_channel = writer.open_channel("short", 250.0);
+            writer.set_channel_block_len(fixed_channel, 123);
+            writer.write_raw_data(scalp_channel, scalp.data(), scalp.size(), start_time);
+            writer.write_raw_data(micro_channel, micro.data(), micro.size(), start_time);
+            writer.write_raw_data(fixed_channel, scalp.data(), scalp.size(), start_time);
+            writer.write_raw_data(short_channel, scalp.data(), 40, start_time);
+            writer.write_raw_data(short_channel, scalp.data() + 40, scalp.size() - 40,
+                                  start_time + 160000);
+            ok = ok && writer.get_block_len_estimate("scalp").block_len == estimate.block_len &&
+                 writer.get_block_len_estimate("micro").found &&
+                 !writer.get_block_len_estimate("short").found;
+            writer.close();
+        }
+        
+        MefReader reader(tuned.string());
+        MefWriter::BlockLengthEstimate micro_estimate =
+            MefWriter::estimate_block_len(micro.data(), micro.size(), 32000.0, 1.0, 0.0);
+        auto first_block_len = [&](const std::string& name) {
+            return reader.read_compressed_blocks(name).front().index.number_of_samples;
+        };
+        ok = ok && first_block_len("scalp") == static_cast<ui4>(estimate.block_len) &&
+             first_block_len("micro") == static_cast<ui4>(micro_estimate.block_len) &&
+             first_block_len("fixed") == 123 && first_block_len("short") == 500 &&
+             reader.get_raw_data("scalp", 0, static_cast<si8>(scalp.size())) == scalp &&
+             reader.get_raw_data("micro", 0, static_cast<si8>(micro.size())) == micro;
+        if (!ok) {
+            std::cout << "  ERROR: Block length tuning mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Block length tuning: OK (" << estimate.block_len << " at 250 Hz, "
+                      << micro_estimate.block_len << " at 32 kHz)" << std::endl;
+        }
+    }
+    
     // Clean up
     try {
         fs::remove_all(test_dir);
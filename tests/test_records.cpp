@@ -0,0 +1,372 @@
+/**
+ * @file test_records.cpp
+ * @brief Record reading and writing tests
+ */
+
+#include <brainmaze_mefd/mef.hpp>
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <algorithm>
+
+using namespace brainmaze_mefd;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct TestRecord {
+    std::string type;
+    si8 time;
+    std::vector<ui1> body;
+    si1 encryption = NO_ENCRYPTION;
+};
+
+template <typename T>
+void put(std::vector<ui1>& body, size_t offset, T value) {
+    std::memcpy(body.data() + offset, &value, sizeof(T));
+}
+
+void put_string(std::vector<ui1>& body, size_t offset, const std::string& text) {
+    std::memcpy(body.data() + offset, text.data(), text.size());
+}
+
+std::vector<ui1> padded(size_t bytes) {
+    return std::vector<ui1>((bytes + 15) / 16 * 16, 0);
+}
+
+// Write a .rdat/.ridx pair laid out as meflib writes them
+void write_record_files(const fs::path& base, const std::vector<TestRecord>& records,
+                        const std::string& password) {
+    std::array<ui1, ENCRYPTION_KEY_BYTES> key{};
+    AES128::key_expansion(password.c_str(), key.data());
+
+    std::vector<ui1> data(UNIVERSAL_HEADER_BYTES, 0);
+    std::vector<RecordIndex> entries;
+    for (const auto& record : records) {
+        RecordHeader header;
+        header.set_type(record.type);
+        header.version_major = 1;
+        header.version_minor = 0;
+        header.encryption = record.encryption;
+        header.bytes = static_cast<ui4>(record.body.size());
+        header.time = record.time;
+        std::vector<ui1> bytes(RECORD_HEADER_BYTES);
+        bytes.insert(bytes.end(), record.body.begin(), record.body.end());
+        if (record.encryption > NO_ENCRYPTION) {
+            for (size_t offset = RECORD_HEADER_BYTES; offset + 16 <= bytes.size(); offset += 16) {
+                AES128::encrypt_with_key(bytes.data() + offset, bytes.data() + offset, key.data());
+            }
+        }
+        std::memcpy(bytes.data(), &header, RECORD_HEADER_BYTES);
+        header.record_CRC = CRC32::calculate(bytes.data() + 4, bytes.size() - 4);
+        std::memcpy(bytes.data(), &header, RECORD_HEADER_BYTES);
+
+        RecordIndex entry;
+        std::memcpy(entry.type_string.data(), header.type_string.data(), TYPE_BYTES);
+        entry.version_major = 1;
+        entry.version_minor = 0;
+        entry.encryption = record.encryption;
+        entry.file_offset = static_cast<si8>(data.size());
+        entry.time = record.time;
+        entries.push_back(entry);
+        data.insert(data.end(), bytes.begin(), bytes.end());
+    }
+
+    UniversalHeader uh;
+    uh.number_of_entries = static_cast<si8>(records.size());
+    std::memcpy(data.data(), &uh, UNIVERSAL_HEADER_BYTES);
+    std::ofstream(base.string() + ".rdat", std::ios::binary)
+        .write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    std::ofstream idx(base.string() + ".ridx", std::ios::binary);
+    idx.write(reinterpret_cast<const char*>(&uh), UNIVERSAL_HEADER_BYTES);
+    idx.write(reinterpret_cast<const char*>(entries.data()),
+              static_cast<std::streamsize>(entries.size() * sizeof(RecordIndex)));
+}
+
+} // namespace
+
+bool test_records() {
+    bool all_passed = true;
+
+    fs::path test_dir = fs::temp_directory_path() / "brainmaze_mefd_records_test";
+    if (fs::exists(test_dir)) {
+        fs::remove_all(test_dir);
+    }
+    fs::create_directories(test_dir);
+
+    const si8 start_time = 1700000000000000LL;
+    fs::path session = test_dir / "annotated.mefd";
+    {
+        MefWriter writer(session.string(), true);
+        std::vector<si4> samples(5000, 7);
+        auto channel = writer.open_channel("eeg", 250.0);
+        writer.write_raw_data(channel, samples.data(), samples.size(), start_time);
+        writer.close();
+    }
+
+    // Session level: notes and EDF annotations with durations, out of order
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<si8> offset(0, 20000000);
+    std::uniform_int_distribution<si8> length(0, 3000000);
+    std::vector<TestRecord> session_records;
+    std::vector<std::pair<si8, si8>> extents;
+    for (int i = 0; i < 2000; ++i) {
+        si8 time = start_time + offset(rng);
+        if (i % 2 == 0) {
+            std::string text = "note " + std::to_string(i);
+            auto body = padded(text.size() + 1);
+            put_string(body, 0, text);
+            session_records.push_back({RECORD_TYPE_NOTE, time, body});
+            extents.emplace_back(time, time);
+        } else {
+            si8 duration = length(rng);
+            auto body = padded(RECORD_EDFA_BYTES + 8);
+            put(body, 0, duration);
+            put_string(body, RECORD_EDFA_BYTES, "edf");
+            session_records.push_back({RECORD_TYPE_EDF_ANNOTATION, time, body});
+            extents.emplace_back(time, time + duration);
+        }
+    }
+    write_record_files(session / "annotated", session_records, "");
+
+    // Channel level: an encrypted seizure; segment level: a stimulation
+    {
+        auto body = padded(RECORD_SEIZ_BYTES + RECORD_SEIZ_CHANNEL_BYTES);
+        put(body, 0, start_time + 2000000);
+        put(body, 8, start_time + 9000000);
+        put(body, 16, si8{7000000});
+        put(body, 24, si4{1});
+        put(body, 28, SEIZURE_ONSET_FOCAL);
+        put_string(body, 32, "onset");
+        put_string(body, 288, "typical seizure");
+        put_string(body, RECORD_SEIZ_BYTES, "eeg");
+        put(body, RECORD_SEIZ_BYTES + 256, start_time + 2500000);
+        put(body, RECORD_SEIZ_BYTES + 264, start_time + 8000000);
+        write_record_files(session / "eeg.timd" / "eeg",
+                           {{RECORD_TYPE_SEIZURE, start_time + 2000000, body, LEVEL_1_ENCRYPTION}},
+                           "pw");
+    }
+    {
+        auto body = padded(RECORD_ESTI_BYTES);
+        put(body, 0, 2.5);
+        put(body, 8, 130.0);
+        put(body, 16, si8{90});
+        put(body, 24, STIMULUS_AMPLITUDE_UNIT_MA);
+        put(body, 28, STIMULUS_MODE_CURRENT);
+        put_string(body, 32, "biphasic");
+        put_string(body, 160, "e1");
+        put_string(body, 288, "e2");
+        write_record_files(session / "eeg.timd" / "eeg-000000.segd" / "eeg-000000",
+                           {{RECORD_TYPE_ELECTRICAL_STIMULUS, start_time + 4000000, body}}, "");
+    }
+
+    // Test 1: Interval queries match a linear scan
+    {
+        MefReader reader(session.string());
+        bool ok = reader.get_records().size() == session_records.size();
+        std::uniform_int_distribution<si8> window(0, 5000000);
+        for (int q = 0; ok && q < 200; ++q) {
+            si8 query_start = start_time + offset(rng) - 2000000;
+            si8 query_end = query_start + window(rng);
+            size_t expected = 0;
+            for (const auto& [first, last] : extents) {
+                expected += (first < query_end && last >= query_start) ? 1 : 0;
+            }
+            auto records = reader.get_records(&query_start, &query_end);
+            ok = records.size() == expected;
+            for (size_t r = 0; ok && r < records.size(); ++r) {
+                ok = records[r].time < query_end && records[r].end_time >= query_start &&
+                     (r == 0 || records[r - 1].time <= records[r].time);
+            }
+        }
+
+        si8 instant = session_records[0].time;
+        si8 after = instant + 1;
+        auto notes = reader.get_records(&instant, &after);
+        bool found = false;
+        for (const auto& info : notes) {
+            if (info.type == RECORD_TYPE_NOTE && info.time == instant) {
+                found = decode_note(reader.read_record(info)) == "note 0";
+            }
+        }
+        ok = ok && found;
+        if (!ok) {
+            std::cout << "  ERROR: Record interval query mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Interval queries: OK (" << session_records.size() << " records)" << std::endl;
+        }
+    }
+
+    // Test 2: Channel and segment records, encrypted bodies
+    {
+        MefReader reader(session.string(), "pw");
+        si8 query_start = start_time + 8500000;
+        auto late = reader.get_records("eeg", &query_start);
+        auto all = reader.get_records("eeg");
+        bool ok = late.size() == 1 && all.size() == 2 && all[0].type == RECORD_TYPE_SEIZURE &&
+                  all[0].end_time == start_time + 9000000 && all[1].segment == 0;
+        if (ok) {
+            auto seizure = decode_seizure(reader.read_record(all[0]));
+            auto stimulus = decode_electrical_stimulus(reader.read_record(all[1]));
+            ok = seizure.annotation == "typical seizure" && seizure.onset_code == SEIZURE_ONSET_FOCAL &&
+                 seizure.channels.size() == 1 && seizure.channels[0].name == "eeg" &&
+                 seizure.channels[0].offset == start_time + 8000000 &&
+                 stimulus.amplitude == 2.5 && stimulus.pulse_width == 90 &&
+                 stimulus.waveform == "biphasic" && stimulus.cathode == "e2";
+        }
+
+        // Without the password the body stays closed and the extent unknown
+        MefReader locked(session.string());
+        auto closed = locked.get_records("eeg");
+        ok = ok && closed.size() == 2 && closed[0].end_time == closed[0].time &&
+             !locked.read_record(closed[0]).accessible;
+        if (!ok) {
+            std::cout << "  ERROR: Channel record mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Channel and segment records: OK" << std::endl;
+        }
+    }
+
+    // Test 3: A corrupted body fails the record CRC
+    {
+        fs::path rdat = session / "eeg.timd" / "eeg-000000.segd" / "eeg-000000.rdat";
+        {
+            std::fstream file(rdat, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(UNIVERSAL_HEADER_BYTES + RECORD_HEADER_BYTES + 40);
+            file.put('x');
+        }
+        MefReader reader(session.string());
+        auto records = reader.get_records("eeg");
+        bool threw = false;
+        try {
+            reader.read_record(records.at(1));
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        if (!threw) {
+            std::cout << "  ERROR: Corrupted record was accepted" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Record CRC check: OK" << std::endl;
+        }
+    }
+
+    // Test 4: Records written while recording are queryable live
+    {
+        fs::path live = test_dir / "live.mefd";
+        MefWriter writer(live.string(), true, "pw");
+        auto channel = writer.open_channel("eeg", 250.0);
+        std::vector<si4> samples(2500, 3);
+        writer.write_raw_data(channel, samples.data(), samples.size(), start_time);
+        writer.sync();
+
+        std::vector<Record> batch;
+        for (int i = 0; i < 100; ++i) {
+            batch.push_back(encode_note(start_time + 100000 * (100 - i), "detection " + std::to_string(i)));
+        }
+        writer.write_records(batch);
+        EdfAnnotationRecord annotation;
+        annotation.duration = 2000000;
+        annotation.annotation = "artifact";
+        writer.write_record(encode_edf_annotation(start_time + 20000000, annotation));
+
+        MefReader reader(live.string(), "pw");
+        bool ok = reader.get_records().size() == 101 &&
+                  reader.get_records().front().time == start_time + 100000;
+
+        // A late batch is merged into the index in time order
+        SeizureRecord seizure;
+        seizure.earliest_onset = start_time + 500000;
+        seizure.latest_offset = start_time + 4000000;
+        seizure.duration = 3500000;
+        seizure.onset_code = SEIZURE_ONSET_GENERALIZED;
+        seizure.annotation = "detector";
+        seizure.channels.push_back({"eeg", start_time + 500000, start_time + 4000000});
+        Record seizure_record = encode_seizure(start_time + 500000, seizure);
+        seizure_record.info.encryption = LEVEL_1_ENCRYPTION;
+        CognitiveStimulusRecord task;
+        task.task_type = "oddball";
+        task.stimulus_duration = 300000;
+        ElectricalStimulusRecord pulse;
+        pulse.amplitude = 1.5;
+        pulse.anode = "e3";
+        writer.write_records({encode_note(start_time + 50, "late"),
+                              encode_cognitive_stimulus(start_time + 150000, task)});
+        writer.write_records({seizure_record, encode_electrical_stimulus(start_time + 600000, pulse)},
+                             "eeg");
+
+        auto session_records = reader.get_records();
+        si8 window_start = start_time + 21000000;
+        auto overlapping = reader.get_records(&window_start);
+        auto channel_records = reader.get_records("eeg");
+        ok = ok && session_records.size() == 103 && session_records[0].time == start_time + 50 &&
+             std::is_sorted(session_records.begin(), session_records.end(),
+                            [](const RecordInfo& a, const RecordInfo& b) { return a.time < b.time; }) &&
+             overlapping.size() == 1 && overlapping[0].type == RECORD_TYPE_EDF_ANNOTATION &&
+             decode_edf_annotation(reader.read_record(overlapping[0])).annotation == "artifact" &&
+             decode_note(reader.read_record(session_records[0])) == "late" &&
+             decode_cognitive_stimulus(reader.read_record(session_records[2])).task_type == "oddball" &&
+             channel_records.size() == 2 && channel_records[0].end_time == start_time + 4000000;
+        if (ok) {
+            auto decoded = decode_seizure(reader.read_record(channel_records[0]));
+            ok = decoded.annotation == "detector" && decoded.channels.size() == 1 &&
+                 decoded.channels[0].offset == start_time + 4000000 &&
+                 decode_electrical_stimulus(reader.read_record(channel_records[1])).anode == "e3";
+        }
+
+        // Encryption without a password and unknown channels are rejected
+        bool threw = false;
+        try {
+            Record secret = encode_note(start_time, "secret");
+            secret.info.encryption = LEVEL_2_ENCRYPTION;
+            writer.write_record(secret);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        try {
+            writer.write_record(encode_note(start_time, "orphan"), "missing");
+            threw = false;
+        } catch (const std::runtime_error&) {
+        }
+        writer.close();
+
+        // The index CRC covers all entries, also after the rewrite
+        std::ifstream idx(live / "live.ridx", std::ios::binary);
+        UniversalHeader uh;
+        idx.read(reinterpret_cast<char*>(&uh), sizeof(uh));
+        std::vector<RecordIndex> entries(static_cast<size_t>(uh.number_of_entries));
+        idx.read(reinterpret_cast<char*>(entries.data()),
+                 static_cast<std::streamsize>(entries.size() * sizeof(RecordIndex)));
+        ok = ok && threw && idx && entries.size() == 103 &&
+             uh.body_CRC == CRC32::calculate(reinterpret_cast<const ui1*>(entries.data()),
+                                             entries.size() * sizeof(RecordIndex));
+
+        // A writer reopening the session continues its record files
+        {
+            MefWriter appender(live.string(), false);
+            appender.write_record(encode_note(start_time + 70, "appended", RECORD_TYPE_SYSTEM_LOG));
+            appender.close();
+        }
+        auto reopened = MefReader(live.string()).get_records();
+        ok = ok && reopened.size() == 104 && reopened[1].type == RECORD_TYPE_SYSTEM_LOG;
+        if (!ok) {
+            std::cout << "  ERROR: Live record writing mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Live record writing: OK" << std::endl;
+        }
+    }
+
+    try {
+        fs::remove_all(test_dir);
+    } catch (...) {
+        // Ignore cleanup errors
+    }
+
+    return all_passed;
+}
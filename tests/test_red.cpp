@@ -153,5 +153,40 @@ bool test_red() {
         }
     }
     
+    // Test 5: Fixed scale factor (lossy) compression
+    {
+        const int NUM_SAMPLES = 1000;
+        const sf4 scale = 64.0f;
+        std::vector<si4> samples(NUM_SAMPLES);
+        for (int i = 0; i < NUM_SAMPLES; ++i) {
+            samples[i] = static_cast<si4>(100000 * std::sin(2 * M_PI * i / 250));
+        }
+        samples[10] = RED_NAN;
+        
+        REDCodec::CompressionParams params;
+        params.mode = RED_FIXED_SCALE_FACTOR;
+        params.scale_factor = scale;
+        auto lossy = REDCodec::compress(samples.data(), NUM_SAMPLES, 0, params);
+        auto lossless = REDCodec::compress(samples.data(), NUM_SAMPLES, 0);
+        auto decomp_result = REDCodec::decompress(lossy.compressed_data.data(),
+                                                   lossy.compressed_data.size());
+        
+        bool ok = lossy.success && decomp_result.success &&
+                  decomp_result.block_header.scale_factor == scale &&
+                  decomp_result.samples.size() == samples.size() &&
+                  decomp_result.samples[10] == RED_NAN;
+        for (size_t i = 0; ok && i < samples.size(); ++i) {
+            if (i == 10) continue;
+            ok = std::abs(decomp_result.samples[i] - samples[i]) <= scale / 2;
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Fixed scale factor round-trip failed" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Fixed scale factor: OK (" << lossless.compressed_data.size()
+                      << " -> " << lossy.compressed_data.size() << " bytes)" << std::endl;
+        }
+    }
+    
     return all_passed;
 }
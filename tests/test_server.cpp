@@ -0,0 +1,154 @@
+/**
+ * @file test_server.cpp
+ * @brief Block cache and local read server tests
+ */
+
+#include "test_helpers.hpp"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <filesystem>
+
+using namespace brainmaze_mefd;
+using namespace brainmaze_mefd::test;
+namespace fs = std::filesystem;
+
+namespace {
+
+sf8 seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<sf8>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+bool test_server() {
+    bool all_passed = true;
+
+    fs::path test_dir = fs::temp_directory_path() / "brainmaze_mefd_server_test";
+    if (fs::exists(test_dir)) {
+        fs::remove_all(test_dir);
+    }
+    fs::create_directories(test_dir);
+
+    // Two channels of 120 s at 1 kHz in 1000-sample blocks, with a gap
+    const si8 start_time = 1700000000000000LL;
+    const sf8 fs_hz = 1000.0;
+    fs::path session = test_dir / "served.mefd";
+    write_session(session.string(), {.channels = {"eeg", "emg"}, .sampling_freq = fs_hz,
+                                      .bursts = {{start_time, 60000}, {start_time + 61000000, 60000}}});
+
+    // Test 1: readers sharing a block cache decode each block once
+    {
+        auto cache = std::make_shared<BlockCache>(64LL << 20);
+        MefReader first(session.string());
+        MefReader second(session.string());
+        MefReader plain(session.string());
+        first.set_block_cache(cache);
+        second.set_block_cache(cache);
+        auto expected = plain.get_data("eeg");
+        auto cold = first.get_data("eeg");
+        auto cold_stats = cache->get_statistics();
+        auto warm = second.get_data("eeg");
+        auto warm_stats = cache->get_statistics();
+        bool ok = same_samples(cold, expected) && same_samples(warm, expected) &&
+                  cold_stats.misses == 120 && cold_stats.hits == 0 && cold_stats.blocks == 120 &&
+                  warm_stats.hits == 120 && warm_stats.misses == 120;
+
+        // A window reads only its own blocks; a small cache evicts
+        si8 t0 = start_time + 10500000, t1 = start_time + 12500000;
+        ok = ok && same_samples(first.get_data("eeg", &t0, &t1), plain.get_data("eeg", &t0, &t1)) &&
+             cache->get_statistics().hits == 123;
+        cache->set_capacity(10 * 1000 * sizeof(si4));
+        auto shrunk = cache->get_statistics();
+        ok = ok && shrunk.blocks == 10 && shrunk.evictions == 110 &&
+             same_samples(first.get_data("emg"), plain.get_data("emg")) &&
+             cache->get_statistics().blocks == 10;
+        if (!ok) {
+            std::cout << "  FAILED: Shared block cache" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Shared block cache: OK" << std::endl;
+        }
+    }
+
+#ifndef _WIN32
+    // Test 2: clients read through the server with cold and warm cache
+    {
+        fs::path socket_path = test_dir / "serve.sock";
+        ServerOptions options;
+        options.cache_bytes = 64LL << 20;
+        MefServer server(socket_path.string(), options);
+        server.start();
+
+        MefReader reader(session.string());
+        MefClient client(socket_path.string(), session.string());
+        bool ok = server.is_running() && client.is_valid() &&
+                  client.get_channels() == reader.get_channels() &&
+                  client.get_time_series_channels() == reader.get_time_series_channels() &&
+                  client.get_start_time() == reader.get_start_time() &&
+                  client.get_end_time() == reader.get_end_time() &&
+                  client.get_channel_info("emg").number_of_samples == 120000 &&
+                  client.get_channel_info("emg").sampling_frequency == fs_hz;
+
+        auto start = std::chrono::steady_clock::now();
+        auto cold = client.get_data("eeg");
+        sf8 cold_seconds = seconds_since(start);
+        start = std::chrono::steady_clock::now();
+        auto warm = client.get_data_view("eeg");
+        sf8 warm_seconds = seconds_since(start);
+        auto expected = reader.get_data("eeg");
+        ok = ok && same_samples(cold, expected) &&
+             same_samples(std::vector<sf8>(warm.begin(), warm.end()), expected);
+
+        si8 t0 = start_time + 59500000, t1 = start_time + 62000000;
+        auto window = client.get_data_view("emg", &t0, &t1);
+        auto raw = client.get_raw_data("emg", 1000, 5500);
+        ok = ok && same_samples(std::vector<sf8>(window.begin(), window.end()),
+                                reader.get_data("emg", &t0, &t1)) &&
+             raw == reader.get_raw_data("emg", 1000, 5500);
+
+        // A second client of the same session hits the shared cache
+        auto before = client.get_server_statistics();
+        MefClient other(socket_path.string(), session.string());
+        auto again = other.get_data("eeg");
+        auto after = other.get_server_statistics();
+        ok = ok && same_samples(again, expected) && after.sessions_opened == 1 &&
+             after.cache.hits - before.cache.hits == 120 && after.cache.misses == before.cache.misses &&
+             after.connections == 2 && after.samples_served >= 2 * 121000;
+
+        // Errors are reported to the client without ending the connection
+        bool threw = false;
+        try {
+            client.get_data("missing");
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        MefClient missing(socket_path.string(), (test_dir / "missing.mefd").string());
+        ok = ok && threw && client.get_raw_data("eeg", 0, 10).size() == 10 &&
+             !missing.is_valid() && missing.get_channels().empty();
+
+        server.stop();
+        bool lost = false;
+        try {
+            client.get_raw_data("eeg", 0, 10);
+        } catch (const std::runtime_error&) {
+            lost = true;
+        }
+        ok = ok && lost && !server.is_running() && !fs::exists(socket_path);
+        if (!ok) {
+            std::cout << "  FAILED: Read server" << std::endl;
+            all_passed = false;
+        } else {
+            sf8 mb = static_cast<sf8>(expected.size() * sizeof(sf8)) / 1e6;
+            // Both figures include the server-side copy into shared memory
+            std::cout << "  Read server: OK (cold " << cold_seconds * 1000.0 << " ms, "
+                      << mb / cold_seconds << " MB/s; warm " << warm_seconds * 1000.0 << " ms, "
+                      << mb / warm_seconds << " MB/s; one server-side copy per request)" << std::endl;
+        }
+    }
+#endif
+
+    fs::remove_all(test_dir);
+    return all_passed;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file test_session_tools.cpp
+ * @brief Session copy and repack tests
+ */
+
+#include <brainmaze_mefd/mef.hpp>
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+
+using namespace brainmaze_mefd;
+namespace fs = std::filesystem;
+
+namespace {
+
+std::vector<si4> make_signal(size_t count, size_t seed) {
+    std::vector<si4> samples(count);
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = static_cast<si4>(std::sin((i + seed * 1000) * 0.003) * 20000.0) +
+                     static_cast<si4>((i * 13 + seed) % 17);
+    }
+    return samples;
+}
+
+} // namespace
+
+bool test_session_tools() {
+    bool all_passed = true;
+
+    fs::path test_dir = fs::temp_directory_path() / "brainmaze_mefd_tools_test";
+    if (fs::exists(test_dir)) {
+        fs::remove_all(test_dir);
+    }
+    fs::create_directories(test_dir);
+
+    // Two consecutive sessions of three channels, 10 s apart
+    const si8 day_start = 17000000000000000LL;
+    const size_t samples_per_session = 5000;
+    const sf8 fs_hz = 500.0;
+    const si8 session_gap = 20000000;
+    const std::vector<std::string> names = {"a", "b", "c"};
+    std::vector<std::vector<si4>> signals;
+    std::vector<std::string> sources;
+    for (size_t s = 0; s < 2; ++s) {
+        fs::path path = test_dir / ("day" + std::to_string(s) + ".mefd");
+        MefWriter writer(path.string(), true);
+        writer.set_mef_block_len(250);
+        for (size_t c = 0; c < names.size(); ++c) {
+            auto signal = make_signal(samples_per_session, s * 10 + c);
+            auto channel = writer.open_channel(names[c], fs_hz);
+            writer.write_raw_data(channel, signal.data(), signal.size(), day_start + s * session_gap);
+            signals.push_back(signal);
+        }
+        writer.close();
+        sources.push_back(path.string());
+    }
+
+    // Test 1: Slice across both sessions and keep two channels
+    {
+        SessionCopyOptions options;
+        options.channels = {"c", "a"};
+        options.start_time = day_start + 3210000;                // Sample 1605 of session 0
+        options.end_time = day_start + session_gap + 4321000;    // Sample 2160.5 of session 1
+        options.threads = 2;
+        options.chunk_seconds = 2;
+        fs::path destination = test_dir / "slice.mefd";
+        auto stats = copy_sessions(sources, destination.string(), options);
+
+        MefReader reader(destination.string());
+        bool ok = reader.is_valid() && reader.get_channels().size() == 2 &&
+                  stats.blocks_decoded == 4 && stats.blocks_copied > 0;
+        for (size_t c : {size_t(2), size_t(0)}) {
+            std::vector<si4> expected(signals[c].begin() + 1605, signals[c].end());
+            expected.insert(expected.end(), signals[3 + c].begin(), signals[3 + c].begin() + 2161);
+            auto data = reader.get_raw_data(names[c], 0, static_cast<si8>(expected.size()) + 10);
+            auto segments = reader.get_segments(names[c]);
+            const auto& info = reader.get_channel_info(names[c]);
+            ok = ok && data == expected && segments.size() == 2 &&
+                 info.start_time == options.start_time;
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Session slice mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Slice and subset: OK (" << stats.blocks_copied << " blocks copied, "
+                      << stats.blocks_decoded << " re-encoded)" << std::endl;
+        }
+    }
+
+    // Test 2: Whole-session concatenation copies every block verbatim
+    {
+        fs::path destination = test_dir / "concat.mefd";
+        auto stats = copy_sessions(sources, destination.string());
+        MefReader reader(destination.string());
+        bool ok = stats.blocks_decoded == 0 && stats.channels == names.size() &&
+                  stats.samples == static_cast<si8>(2 * names.size() * samples_per_session);
+        for (size_t c = 0; c < names.size(); ++c) {
+            std::vector<si4> expected = signals[c];
+            expected.insert(expected.end(), signals[3 + c].begin(), signals[3 + c].end());
+            ok = ok && reader.get_raw_data(names[c], 0, static_cast<si8>(expected.size())) == expected;
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Session concatenation mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Concatenation: OK (" << stats.bytes_copied << " bytes in "
+                      << stats.seconds * 1000.0 << " ms)" << std::endl;
+        }
+    }
+
+    // Test 3: Repack with longer blocks, then resume an interrupted repack
+    {
+        fs::path destination = test_dir / "repacked.mefd";
+        RepackOptions options;
+        options.block_len = 2000;
+        options.threads = 2;
+        options.chunk_seconds = 3;
+        auto stats = repack_session(sources[0], destination.string(), options);
+
+        MefReader reader(destination.string());
+        bool ok = stats.channels == names.size() &&
+                  stats.samples == static_cast<si8>(names.size() * samples_per_session) &&
+                  stats.destination_bytes < stats.source_bytes &&
+                  !fs::exists(destination / "repack.journal");
+        for (size_t c = 0; c < names.size(); ++c) {
+            auto segments = reader.get_segments(names[c]);
+            ok = ok && segments.size() == 1 && segments[0].number_of_blocks == 3 &&
+                 reader.get_raw_data(names[c], 0, samples_per_session) == signals[c];
+        }
+
+        // Channel "a" finished before the interruption, "b" was cut short
+        {
+            std::ofstream journal(destination / "repack.journal");
+            journal << "a\n";
+        }
+        fs::remove_all(destination / "b.timd" / "b-000000.segd");
+        options.resume = true;
+        auto resumed = repack_session(sources[0], destination.string(), options);
+        MefReader resumed_reader(destination.string());
+        ok = ok && resumed.channels_skipped == 1 && resumed.channels == 2;
+        for (size_t c = 0; c < names.size(); ++c) {
+            ok = ok && resumed_reader.get_raw_data(names[c], 0, samples_per_session) == signals[c];
+        }
+        if (!ok) {
+            std::cout << "  ERROR: Session repack mismatch" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Repack: OK (" << stats.source_bytes << " -> " << stats.destination_bytes
+                      << " bytes, resumed " << resumed.channels << " channels)" << std::endl;
+        }
+    }
+
+    // Test 4: Unknown channels are rejected
+    {
+        SessionCopyOptions options;
+        options.channels = {"missing"};
+        bool threw = false;
+        try {
+            copy_sessions(sources, (test_dir / "missing.mefd").string(), options);
+        } catch (const std::exception&) {
+            threw = true;
+        }
+        if (!threw) {
+            std::cout << "  ERROR: Missing channel accepted" << std::endl;
+            all_passed = false;
+        }
+    }
+
+    try {
+        fs::remove_all(test_dir);
+    } catch (...) {
+        // Ignore cleanup errors
+    }
+
+    return all_passed;
+}
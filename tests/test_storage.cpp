@@ -0,0 +1,178 @@
+/**
+ * @file test_storage.cpp
+ * @brief Storage backend tests
+ */
+
+#include "test_helpers.hpp"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <filesystem>
+
+using namespace brainmaze_mefd;
+using namespace brainmaze_mefd::test;
+namespace fs = std::filesystem;
+
+namespace {
+
+// Two channels of 10 s at 1 kHz and one session note
+SessionSpec stored_session(std::shared_ptr<Storage> storage, si8 start_time) {
+    return {.channels = {"eeg1", "eeg2"}, .bursts = {{start_time, 10000}},
+            .notes = {{start_time + 1000000, "stored"}}, .storage = std::move(storage)};
+}
+
+bool same_session(MefReader& a, MefReader& b) {
+    if (!a.is_valid() || !b.is_valid() || a.get_channels() != b.get_channels()) {
+        return false;
+    }
+    for (const auto& name : a.get_channels()) {
+        if (!same_samples(a.get_data(name), b.get_data(name))) {
+            return false;
+        }
+    }
+    auto records_a = a.get_records();
+    auto records_b = b.get_records();
+    return records_a.size() == 1 && records_b.size() == 1 &&
+           decode_note(a.read_record(records_a.front())) == decode_note(b.read_record(records_b.front()));
+}
+
+} // namespace
+
+bool test_storage() {
+    bool all_passed = true;
+
+    fs::path test_dir = fs::temp_directory_path() / "brainmaze_mefd_storage_test";
+    if (fs::exists(test_dir)) {
+        fs::remove_all(test_dir);
+    }
+    fs::create_directories(test_dir);
+
+    const si8 start_time = 1700000000000000LL;
+    fs::path session = test_dir / "local.mefd";
+    write_session(session.string(), stored_session(nullptr, start_time));
+    MefReader local(session.string());
+
+    // Test 1: a session written to memory reads back like one on disk
+    {
+        auto memory = std::make_shared<MemoryStorage>();
+        std::string path = (test_dir / "memory.mefd").string();
+        write_session(path, stored_session(memory, start_time));
+        MefReader reader(path, "", memory);
+        bool ok = same_session(local, reader) && !fs::exists(path) && memory->get_bytes() > 0 &&
+                  reader.get_storage() == memory;
+
+        // A channel added by a second writer is picked up by refresh()
+        {
+            MefWriter writer(path, false, "", "", memory);
+            std::vector<si4> more(2000, 7);
+            auto channel = writer.open_channel("eeg3", 1000.0);
+            writer.write_raw_data(channel, more.data(), more.size(), start_time);
+            writer.close();
+        }
+        auto result = reader.refresh();
+        ok = ok && result.new_channels == 1 && reader.get_data("eeg3") == std::vector<sf8>(2000, 7.0);
+        if (!ok) {
+            std::cout << "  FAILED: Memory storage session" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Memory storage session: OK (" << memory->get_bytes() << " bytes)" << std::endl;
+        }
+    }
+
+    // Test 2: a packed session is read through the archive
+    {
+        std::string archive = (test_dir / "local.mefpack").string();
+        PackedStorage::pack(*posix_storage(), session.string(), archive);
+        auto packed = std::make_shared<PackedStorage>(archive);
+        auto start = std::chrono::steady_clock::now();
+        MefReader reader("local.mefd", "", packed);
+        bool ok = same_session(local, reader);
+        sf8 ms = std::chrono::duration<sf8, std::milli>(std::chrono::steady_clock::now() - start).count();
+        ok = ok && packed->is_directory("/local.mefd/eeg1.timd") &&
+             packed->file_size("local.mefd/eeg1.timd/eeg1-000000.segd/eeg1-000000.tdat") ==
+                 static_cast<si8>(fs::file_size(session / "eeg1.timd" / "eeg1-000000.segd" / "eeg1-000000.tdat")) &&
+             !fs::exists(archive + ".tmp");
+        if (!ok) {
+            std::cout << "  FAILED: Packed session" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Packed session: OK (" << fs::file_size(archive) << " bytes, open and read "
+                      << ms << " ms)" << std::endl;
+        }
+    }
+
+    // Test 3: archives are read-only and damaged archives are rejected
+    {
+        std::string archive = (test_dir / "local.mefpack").string();
+        auto packed = std::make_shared<PackedStorage>(archive);
+        bool ok = true;
+        try {
+            packed->open("local.mefd/new.dat", Storage::OpenMode::WRITE);
+            ok = false;
+        } catch (const std::runtime_error&) {
+        }
+        try {
+            MefWriter writer("local.mefd", false, "", "", packed);
+            writer.open_channel("eeg3", 1000.0);
+            ok = false;
+        } catch (const std::runtime_error&) {
+        }
+        {
+            auto file = posix_storage()->open(archive, Storage::OpenMode::WRITE);
+            file->truncate(file->size() - 1);
+        }
+        try {
+            PackedStorage damaged(archive);
+            ok = false;
+        } catch (const std::runtime_error&) {
+        }
+        if (!ok) {
+            std::cout << "  FAILED: Packed storage errors" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Packed storage errors: OK" << std::endl;
+        }
+    }
+
+    // Test 4: memory storage files, renames and mapping snapshots
+    {
+        auto memory = std::make_shared<MemoryStorage>();
+        memory->create_directories("a/b");
+        FilePool pool(FilePool::Options{}, memory);
+        auto id = pool.create("a/b/data", 1 << 16);
+        std::vector<ui1> bytes(100000);
+        for (size_t i = 0; i < bytes.size(); ++i) {
+            bytes[i] = static_cast<ui1>(i * 31);
+        }
+        pool.append(id, bytes.data(), bytes.size());
+        pool.close(id);
+
+        auto file = memory->open("a/b/data", Storage::OpenMode::READ);
+        auto mapping = file->map(0, bytes.size());
+        bool ok = memory->file_size("a/b/data") == static_cast<si8>(bytes.size()) &&
+                  std::equal(bytes.begin(), bytes.end(), mapping.data());
+
+        memory->open("a/b/data", Storage::OpenMode::TRUNCATE)->pwrite("x", 1, 0);
+        memory->rename("a/b", "c");
+        auto listing = memory->list("c");
+        ok = ok && std::equal(bytes.begin(), bytes.end(), mapping.data()) &&
+             !memory->exists("a/b/data") && memory->file_size("c/data") == 1 &&
+             listing.size() == 1 && listing.front().name == "data" && !listing.front().is_directory &&
+             memory->is_directory("./a") && memory->list("a").empty();
+        try {
+            memory->open("missing/data", Storage::OpenMode::WRITE);
+            ok = false;
+        } catch (const std::runtime_error&) {
+        }
+        if (!ok) {
+            std::cout << "  FAILED: Memory storage files" << std::endl;
+            all_passed = false;
+        } else {
+            std::cout << "  Memory storage files: OK" << std::endl;
+        }
+    }
+
+    fs::remove_all(test_dir);
+    return all_passed;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file mefd_block_len.cpp
+ * @brief Recommend a block length per channel of a MEF 3.0 session
+ *
+ * Usage:
+ *   mefd_block_len [options] <session.mefd>
+ *
+ * Options:
+ *   --seconds <s>          Training window per channel (default: 60)
+ *   --query-seconds <s>    Typical query window (default: 1)
+ *   --latency-weight <w>   Weight of decode latency against size (default: 1)
+ *   --candidates <n,m,...> Block lengths to evaluate (default: 1/8 s to 8 s)
+ *   --channels <a,b,...>   Evaluate only these channels
+ *   --password <pw>        Password of the session
+ */
+
+#include <brainmaze_mefd/mef_reader.hpp>
+#include <brainmaze_mefd/mef_writer.hpp>
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace brainmaze_mefd;
+
+namespace {
+
+void print_usage() {
+    std::cerr << "Usage: mefd_block_len [--seconds s] [--query-seconds s] [--latency-weight w]\n"
+              << "                      [--candidates n,m,...] [--channels a,b,...]\n"
+              << "                      [--password pw] <session.mefd>" << std::endl;
+}
+
+std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    sf8 seconds = 60.0;
+    sf8 query_seconds = 1.0;
+    sf8 latency_weight = 1.0;
+    std::vector<si4> candidates;
+    std::vector<std::string> channels;
+    std::string password;
+    std::vector<std::string> paths;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--seconds" && has_value) {
+                seconds = std::stod(argv[++i]);
+            } else if (arg == "--query-seconds" && has_value) {
+                query_seconds = std::stod(argv[++i]);
+            } else if (arg == "--latency-weight" && has_value) {
+                latency_weight = std::stod(argv[++i]);
+            } else if (arg == "--candidates" && has_value) {
+                for (const auto& item : split(argv[++i])) {
+                    candidates.push_back(std::stoi(item));
+                }
+            } else if (arg == "--channels" && has_value) {
+                channels = split(argv[++i]);
+            } else if (arg == "--password" && has_value) {
+                password = argv[++i];
+            } else if (arg == "--help" || arg == "-h") {
+                print_usage();
+                return 0;
+            } else if (arg.rfind("--", 0) == 0) {
+                std::cerr << "mefd_block_len: unknown or incomplete option " << arg << std::endl;
+                print_usage();
+                return 1;
+            } else {
+                paths.push_back(arg);
+            }
+        }
+    } catch (const std::exception&) {
+        print_usage();
+        return 1;
+    }
+
+    if (paths.size() != 1) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        MefReader reader(paths[0], password);
+        if (!reader.is_valid()) {
+            std::cerr << "mefd_block_len: cannot open session " << paths[0] << std::endl;
+            return 1;
+        }
+        if (channels.empty()) {
+            channels = reader.get_channels();
+        }
+        for (const auto& name : channels) {
+            const auto& info = reader.get_channel_info(name);
+            si8 count = std::min(info.number_of_samples,
+                                 static_cast<si8>(std::llround(seconds * info.sampling_frequency)));
+            auto samples = reader.get_raw_data(name, 0, count);
+            auto estimate = MefWriter::estimate_block_len(samples.data(), samples.size(),
+                                                          info.sampling_frequency, query_seconds,
+                                                          latency_weight, candidates);
+            std::cout << name << " (" << info.sampling_frequency << " Hz, "
+                      << estimate.samples_used << " samples)\n";
+            if (!estimate.found) {
+                std::cout << "  not enough samples to evaluate any candidate\n";
+                continue;
+            }
+            std::cout << "  block_len  bytes/sample  index bytes  query ms    cost\n";
+            for (const auto& candidate : estimate.candidates) {
+                std::cout << (candidate.block_len == estimate.block_len ? "* " : "  ")
+                          << std::setw(9) << candidate.block_len
+                          << std::setw(14) << std::fixed << std::setprecision(3)
+                          << candidate.bytes_per_sample
+                          << std::setw(13) << candidate.index_bytes
+                          << std::setw(10) << candidate.query_seconds * 1000.0
+                          << std::setw(8) << candidate.cost << "\n";
+                std::cout.unsetf(std::ios::fixed);
+            }
+            std::cout << "  recommended block_len: " << estimate.block_len << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "mefd_block_len: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
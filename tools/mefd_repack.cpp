@@ -0,0 +1,119 @@
+/**
+ * @file mefd_repack.cpp
+ * @brief Re-encode a MEF 3.0 session with different writer settings
+ *
+ * Usage:
+ *   mefd_repack [options] <source.mefd> <destination.mefd>
+ *
+ * Options:
+ *   --block-len <n|auto>  Destination block length in samples, or tuned per channel
+ *   --precision <r>       Lossy tier: relative error bound per block
+ *   --channels <a,b,...>  Repack only these channels
+ *   --threads <n>         Channels repacked in parallel (default: all cores)
+ *   --password <pw>       Password of the source session
+ *   --password1 <pw>      Level 1 password of the destination
+ *   --password2 <pw>      Level 2 password of the destination
+ *   --resume              Continue an interrupted repack
+ */
+
+#include <brainmaze_mefd/session_tools.hpp>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace brainmaze_mefd;
+
+namespace {
+
+void print_usage() {
+    std::cerr << "Usage: mefd_repack [--block-len n|auto] [--precision r] [--channels a,b,...]\n"
+              << "                   [--threads n] [--password pw] [--password1 pw]\n"
+              << "                   [--password2 pw] [--resume]\n"
+              << "                   <source.mefd> <destination.mefd>" << std::endl;
+}
+
+std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    RepackOptions options;
+    std::vector<std::string> paths;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--block-len" && has_value) {
+                std::string value = argv[++i];
+                if (value == "auto") {
+                    options.auto_block_len = true;
+                } else {
+                    options.block_len = std::stoi(value);
+                }
+            } else if (arg == "--precision" && has_value) {
+                options.block_relative_precision = std::stod(argv[++i]);
+            } else if (arg == "--channels" && has_value) {
+                options.channels = split(argv[++i]);
+            } else if (arg == "--threads" && has_value) {
+                options.threads = std::stoul(argv[++i]);
+            } else if (arg == "--password" && has_value) {
+                options.password = argv[++i];
+            } else if (arg == "--password1" && has_value) {
+                options.password1 = argv[++i];
+            } else if (arg == "--password2" && has_value) {
+                options.password2 = argv[++i];
+            } else if (arg == "--resume") {
+                options.resume = true;
+            } else if (arg == "--help" || arg == "-h") {
+                print_usage();
+                return 0;
+            } else if (arg.rfind("--", 0) == 0) {
+                std::cerr << "mefd_repack: unknown or incomplete option " << arg << std::endl;
+                print_usage();
+                return 1;
+            } else {
+                paths.push_back(arg);
+            }
+        }
+    } catch (const std::exception&) {
+        print_usage();
+        return 1;
+    }
+
+    if (paths.size() != 2) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        auto stats = repack_session(paths[0], paths[1], options);
+        sf8 ratio = stats.source_bytes > 0
+                    ? static_cast<sf8>(stats.destination_bytes) / static_cast<sf8>(stats.source_bytes)
+                    : 0.0;
+        sf8 seconds = stats.seconds > 0.0 ? stats.seconds : 1e-9;
+        std::cout << "Repacked " << stats.channels << " channels (" << stats.channels_skipped
+                  << " already complete), " << stats.samples << " samples\n"
+                  << "  Size: " << stats.source_bytes << " -> " << stats.destination_bytes
+                  << " bytes (" << ratio * 100.0 << "%)\n"
+                  << "  Throughput: " << stats.samples / seconds / 1e6 << " MS/s, "
+                  << stats.source_bytes / seconds / 1e6 << " MB/s read in " << stats.seconds
+                  << " s" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "mefd_repack: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
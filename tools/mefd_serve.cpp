@@ -0,0 +1,104 @@
+/**
+ * @file mefd_serve.cpp
+ * @brief Serve MEF 3.0 sessions to local clients from a shared block cache
+ *
+ * Usage:
+ *   mefd_serve [options] <socket path>
+ *
+ * Options:
+ *   --cache-mb <n>        Decoded block cache size in MB (default: 1024)
+ *   --max-sessions <n>    Session readers kept open (default: 64)
+ *
+ * Runs until interrupted (SIGINT or SIGTERM), then prints its counters.
+ * Clients connect with MefClient.
+ */
+
+#include <brainmaze_mefd/mef_server.hpp>
+#include <csignal>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+using namespace brainmaze_mefd;
+
+namespace {
+
+void print_usage() {
+    std::cerr << "Usage: mefd_serve [--cache-mb n] [--max-sessions n] <socket path>" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+#ifdef _WIN32
+    (void)argc;
+    (void)argv;
+    std::cerr << "mefd_serve: Unix domain sockets are not available on this platform" << std::endl;
+    return 1;
+#else
+    ServerOptions options;
+    std::vector<std::string> paths;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--cache-mb" && has_value) {
+                options.cache_bytes = std::stoll(argv[++i]) << 20;
+            } else if (arg == "--max-sessions" && has_value) {
+                options.max_sessions = static_cast<size_t>(std::stoul(argv[++i]));
+            } else if (arg == "--help" || arg == "-h") {
+                print_usage();
+                return 0;
+            } else if (arg.rfind("--", 0) == 0) {
+                std::cerr << "mefd_serve: unknown or incomplete option " << arg << std::endl;
+                print_usage();
+                return 1;
+            } else {
+                paths.push_back(arg);
+            }
+        }
+    } catch (const std::exception&) {
+        print_usage();
+        return 1;
+    }
+
+    if (paths.size() != 1) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        // Server threads inherit the blocked signals, so only sigwait() sees them
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        MefServer server(paths[0], options);
+        server.start();
+        std::cerr << "mefd_serve: listening on " << paths[0] << std::endl;
+        int signal = 0;
+        sigwait(&signals, &signal);
+        server.stop();
+
+        auto stats = server.get_statistics();
+        si8 lookups = stats.cache.hits + stats.cache.misses;
+        std::cerr << "mefd_serve: " << stats.connections << " connections, "
+                  << stats.requests << " requests (" << stats.errors << " errors), "
+                  << stats.sessions_opened << " sessions opened, "
+                  << stats.bytes_served / 1000000 << " MB served, cache hit rate "
+                  << (lookups > 0 ? 100.0 * stats.cache.hits / lookups : 0.0) << "%" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "mefd_serve: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+#endif
+}